@@ -0,0 +1,305 @@
+// host/bench/bench_common.c
+#include "bench_common.h"
+#include "sim.h"
+#include "scan_stream.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+void app_main(void);
+
+// — boot —
+
+static void main_task(void *arg) {
+    (void)arg;
+    app_main();
+    vTaskDelete(NULL);
+}
+
+int64_t bench_boot_firmware(uint32_t timeout_ms) {
+    int64_t start = sim_now_us();
+    // Stesso stack del main task in sdkconfig (CONFIG_ESP_MAIN_TASK_STACK_SIZE)
+    xTaskCreate(main_task, "main", 3584, NULL, 1, NULL);
+    if (!sim_ble_wait_advertising(timeout_ms)) {
+        return -1;
+    }
+    return sim_ble_advertising_since_us() - start;
+}
+
+// — notifiche —
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static uint16_t s_handle;
+
+// Un flusso in ricostruzione per telefono collegato
+#define RX_SLOTS 4
+typedef struct {
+    bool used;
+    uint16_t conn_id;
+    bool complete;
+    bool corrupt;
+    bench_result_t res;
+    uint8_t body[SCAN_STREAM_BODY_MAX_LEN];
+    size_t body_len;
+    uint8_t next_seq;
+} rx_t;
+static rx_t s_rx[RX_SLOTS];
+
+#define SHORT_RING 16
+static uint16_t s_short_handle;
+static bench_short_t s_short[SHORT_RING];
+static unsigned s_short_head;       // prossima da leggere
+static unsigned s_short_tail;       // prossima da scrivere
+
+// Conta i record del corpo ricostruito; -1 se malformato
+static int decode_records(const uint8_t *body, size_t len) {
+    if (len < SCAN_STREAM_BODY_HDR_LEN || body[0] != SCAN_STREAM_VERSION) {
+        return -1;
+    }
+    size_t pos = SCAN_STREAM_BODY_HDR_LEN;
+    int count = body[1];
+    for (int i = 0; i < count; i++) {
+        if (pos >= len || body[pos] > 32) {
+            return -1;
+        }
+        pos += 1 + body[pos] + 3 + 6;
+    }
+    return pos == len ? count : -1;
+}
+
+static rx_t *rx_slot_locked(uint16_t conn_id, bool create) {
+    for (int i = 0; i < RX_SLOTS; i++) {
+        if (s_rx[i].used && s_rx[i].conn_id == conn_id) {
+            return &s_rx[i];
+        }
+    }
+    for (int i = 0; create && i < RX_SLOTS; i++) {
+        if (!s_rx[i].used) {
+            s_rx[i].used = true;
+            s_rx[i].conn_id = conn_id;
+            return &s_rx[i];
+        }
+    }
+    return NULL;
+}
+
+// Primo flusso completo fra tutti i telefoni (any) o quello di conn_id
+static rx_t *rx_complete_locked(bool any, uint16_t conn_id) {
+    for (int i = 0; i < RX_SLOTS; i++) {
+        if (s_rx[i].used && s_rx[i].complete && (any || s_rx[i].conn_id == conn_id)) {
+            return &s_rx[i];
+        }
+    }
+    return NULL;
+}
+
+static void on_notify(uint16_t conn_id, uint16_t handle, const uint8_t *data, uint16_t len,
+                      int64_t delivered_us, void *ctx) {
+    (void)ctx;
+    pthread_mutex_lock(&s_lock);
+    if (handle == s_short_handle && handle != 0) {
+        bench_short_t *n = &s_short[s_short_tail % SHORT_RING];
+        n->conn_id = conn_id;
+        n->delivered_us = delivered_us;
+        n->len = len < BENCH_SHORT_MAX_LEN ? len : BENCH_SHORT_MAX_LEN;
+        memcpy(n->data, data, n->len);
+        s_short_tail++;
+        if (s_short_tail - s_short_head > SHORT_RING) {
+            s_short_head = s_short_tail - SHORT_RING;   // le piu' vecchie si perdono
+        }
+        pthread_cond_broadcast(&s_cond);
+    }
+    rx_t *rx = handle == s_handle ? rx_slot_locked(conn_id, true) : NULL;
+    if (rx && !rx->complete && len >= SCAN_STREAM_CHUNK_HDR_LEN) {
+        uint8_t seq = data[0];
+        uint8_t flags = data[1];
+        if (flags & SCAN_STREAM_FLAG_FIRST) {
+            rx->body_len = 0;
+            rx->next_seq = 0;
+            rx->corrupt = false;
+        }
+        size_t n = len - SCAN_STREAM_CHUNK_HDR_LEN;
+        if (seq != rx->next_seq || rx->body_len + n > sizeof(rx->body)) {
+            rx->corrupt = true;
+        } else {
+            memcpy(&rx->body[rx->body_len], &data[SCAN_STREAM_CHUNK_HDR_LEN], n);
+            rx->body_len += n;
+        }
+        rx->next_seq = (uint8_t)(seq + 1);
+        rx->res.bytes += len;
+        rx->res.packets++;
+        rx->res.delivered_us = delivered_us;
+        if ((flags & SCAN_STREAM_FLAG_LAST) && (flags & SCAN_STREAM_FLAG_PARTIAL)) {
+            // La scansione continua: la lista finale riparte da FIRST
+            if (rx->res.partials++ == 0) {
+                rx->res.first_partial_us = delivered_us;
+            }
+        } else if (flags & SCAN_STREAM_FLAG_LAST) {
+            rx->res.records = rx->corrupt ? -1 : decode_records(rx->body, rx->body_len);
+            rx->complete = true;
+            pthread_cond_broadcast(&s_cond);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void bench_notify_reset(uint16_t handle) {
+    pthread_mutex_lock(&s_lock);
+    s_handle = handle;
+    memset(s_rx, 0, sizeof(s_rx));
+    pthread_mutex_unlock(&s_lock);
+    sim_ble_set_notify_cb(on_notify, NULL);
+}
+static struct timespec deadline_in(uint32_t timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static bool notify_wait(bool any, uint16_t conn_id, uint16_t handle, uint32_t timeout_ms,
+                        bench_result_t *res) {
+    struct timespec deadline = deadline_in(timeout_ms);
+    pthread_mutex_lock(&s_lock);
+    rx_t *rx = NULL;
+    while (s_handle != handle || (rx = rx_complete_locked(any, conn_id)) == NULL) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    rx = s_handle == handle ? rx_complete_locked(any, conn_id) : NULL;
+    if (rx) {
+        *res = rx->res;
+    }
+    pthread_mutex_unlock(&s_lock);
+    // La consegna simulata puo' essere nel futuro: aspettiamo che avvenga
+    if (rx) {
+        sim_sleep_us(res->delivered_us - sim_now_us());
+    }
+    return rx != NULL;
+}
+
+bool bench_notify_wait(uint16_t handle, uint32_t timeout_ms, bench_result_t *res) {
+    return notify_wait(true, 0, handle, timeout_ms, res);
+}
+
+bool bench_notify_wait_conn(uint16_t conn_id, uint16_t handle, uint32_t timeout_ms,
+                            bench_result_t *res) {
+    return notify_wait(false, conn_id, handle, timeout_ms, res);
+}
+
+bool bench_notify_peek(uint16_t conn_id, bench_result_t *res) {
+    pthread_mutex_lock(&s_lock);
+    rx_t *rx = rx_slot_locked(conn_id, false);
+    bool complete = rx && rx->complete;
+    if (rx) {
+        *res = rx->res;
+    } else {
+        memset(res, 0, sizeof(*res));
+    }
+    pthread_mutex_unlock(&s_lock);
+    return complete;
+}
+
+void bench_short_watch(uint16_t handle) {
+    pthread_mutex_lock(&s_lock);
+    s_short_handle = handle;
+    s_short_head = s_short_tail = 0;
+    pthread_mutex_unlock(&s_lock);
+    sim_ble_set_notify_cb(on_notify, NULL);
+}
+
+bool bench_short_wait(uint32_t timeout_ms, bench_short_t *out) {
+    struct timespec deadline = deadline_in(timeout_ms);
+    pthread_mutex_lock(&s_lock);
+    while (s_short_head == s_short_tail) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool ok = s_short_head != s_short_tail;
+    if (ok) {
+        *out = s_short[s_short_head % SHORT_RING];
+        s_short_head++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (ok) {
+        sim_sleep_us(out->delivered_us - sim_now_us());
+    }
+    return ok;
+}
+
+// — statistiche —
+
+void bench_stats_init(bench_stats_t *st, size_t capacity) {
+    st->samples = calloc(capacity ? capacity : 1, sizeof(int64_t));
+    st->count = 0;
+    st->capacity = capacity;
+}
+
+void bench_stats_add(bench_stats_t *st, int64_t sample_us) {
+    if (st->count < st->capacity) {
+        st->samples[st->count++] = sample_us;
+    }
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Percentile nearest-rank
+int64_t bench_stats_percentile(bench_stats_t *st, double pct) {
+    if (st->count == 0) {
+        return 0;
+    }
+    qsort(st->samples, st->count, sizeof(int64_t), cmp_i64);
+    size_t rank = (size_t)((pct / 100.0) * (double)st->count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    if (rank > st->count) {
+        rank = st->count;
+    }
+    return st->samples[rank - 1];
+}
+
+double bench_stats_mean(const bench_stats_t *st) {
+    if (st->count == 0) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < st->count; i++) {
+        sum += (double)st->samples[i];
+    }
+    return sum / (double)st->count;
+}
+
+void bench_stats_print(bench_stats_t *st, const char *label) {
+    printf("%-22s n=%-4zu p50=%8.2f p90=%8.2f p99=%8.2f max=%8.2f mean=%8.2f ms\n",
+           label, st->count,
+           bench_stats_percentile(st, 50) / 1000.0,
+           bench_stats_percentile(st, 90) / 1000.0,
+           bench_stats_percentile(st, 99) / 1000.0,
+           bench_stats_percentile(st, 100) / 1000.0,
+           bench_stats_mean(st) / 1000.0);
+}
+
+void bench_stats_free(bench_stats_t *st) {
+    free(st->samples);
+    st->samples = NULL;
+    st->count = st->capacity = 0;
+}
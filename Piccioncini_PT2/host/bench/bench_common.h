@@ -0,0 +1,65 @@
+// host/bench/bench_common.h
+// Servizi comuni ai banchi di prova host: avvio del firmware vero sopra il
+// simulatore, raccolta delle notifiche lato "telefono", statistiche.
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Avvia app_main() in un task come fa l'IDF e attende l'advertising.
+// Ritorna il tempo di boot fino all'advertising in microsecondi, -1 se scade.
+int64_t bench_boot_firmware(uint32_t timeout_ms);
+
+// — notifiche lato central —
+typedef struct {
+    int64_t delivered_us;   // consegna dell'ultimo frammento
+    uint32_t bytes;         // byte ATT ricevuti, header dei frammenti compresi
+    uint32_t packets;       // notifiche ricevute
+    int records;            // reti decodificate, -1 se il flusso e' corrotto
+    uint32_t partials;      // liste parziali arrivate prima di quella finale
+    int64_t first_partial_us;   // consegna della prima lista parziale, 0 se nessuna
+} bench_result_t;
+
+// I flussi si ricostruiscono separatamente per ogni telefono collegato
+void bench_notify_reset(uint16_t handle);
+// Attende una lista reti completa (marcatore di fine) sull'handle, dal primo
+// telefono che la riceve; ritorna false allo scadere del timeout. Le liste
+// parziali (SCAN_STREAM_FLAG_PARTIAL) si contano ma non la completano.
+bool bench_notify_wait(uint16_t handle, uint32_t timeout_ms, bench_result_t *res);
+// Come sopra, ma solo per il telefono conn_id
+bool bench_notify_wait_conn(uint16_t conn_id, uint16_t handle, uint32_t timeout_ms,
+                            bench_result_t *res);
+// Quanto ha ricevuto conn_id dall'ultimo reset, senza attendere; true se completo
+bool bench_notify_peek(uint16_t conn_id, bench_result_t *res);
+
+// Notifiche di un solo pacchetto (es. stato Wi-Fi) su un secondo handle,
+// raccolte in ordine di arrivo accanto alla lista reti
+#define BENCH_SHORT_MAX_LEN 32
+typedef struct {
+    uint16_t conn_id;
+    int64_t delivered_us;
+    uint16_t len;
+    uint8_t data[BENCH_SHORT_MAX_LEN];
+} bench_short_t;
+
+void bench_short_watch(uint16_t handle);
+// Prossima notifica non ancora letta; false allo scadere del timeout
+bool bench_short_wait(uint32_t timeout_ms, bench_short_t *out);
+
+// — statistiche —
+typedef struct {
+    int64_t *samples;
+    size_t count;
+    size_t capacity;
+} bench_stats_t;
+
+void bench_stats_init(bench_stats_t *st, size_t capacity);
+void bench_stats_add(bench_stats_t *st, int64_t sample_us);
+int64_t bench_stats_percentile(bench_stats_t *st, double pct);
+double bench_stats_mean(const bench_stats_t *st);
+void bench_stats_print(bench_stats_t *st, const char *label);
+void bench_stats_free(bench_stats_t *st);
+
+#endif // BENCH_COMMON_H
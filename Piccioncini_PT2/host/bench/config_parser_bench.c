@@ -0,0 +1,143 @@
+// host/bench/config_parser_bench.c
+// Microbenchmark del parser delle credenziali: ns per scrittura e
+// allocazioni, confrontando config_parse (formato storico e TLV) con il
+// parser strstr + malloc usato prima in ble_handler.c.
+// Non serve il simulatore: si collega solo src/config_parser.c.
+#include "config_parser.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned long s_allocs;
+
+static void *counted_malloc(size_t n) {
+    s_allocs++;
+    return malloc(n);
+}
+
+// Il parser originale, ricopiato com'era (lettura su stringa terminata:
+// Bluedroid non la garantisce, qui gliela diamo per poterlo misurare)
+static int legacy_parse(const char *to_decode, ble_wifi_evt_t *evt) {
+    char *start1 = strstr(to_decode, "%%");
+    if (start1 == NULL) {
+        return -1;
+    }
+    start1 += 2;
+    char *end1 = strstr(start1, "%%");
+    if (end1 == NULL) {
+        return -1;
+    }
+    size_t len1 = end1 - start1;
+    char *ssid = counted_malloc(len1 + 1);
+    strncpy(ssid, start1, len1);
+    ssid[len1] = '\0';
+
+    char *start2 = end1 + 2;
+    char *end2 = strstr(start2, "%%");
+    if (end2 == NULL) {
+        free(ssid);
+        return -1;
+    }
+    size_t len2 = end2 - start2;
+    char *password = counted_malloc(len2 + 1);
+    strncpy(password, start2, len2);
+    password[len2] = '\0';
+
+    evt->type = BLE_WIFI_EVT_CONNECT;
+    strncpy(evt->ssid, ssid, sizeof(evt->ssid) - 1);
+    evt->ssid[sizeof(evt->ssid) - 1] = '\0';
+    strncpy(evt->password, password, sizeof(evt->password) - 1);
+    evt->password[sizeof(evt->password) - 1] = '\0';
+    free(ssid);
+    free(password);
+    return 0;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+typedef struct {
+    const char *label;
+    uint8_t buf[160];
+    size_t len;
+} payload_t;
+
+static void make_legacy(payload_t *p, const char *label, const char *ssid, const char *pass) {
+    p->label = label;
+    p->len = (size_t)snprintf((char *)p->buf, sizeof(p->buf), "%%%%%s%%%%%s%%%%", ssid, pass);
+}
+
+static void make_tlv(payload_t *p, const char *label, const char *ssid, const char *pass) {
+    size_t sl = strlen(ssid), pl = strlen(pass), n = 0;
+    p->label = label;
+    p->buf[n++] = CONFIG_TLV_SSID;
+    p->buf[n++] = (uint8_t)sl;
+    memcpy(&p->buf[n], ssid, sl);
+    n += sl;
+    p->buf[n++] = CONFIG_TLV_PASSWORD;
+    p->buf[n++] = (uint8_t)pl;
+    memcpy(&p->buf[n], pass, pl);
+    n += pl;
+    p->len = n;
+}
+
+static volatile uint8_t s_sink;
+
+static void run(const char *parser, const payload_t *p, long iters, bool legacy) {
+    ble_wifi_evt_t evt;
+    char text[sizeof(p->buf) + 1];
+    s_allocs = 0;
+    int64_t t0 = now_ns();
+    for (long i = 0; i < iters; i++) {
+        int ok;
+        if (legacy) {
+            // La copia terminata fa parte del costo: il vecchio codice la ometteva
+            memcpy(text, p->buf, p->len);
+            text[p->len] = '\0';
+            ok = legacy_parse(text, &evt) == 0;
+        } else {
+            ok = config_parse(p->buf, p->len, &evt) == CONFIG_PARSE_OK;
+        }
+        s_sink ^= (uint8_t)(ok + evt.ssid[0]);
+    }
+    int64_t dt = now_ns() - t0;
+    printf("%-14s %-8s %4zu B  %8.1f ns/parse  %5.2f malloc/parse\n",
+           parser, p->label, p->len, (double)dt / (double)iters, (double)s_allocs / (double)iters);
+}
+
+int main(int argc, char **argv) {
+    long iters = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            iters = atol(optarg);
+        } else {
+            fprintf(stderr, "uso: %s [-n iterazioni]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static const char k_long_ssid[] = "0123456789abcdef0123456789abcdef";
+    static const char k_hex_psk[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+    payload_t p[4];
+    make_legacy(&p[0], "corto", "Casa", "pw123456");
+    make_legacy(&p[1], "massimo", k_long_ssid, k_hex_psk);
+    make_tlv(&p[2], "corto", "Casa", "pw123456");
+    make_tlv(&p[3], "massimo", k_long_ssid, k_hex_psk);
+
+    // Il formato storico passa da entrambi i parser: confronto diretto
+    for (int i = 0; i < 2; i++) {
+        run("strstr+malloc", &p[i], iters, true);
+        run("config_parse", &p[i], iters, false);
+    }
+    for (int i = 2; i < 4; i++) {
+        run("config_parse", &p[i], iters, false);
+    }
+    return 0;
+}
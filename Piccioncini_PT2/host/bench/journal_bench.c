@@ -0,0 +1,457 @@
+// host/bench/journal_bench.c
+// Banco di prova del diario degli eventi (include/journal.h): costo di
+// journal_log per chi registra contro una scrittura in flash per evento,
+// usura dei settori dopo alcuni giri dell'anello, e spegnimenti a meta' di
+// una scrittura (sim_flash_power_cut) seguiti dal riavvio.
+//
+// Come ota_bench ogni "avvio" e' un processo figlio che condivide il file
+// della flash con i precedenti. I figli tagliati dallo spegnimento non
+// tornano: scrivono i risultati in una memoria condivisa man mano.
+#include "bench_common.h"
+#include "sim.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "journal.h"
+
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Record del banco: un tipo che il firmware non usa, con un numero
+// progressivo che continua da un avvio all'altro
+#define BENCH_EVENT         ((journal_event_t)0x7E)
+#define BENCH_PAYLOAD_LEN   12
+#define HOT_BATCH           64          // record fra due journal_flush
+#define CUT_RECORDS         150         // record per avvio nella prova di spegnimento
+#define CUT_FLUSH_EVERY     16
+
+typedef struct {
+    unsigned records;
+    unsigned passes;
+    unsigned cuts;
+    unsigned seed;
+    bool verbose;
+} bench_opts_t;
+
+typedef enum {
+    STEP_HOT,
+    STEP_WEAR,
+    STEP_CUT,
+} step_kind_t;
+
+// Cosa fa il prossimo avvio: il padre lo sceglie prima del fork
+typedef struct {
+    step_kind_t kind;
+    uint32_t cut_after;         // byte scritti prima dello spegnimento (0 = mai)
+    uint32_t next_seq;          // primo numero da registrare
+    uint32_t prev_durable;      // avvio precedente: ultimo numero gia' in flash
+    uint32_t prev_logged;       // ... e ultimo registrato
+    uint16_t prev_boot;
+    esp_reset_reason_t reason;
+} step_t;
+
+// Risultati in memoria condivisa: restano anche se il figlio muore
+typedef struct {
+    _Atomic int ok;
+    _Atomic uint32_t durable;   // ultimo numero con journal_flush concluso
+    _Atomic uint32_t logged;    // ultimo numero accettato da journal_log
+    uint16_t boot;
+    int reason;                 // dal record BOOT di questo avvio
+    uint32_t found;             // record del banco letti al montaggio
+    uint32_t lost;              // dell'avvio precedente, gia' in flash, mancanti
+    uint32_t bogus;             // numeri fuori ordine o mai registrati
+    int64_t log_ns[3];          // journal_log p50 p99 max
+    int64_t sync_ns[3];         // scrittura diretta p50 p99 max
+    journal_stats_t stats;
+    sim_flash_stats_t flash;
+    uint32_t erase_min, erase_max;
+    uint32_t sectors;
+} child_result_t;
+
+static step_t s_step;
+static child_result_t *s_res;
+static char s_flash_file[64];
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_payload(uint8_t *p, uint32_t seq) {
+    put_le32(p, seq);
+    put_le32(p + 4, ~seq);
+    put_le32(p + 8, seq * 2654435761u);
+}
+
+// Registra finche' il buffer accetta; a buffer pieno attende il task
+static void log_seq(uint32_t seq) {
+    uint8_t p[BENCH_PAYLOAD_LEN];
+    bench_payload(p, seq);
+    while (!journal_log(BENCH_EVENT, p, sizeof(p))) {
+        sim_sleep_us(10 * 1000);
+    }
+}
+
+// Legge tutto il diario dal piu' vecchio e controlla i record del banco:
+// numeri crescenti, payload coerente, quelli gia' in flash nell'avvio
+// precedente tutti presenti
+static void verify_journal(child_result_t *r) {
+    static uint8_t buf[4096];
+    uint32_t pos = 0, next;
+    uint32_t last = 0;
+    uint32_t prev_first = s_step.prev_durable ? UINT32_MAX : 0;
+    uint32_t prev_count = 0;
+    size_t n;
+    r->reason = -1;
+    while ((n = journal_read(pos, buf, sizeof(buf), &next)) > 0) {
+        for (size_t off = 0; off < n; off += JOURNAL_REC_HDR_LEN + buf[off + 1] + 1u) {
+            const uint8_t *rec = &buf[off];
+            const uint8_t *d = rec + JOURNAL_REC_HDR_LEN;
+            uint16_t boot = (uint16_t)(rec[2] | rec[3] << 8);
+            if (rec[0] == JOURNAL_EV_BOOT && boot == r->boot) {
+                r->reason = d[0];
+            }
+            if (rec[0] != BENCH_EVENT) {
+                continue;
+            }
+            uint8_t want[BENCH_PAYLOAD_LEN];
+            uint32_t seq = get_le32(d);
+            bench_payload(want, seq);
+            if (rec[1] != BENCH_PAYLOAD_LEN || memcmp(d, want, sizeof(want)) != 0 || seq <= last ||
+                seq > s_step.prev_logged) {
+                r->bogus++;
+            }
+            last = seq;
+            r->found++;
+            if (boot == s_step.prev_boot && seq <= s_step.prev_durable) {
+                prev_first = seq < prev_first ? seq : prev_first;
+                prev_count++;
+            }
+        }
+        pos = next;
+    }
+    // Dell'avvio precedente non deve mancare nulla fra il primo letto (i
+    // piu' vecchi possono essere stati riciclati) e l'ultimo in flash
+    if (prev_count > 0) {
+        r->lost = s_step.prev_durable - prev_first + 1 - prev_count;
+    } else if (s_step.prev_durable != 0) {
+        r->lost = 1;
+    }
+}
+
+static void percentiles(int64_t *samples, size_t n, int64_t out[3]) {
+    bench_stats_t st;
+    bench_stats_init(&st, n);
+    for (size_t i = 0; i < n; i++) {
+        bench_stats_add(&st, samples[i]);
+    }
+    out[0] = bench_stats_percentile(&st, 50);
+    out[1] = bench_stats_percentile(&st, 99);
+    out[2] = bench_stats_percentile(&st, 100);
+    bench_stats_free(&st);
+}
+
+// journal_log contro esp_partition_write di un record per evento (in ota_1,
+// vuota in questa flash usa e getta)
+static void child_hot(const bench_opts_t *o, child_result_t *r) {
+    int64_t *log_ns = calloc(o->records, sizeof(int64_t));
+    int64_t *sync_ns = calloc(o->records, sizeof(int64_t));
+    uint8_t rec[JOURNAL_REC_HDR_LEN + BENCH_PAYLOAD_LEN + 1] = { 0 };
+    for (unsigned i = 0; i < o->records; i++) {
+        uint8_t p[BENCH_PAYLOAD_LEN];
+        bench_payload(p, i + 1);
+        int64_t t0 = now_ns();
+        bool ok = journal_log(BENCH_EVENT, p, sizeof(p));
+        log_ns[i] = now_ns() - t0;
+        if (!ok) {
+            return;
+        }
+        if ((i + 1) % HOT_BATCH == 0) {
+            journal_flush(5000);
+        }
+    }
+    journal_flush(5000);
+    journal_get_stats(&r->stats);
+
+    const esp_partition_t *spare = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                            ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+    size_t need = (size_t)o->records * sizeof(rec);
+    esp_partition_erase_range(spare, 0,
+                              (need + JOURNAL_SECTOR_LEN - 1) / JOURNAL_SECTOR_LEN * JOURNAL_SECTOR_LEN);
+    for (unsigned i = 0; i < o->records; i++) {
+        bench_payload(&rec[JOURNAL_REC_HDR_LEN], i + 1);
+        int64_t t0 = now_ns();
+        esp_partition_write(spare, (size_t)i * sizeof(rec), rec, sizeof(rec));
+        sync_ns[i] = now_ns() - t0;
+    }
+    percentiles(log_ns, o->records, r->log_ns);
+    percentiles(sync_ns, o->records, r->sync_ns);
+    free(log_ns);
+    free(sync_ns);
+    r->ok = 1;
+}
+
+// Qualche giro completo dell'anello, poi cancellazioni per settore
+static void child_wear(const bench_opts_t *o, child_result_t *r) {
+    const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                        ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "spiffs");
+    r->sectors = (uint32_t)(p->size / JOURNAL_SECTOR_LEN);
+    journal_stats_t st;
+    uint32_t seq = s_step.next_seq;
+    do {
+        log_seq(seq);
+        atomic_store(&r->logged, seq++);
+        journal_get_stats(&st);
+    } while (st.head < o->passes * p->size);
+    journal_flush(5000);
+    atomic_store(&r->durable, seq - 1);
+    journal_get_stats(&r->stats);
+    r->erase_min = UINT32_MAX;
+    for (uint32_t i = 0; i < r->sectors; i++) {
+        uint32_t n = sim_flash_sector_erases(p->address + i * JOURNAL_SECTOR_LEN);
+        r->erase_min = n < r->erase_min ? n : r->erase_min;
+        r->erase_max = n > r->erase_max ? n : r->erase_max;
+    }
+    r->ok = 1;
+}
+
+// Registra con un journal_flush ogni tanto; lo spegnimento armato taglia
+// il processo durante una scrittura
+static void child_cut(child_result_t *r) {
+    uint32_t seq = s_step.next_seq;
+    sim_flash_power_cut(s_step.cut_after);
+    for (unsigned i = 0; i < CUT_RECORDS; i++) {
+        log_seq(seq);
+        atomic_store(&r->logged, seq);
+        if ((i + 1) % CUT_FLUSH_EVERY == 0) {
+            journal_flush(5000);
+            journal_stats_t st;
+            journal_get_stats(&st);
+            if (st.pending == 0) {
+                atomic_store(&r->durable, seq);
+            }
+        }
+        seq++;
+        sim_sleep_us(1000);
+    }
+    journal_flush(5000);
+    atomic_store(&r->durable, seq - 1);
+    r->ok = 1;
+}
+
+static void child_run(const bench_opts_t *o, child_result_t *r) {
+    esp_log_level_set("*", o->verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    sim_flash_set_file(s_flash_file);
+    sim_set_reset_reason(s_step.reason);
+    if (bench_boot_firmware(5000) < 0) {
+        return;
+    }
+    journal_stats_t st;
+    journal_get_stats(&st);
+    r->boot = st.boot;
+    verify_journal(r);
+    switch (s_step.kind) {
+        case STEP_HOT:  child_hot(o, r); break;
+        case STEP_WEAR: child_wear(o, r); break;
+        case STEP_CUT:  child_cut(r); break;
+    }
+    sim_flash_get_stats(&r->flash);
+}
+
+// Ritorna lo stato di uscita del figlio (SIM_POWER_CUT_EXIT se tagliato)
+static int run_child(const bench_opts_t *o, const step_t *step) {
+    memset(s_res, 0, sizeof(*s_res));
+    s_step = *step;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        child_run(o, s_res);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "uso: %s [opzioni]\n"
+            "  -n N    record per la misura di journal_log (default 2000)\n"
+            "  -p N    giri dell'anello per la prova di usura (default 2)\n"
+            "  -c N    spegnimenti (default 20)\n"
+            "  -s N    seme dei punti di spegnimento (default 1)\n"
+            "  -v      log del firmware a livello INFO\n", argv0);
+}
+
+static unsigned s_failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("  FALLITO: %s\n", what);
+        s_failures++;
+    }
+}
+
+static void fresh_flash(void) {
+    FILE *f = fopen(s_flash_file, "wb");
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = {
+        .records = 2000,
+        .passes = 2,
+        .cuts = 20,
+        .seed = 1,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:c:s:vh")) != -1) {
+        switch (opt) {
+            case 'n': o.records = (unsigned)atoi(optarg); break;
+            case 'p': o.passes = (unsigned)atoi(optarg); break;
+            case 'c': o.cuts = (unsigned)atoi(optarg); break;
+            case 's': o.seed = (unsigned)atoi(optarg); break;
+            case 'v': o.verbose = true; break;
+            default:  usage(argv[0]); return 1;
+        }
+    }
+    if (o.records < HOT_BATCH || o.passes < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    s_res = mmap(NULL, sizeof(*s_res), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s_res == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    snprintf(s_flash_file, sizeof(s_flash_file), "/tmp/journal_bench_flashXXXXXX");
+    int fd = mkstemp(s_flash_file);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    child_result_t *r = s_res;
+
+    sim_flash_timing_t ft;
+    sim_flash_get_timing(&ft);
+    printf("\n== Diario: costo per evento, usura dell'anello, spegnimenti ==\n");
+    printf("buffer %u B, scrittura a %u B o dopo %u ms, flash: cancellazione %u us, pagina %u us\n",
+           JOURNAL_RAM_LEN, JOURNAL_FLUSH_BYTES, JOURNAL_FLUSH_MS, ft.erase_us, ft.page_us);
+
+    // 1. chi registra non aspetta la flash
+    step_t hot = { .kind = STEP_HOT, .reason = ESP_RST_POWERON };
+    int st = run_child(&o, &hot);
+    check(st == 0 && r->ok, "misura di journal_log");
+    if (st == 0 && r->ok) {
+        printf("journal_log            p50 %6.1f us  p99 %6.1f us  max %7.1f us\n",
+               r->log_ns[0] / 1000.0, r->log_ns[1] / 1000.0, r->log_ns[2] / 1000.0);
+        printf("scrittura per evento   p50 %6.1f us  p99 %6.1f us  max %7.1f us\n",
+               r->sync_ns[0] / 1000.0, r->sync_ns[1] / 1000.0, r->sync_ns[2] / 1000.0);
+        printf("a blocchi              %u record in %u scritture (%.0f B l'una), %u cancellazioni\n",
+               r->stats.appended, r->stats.flushes,
+               (double)r->stats.bytes_written / (r->stats.flushes ? r->stats.flushes : 1),
+               r->stats.erases);
+        check(r->flash.dirty_writes == 0, "scritture senza cancellazione");
+        check(r->stats.dropped == 0, "record persi a buffer libero");
+    }
+
+    // 2. usura: l'anello gira, ogni settore si cancella lo stesso numero di volte
+    fresh_flash();
+    step_t wear = { .kind = STEP_WEAR, .next_seq = 1, .reason = ESP_RST_POWERON };
+    int64_t t0 = sim_now_us();
+    st = run_child(&o, &wear);
+    check(st == 0 && r->ok, "giri dell'anello");
+    if (st == 0 && r->ok) {
+        printf("usura                  %u giri in %.1f s: %u cancellazioni, per settore %u..%u "
+               "(%u settori)\n", o.passes, (sim_now_us() - t0) / 1e6, r->stats.erases,
+               r->erase_min, r->erase_max, r->sectors);
+        check(r->erase_max - r->erase_min <= 1, "usura uniforme fra i settori");
+        check(r->flash.dirty_writes == 0, "scritture senza cancellazione");
+    }
+    uint32_t durable = atomic_load(&r->durable);
+    uint32_t logged = atomic_load(&r->logged);
+    uint16_t boot = r->boot;
+
+    // 3. dopo i giri si rimonta e si rilegge tutto cio' che e' ancora nell'anello
+    step_t remount = { .kind = STEP_CUT, .next_seq = logged + 1, .prev_durable = durable,
+                       .prev_logged = logged, .prev_boot = boot, .reason = ESP_RST_SW };
+    remount.cut_after = 1;
+    st = run_child(&o, &remount);
+    check(st == SIM_POWER_CUT_EXIT, "spegnimento alla prima scrittura");
+    check(r->boot == boot + 1 && r->reason == ESP_RST_SW, "numero di avvio e causa del reset");
+    check(r->lost == 0 && r->bogus == 0, "rilettura dopo i giri");
+    printf("rimontaggio            avvio %u, %u record del banco riletti, %u mancanti, %u errati\n",
+           r->boot, r->found, r->lost, r->bogus);
+    boot = r->boot;
+    logged = atomic_load(&r->logged);
+    durable = atomic_load(&r->durable);
+
+    // 4. spegnimenti a caso durante le scritture; ogni avvio controlla il precedente
+    srand(o.seed);
+    unsigned cut = 0, lost = 0, bogus = 0, tail = 0;
+    for (unsigned i = 0; i < o.cuts; i++) {
+        step_t s = { .kind = STEP_CUT, .next_seq = logged + 1, .prev_durable = durable,
+                     .prev_logged = logged, .prev_boot = boot, .reason = ESP_RST_POWERON };
+        s.cut_after = 1 + (uint32_t)rand() % (CUT_RECORDS * (JOURNAL_REC_HDR_LEN + BENCH_PAYLOAD_LEN + 1));
+        st = run_child(&o, &s);
+        if (st != 0 && st != SIM_POWER_CUT_EXIT) {
+            check(false, "avvio dopo uno spegnimento");
+            break;
+        }
+        check(r->boot == boot + 1, "numero di avvio dopo lo spegnimento");
+        cut += st == SIM_POWER_CUT_EXIT;
+        lost += r->lost;
+        bogus += r->bogus;
+        if (o.verbose) {
+            printf("  avvio %u: taglio a %u B %s, %u record letti\n", r->boot, s.cut_after,
+                   st == SIM_POWER_CUT_EXIT ? "avvenuto" : "mai raggiunto", r->found);
+        }
+        boot = r->boot;
+        durable = atomic_load(&r->durable);
+        if (atomic_load(&r->logged) != 0) {
+            logged = atomic_load(&r->logged);
+            tail += logged - (durable > s.next_seq - 1 ? durable : s.next_seq - 1);
+        }
+    }
+    // L'ultimo avvio si controlla con un altro, senza spegnimento
+    step_t last = { .kind = STEP_CUT, .next_seq = logged + 1, .prev_durable = durable,
+                    .prev_logged = logged, .prev_boot = boot, .reason = ESP_RST_POWERON };
+    st = run_child(&o, &last);
+    check(st == 0 && r->ok, "avvio finale");
+    lost += r->lost;
+    bogus += r->bogus;
+    check(lost == 0, "record gia' in flash persi dopo uno spegnimento");
+    check(bogus == 0, "record errati riletti");
+    printf("spegnimenti            %u su %u avvii, %u record non ancora in flash al taglio, %u gia' in flash persi, "
+           "%u errati\n", cut, o.cuts, tail, lost, bogus);
+
+    printf("fallimenti             %u\n", s_failures);
+    unlink(s_flash_file);
+    return s_failures ? 2 : 0;
+}
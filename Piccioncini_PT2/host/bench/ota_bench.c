@@ -0,0 +1,571 @@
+// host/bench/ota_bench.c
+// Banco di prova dell'aggiornamento OTA (include/ota_update.h) contro un
+// server HTTP locale: comando su FF11 -> download -> riavvio, ripresa dopo
+// una connessione caduta e dopo uno spegnimento, conferma della nuova
+// immagine, rollback se si riavvia prima della conferma, immagini rifiutate.
+//
+// Come reconnect_bench ogni "riavvio" e' un processo figlio nuovo che
+// condivide con i precedenti i file di NVS e flash (host/sim/ota_sim.c). Il
+// server e' un altro processo, creato per primo: serve l'immagine da una
+// memoria condivisa, con Range/If-Range, ETag, banda limitata (-b) e una
+// connessione fatta cadere a comando.
+#include "bench_common.h"
+#include "sim.h"
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "ble_command.h"
+#include "ota_update.h"
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define COMMAND_UUID        0xFF11
+#define WIFI_CONFIG_UUID    0xFF21
+
+#define TARGET_SSID         "Casa"
+#define TARGET_PASSWORD     "pw123456"
+
+#define IMAGE_MAX           0x1E0000        // uno slot di partitions_ota.csv
+#define SERVER_CHUNK        1460            // un segmento TCP
+
+typedef struct {
+    unsigned image_kb;
+    unsigned rate_kbs;
+    unsigned timeout_ms;
+    bool verbose;
+} bench_opts_t;
+
+// — server HTTP (processo a parte, memoria condivisa col banco) —
+
+typedef struct {
+    uint16_t port;
+    uint32_t image_len;
+    uint32_t gen;                       // cambia l'ETag
+    _Atomic uint32_t rate_kbs;          // 0 = senza limite
+    _Atomic uint32_t drop_after;        // chiude dopo N byte di corpo, una volta
+    _Atomic uint32_t requests;
+    _Atomic uint32_t ranged;            // risposte 206
+    _Atomic int64_t first_range;        // inizio del primo Range dall'azzeramento, -1 nessuno
+    uint8_t image[IMAGE_MAX];
+} server_t;
+
+static server_t *s_srv;
+
+static bool send_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Valore dell'header 'name' nella richiesta (copiato in out), false se manca
+static bool req_header(const char *req, const char *name, char *out, size_t cap) {
+    size_t nlen = strlen(name);
+    for (const char *line = strstr(req, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        const char *h = line + 2;
+        if (strncasecmp(h, name, nlen) == 0 && h[nlen] == ':') {
+            h += nlen + 1;
+            while (*h == ' ') {
+                h++;
+            }
+            size_t len = strcspn(h, "\r\n");
+            if (len >= cap) {
+                len = cap - 1;
+            }
+            memcpy(out, h, len);
+            out[len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+static void serve_one(int fd) {
+    char req[2048] = "";
+    size_t len = 0;
+    while (strstr(req, "\r\n\r\n") == NULL) {
+        if (len == sizeof(req) - 1) {
+            return;
+        }
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            return;
+        }
+        len += (size_t)n;
+        req[len] = '\0';
+    }
+    atomic_fetch_add(&s_srv->requests, 1);
+    char hdr[512];
+    if (strncmp(req, "GET /fw.bin ", 12) != 0) {
+        int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                                           "Connection: close\r\n\r\n");
+        send_all(fd, hdr, (size_t)n);
+        return;
+    }
+    char etag[32], value[64];
+    snprintf(etag, sizeof(etag), "\"fw-%u\"", s_srv->gen);
+    uint32_t total = s_srv->image_len;
+    uint32_t start = 0;
+    unsigned long from;
+    if (req_header(req, "Range", value, sizeof(value)) && sscanf(value, "bytes=%lu-", &from) == 1 &&
+        from < total) {
+        char if_range[64];
+        if (!req_header(req, "If-Range", if_range, sizeof(if_range)) || strcmp(if_range, etag) == 0) {
+            start = (uint32_t)from;
+        }
+    }
+    int n;
+    if (start > 0) {
+        atomic_fetch_add(&s_srv->ranged, 1);
+        int64_t none = -1;
+        atomic_compare_exchange_strong(&s_srv->first_range, &none, (int64_t)start);
+        n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\n"
+                     "Content-Range: bytes %u-%u/%u\r\nETag: %s\r\nConnection: close\r\n\r\n",
+                     total - start, start, total - 1, total, etag);
+    } else {
+        n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n"
+                     "Accept-Ranges: bytes\r\nETag: %s\r\nConnection: close\r\n\r\n", total, etag);
+    }
+    if (!send_all(fd, hdr, (size_t)n)) {
+        return;
+    }
+    // Il "filo" non accumula credito: se il client non legge, il tempo
+    // perso non si recupera dopo con una raffica
+    int64_t next_us = sim_now_us();
+    uint32_t sent = 0;
+    while (start + sent < total) {
+        uint32_t chunk = total - start - sent < SERVER_CHUNK ? total - start - sent : SERVER_CHUNK;
+        uint32_t drop = atomic_load(&s_srv->drop_after);
+        if (drop != 0 && start + sent >= drop) {
+            atomic_store(&s_srv->drop_after, 0);
+            return;
+        }
+        if (!send_all(fd, s_srv->image + start + sent, chunk)) {
+            return;
+        }
+        sent += chunk;
+        uint32_t rate = atomic_load(&s_srv->rate_kbs);
+        if (rate) {
+            int64_t now = sim_now_us();
+            next_us = (next_us > now ? next_us : now) + (int64_t)chunk * 1000000 / ((int64_t)rate * 1024);
+            sim_sleep_us(next_us - now);
+        }
+    }
+}
+
+static void server_main(int lfd) {
+    while (1) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        // Niente scorta nel kernel: la banda limitata vale sul "filo"
+        int sndbuf = SERVER_CHUNK * 2;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        serve_one(fd);
+        close(fd);
+    }
+}
+
+static pid_t server_start(void) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 4) != 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &alen) != 0) {
+        perror("server");
+        return -1;
+    }
+    s_srv->port = ntohs(addr.sin_port);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        server_main(lfd);
+        _exit(0);
+    }
+    close(lfd);
+    return pid;
+}
+
+static void server_publish(const uint8_t *image, size_t len) {
+    memcpy(s_srv->image, image, len);
+    s_srv->image_len = (uint32_t)len;
+    s_srv->gen++;
+}
+
+// — firmware (processi figli) —
+
+// Cosa fa il prossimo "avvio": il padre lo sceglie prima del fork
+typedef struct {
+    bool provision;             // credenziali dal telefono (primo avvio)
+    bool command;               // CMD_OP_OTA su FF11
+    bool by_url;                // ... con l'URL, altrimenti CMD_OTA_START
+    uint32_t cut_at;            // spegne appena l'immagine e' a tanti byte (0 = mai)
+    bool crash;                 // si spegne appena avviato, prima della conferma
+    bool wait_confirm;          // attende la conferma dell'immagine in prova
+    bool wait_restart;          // attende il riavvio di fine aggiornamento
+    bool wait_failed;           // attende OTA_STATE_FAILED
+} step_t;
+
+typedef struct {
+    int ok;
+    int slot;                   // slot avviato dal bootloader
+    char version[32];
+    ota_state_t boot_state;
+    int cmd_status;             // stato della risposta al comando, -1 nessuna
+    int64_t confirm_us;         // boot -> conferma
+    int64_t update_us;          // comando (o boot) -> esp_restart
+    ota_progress_t prog;
+    sim_flash_stats_t flash;
+} child_result_t;
+
+static step_t s_step;
+static char s_nvs_file[64];
+static char s_flash_file[64];
+
+static void setup_world(const bench_opts_t *o) {
+    esp_log_level_set("*", o->verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    sim_nvs_set_file(s_nvs_file);
+    sim_flash_set_file(s_flash_file);
+    sim_ap_t home = { .enabled = true, .rssi = -52, .authmode = WIFI_AUTH_WPA2_PSK, .channel = 6,
+                      .bssid = { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 } };
+    snprintf(home.ssid, sizeof(home.ssid), "%s", TARGET_SSID);
+    snprintf(home.password, sizeof(home.password), "%s", TARGET_PASSWORD);
+    sim_wifi_add_ap(&home);
+}
+
+static bool wait_got_ip(uint32_t timeout_ms) {
+    int64_t deadline = sim_now_us() + (int64_t)timeout_ms * 1000;
+    sim_wifi_stats_t st;
+    do {
+        sim_wifi_get_stats(&st);
+        if (st.got_ip > 0) {
+            return true;
+        }
+        sim_sleep_us(2000);
+    } while (sim_now_us() < deadline);
+    return false;
+}
+
+// Attende uno stato OTA; false allo scadere
+static bool wait_state(ota_state_t state, uint32_t timeout_ms) {
+    int64_t deadline = sim_now_us() + (int64_t)timeout_ms * 1000;
+    ota_progress_t p;
+    do {
+        ota_update_get(&p);
+        if (p.state == state) {
+            return true;
+        }
+        sim_sleep_us(5000);
+    } while (sim_now_us() < deadline);
+    return false;
+}
+
+static int send_ota_command(uint16_t conn_id) {
+    uint8_t cmd[CMD_REPLY_MAX_LEN + OTA_URL_MAX];
+    size_t n = 0;
+    cmd[n++] = CMD_OP_OTA;
+    if (s_step.by_url) {
+        char url[OTA_URL_MAX];
+        int len = snprintf(url, sizeof(url), "http://127.0.0.1:%u/fw.bin", s_srv->port);
+        cmd[n++] = (uint8_t)len;
+        memcpy(&cmd[n], url, (size_t)len);
+        n += (size_t)len;
+    } else {
+        cmd[n++] = 1;
+        cmd[n++] = CMD_OTA_START;
+    }
+    uint16_t h = sim_ble_find_char(COMMAND_UUID);
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    sim_ble_write(conn_id, sim_ble_find_cccd(COMMAND_UUID), enable, sizeof(enable));
+    bench_short_watch(h);
+    sim_ble_write_nr(conn_id, h, cmd, (uint16_t)n);
+    bench_short_t r;
+    while (bench_short_wait(2000, &r)) {
+        if (r.len >= CMD_REPLY_HDR_LEN && r.data[1] == CMD_OP_OTA) {
+            return r.data[2];
+        }
+    }
+    return -1;
+}
+
+static void child_run(const bench_opts_t *o, child_result_t *r) {
+    setup_world(o);
+    int64_t t_boot = sim_now_us();
+    if (bench_boot_firmware(5000) < 0) {
+        return;
+    }
+    r->slot = sim_ota_running_slot();
+    snprintf(r->version, sizeof(r->version), "%s", esp_app_get_description()->version);
+    ota_update_get(&r->prog);
+    r->boot_state = r->prog.state;
+    r->cmd_status = -1;
+    if (s_step.crash) {
+        r->ok = 1;
+        return;
+    }
+
+    uint16_t conn_id = sim_ble_connect();
+    sim_ble_exchange_mtu(conn_id, 185);
+    if (s_step.provision) {
+        static const char creds[] = "%%" TARGET_SSID "%%" TARGET_PASSWORD "%%";
+        uint16_t cfg = sim_ble_find_char(WIFI_CONFIG_UUID);
+        if (cfg == 0 || sim_ble_write(conn_id, cfg, creds, sizeof(creds) - 1) != ESP_GATT_OK) {
+            return;
+        }
+    }
+    if (s_step.wait_confirm) {
+        if (!wait_state(OTA_STATE_IDLE, o->timeout_ms)) {
+            return;
+        }
+        r->confirm_us = sim_now_us() - t_boot;
+    }
+    int64_t t0 = t_boot;
+    if (s_step.command) {
+        if (!wait_got_ip(o->timeout_ms)) {
+            return;
+        }
+        t0 = sim_now_us();
+        r->cmd_status = send_ota_command(conn_id);
+    }
+    if (s_step.cut_at) {
+        int64_t deadline = sim_now_us() + (int64_t)o->timeout_ms * 1000;
+        do {
+            ota_update_get(&r->prog);
+            sim_sleep_us(1000);
+        } while (r->prog.written < s_step.cut_at && sim_now_us() < deadline);
+        r->ok = r->prog.written >= s_step.cut_at;
+        return;
+    }
+    if (s_step.wait_restart) {
+        if (!sim_restart_wait(o->timeout_ms)) {
+            return;
+        }
+        r->update_us = sim_now_us() - t0;
+    }
+    if (s_step.wait_failed && !wait_state(OTA_STATE_FAILED, o->timeout_ms)) {
+        return;
+    }
+    ota_update_get(&r->prog);
+    sim_flash_get_stats(&r->flash);
+    // le scritture in NVS seguono il GOT_IP nel loop eventi
+    sim_sleep_us(200 * 1000);
+    r->ok = 1;
+}
+
+static bool run_child(const bench_opts_t *o, const step_t *step, child_result_t *r) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    s_step = *step;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        child_result_t res;
+        memset(&res, 0, sizeof(res));
+        child_run(o, &res);
+        ssize_t n = write(fds[1], &res, sizeof(res));
+        _exit(n == (ssize_t)sizeof(res) ? 0 : 1);
+    }
+    close(fds[1]);
+    memset(r, 0, sizeof(*r));
+    ssize_t n = read(fds[0], r, sizeof(*r));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(*r) && r->ok;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "uso: %s [opzioni]\n"
+            "  -i KB   dimensione dell'immagine (default 512, max %u)\n"
+            "  -b KB/s banda del server (default 0, senza limite)\n"
+            "  -t MS   timeout per passo (default 120000)\n"
+            "  -v      log del firmware a livello INFO\n", argv0, IMAGE_MAX / 1024);
+}
+
+static unsigned s_failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("  FALLITO: %s\n", what);
+        s_failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = {
+        .image_kb = 512,
+        .timeout_ms = 120000,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "i:b:t:vh")) != -1) {
+        switch (opt) {
+            case 'i': o.image_kb = (unsigned)atoi(optarg); break;
+            case 'b': o.rate_kbs = (unsigned)atoi(optarg); break;
+            case 't': o.timeout_ms = (unsigned)atoi(optarg); break;
+            case 'v': o.verbose = true; break;
+            default:  usage(argv[0]); return 1;
+        }
+    }
+    if (o.image_kb < 16 || o.image_kb * 1024 > IMAGE_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    s_srv = mmap(NULL, sizeof(*s_srv), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s_srv == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    atomic_store(&s_srv->rate_kbs, o.rate_kbs);
+    pid_t server = server_start();
+    if (server < 0) {
+        return 1;
+    }
+    snprintf(s_nvs_file, sizeof(s_nvs_file), "/tmp/ota_bench_nvsXXXXXX");
+    snprintf(s_flash_file, sizeof(s_flash_file), "/tmp/ota_bench_flashXXXXXX");
+    int fd1 = mkstemp(s_nvs_file), fd2 = mkstemp(s_flash_file);
+    if (fd1 < 0 || fd2 < 0) {
+        perror("mkstemp");
+        kill(server, SIGTERM);
+        return 1;
+    }
+    close(fd1);
+    close(fd2);
+
+    static uint8_t image[IMAGE_MAX];
+    size_t len = sim_ota_build_image(image, o.image_kb * 1024, SIM_PROJECT_NAME, "2.0", 1);
+    server_publish(image, len);
+
+    sim_flash_timing_t ft;
+    sim_flash_get_timing(&ft);
+    uint32_t sectors = (uint32_t)((len + OTA_CHUNK_LEN - 1) / OTA_CHUNK_LEN);
+    double flash_ms = sectors * (ft.erase_us + (OTA_CHUNK_LEN / 256) * ft.page_us) / 1000.0;
+    double net_ms = o.rate_kbs ? len * 1000.0 / (o.rate_kbs * 1024.0) : 0;
+
+    printf("\n== OTA: download -> flash -> riavvio, ripresa, conferma e rollback ==\n");
+    printf("immagine %zu B (%u settori), server %s, %u buffer da %u B\n", len, sectors,
+           o.rate_kbs ? "con banda limitata" : "senza limite di banda", OTA_CHUNK_BUFS,
+           OTA_CHUNK_LEN);
+    printf("limite flash %.0f ms (cancellazione %u us + scrittura %u us per pagina)", flash_ms,
+           ft.erase_us, ft.page_us);
+    if (o.rate_kbs) {
+        printf(", limite rete %.0f ms (%u KB/s)", net_ms, o.rate_kbs);
+    }
+    printf("\n");
+
+    child_result_t r;
+    // 1. provisioning e primo aggiornamento; la connessione cade al 40%
+    atomic_store(&s_srv->drop_after, (uint32_t)(len * 2 / 5));
+    step_t update = { .provision = true, .command = true, .by_url = true, .wait_restart = true };
+    bool ok = run_child(&o, &update, &r);
+    check(ok, "aggiornamento a 2.0");
+    if (ok) {
+        printf("comando -> riavvio     %8.0f ms  (%.0f KB/s, %.2fx il limite), %u riprese\n",
+               r.update_us / 1000.0, len / 1024.0 / (r.update_us / 1e6),
+               r.update_us / 1000.0 / (flash_ms > net_ms ? flash_ms : net_ms), r.prog.resumes);
+        printf("flash                  %u settori cancellati, %llu B scritti, %u pagine sporche\n",
+               r.flash.erases, (unsigned long long)r.flash.written, r.flash.dirty_writes);
+        check(r.cmd_status == CMD_STATUS_OK, "risposta al comando");
+        check(r.prog.resumes >= 1, "ripresa dopo la connessione caduta");
+        check(r.flash.dirty_writes == 0, "scritture senza cancellazione");
+    }
+
+    // 2. primo avvio della 2.0: in prova, poi confermata
+    step_t confirm = { .wait_confirm = true };
+    ok = run_child(&o, &confirm, &r);
+    check(ok && r.slot == 1 && strcmp(r.version, "2.0") == 0 &&
+          r.boot_state == OTA_STATE_PENDING_VERIFY, "avvio della 2.0 in prova su ota_1");
+    if (ok) {
+        printf("avvio 2.0 -> conferma  %8.0f ms\n", r.confirm_us / 1000.0);
+    }
+
+    // 3. aggiornamento a 3.0 interrotto a meta' da uno spegnimento
+    len = sim_ota_build_image(image, o.image_kb * 1024, SIM_PROJECT_NAME, "3.0", 2);
+    server_publish(image, len);
+    step_t cut = { .command = true, .cut_at = (uint32_t)(len / 2) };
+    ok = run_child(&o, &cut, &r);
+    check(ok, "spegnimento a meta' download");
+
+    // 4. al riavvio il download riprende da solo dall'ultimo punto salvato
+    atomic_store(&s_srv->first_range, -1);
+    step_t resume = { .wait_restart = true };
+    ok = run_child(&o, &resume, &r);
+    int64_t from = atomic_load(&s_srv->first_range);
+    check(ok && from > 0, "ripresa dopo lo spegnimento");
+    if (ok) {
+        printf("ripresa da spento      da %lld B, boot -> riavvio %.0f ms\n", (long long)from,
+               r.update_us / 1000.0);
+    }
+
+    // 5. la 3.0 si riavvia prima di confermarsi (crash, watchdog...)
+    step_t crash = { .crash = true };
+    ok = run_child(&o, &crash, &r);
+    check(ok && r.slot == 0 && strcmp(r.version, "3.0") == 0 &&
+          r.boot_state == OTA_STATE_PENDING_VERIFY, "avvio della 3.0 in prova su ota_0");
+
+    // 6. il bootloader torna alla 2.0
+    step_t plain = { 0 };
+    ok = run_child(&o, &plain, &r);
+    check(ok && r.slot == 1 && strcmp(r.version, "2.0") == 0 && r.boot_state == OTA_STATE_IDLE,
+          "rollback alla 2.0");
+    if (ok) {
+        printf("rollback               di nuovo %s su ota_%d\n", r.version, r.slot);
+    }
+
+    // 7. immagine corrotta: scaricata tutta, rifiutata dalla verifica
+    len = sim_ota_build_image(image, o.image_kb * 1024, SIM_PROJECT_NAME, "4.0", 3);
+    image[len / 2] ^= 0x40;
+    server_publish(image, len);
+    step_t bad = { .command = true, .wait_failed = true };
+    ok = run_child(&o, &bad, &r);
+    check(ok && r.prog.err == ESP_ERR_OTA_VALIDATE_FAILED, "immagine corrotta rifiutata");
+    if (ok) {
+        printf("immagine corrotta      %s dopo %u B\n", esp_err_to_name(r.prog.err), r.prog.written);
+    }
+
+    // 8. immagine di un altro progetto: fermata dall'intestazione
+    len = sim_ota_build_image(image, o.image_kb * 1024, "altro_progetto", "9.9", 4);
+    server_publish(image, len);
+    ok = run_child(&o, &bad, &r);
+    check(ok && r.prog.err == ESP_ERR_INVALID_VERSION && r.prog.written < OTA_CHUNK_LEN * 2,
+          "immagine di un altro progetto rifiutata");
+    check(ok && r.slot == 1 && strcmp(r.version, "2.0") == 0, "la 2.0 resta in esecuzione");
+    if (ok) {
+        printf("altro progetto         %s dopo %u B\n", esp_err_to_name(r.prog.err), r.prog.written);
+    }
+
+    printf("fallimenti             %u\n", s_failures);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(s_nvs_file);
+    unlink(s_flash_file);
+    return s_failures ? 2 : 0;
+}
@@ -0,0 +1,756 @@
+// host/bench/pipeline_bench.c
+// Banco di prova della pipeline BLE -> Wi-Fi -> BLE: avvia il firmware vero
+// sopra il simulatore, fa da telefono e misura "write comando -> scansione ->
+// notifica" (percentili di latenza e throughput). Con -s esegue uno script.
+#include "bench_common.h"
+#include "sim.h"
+#include "esp_log.h"
+#include "common_variables.h"
+#include "wifi_handler.h"
+#include "boot_profile.h"
+#include "ble_command.h"
+#include "ble_link.h"
+#include "dlog.h"
+#include "journal.h"
+#include "ota_update.h"
+#include "telemetry.h"
+#include "wifi_status.h"
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIFI_STATUS_UUID     0xFF10
+#define COMMAND_UUID         0xFF11
+#define WIFI_SCAN_LIST_UUID  0xFF20
+#define TELEMETRY_UUID       0xFF30
+#define JOURNAL_UUID         0xFF31
+
+typedef struct {
+    unsigned iterations;
+    unsigned aps;
+    unsigned ssid_groups;
+    unsigned dwell_ms;
+    unsigned pause_ms;
+    unsigned mtu;
+    unsigned conn_interval_ms;
+    unsigned timeout_ms;
+    const char *script;
+    bool verbose;
+} bench_opts_t;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "uso: %s [opzioni]\n"
+            "  -n N    iterazioni (default 20)\n"
+            "  -a N    AP simulati (default 12)\n"
+            "  -g N    SSID distinti fra gli AP (default = AP)\n"
+            "  -d MS   dwell per canale della scansione attiva (default 120)\n"
+            "  -i MS   intervallo di connessione BLE (default 30)\n"
+            "  -m N    MTU richiesto dal telefono (default 23, nessuno scambio)\n"
+            "  -p MS   pausa fra le iterazioni (default 0)\n"
+            "  -t MS   timeout per risultato (default 10000)\n"
+            "  -s FILE esegue uno script invece del benchmark\n"
+            "  -v      log del firmware a livello INFO\n", argv0);
+}
+
+static void subscribe(uint16_t conn_id, uint16_t uuid) {
+    uint16_t cccd = sim_ble_find_cccd(uuid);
+    if (cccd) {
+        static const uint8_t enable[2] = { 0x01, 0x00 };
+        sim_ble_write(conn_id, cccd, enable, sizeof(enable));
+    }
+}
+
+static uint16_t connect_phone(const bench_opts_t *o) {
+    uint16_t conn_id = sim_ble_connect();
+    sim_ble_link_t link;
+    sim_ble_get_link(conn_id, &link);
+    link.conn_interval_us = o->conn_interval_ms * 1000;
+    sim_ble_set_link(conn_id, &link);
+    if (o->mtu > 23) {
+        sim_ble_exchange_mtu(conn_id, (uint16_t)o->mtu);
+    }
+    return conn_id;
+}
+
+static int run_benchmark(const bench_opts_t *o) {
+    int64_t t_adv = bench_boot_firmware(5000);
+    if (t_adv < 0) {
+        fprintf(stderr, "il firmware non ha avviato l'advertising\n");
+        return 1;
+    }
+    uint16_t conn_id = connect_phone(o);
+    uint16_t cmd = sim_ble_find_char(COMMAND_UUID);
+    uint16_t list = sim_ble_find_char(WIFI_SCAN_LIST_UUID);
+    if (cmd == 0 || list == 0) {
+        fprintf(stderr, "caratteristiche COMMAND/WIFI_SCAN_LIST non trovate\n");
+        return 1;
+    }
+    subscribe(conn_id, WIFI_SCAN_LIST_UUID);
+
+    bench_stats_t lat, first;
+    bench_stats_init(&lat, o->iterations);
+    bench_stats_init(&first, o->iterations);
+    uint64_t total_bytes = 0;
+    uint32_t total_packets = 0;
+    uint32_t total_records = 0;
+    unsigned failures = 0;
+    uint64_t copy_before = sim_stats_copy_bytes();
+    sim_wifi_stats_t wifi_before;
+    sim_wifi_get_stats(&wifi_before);
+    int64_t run_start = sim_now_us();
+
+    for (unsigned i = 0; i < o->iterations; i++) {
+        bench_notify_reset(list);
+        int64_t t0 = sim_now_us();
+        esp_gatt_status_t st = sim_ble_write(conn_id, cmd, "scan", 4);
+        bench_result_t res;
+        if (st != ESP_GATT_OK || !bench_notify_wait(list, o->timeout_ms, &res) || res.records < 0) {
+            failures++;
+            continue;
+        }
+        bench_stats_add(&lat, res.delivered_us - t0);
+        if (res.partials) {
+            bench_stats_add(&first, res.first_partial_us - t0);
+        }
+        total_bytes += res.bytes;
+        total_packets += res.packets;
+        total_records += (uint32_t)res.records;
+        sim_sleep_us((int64_t)o->pause_ms * 1000);
+    }
+
+    double elapsed_s = (double)(sim_now_us() - run_start) / 1e6;
+    sim_wifi_stats_t wifi_after;
+    sim_wifi_get_stats(&wifi_after);
+    uint32_t scans = wifi_after.scans - wifi_before.scans;
+    size_t ok = lat.count;
+
+    printf("\n== pipeline: command write -> scan -> notification ==\n");
+    printf("AP simulati=%u  dwell=%ums  conn_interval=%ums  mtu=%u\n",
+           o->aps, o->dwell_ms, o->conn_interval_ms, o->mtu);
+    printf("boot -> advertising       %8.2f ms (adv data configurati %u volte)\n",
+           t_adv / 1000.0, sim_ble_adv_config_count());
+    boot_profile_t boot;
+    boot_profile_get(&boot);
+    printf("fasi di avvio (fine)      nvs %.1f  queues %.1f  ble %.1f  wifi %.1f  init %.1f ms\n",
+           boot.end_us[BOOT_PHASE_NVS] / 1000.0, boot.end_us[BOOT_PHASE_QUEUES] / 1000.0,
+           boot.end_us[BOOT_PHASE_BLE] / 1000.0, boot.end_us[BOOT_PHASE_WIFI] / 1000.0,
+           boot.done_us / 1000.0);
+    bench_stats_print(&lat, "end-to-end latency");
+    if (first.count) {
+        bench_stats_print(&first, "first partial list");
+    }
+    printf("throughput                %8.2f risultati/s, %8.1f B/s\n",
+           ok / elapsed_s, total_bytes / elapsed_s);
+    printf("per risultato             %8.1f reti, %.1f B in %.1f notifiche, %u troncate\n",
+           ok ? (double)total_records / ok : 0.0,
+           ok ? (double)total_bytes / ok : 0.0, ok ? (double)total_packets / ok : 0.0,
+           sim_ble_notifications_truncated());
+    printf("scansioni radio           %u (%.1f ms radio per scansione)\n", scans,
+           scans ? (double)(wifi_after.scan_radio_us - wifi_before.scan_radio_us) / scans / 1000.0 : 0.0);
+    printf("byte copiati nelle code   %.1f B/evento\n",
+           ok ? (double)(sim_stats_copy_bytes() - copy_before) / ok : 0.0);
+    printf("fallimenti                %u/%u\n", failures, o->iterations);
+    bench_stats_free(&lat);
+    bench_stats_free(&first);
+    return failures ? 2 : 0;
+}
+
+// — script —
+
+static wifi_auth_mode_t parse_auth(const char *s) {
+    if (s == NULL || strcmp(s, "wpa2") == 0) return WIFI_AUTH_WPA2_PSK;
+    if (strcmp(s, "open") == 0)              return WIFI_AUTH_OPEN;
+    if (strcmp(s, "wpa") == 0)               return WIFI_AUTH_WPA_PSK;
+    if (strcmp(s, "wpa3") == 0)              return WIFI_AUTH_WPA3_PSK;
+    if (strcmp(s, "wpa2wpa3") == 0)          return WIFI_AUTH_WPA2_WPA3_PSK;
+    if (strcmp(s, "ent") == 0)               return WIFI_AUTH_WPA2_ENTERPRISE;
+    return WIFI_AUTH_WPA2_PSK;
+}
+
+// Payload: testo ASCII oppure "hex:0a0b0c"
+static int parse_payload(const char *text, uint8_t *out, size_t max) {
+    if (strncmp(text, "hex:", 4) == 0) {
+        size_t n = 0;
+        for (const char *p = text + 4; p[0] && p[1] && n < max; p += 2) {
+            unsigned v;
+            if (sscanf(p, "%2x", &v) != 1) {
+                return -1;
+            }
+            out[n++] = (uint8_t)v;
+        }
+        return (int)n;
+    }
+    size_t n = strlen(text);
+    if (n > max) {
+        n = max;
+    }
+    memcpy(out, text, n);
+    return (int)n;
+}
+
+static uint32_t get_le(const uint8_t *p, int n) {
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Legge l'istantanea di telemetria come farebbe l'app e la stampa
+static void print_telemetry(uint16_t conn_id) {
+    static const char *const tasks[] = { "BLE_TASK", "WIFI_TASK" };
+    static const char *const queues[] = { "ble_to_wifi", "wifi_to_ble" };
+    static const char *const hists[] = { "scan", "wifi_evt", "gatts_cb", "wake_wifi", "wake_ble" };
+    uint8_t buf[512];
+    esp_gatt_status_t st;
+    uint16_t h = sim_ble_find_char(TELEMETRY_UUID);
+    int n = h ? sim_ble_read_long(conn_id, h, buf, sizeof(buf), &st) : -1;
+    if (n != TELEMETRY_SNAPSHOT_LEN || buf[0] != TELEMETRY_VERSION) {
+        printf("[script] telemetria: lettura non valida (%d B)\n", n);
+        return;
+    }
+    const uint8_t *p = buf + 2;
+    printf("[script] telemetria (%d B): uptime %u ms, heap %u libero / %u minimo\n",
+           n, get_le(p, 4), get_le(p + 4, 4), get_le(p + 8, 4));
+    p += 12;
+    for (int i = 0; i < buf[1]; i++, p += 4) {
+        printf("[script]   %-11s CPU %4.1f%%  stack libero %u B\n",
+               tasks[i], get_le(p, 2) / 10.0, get_le(p + 2, 2));
+    }
+    for (int i = 0; i < 2; i++, p += 4) {
+        printf("[script]   %-11s coda %u (picco %u)  pool %u (picco %u)\n",
+               queues[i], p[0], p[1], p[2], p[3]);
+    }
+    int nh = p[0], nb = p[1];
+    p += 2;
+    for (int l = 0; l < nh; l++) {
+        printf("[script]   %-11s", l < (int)(sizeof(hists) / sizeof(hists[0])) ? hists[l] : "?");
+        for (int b = 0; b < nb; b++, p += 2) {
+            uint32_t c = get_le(p, 2);
+            if (c) {
+                if (b == nb - 1) {
+                    printf("  >=%.1fms:%u", (1u << (b + 6)) / 1000.0, c);
+                } else {
+                    printf("  <%.1fms:%u", (1u << (b + 7)) / 1000.0, c);
+                }
+            }
+        }
+        printf("\n");
+    }
+}
+
+// Un record del diario in chiaro (formati in include/journal.h)
+static void print_journal_record(const uint8_t *r) {
+    const uint8_t *d = r + JOURNAL_REC_HDR_LEN;
+    int len = r[1];
+    printf("[script]   avvio %u %7u ms  %-15s", get_le(r + 2, 2), get_le(r + 4, 4),
+           journal_event_name((journal_event_t)r[0]));
+    switch (r[0]) {
+        case JOURNAL_EV_BOOT:
+            printf(" reset %u, versione %.*s", d[0], len - 1, (const char *)d + 1);
+            break;
+        case JOURNAL_EV_BOOT_PROFILE:
+            printf(" nvs %u queues %u ble %u wifi %u, init %u adv %u", get_le(d, 2), get_le(d + 2, 2),
+                   get_le(d + 4, 2), get_le(d + 6, 2), get_le(d + 8, 2), get_le(d + 10, 2));
+            break;
+        case JOURNAL_EV_WIFI_CONNECT:
+            printf(" ch %u %d dBm, %u tentativi, %u ms, bssid %02x:%02x:%02x:%02x:%02x:%02x",
+                   d[0], (int8_t)d[1], d[2], get_le(d + 3, 2), d[5], d[6], d[7], d[8], d[9], d[10]);
+            break;
+        case JOURNAL_EV_WIFI_DISCONNECT:
+            printf(" reason %u%s, %d dBm", d[0], d[1] ? " (era connesso)" : "", (int8_t)d[2]);
+            break;
+        case JOURNAL_EV_SCAN:
+            printf(" %s, %u inviate / %u viste (%u unite), %u ms, %u richieste", d[0] ? "ok" : "fallita",
+                   d[1], get_le(d + 2, 2), get_le(d + 4, 2), get_le(d + 6, 2), d[8]);
+            break;
+        case JOURNAL_EV_BLE_CONNECT:
+            printf(" conn %u (%u collegati)", d[0], d[1]);
+            break;
+        case JOURNAL_EV_BLE_DISCONNECT:
+            printf(" conn %u, reason 0x%02x", d[0], get_le(d + 1, 2));
+            break;
+        default:
+            printf(" %d B", len);
+            break;
+    }
+    printf("\n");
+}
+
+// Scarica il diario da FF31 a pagine, come l'app, dalla posizione 'from'
+// (0 = dal piu' vecchio). Ritorna i record letti.
+static int print_journal(uint16_t conn_id, uint32_t from) {
+    uint16_t h = sim_ble_find_char(JOURNAL_UUID);
+    uint8_t pos[4] = { (uint8_t)from, (uint8_t)(from >> 8), (uint8_t)(from >> 16), (uint8_t)(from >> 24) };
+    if (h == 0 || sim_ble_write(conn_id, h, pos, sizeof(pos)) != ESP_GATT_OK) {
+        printf("[script] diario: FF31 non disponibile\n");
+        return -1;
+    }
+    int records = 0, pages = 0, bytes = 0;
+    int64_t t0 = sim_now_us();
+    while (1) {
+        uint8_t page[JOURNAL_PAGE_LEN];
+        esp_gatt_status_t st;
+        int n = sim_ble_read_long(conn_id, h, page, sizeof(page), &st);
+        if (n < JOURNAL_PAGE_HDR_LEN) {
+            printf("[script] diario: pagina non valida (%d B)\n", n);
+            return -1;
+        }
+        pages++;
+        bytes += n;
+        if (n == JOURNAL_PAGE_HDR_LEN) {
+            break;
+        }
+        for (int off = JOURNAL_PAGE_HDR_LEN; off + JOURNAL_REC_HDR_LEN < n;
+             off += JOURNAL_REC_HDR_LEN + page[off + 1] + 1) {
+            print_journal_record(&page[off]);
+            records++;
+        }
+    }
+    printf("[script] diario: %d record in %d pagine (%d B) in %.1f ms\n", records, pages, bytes,
+           (sim_now_us() - t0) / 1000.0);
+    return records;
+}
+
+// Valore di FF10 (read o notifica) in chiaro
+static void print_status(const char *what, const uint8_t *v, int n, int64_t at_us) {
+    if (n != WIFI_STATUS_VALUE_LEN || v[0] != WIFI_STATUS_VERSION) {
+        printf("[script] %s: valore non valido (%d B)\n", what, n);
+        return;
+    }
+    printf("[script] %s a %.1f ms: %s, reason %u, %d dBm, seq %u, ip %u.%u.%u.%u\n", what,
+           at_us / 1000.0, wifi_state_name((wifi_state_t)v[1]), v[2], (int8_t)v[3], v[4],
+           v[5], v[6], v[7], v[8]);
+}
+
+// Risposta a un comando su FF11: [indice][opcode][stato][dati]
+static void print_reply(const bench_short_t *r) {
+    static const char *const status_names[] = { "ok", "sconosciuto", "lunghezza", "argomento",
+                                                "occupato", "troncato" };
+    if (r->len < CMD_REPLY_HDR_LEN) {
+        printf("[script] risposta non valida (%u B)\n", r->len);
+        return;
+    }
+    const char *st = r->data[2] < sizeof(status_names) / sizeof(status_names[0])
+                     ? status_names[r->data[2]] : "?";
+    printf("[script] risposta a %.1f ms: comando %u, op 0x%02x, %s", r->delivered_us / 1000.0,
+           r->data[0], r->data[1], st);
+    const uint8_t *d = r->data + CMD_REPLY_HDR_LEN;
+    if (r->data[1] == CMD_OP_STATS && r->len == CMD_REPLY_HDR_LEN + CMD_STATS_LEN) {
+        printf(" (uptime %u ms, heap %u, %s, %d dBm, %u reti, %u rifiutati, %u log persi)",
+               get_le(d, 4), get_le(d + 4, 4), wifi_state_name((wifi_state_t)d[8]), (int8_t)d[9],
+               d[10], get_le(d + 11, 2), get_le(d + 13, 2));
+    } else if (r->data[1] == CMD_OP_OTA && r->len == CMD_REPLY_HDR_LEN + CMD_OTA_LEN) {
+        printf(" (OTA %s, %u/%u B, %u riprese)", ota_state_name((ota_state_t)d[0]), get_le(d + 1, 4),
+               get_le(d + 5, 4), d[9]);
+    }
+    printf("\n");
+}
+
+// Parametri del link visti dal firmware (ble_link_get) e dalla radio
+// simulata. Gli eventi al secondo sono quelli in cui la periferica ascolta
+// a link fermo: uno ogni latency + 1.
+static void print_link(uint16_t conn_id) {
+    ble_link_params_t p;
+    sim_ble_link_t link;
+    if (!ble_link_get(conn_id, &p)) {
+        printf("[script] link: conn %u non collegata\n", conn_id);
+        return;
+    }
+    sim_ble_get_link(conn_id, &link);
+    printf("[script] link conn %u: profilo %s%s, %.2f ms, latency %u, timeout %u ms, MTU %u, "
+           "LL %u B, %u aggiornamenti, %u rifiuti\n", conn_id, ble_link_profile_name(p.profile),
+           p.update_pending ? " (in corso)" : "", p.interval * 1.25, p.latency, p.timeout * 10,
+           p.mtu, p.tx_octets, p.updates, p.rejects);
+    printf("[script]   radio: %.2f ms, latency %u, LL %u B -> %.1f eventi/s a riposo\n",
+           link.conn_interval_us / 1000.0, link.latency, link.ll_payload,
+           1e6 / ((double)link.conn_interval_us * (link.latency + 1)));
+}
+
+// Un telefono che interroga il dispositivo mentre succede altro (es. una
+// scansione): write command STATS ogni period_ms per duration_ms, ognuno
+// atteso fino alla sua risposta su FF11 (serve watch_replies). Le risposte
+// ad altri comandi si saltano. Stampa il giro write -> notifica e quanto la
+// scansione ha tenuto la radio lontana dal BLE.
+static int probe_replies(uint16_t conn_id, uint32_t period_ms, uint32_t duration_ms) {
+    static const uint8_t stats_cmd[] = { CMD_OP_STATS, 0x00 };
+    uint16_t h = sim_ble_find_char(COMMAND_UUID);
+    bench_stats_t rtt;
+    bench_stats_init(&rtt, duration_ms / (period_ms ? period_ms : 1) + 1);
+    uint32_t deferred_before, lost_before, deferred, lost;
+    sim_ble_coex_stats(&deferred_before, &lost_before);
+    unsigned missed = 0;
+    int64_t end = sim_now_us() + (int64_t)duration_ms * 1000;
+    while (sim_now_us() < end) {
+        int64_t t0 = sim_now_us();
+        sim_ble_write_nr(conn_id, h, stats_cmd, sizeof(stats_cmd));
+        bench_short_t r;
+        bool got = false;
+        while (!got && bench_short_wait(2000, &r)) {
+            got = r.len >= CMD_REPLY_HDR_LEN && r.data[1] == CMD_OP_STATS;
+        }
+        if (!got) {
+            missed++;
+            continue;
+        }
+        sim_sleep_us(r.delivered_us - sim_now_us());
+        bench_stats_add(&rtt, r.delivered_us - t0);
+        sim_sleep_us(t0 + (int64_t)period_ms * 1000 - sim_now_us());
+    }
+    sim_wifi_stats_t wifi;
+    sim_wifi_get_stats(&wifi);
+    sim_ble_coex_stats(&deferred, &lost);
+    printf("[script] probe: %zu risposte, %u perse, p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           rtt.count, missed, bench_stats_percentile(&rtt, 50) / 1000.0,
+           bench_stats_percentile(&rtt, 99) / 1000.0, bench_stats_percentile(&rtt, 100) / 1000.0);
+    printf("[script]   BLE senza radio al massimo %.1f ms di fila, %u pacchetti rinviati, "
+           "%u link persi\n", wifi.coex_max_blackout_us / 1000.0,
+           deferred - deferred_before, lost - lost_before);
+    size_t got = rtt.count;
+    bench_stats_free(&rtt);
+    return got ? 0 : 1;
+}
+
+#define SCRIPT_PHONES 4
+
+static int run_script(const bench_opts_t *o) {
+    FILE *f = fopen(o->script, "r");
+    if (f == NULL) {
+        perror(o->script);
+        return 1;
+    }
+    bench_stats_t lat;
+    bench_stats_init(&lat, 1024);
+    bool booted = false;
+    uint16_t conn_id = 0;
+    // "phone <n>" sceglie il telefono a cui vanno i comandi successivi
+    uint16_t phones[SCRIPT_PHONES + 1] = { 0 };
+    bool phone_on[SCRIPT_PHONES + 1] = { false };
+    int phone = 1;
+    uint16_t expect = 0;
+    int64_t last_write = 0;
+    int rc = 0;
+    unsigned lineno = 0;
+    char line[512];
+    static sim_ble_write_t pending[64];
+    static uint8_t pending_buf[64][256];
+    size_t pending_count = 0;
+
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char *cmd = strtok(line, " \t\r\n");
+        if (cmd == NULL) {
+            continue;
+        }
+        char *a1 = strtok(NULL, " \t\r\n");
+        char *rest = a1 ? strtok(NULL, "\r\n") : NULL;
+        while (rest && isspace((unsigned char)*rest)) {
+            rest++;
+        }
+
+        if (strcmp(cmd, "ap") == 0 && a1 && rest) {
+            sim_ap_t ap = { .enabled = true };
+            char pass[65], auth[16] = "";
+            int ch, rssi;
+            if (sscanf(rest, "%64s %d %d %15s", pass, &ch, &rssi, auth) < 3) {
+                rc = 1;
+                break;
+            }
+            snprintf(ap.ssid, sizeof(ap.ssid), "%s", a1);
+            snprintf(ap.password, sizeof(ap.password), "%s", pass);
+            ap.channel = (uint8_t)ch;
+            ap.rssi = (int8_t)rssi;
+            ap.authmode = parse_auth(auth[0] ? auth : NULL);
+            for (size_t i = 0; i < 6; i++) {
+                ap.bssid[i] = (uint8_t)(0x10 * i + lineno);
+            }
+            sim_wifi_add_ap(&ap);
+        } else if (strcmp(cmd, "aps") == 0 && a1) {
+            unsigned groups = 0, seed = 1;
+            if (rest) {
+                sscanf(rest, "%u %u", &groups, &seed);
+            }
+            sim_wifi_generate_aps((unsigned)atoi(a1), groups, seed);
+        } else if (strcmp(cmd, "ap_off") == 0 && a1) {
+            sim_wifi_set_ap_enabled(a1, false);
+        } else if (strcmp(cmd, "ap_on") == 0 && a1) {
+            sim_wifi_set_ap_enabled(a1, true);
+        } else if (strcmp(cmd, "drop") == 0) {
+            sim_wifi_drop_link(a1 ? (uint8_t)atoi(a1) : WIFI_REASON_BEACON_TIMEOUT);
+        } else if (strcmp(cmd, "boot") == 0) {
+            int64_t t = bench_boot_firmware(5000);
+            printf("[script] boot -> advertising %.2f ms\n", t / 1000.0);
+            booted = t >= 0;
+            rc = booted ? 0 : 1;
+        } else if (strcmp(cmd, "connect") == 0) {
+            if (!booted) {
+                booted = bench_boot_firmware(5000) >= 0;
+            }
+            if (!sim_ble_wait_advertising(0)) {
+                printf("[script] telefono %d: il dispositivo non e' in advertising\n", phone);
+            } else {
+                conn_id = connect_phone(o);
+                phone_on[phone] = true;
+            }
+        } else if (strcmp(cmd, "disconnect") == 0) {
+            sim_ble_disconnect(conn_id);
+            phone_on[phone] = false;
+        } else if (strcmp(cmd, "phone") == 0 && a1) {
+            int n = atoi(a1);
+            if (n < 1 || n > SCRIPT_PHONES) {
+                rc = 1;
+                break;
+            }
+            phones[phone] = conn_id;
+            phone = n;
+            conn_id = phones[phone];
+        } else if (strcmp(cmd, "adv") == 0) {
+            printf("[script] advertising %s\n", sim_ble_wait_advertising(0) ? "attivo" : "fermo");
+        } else if (strcmp(cmd, "streams") == 0) {
+            // Cosa ha ricevuto ogni telefono collegato dall'ultimo expect
+            phones[phone] = conn_id;
+            for (int i = 1; i <= SCRIPT_PHONES; i++) {
+                if (!phone_on[i]) {
+                    continue;
+                }
+                bench_result_t res;
+                bool done = bench_notify_peek(phones[i], &res);
+                printf("[script] telefono %d: %s, %d reti, %u B in %u notifiche\n", i,
+                       done ? "completo" : "incompleto", done ? res.records : 0, res.bytes, res.packets);
+            }
+        } else if (strcmp(cmd, "mtu") == 0 && a1) {
+            sim_ble_exchange_mtu(conn_id, (uint16_t)atoi(a1));
+        } else if (strcmp(cmd, "subscribe") == 0 && a1) {
+            subscribe(conn_id, (uint16_t)strtoul(a1, NULL, 16));
+        } else if (strcmp(cmd, "expect") == 0 && a1) {
+            expect = sim_ble_find_char((uint16_t)strtoul(a1, NULL, 16));
+            bench_notify_reset(expect);
+        } else if (strcmp(cmd, "write") == 0 && a1) {
+            uint8_t buf[512];
+            int n = parse_payload(rest ? rest : "", buf, sizeof(buf));
+            uint16_t h = sim_ble_find_char((uint16_t)strtoul(a1, NULL, 16));
+            last_write = sim_now_us();
+            esp_gatt_status_t st = (n < 0 || h == 0) ? ESP_GATT_INVALID_HANDLE
+                                                     : sim_ble_write(conn_id, h, buf, (uint16_t)n);
+            printf("[script] write %s (%d B) -> status 0x%02x\n", a1, n, st);
+        } else if (strcmp(cmd, "read") == 0 && a1) {
+            uint8_t buf[512];
+            esp_gatt_status_t st;
+            uint16_t h = sim_ble_find_char((uint16_t)strtoul(a1, NULL, 16));
+            int n = h ? sim_ble_read_long(conn_id, h, buf, sizeof(buf), &st) : -1;
+            printf("[script] read %s -> ", a1);
+            if (n < 0) {
+                printf("errore\n");
+            } else {
+                printf("%d B:", n);
+                for (int i = 0; i < n; i++) {
+                    printf(" %02x", buf[i]);
+                }
+                printf("\n");
+            }
+        } else if (strcmp(cmd, "wait") == 0) {
+            bench_result_t res;
+            uint32_t timeout = a1 ? (uint32_t)atoi(a1) : o->timeout_ms;
+            if (expect && bench_notify_wait_conn(conn_id, expect, timeout, &res)) {
+                bench_stats_add(&lat, res.delivered_us - last_write);
+                printf("[script] risultato in %.2f ms: %d reti, %u B, %u notifiche\n",
+                       (res.delivered_us - last_write) / 1000.0, res.records, res.bytes, res.packets);
+                if (res.partials) {
+                    printf("[script]   %u liste parziali, la prima in %.2f ms\n", res.partials,
+                           (res.first_partial_us - last_write) / 1000.0);
+                }
+            } else {
+                printf("[script] timeout alla riga %u\n", lineno);
+                rc = 2;
+            }
+        } else if (strcmp(cmd, "link") == 0 && a1) {
+            // link <intervallo ms> [pacchetti per evento]
+            sim_ble_link_t link;
+            sim_ble_get_link(conn_id, &link);
+            link.conn_interval_us = (uint32_t)(atof(a1) * 1000);
+            if (rest) {
+                link.pkts_per_event = (uint8_t)atoi(rest);
+            }
+            sim_ble_set_link(conn_id, &link);
+        } else if (strcmp(cmd, "burst") == 0 && a1 && rest) {
+            // burst <n> <uuid> <payload>: n write command accodati insieme
+            char uuid[8];
+            int off = 0;
+            if (sscanf(rest, "%7s %n", uuid, &off) < 1) {
+                rc = 1;
+                break;
+            }
+            uint8_t buf[512];
+            int n = parse_payload(rest + off, buf, sizeof(buf));
+            uint16_t h = sim_ble_find_char((uint16_t)strtoul(uuid, NULL, 16));
+            int count = atoi(a1);
+            if (count > 64) {
+                count = 64;
+            }
+            sim_ble_write_t writes[64];
+            for (int i = 0; i < count; i++) {
+                writes[i] = (sim_ble_write_t){ .handle = h, .data = buf, .len = (uint16_t)n };
+            }
+            int64_t t0 = sim_now_us();
+            if (n >= 0 && h) {
+                sim_ble_write_nr_many(conn_id, writes, (size_t)count);
+            }
+            printf("[script] burst %d x %s (%d B) in %.2f ms\n", count, uuid, n,
+                   (sim_now_us() - t0) / 1000.0);
+        } else if (strcmp(cmd, "queue") == 0 && a1) {
+            // queue <uuid> <payload>: write command tenuto da parte fino a flush
+            int n = parse_payload(rest ? rest : "", pending_buf[pending_count], sizeof(pending_buf[0]));
+            uint16_t h = sim_ble_find_char((uint16_t)strtoul(a1, NULL, 16));
+            if (n < 0 || h == 0 || pending_count == 64) {
+                rc = 1;
+                break;
+            }
+            pending[pending_count] = (sim_ble_write_t){
+                .handle = h, .data = pending_buf[pending_count], .len = (uint16_t)n };
+            pending_count++;
+        } else if (strcmp(cmd, "flush") == 0) {
+            int64_t t0 = sim_now_us();
+            sim_ble_write_nr_many(conn_id, pending, pending_count);
+            printf("[script] flush di %zu write in %.2f ms\n", pending_count,
+                   (sim_now_us() - t0) / 1000.0);
+            pending_count = 0;
+        } else if (strcmp(cmd, "qstats") == 0) {
+            queue_stats_t bw, wb;
+            queues_get_stats(&bw, &wb);
+            printf("[script] ble_to_wifi: %u accodati, %u fusi, %u sostituiti, %u rifiutati, picco %u/%u\n",
+                   bw.posted, bw.coalesced, bw.superseded, bw.rejected, bw.high_water, bw.depth);
+            printf("[script] wifi_to_ble: %u accodati, %u scartati, picco %u/%u\n",
+                   wb.posted, wb.dropped, wb.high_water, wb.depth);
+            wifi_cmd_stats_t cs;
+            wifi_get_cmd_stats(&cs);
+            printf("[script] wifi_task: %u scansioni avviate, %u richieste agganciate, %u dalla cache, "
+                   "%u connect eseguiti, %u ridondanti, %u auto-join annullati\n",
+                   cs.scans_started, cs.scans_joined, cs.scans_cached, cs.connects, cs.connects_redundant,
+                   cs.autojoins_dropped);
+            printf("[script] callback BTC piu' lunga: %.2f ms\n",
+                   sim_ble_callback_max_us(true) / 1000.0);
+            dlog_stats_t ls;
+            dlog_get_stats(&ls);
+            printf("[script] log differito: %u righe, %u perse, picco %u/%u in attesa\n",
+                   ls.written, ls.dropped, ls.peak, DLOG_RING_LEN);
+        } else if (strcmp(cmd, "rssi") == 0 && a1 && rest) {
+            sim_wifi_set_ap_rssi(a1, (int8_t)atoi(rest));
+        } else if (strcmp(cmd, "status") == 0) {
+            uint8_t buf[64];
+            esp_gatt_status_t st;
+            uint16_t h = sim_ble_find_char(WIFI_STATUS_UUID);
+            int n = h ? sim_ble_read(conn_id, h, buf, sizeof(buf), &st) : -1;
+            print_status("stato letto", buf, n, sim_now_us());
+        } else if (strcmp(cmd, "watch_status") == 0) {
+            subscribe(conn_id, WIFI_STATUS_UUID);
+            bench_short_watch(sim_ble_find_char(WIFI_STATUS_UUID));
+        } else if (strcmp(cmd, "wait_status") == 0 && a1) {
+            // wait_status <stato> [ms]: stampa le notifiche fino a quella con lo stato dato
+            uint32_t timeout = rest ? (uint32_t)atoi(rest) : o->timeout_ms;
+            int64_t deadline = sim_now_us() + (int64_t)timeout * 1000;
+            bench_short_t n;
+            bool found = false;
+            while (!found && sim_now_us() < deadline &&
+                   bench_short_wait((uint32_t)((deadline - sim_now_us()) / 1000), &n)) {
+                char what[32];
+                snprintf(what, sizeof(what), "notifica stato (conn %u)", n.conn_id);
+                print_status(what, n.data, n.len, n.delivered_us);
+                found = n.len == WIFI_STATUS_VALUE_LEN && strcmp(wifi_state_name(n.data[1]), a1) == 0;
+            }
+            if (!found) {
+                printf("[script] stato %s non arrivato alla riga %u\n", a1, lineno);
+                rc = 2;
+            }
+        } else if (strcmp(cmd, "watch_replies") == 0) {
+            subscribe(conn_id, COMMAND_UUID);
+            bench_short_watch(sim_ble_find_char(COMMAND_UUID));
+        } else if (strcmp(cmd, "wait_replies") == 0 && a1) {
+            // wait_replies <n> [ms]: stampa le prossime n risposte ai comandi
+            uint32_t timeout = rest ? (uint32_t)atoi(rest) : o->timeout_ms;
+            bench_short_t r;
+            for (int i = 0; i < atoi(a1); i++) {
+                if (!bench_short_wait(timeout, &r)) {
+                    printf("[script] risposta %d non arrivata alla riga %u\n", i, lineno);
+                    rc = 2;
+                    break;
+                }
+                print_reply(&r);
+            }
+        } else if (strcmp(cmd, "probe") == 0 && a1 && rest) {
+            // probe <periodo ms> <durata ms>: statistiche (04 00) su FF11 e
+            // attesa della risposta; misura il giro write -> notifica
+            if (probe_replies(conn_id, (uint32_t)atoi(a1), (uint32_t)atoi(rest)) != 0) {
+                printf("[script] probe senza risposte alla riga %u\n", lineno);
+                rc = 2;
+            }
+        } else if (strcmp(cmd, "telemetry") == 0) {
+            print_telemetry(conn_id);
+        } else if (strcmp(cmd, "journal") == 0) {
+            // journal [posizione]: il diario da FF31, dal piu' vecchio
+            if (print_journal(conn_id, a1 ? (uint32_t)strtoul(a1, NULL, 0) : 0) <= 0) {
+                printf("[script] diario vuoto alla riga %u\n", lineno);
+                rc = 2;
+            }
+        } else if (strcmp(cmd, "radio") == 0) {
+            print_link(conn_id);
+        } else if (strcmp(cmd, "sleep") == 0 && a1) {
+            sim_sleep_us((int64_t)atoi(a1) * 1000);
+        } else {
+            fprintf(stderr, "%s:%u: comando non valido '%s'\n", o->script, lineno, cmd);
+            rc = 1;
+        }
+    }
+    fclose(f);
+    if (lat.count) {
+        bench_stats_print(&lat, "script latency");
+    }
+    bench_stats_free(&lat);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = {
+        .iterations = 20,
+        .aps = 12,
+        .dwell_ms = 120,
+        .conn_interval_ms = 30,
+        .mtu = 23,
+        .timeout_ms = 10000,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "n:a:g:d:i:m:p:t:s:vh")) != -1) {
+        switch (opt) {
+            case 'n': o.iterations = (unsigned)atoi(optarg); break;
+            case 'a': o.aps = (unsigned)atoi(optarg); break;
+            case 'g': o.ssid_groups = (unsigned)atoi(optarg); break;
+            case 'd': o.dwell_ms = (unsigned)atoi(optarg); break;
+            case 'i': o.conn_interval_ms = (unsigned)atoi(optarg); break;
+            case 'm': o.mtu = (unsigned)atoi(optarg); break;
+            case 'p': o.pause_ms = (unsigned)atoi(optarg); break;
+            case 't': o.timeout_ms = (unsigned)atoi(optarg); break;
+            case 's': o.script = optarg; break;
+            case 'v': o.verbose = true; break;
+            default:  usage(argv[0]); return 1;
+        }
+    }
+
+    esp_log_level_set("*", o.verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    sim_wifi_timing_t timing;
+    sim_wifi_get_timing(&timing);
+    timing.active_dwell_ms = o.dwell_ms;
+    sim_wifi_set_timing(&timing);
+
+    if (o.script) {
+        return run_script(&o);
+    }
+    sim_wifi_generate_aps(o.aps, o.ssid_groups, 1);
+    return run_benchmark(&o);
+}
@@ -0,0 +1,147 @@
+// host/bench/queue_bench.c
+// Passaggio dei messaggi fra task: code per valore (come prima) contro pool
+// di messaggi con code di puntatori (msg_pool). Per ciascun tipo misura
+// byte copiati dalle code, tempo per evento e RAM di code, pool e buffer.
+#include "sim.h"
+#include "msg_pool.h"
+#include "common_variables.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Stesse dimensioni del firmware (common_variables.c)
+#define BLE_WIFI_POOL_LEN   7
+#define BLE_WIFI_Q_DEPTH    10
+#define WIFI_BLE_POOL_LEN   3
+#define WIFI_BLE_Q_DEPTH    2
+
+MSG_POOL_DEFINE(bench_ble_wifi_pool, ble_wifi_evt_t, BLE_WIFI_POOL_LEN);
+MSG_POOL_DEFINE(bench_wifi_ble_pool, wifi_ble_evt_t, WIFI_BLE_POOL_LEN);
+
+typedef struct {
+    const char *label;
+    size_t item_size;       // dimensione del messaggio
+    bool pooled;
+    msg_pool_t *pool;
+    long events;
+    size_t records;         // record scritti/letti per evento (liste reti)
+    volatile uint32_t sum;  // il consumatore legge davvero il contenuto
+} run_t;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Scrive il contenuto come farebbe il firmware: una lista di reti o le
+// credenziali di un evento BLE -> Wi-Fi
+static void fill(run_t *r, void *msg, long i) {
+    if (r->records) {
+        wifi_ble_evt_t *e = msg;
+        e->type = WIFI_BLE_EVT_SCAN_DONE;
+        e->ap_count = (uint8_t)r->records;
+        for (size_t k = 0; k < r->records; k++) {
+            memcpy(e->ap_list[k].ssid, "rete-xx", 8);
+            e->ap_list[k].ssid[5] = (char)('a' + k);
+            e->ap_list[k].rssi = (int8_t)(-40 - (int)k);
+            e->ap_list[k].channel = (uint8_t)(1 + k % 13);
+        }
+    } else {
+        ble_wifi_evt_t *e = msg;
+        e->type = BLE_WIFI_EVT_NET_ADD;
+        e->priority = (uint8_t)i;
+        memcpy(e->ssid, "Ufficio", 8);
+        memcpy(e->password, "ufficio2024", 12);
+    }
+}
+
+static uint32_t consume(run_t *r, const void *msg) {
+    if (r->records) {
+        const wifi_ble_evt_t *e = msg;
+        uint32_t s = 0;
+        for (size_t k = 0; k < e->ap_count; k++) {
+            s += (uint8_t)e->ap_list[k].rssi + e->ap_list[k].ssid[5];
+        }
+        return s;
+    }
+    const ble_wifi_evt_t *e = msg;
+    return e->priority + (uint8_t)e->ssid[0];
+}
+
+// Produttore e consumatore nello stesso thread: resta solo il costo del
+// passaggio (riempimento, coda, lettura), senza il rumore dello scheduler
+static void run(run_t *r) {
+    size_t slot = r->pooled ? sizeof(void *) : r->item_size;
+    unsigned depth = r->records ? WIFI_BLE_Q_DEPTH : BLE_WIFI_Q_DEPTH;
+    QueueHandle_t q = xQueueCreate(depth, slot);
+    // Per valore: la struct del produttore e la copia locale del consumatore
+    void *staging = malloc(r->item_size);
+    void *local = malloc(r->item_size);
+
+    uint64_t copy0 = sim_stats_copy_bytes();
+    int64_t t0 = now_ns();
+    for (long i = 0; i < r->events; i++) {
+        if (r->pooled) {
+            void *msg = msg_pool_alloc(r->pool);
+            fill(r, msg, i);
+            xQueueSend(q, &msg, portMAX_DELAY);
+            const void *got;
+            xQueueReceive(q, &got, portMAX_DELAY);
+            r->sum += consume(r, got);
+            msg_pool_release(r->pool, got);
+        } else {
+            memset(staging, 0, r->item_size);
+            fill(r, staging, i);
+            xQueueSend(q, staging, portMAX_DELAY);
+            xQueueReceive(q, local, portMAX_DELAY);
+            r->sum += consume(r, local);
+        }
+    }
+    int64_t dt = now_ns() - t0;
+    uint64_t copied = sim_stats_copy_bytes() - copy0;
+
+    size_t ram = depth * slot + (r->pooled ? r->pool->count * r->pool->item_size
+                                           : 2 * r->item_size);
+    printf("%-24s %7.1f B copiati/evento  %6.0f ns/evento  %5zu B di RAM\n",
+           r->label, (double)copied / (double)r->events, (double)dt / (double)r->events, ram);
+    vQueueDelete(q);
+    free(staging);
+    free(local);
+}
+
+int main(int argc, char **argv) {
+    long events = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            events = atol(optarg);
+        } else {
+            fprintf(stderr, "uso: %s [-n eventi]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("ble_wifi_evt_t %zu B, wifi_ble_evt_t %zu B, %ld eventi per prova\n\n",
+           sizeof(ble_wifi_evt_t), sizeof(wifi_ble_evt_t), events);
+
+    run_t runs[] = {
+        { .label = "ble_to_wifi per valore", .item_size = sizeof(ble_wifi_evt_t) },
+        { .label = "ble_to_wifi pool",       .item_size = sizeof(ble_wifi_evt_t),
+          .pooled = true, .pool = &bench_ble_wifi_pool },
+        { .label = "wifi_to_ble per valore", .item_size = sizeof(wifi_ble_evt_t),
+          .records = 12 },
+        { .label = "wifi_to_ble pool",       .item_size = sizeof(wifi_ble_evt_t),
+          .records = 12, .pooled = true, .pool = &bench_wifi_ble_pool },
+    };
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        runs[i].events = events;
+        run(&runs[i]);
+    }
+    return 0;
+}
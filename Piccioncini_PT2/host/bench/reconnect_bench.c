@@ -0,0 +1,338 @@
+// host/bench/reconnect_bench.c
+// Banco di prova del collegamento Wi-Fi: tempo dal boot all'IP con un AP
+// salvato in NVS, tempo di riconnessione dopo la perdita del link, numero
+// di tentativi durante un'interruzione dell'AP e boot in un altro sito
+// (rete salvata diversa dall'ultima usata).
+//
+// Ogni "riavvio" e' un processo figlio nuovo (fork prima di avviare
+// qualsiasi thread) che condivide con i precedenti solo il file NVS.
+#include "bench_common.h"
+#include "sim.h"
+#include "esp_log.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define WIFI_CONFIG_UUID    0xFF21
+#define WIFI_NETWORKS_UUID  0xFF22
+
+#define TARGET_SSID       "Casa"
+#define TARGET_PASSWORD   "pw123456"
+#define OTHER_SSID        "Ufficio"
+#define OTHER_PASSWORD    "ufficio2024"
+#define OTHER_CHANNEL     4
+
+// Sito in cui si trova il dispositivo: a casa l'ufficio non si vede e viceversa
+typedef enum {
+    SITE_HOME,
+    SITE_OFFICE,
+} site_t;
+
+static site_t s_site = SITE_HOME;
+
+typedef struct {
+    unsigned reboots;
+    unsigned drops;
+    unsigned aps;
+    unsigned channel;
+    unsigned outage_ms;
+    unsigned timeout_ms;
+    const char *nvs_file;
+    bool verbose;
+} bench_opts_t;
+
+// Risultato di un processo figlio, letto dal padre sulla pipe
+typedef struct {
+    int ok;
+    int64_t boot_to_ip_us;
+    int64_t samples_us[64];
+    unsigned samples;
+    uint32_t outage_connects;
+    int64_t recover_us;
+} child_result_t;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "uso: %s [opzioni]\n"
+            "  -r N    riavvii con AP salvato (default 10)\n"
+            "  -n N    perdite del link simulate (default 10, max 64)\n"
+            "  -a N    altri AP simulati (default 12)\n"
+            "  -c CH   canale dell'AP di casa (default 11)\n"
+            "  -o MS   durata dell'interruzione dell'AP (default 20000)\n"
+            "  -t MS   timeout per ottenere l'IP (default 10000)\n"
+            "  -f FILE file NVS (default temporaneo)\n"
+            "  -v      log del firmware a livello INFO\n", argv0);
+}
+
+static void setup_world(const bench_opts_t *o) {
+    esp_log_level_set("*", o->verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    sim_nvs_set_file(o->nvs_file);
+    sim_wifi_generate_aps(o->aps, 0, 1);
+    sim_ap_t home = { .enabled = true, .rssi = -52, .authmode = WIFI_AUTH_WPA2_PSK,
+                      .bssid = { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 } };
+    snprintf(home.ssid, sizeof(home.ssid), "%s", TARGET_SSID);
+    snprintf(home.password, sizeof(home.password), "%s", TARGET_PASSWORD);
+    home.channel = (uint8_t)o->channel;
+    home.enabled = s_site == SITE_HOME;
+    sim_wifi_add_ap(&home);
+
+    sim_ap_t office = { .rssi = -58, .authmode = WIFI_AUTH_WPA2_PSK, .channel = OTHER_CHANNEL,
+                        .bssid = { 0x24, 0x0A, 0xC4, 0x44, 0x55, 0x66 } };
+    snprintf(office.ssid, sizeof(office.ssid), "%s", OTHER_SSID);
+    snprintf(office.password, sizeof(office.password), "%s", OTHER_PASSWORD);
+    office.enabled = s_site == SITE_OFFICE;
+    sim_wifi_add_ap(&office);
+}
+
+// Attende il GOT_IP numero 'count'; ritorna l'istante o -1 allo scadere
+static int64_t wait_got_ip(uint32_t count, uint32_t timeout_ms) {
+    int64_t deadline = sim_now_us() + (int64_t)timeout_ms * 1000;
+    sim_wifi_stats_t st;
+    do {
+        sim_wifi_get_stats(&st);
+        if (st.got_ip >= count) {
+            return st.last_got_ip_us;
+        }
+        sim_sleep_us(2000);
+    } while (sim_now_us() < deadline);
+    return -1;
+}
+
+// Primo avvio: NVS vuota, le credenziali arrivano dal telefono
+static void child_provision(const bench_opts_t *o, child_result_t *r) {
+    setup_world(o);
+    if (bench_boot_firmware(5000) < 0) {
+        return;
+    }
+    uint16_t conn_id = sim_ble_connect();
+    sim_ble_exchange_mtu(conn_id, 185);
+    uint16_t cfg = sim_ble_find_char(WIFI_CONFIG_UUID);
+    static const char creds[] = "%%" TARGET_SSID "%%" TARGET_PASSWORD "%%";
+    int64_t t0 = sim_now_us();
+    if (cfg == 0 || sim_ble_write(conn_id, cfg, creds, sizeof(creds) - 1) != ESP_GATT_OK) {
+        return;
+    }
+    int64_t t_ip = wait_got_ip(1, o->timeout_ms);
+    if (t_ip < 0) {
+        return;
+    }
+    r->boot_to_ip_us = t_ip - t0;
+    // il salvataggio in NVS segue il GOT_IP nel loop eventi
+    sim_sleep_us(200 * 1000);
+    r->ok = 1;
+}
+
+// Riavvio: l'AP salvato deve bastare, senza telefono
+static void child_reboot(const bench_opts_t *o, child_result_t *r) {
+    setup_world(o);
+    int64_t t0 = sim_now_us();
+    if (bench_boot_firmware(5000) < 0) {
+        return;
+    }
+    int64_t t_ip = wait_got_ip(1, o->timeout_ms);
+    if (t_ip < 0) {
+        return;
+    }
+    r->boot_to_ip_us = t_ip - t0;
+    r->ok = 1;
+}
+
+// A casa si aggiunge anche la rete dell'ufficio (operazione su FF22)
+static void child_add_office(const bench_opts_t *o, child_result_t *r) {
+    setup_world(o);
+    if (bench_boot_firmware(5000) < 0) {
+        return;
+    }
+    uint16_t conn_id = sim_ble_connect();
+    sim_ble_exchange_mtu(conn_id, 185);
+    uint16_t nets = sim_ble_find_char(WIFI_NETWORKS_UUID);
+    uint8_t op[64];
+    size_t n = 0;
+    op[n++] = 0x01;                         // aggiungi
+    op[n++] = 1;                            // priorita'
+    op[n++] = (uint8_t)strlen(OTHER_SSID);
+    memcpy(&op[n], OTHER_SSID, strlen(OTHER_SSID));
+    n += strlen(OTHER_SSID);
+    op[n++] = (uint8_t)strlen(OTHER_PASSWORD);
+    memcpy(&op[n], OTHER_PASSWORD, strlen(OTHER_PASSWORD));
+    n += strlen(OTHER_PASSWORD);
+    if (nets == 0 || sim_ble_write(conn_id, nets, op, (uint16_t)n) != ESP_GATT_OK) {
+        return;
+    }
+    sim_sleep_us(200 * 1000);
+    r->ok = 1;
+}
+
+// Perdite del link e interruzione dell'AP
+static void child_link_loss(const bench_opts_t *o, child_result_t *r) {
+    setup_world(o);
+    if (bench_boot_firmware(5000) < 0 || wait_got_ip(1, o->timeout_ms) < 0) {
+        return;
+    }
+    uint32_t ips = 1;
+    for (unsigned i = 0; i < o->drops && i < 64; i++) {
+        sim_sleep_us(300 * 1000);
+        int64_t t0 = sim_now_us();
+        sim_wifi_drop_link(WIFI_REASON_BEACON_TIMEOUT);
+        int64_t t_ip = wait_got_ip(++ips, o->timeout_ms);
+        if (t_ip < 0) {
+            return;
+        }
+        r->samples_us[r->samples++] = t_ip - t0;
+    }
+
+    sim_wifi_stats_t before, after;
+    sim_wifi_get_stats(&before);
+    sim_wifi_set_ap_enabled(TARGET_SSID, false);
+    sim_sleep_us((int64_t)o->outage_ms * 1000);
+    sim_wifi_get_stats(&after);
+    r->outage_connects = after.connects - before.connects;
+
+    int64_t t0 = sim_now_us();
+    sim_wifi_set_ap_enabled(TARGET_SSID, true);
+    int64_t t_ip = wait_got_ip(++ips, o->outage_ms + o->timeout_ms + 60000);
+    if (t_ip < 0) {
+        return;
+    }
+    r->recover_us = t_ip - t0;
+    r->ok = 1;
+}
+
+static bool run_child(const bench_opts_t *o, void (*fn)(const bench_opts_t *, child_result_t *),
+                      child_result_t *r) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        child_result_t res;
+        memset(&res, 0, sizeof(res));
+        fn(o, &res);
+        ssize_t n = write(fds[1], &res, sizeof(res));
+        _exit(n == (ssize_t)sizeof(res) ? 0 : 1);
+    }
+    close(fds[1]);
+    memset(r, 0, sizeof(*r));
+    ssize_t n = read(fds[0], r, sizeof(*r));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return n == (ssize_t)sizeof(*r) && r->ok;
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = {
+        .reboots = 10,
+        .drops = 10,
+        .aps = 12,
+        .channel = 11,
+        .outage_ms = 20000,
+        .timeout_ms = 10000,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:a:c:o:t:f:vh")) != -1) {
+        switch (opt) {
+            case 'r': o.reboots = (unsigned)atoi(optarg); break;
+            case 'n': o.drops = (unsigned)atoi(optarg); break;
+            case 'a': o.aps = (unsigned)atoi(optarg); break;
+            case 'c': o.channel = (unsigned)atoi(optarg); break;
+            case 'o': o.outage_ms = (unsigned)atoi(optarg); break;
+            case 't': o.timeout_ms = (unsigned)atoi(optarg); break;
+            case 'f': o.nvs_file = optarg; break;
+            case 'v': o.verbose = true; break;
+            default:  usage(argv[0]); return 1;
+        }
+    }
+    if (o.channel < 1 || o.channel > 13) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char tmp_path[] = "/tmp/reconnect_bench_nvsXXXXXX";
+    if (o.nvs_file == NULL) {
+        int fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+        o.nvs_file = tmp_path;
+    }
+    // Il primo avvio parte sempre da NVS vuota
+    FILE *f = fopen(o.nvs_file, "wb");
+    if (f) {
+        fclose(f);
+    }
+
+    int rc = 0;
+    child_result_t r;
+    printf("\n== collegamento Wi-Fi: boot -> IP, perdita del link, interruzione AP ==\n");
+    printf("AP casa su ch %u, altri AP=%u, interruzione=%u ms\n", o.channel, o.aps, o.outage_ms);
+
+    if (!run_child(&o, child_provision, &r)) {
+        fprintf(stderr, "provisioning fallito\n");
+        rc = 2;
+        goto out;
+    }
+    printf("provisioning: credenziali -> IP %8.2f ms\n", r.boot_to_ip_us / 1000.0);
+
+    bench_stats_t boot;
+    bench_stats_init(&boot, o.reboots);
+    unsigned failures = 0;
+    for (unsigned i = 0; i < o.reboots; i++) {
+        if (run_child(&o, child_reboot, &r)) {
+            bench_stats_add(&boot, r.boot_to_ip_us);
+        } else {
+            failures++;
+        }
+    }
+    bench_stats_print(&boot, "riavvio: boot -> IP");
+    bench_stats_free(&boot);
+
+    if (run_child(&o, child_link_loss, &r)) {
+        bench_stats_t loss;
+        bench_stats_init(&loss, r.samples);
+        for (unsigned i = 0; i < r.samples; i++) {
+            bench_stats_add(&loss, r.samples_us[i]);
+        }
+        bench_stats_print(&loss, "link perso -> IP");
+        bench_stats_free(&loss);
+        printf("tentativi durante l'interruzione  %u in %.1f s\n",
+               r.outage_connects, o.outage_ms / 1000.0);
+        printf("AP di nuovo su -> IP      %8.2f ms\n", r.recover_us / 1000.0);
+    } else {
+        failures++;
+    }
+    // Trasloco: il dispositivo si riaccende in ufficio
+    if (run_child(&o, child_add_office, &r)) {
+        s_site = SITE_OFFICE;
+        if (run_child(&o, child_reboot, &r)) {
+            printf("altro sito: boot -> IP    %8.2f ms\n", r.boot_to_ip_us / 1000.0);
+        } else {
+            failures++;
+        }
+        s_site = SITE_HOME;
+    } else {
+        failures++;
+    }
+    printf("fallimenti                %u\n", failures);
+    rc = failures ? 2 : 0;
+
+out:
+    if (o.nvs_file == tmp_path) {
+        unlink(tmp_path);
+    }
+    return rc;
+}
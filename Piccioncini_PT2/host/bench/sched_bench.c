@@ -0,0 +1,415 @@
+// host/bench/sched_bench.c
+// Attesa dei consumatori delle code (post -> il task entra in esecuzione)
+// con le politiche di task_plan.h, sotto un carico sintetico degli stack
+// radio. Il simulatore a thread non serve qui: Linux ignora priorita' e
+// core di FreeRTOS e la macchina di prova puo' avere un solo core. Il banco
+// modella quindi lo scheduler SMP di ESP-IDF a eventi discreti:
+//   - due core; su ciascuno gira il task pronto di priorita' piu' alta fra
+//     quelli che possono starci (affinita'), con prelazione immediata
+//   - a pari priorita' non c'e' prelazione (round robin al tick ignorato)
+//   - un task senza affinita' prende il core libero che lascia spazio ai
+//     task fissati; a parita' quello dove ha girato l'ultima volta
+//   - un task senza affinita' interrotto da uno di priorita' piu' alta resta
+//     sul suo core fino al tick successivo: l'altro core lo vede solo quando
+//     ripassa dallo scheduler (non c'e' un'IPI per chi torna pronto)
+//   - cambi di contesto e IPI fra i core costano zero: conta solo la contesa
+// I task IDF e le loro priorita' sono quelli di ESP-IDF 5.x con lo sdkconfig
+// del progetto (task_plan.h); durate e quote del carico sono stime da
+// confrontare con la telemetria del dispositivo (TELEMETRY_LAT_WAKE_*).
+#include "task_plan.h"
+#include "bench_common.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANY_CORE            (-1)
+#define JOB_RING            1024        // potenza di 2
+#define NCORES              2
+#define TICK_US             (1000000 / configTICK_RATE_HZ)
+
+typedef enum {
+    T_BT_CTRL,      // controller BT: eventi di connessione
+    T_WIFI_DRV,     // task del driver Wi-Fi
+    T_ESP_TIMER,
+    T_SYS_EVT,      // loop eventi di default: posta gli stati a BLE_TASK
+    T_BTC,          // callback GATTS/GAP: posta i comandi a WIFI_TASK
+    T_TCPIP,
+    T_BLE,          // consumatore di wifi_to_ble_q
+    T_WIFI,         // consumatore di ble_to_wifi_q
+    T_DLOG,
+    T_COUNT
+} task_idx_t;
+
+typedef struct {
+    int64_t release;
+    int64_t cost;
+    bool measured;  // postato su coda vuota: la sua attesa e' un risveglio
+} job_t;
+
+typedef struct {
+    const char *name;
+    int prio;
+    int core;               // 0, 1 o ANY_CORE
+    // Arrivi propri (Poisson): tasso in eventi/s, durata media in us
+    double rate_hz;
+    double cost_us;
+    // A fine job posta un job a 'post_to' con probabilita' post_prob
+    int post_to;
+    double post_prob;
+    // stato
+    job_t jobs[JOB_RING];
+    unsigned head, count;
+    bool started;           // il job in testa ha gia' avuto la CPU
+    int last_core;
+    int parked_core;        // interrotto su questo core, fino al prossimo tick
+    int64_t next_arrival;
+    uint64_t rng;
+    uint64_t overflow;
+    bench_stats_t wake;     // solo per i consumatori
+} mtask_t;
+
+typedef struct {
+    double load;            // quota di un core occupata dagli stack IDF
+    double cmd_hz;          // comandi BLE -> WIFI_TASK al secondo
+    int64_t duration_us;
+    uint64_t seed;
+} model_cfg_t;
+
+// Carico IDF: priorita', core e quota del carico totale. Le quote si
+// sommano a 1: con -l 50 gli stack radio occupano mezzo core.
+typedef struct {
+    const char *name;
+    int prio;
+    int core;
+    double share;
+    double cost_us;
+} load_spec_t;
+
+static const load_spec_t load_specs[] = {
+    [T_BT_CTRL]   = { "bt_ctrl",   23, TASK_PLAN_BT_CORE,   0.15,  80 },
+    [T_WIFI_DRV]  = { "wifi",      23, TASK_PLAN_WIFI_CORE, 0.45, 250 },
+    [T_ESP_TIMER] = { "esp_timer", 22, 0,                   0.05,  30 },
+    [T_SYS_EVT]   = { "sys_evt",   20, 0,                   0.10,  60 },
+    [T_BTC]       = { "btc",       19, TASK_PLAN_BT_CORE,   0.15, 150 },
+    [T_TCPIP]     = { "tcpip",     18, ANY_CORE,            0.10, 200 },
+};
+
+// Lavoro dei consumatori per evento (us): una notifica frammentata, un
+// comando con eventuale scrittura NVS, una riga di log
+#define BLE_JOB_US          250
+#define WIFI_JOB_US         400
+#define DLOG_JOB_US         150
+// Parte degli eventi di WIFI_TASK che produce una lista o uno stato per BLE_TASK
+#define WIFI_TO_BLE_PROB    0.5
+
+static uint64_t rng_next(uint64_t *s) {
+    // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+static double rng_unit(uint64_t *s) {
+    return ((double)(rng_next(s) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Durata esponenziale, tagliata a 10 volte la media
+static int64_t rng_exp(uint64_t *s, double mean) {
+    double v = -mean * log(rng_unit(s));
+    if (v > 10 * mean) {
+        v = 10 * mean;
+    }
+    return v < 1 ? 1 : (int64_t)v;
+}
+
+static int core_of(BaseType_t core) {
+    return core == tskNO_AFFINITY ? ANY_CORE : (int)core;
+}
+
+static void post_job(mtask_t *t, int64_t now, int64_t cost) {
+    if (t->count == JOB_RING) {
+        t->overflow++;
+        return;
+    }
+    job_t *j = &t->jobs[(t->head + t->count) & (JOB_RING - 1)];
+    j->release = now;
+    j->cost = cost;
+    j->measured = t->count == 0;
+    t->count++;
+}
+
+static void schedule_arrival(mtask_t *t, int64_t now) {
+    t->next_arrival = t->rate_hz > 0 ? now + rng_exp(&t->rng, 1e6 / t->rate_hz) : INT64_MAX;
+}
+
+static void setup(mtask_t *tasks, const model_cfg_t *cfg, task_place_policy_t policy) {
+    memset(tasks, 0, sizeof(mtask_t) * T_COUNT);
+    for (int i = 0; i < T_COUNT; i++) {
+        tasks[i].post_to = -1;
+        tasks[i].last_core = i % NCORES;
+        tasks[i].parked_core = ANY_CORE;
+        tasks[i].rng = cfg->seed * 0x9E3779B97F4A7C15ULL + (uint64_t)i * 0xD1B54A32D192ED03ULL + 1;
+    }
+    for (int i = 0; i < T_BLE; i++) {
+        const load_spec_t *s = &load_specs[i];
+        tasks[i].name = s->name;
+        tasks[i].prio = s->prio;
+        tasks[i].core = s->core;
+        tasks[i].cost_us = s->cost_us;
+        tasks[i].rate_hz = cfg->load * s->share * 1e6 / s->cost_us;
+    }
+    const struct { int idx; task_plan_id_t id; double cost; } apps[] = {
+        { T_BLE,  TASK_PLAN_BLE,  BLE_JOB_US },
+        { T_WIFI, TASK_PLAN_WIFI, WIFI_JOB_US },
+        { T_DLOG, TASK_PLAN_DLOG, DLOG_JOB_US },
+    };
+    for (size_t i = 0; i < sizeof(apps) / sizeof(apps[0]); i++) {
+        task_place_t p = task_plan_get(apps[i].id, policy);
+        mtask_t *t = &tasks[apps[i].idx];
+        t->name = p.name;
+        t->prio = (int)p.priority;
+        t->core = core_of(p.core);
+        t->cost_us = apps[i].cost;
+    }
+    // I comandi arrivano dalle callback GATTS, gli stati dal loop eventi:
+    // il lavoro di chi posta e' gia' nel carico IDF, qui conta solo l'istante
+    tasks[T_WIFI].rate_hz = cfg->cmd_hz;
+    tasks[T_WIFI].post_to = T_BLE;
+    tasks[T_WIFI].post_prob = WIFI_TO_BLE_PROB;
+    tasks[T_BLE].rate_hz = cfg->cmd_hz / 2;
+    tasks[T_BLE].post_to = T_DLOG;
+    tasks[T_BLE].post_prob = 1.0;
+    size_t cap = (size_t)(cfg->cmd_hz * 2 * (double)cfg->duration_us / 1e6) + 1024;
+    bench_stats_init(&tasks[T_BLE].wake, cap);
+    bench_stats_init(&tasks[T_WIFI].wake, cap);
+    for (int i = 0; i < T_COUNT; i++) {
+        schedule_arrival(&tasks[i], 0);
+    }
+}
+
+// Assegna i core: i task pronti in ordine di priorita' (a pari priorita'
+// resta chi sta gia' girando, poi il job piu' vecchio)
+static void dispatch(mtask_t *tasks, int running[NCORES]) {
+    int order[T_COUNT];
+    int n = 0;
+    for (int i = 0; i < T_COUNT; i++) {
+        if (tasks[i].count > 0) {
+            order[n++] = i;
+        }
+    }
+    for (int a = 1; a < n; a++) {
+        for (int b = a; b > 0; b--) {
+            const mtask_t *x = &tasks[order[b - 1]], *y = &tasks[order[b]];
+            bool x_runs = running[0] == order[b - 1] || running[1] == order[b - 1];
+            bool y_runs = running[0] == order[b] || running[1] == order[b];
+            bool swap = y->prio > x->prio ||
+                        (y->prio == x->prio && y_runs && !x_runs) ||
+                        (y->prio == x->prio && y_runs == x_runs &&
+                         y->jobs[y->head].release < x->jobs[x->head].release);
+            if (!swap) {
+                break;
+            }
+            int tmp = order[b - 1];
+            order[b - 1] = order[b];
+            order[b] = tmp;
+        }
+    }
+    int next[NCORES] = { -1, -1 };
+    for (int k = 0; k < n; k++) {
+        const mtask_t *t = &tasks[order[k]];
+        int pin = t->core != ANY_CORE ? t->core : t->parked_core;
+        int core = -1;
+        if (pin != ANY_CORE) {
+            core = next[pin] < 0 ? pin : -1;
+        } else if (next[0] < 0 && next[1] < 0) {
+            // Il core conteso dal prossimo task fissato resta a lui
+            int want = -1;
+            for (int m = k + 1; m < n && want < 0; m++) {
+                const mtask_t *o = &tasks[order[m]];
+                want = o->core != ANY_CORE ? o->core : o->parked_core;
+            }
+            core = want >= 0 ? 1 - want : t->last_core;
+        } else {
+            core = next[0] < 0 ? 0 : (next[1] < 0 ? 1 : -1);
+        }
+        if (core >= 0) {
+            next[core] = order[k];
+        }
+    }
+    running[0] = next[0];
+    running[1] = next[1];
+}
+
+typedef struct {
+    double busy[NCORES];    // quota di ciascun core occupata
+    uint64_t overflow;
+} model_result_t;
+
+static void run_model(mtask_t *tasks, const model_cfg_t *cfg, model_result_t *res) {
+    int running[NCORES] = { -1, -1 };
+    int64_t busy[NCORES] = { 0, 0 };
+    int64_t now = 0;
+    while (now < cfg->duration_us) {
+        if (now % TICK_US == 0) {
+            for (int i = 0; i < T_COUNT; i++) {
+                tasks[i].parked_core = ANY_CORE;
+            }
+        }
+        int prev[NCORES] = { running[0], running[1] };
+        dispatch(tasks, running);
+        for (int c = 0; c < NCORES; c++) {
+            // Interrotto a meta' job: resta in coda su questo core
+            mtask_t *p = prev[c] >= 0 ? &tasks[prev[c]] : NULL;
+            if (p && p->core == ANY_CORE && p->count > 0 && running[0] != prev[c] && running[1] != prev[c]) {
+                p->parked_core = c;
+            }
+        }
+        for (int c = 0; c < NCORES; c++) {
+            mtask_t *t = running[c] >= 0 ? &tasks[running[c]] : NULL;
+            if (t && !t->started) {
+                t->started = true;
+                job_t *j = &t->jobs[t->head];
+                if (j->measured && t->wake.samples) {
+                    bench_stats_add(&t->wake, now - j->release);
+                }
+            }
+            if (t) {
+                t->last_core = c;
+            }
+        }
+        // Prossimo evento: un arrivo, la fine di un job in esecuzione o il tick
+        int64_t next = (now / TICK_US + 1) * TICK_US;
+        if (next > cfg->duration_us) {
+            next = cfg->duration_us;
+        }
+        for (int i = 0; i < T_COUNT; i++) {
+            if (tasks[i].next_arrival < next) {
+                next = tasks[i].next_arrival;
+            }
+        }
+        for (int c = 0; c < NCORES; c++) {
+            if (running[c] >= 0) {
+                const mtask_t *t = &tasks[running[c]];
+                int64_t end = now + t->jobs[t->head].cost;
+                if (end < next) {
+                    next = end;
+                }
+            }
+        }
+        int64_t dt = next - now;
+        for (int c = 0; c < NCORES; c++) {
+            if (running[c] < 0) {
+                continue;
+            }
+            busy[c] += dt;
+            mtask_t *t = &tasks[running[c]];
+            t->jobs[t->head].cost -= dt;
+            if (t->jobs[t->head].cost > 0) {
+                continue;
+            }
+            t->head = (t->head + 1) & (JOB_RING - 1);
+            t->count--;
+            t->started = false;
+            if (t->post_to >= 0 && rng_unit(&t->rng) < t->post_prob) {
+                mtask_t *to = &tasks[t->post_to];
+                post_job(to, next, rng_exp(&to->rng, to->cost_us));
+            }
+        }
+        now = next;
+        for (int i = 0; i < T_COUNT; i++) {
+            mtask_t *t = &tasks[i];
+            if (t->next_arrival <= now) {
+                post_job(t, now, rng_exp(&t->rng, t->cost_us));
+                schedule_arrival(t, now);
+            }
+        }
+    }
+    res->overflow = 0;
+    for (int c = 0; c < NCORES; c++) {
+        res->busy[c] = (double)busy[c] / (double)cfg->duration_us;
+    }
+    for (int i = 0; i < T_COUNT; i++) {
+        res->overflow += tasks[i].overflow;
+    }
+}
+
+static void print_core(int core) {
+    if (core == ANY_CORE) {
+        printf("  -");
+    } else {
+        printf("  %d", core);
+    }
+}
+
+static void print_row(double load, task_place_policy_t policy, mtask_t *t, const model_result_t *res) {
+    printf("%4.0f%%  %-10s %-10s p%-2d", load * 100, task_plan_policy_name(policy), t->name, t->prio);
+    print_core(t->core);
+    printf(" %7zu %8.0f %8lld %8lld %8lld   %3.0f%% %3.0f%%\n", t->wake.count, bench_stats_mean(&t->wake),
+           (long long)bench_stats_percentile(&t->wake, 50), (long long)bench_stats_percentile(&t->wake, 99),
+           (long long)bench_stats_percentile(&t->wake, 100), res->busy[0] * 100, res->busy[1] * 100);
+}
+
+static int parse_loads(const char *arg, double *loads, int max) {
+    int n = 0;
+    char *copy = strdup(arg);
+    for (char *tok = strtok(copy, ","); tok && n < max; tok = strtok(NULL, ",")) {
+        double v = atof(tok);
+        if (v < 0 || v > 100) {
+            free(copy);
+            return -1;
+        }
+        loads[n++] = v / 100.0;
+    }
+    free(copy);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    model_cfg_t cfg = { .cmd_hz = 50, .duration_us = 20 * 1000000LL, .seed = 1 };
+    double loads[8] = { 0.2, 0.5, 0.8 };
+    int nloads = 3;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:l:r:S:")) != -1) {
+        switch (opt) {
+            case 'd': cfg.duration_us = (int64_t)(atof(optarg) * 1e6); break;
+            case 'l': nloads = parse_loads(optarg, loads, 8); break;
+            case 'r': cfg.cmd_hz = atof(optarg); break;
+            case 'S': cfg.seed = strtoull(optarg, NULL, 0); break;
+            default: nloads = -1; break;
+        }
+        if (nloads <= 0 || cfg.duration_us <= 0 || cfg.cmd_hz < 0) {
+            fprintf(stderr, "uso: %s [-d secondi] [-l carico%%,...] [-r comandi/s] [-S seme]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("modello SMP a 2 core, %.0f s simulati per prova, %.0f comandi/s, seme %llu\n",
+           (double)cfg.duration_us / 1e6, cfg.cmd_hz, (unsigned long long)cfg.seed);
+    printf("politica di build: %s; attese in us (post su coda vuota -> task in esecuzione)\n\n",
+           task_plan_policy_name(APP_TASK_PLACEMENT));
+    printf("radio  politica   task       prio core  eventi    media      p50      p99      max   core0 core1\n");
+    static mtask_t tasks[T_COUNT];
+    int rc = 0;
+    for (int l = 0; l < nloads; l++) {
+        cfg.load = loads[l];
+        for (int p = 0; p < TASK_PLACE_COUNT; p++) {
+            model_result_t res;
+            setup(tasks, &cfg, (task_place_policy_t)p);
+            run_model(tasks, &cfg, &res);
+            print_row(cfg.load, (task_place_policy_t)p, &tasks[T_BLE], &res);
+            print_row(cfg.load, (task_place_policy_t)p, &tasks[T_WIFI], &res);
+            if (res.overflow) {
+                printf("       %llu job persi: core saturi\n", (unsigned long long)res.overflow);
+                rc = 1;
+            }
+            bench_stats_free(&tasks[T_BLE].wake);
+            bench_stats_free(&tasks[T_WIFI].wake);
+        }
+        printf("\n");
+    }
+    return rc;
+}
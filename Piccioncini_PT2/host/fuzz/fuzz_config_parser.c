@@ -0,0 +1,180 @@
+// host/fuzz/fuzz_config_parser.c
+/*
+ * Fuzz di config_parse. Con clang + libFuzzer:
+ *   clang -g -O1 -fsanitize=fuzzer,address,undefined -DCONFIG_PARSER_LIBFUZZER \
+ *         -Iinclude -Ihost/include \
+ *         src/config_parser.c host/fuzz/fuzz_config_parser.c -o fuzz_config_parser
+ * Con gcc (senza libFuzzer) si usa il driver interno, che muta i seed a caso:
+ *   gcc -g -O1 -fsanitize=address,undefined -Iinclude -Ihost/include \
+ *       src/config_parser.c host/fuzz/fuzz_config_parser.c -o fuzz_config_parser
+ *   ./fuzz_config_parser [iterazioni] [seed]
+ */
+#include "config_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond) do { if (!(cond)) { \
+    fprintf(stderr, "invariante violata: %s (%s:%d)\n", #cond, __FILE__, __LINE__); abort(); } } while (0)
+
+// Riserializza evt in TLV: deve tornare esattamente gli stessi campi
+static void check_roundtrip(const ble_wifi_evt_t *evt) {
+    uint8_t buf[2 + 32 + 2 + 64];
+    size_t ssid_len = strlen(evt->ssid);
+    size_t pass_len = strlen(evt->password);
+    size_t n = 0;
+    buf[n++] = CONFIG_TLV_SSID;
+    buf[n++] = (uint8_t)ssid_len;
+    memcpy(&buf[n], evt->ssid, ssid_len);
+    n += ssid_len;
+    buf[n++] = CONFIG_TLV_PASSWORD;
+    buf[n++] = (uint8_t)pass_len;
+    memcpy(&buf[n], evt->password, pass_len);
+    n += pass_len;
+
+    ble_wifi_evt_t again;
+    CHECK(config_parse(buf, n, &again) == CONFIG_PARSE_OK);
+    CHECK(strcmp(again.ssid, evt->ssid) == 0);
+    CHECK(strcmp(again.password, evt->password) == 0);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // Copia esatta: ASan segnala qualsiasi lettura oltre 'size'
+    uint8_t *buf = malloc(size ? size : 1);
+    if (buf == NULL) {
+        return 0;
+    }
+    memcpy(buf, data, size);
+
+    ble_wifi_evt_t evt;
+    memset(&evt, 0xA5, sizeof(evt));
+    config_parse_status_t st = config_parse(buf, size, &evt);
+    CHECK(config_parse_status_name(st)[0] != '?');
+    if (st == CONFIG_PARSE_OK) {
+        CHECK(evt.type == BLE_WIFI_EVT_CONNECT);
+        CHECK(memchr(evt.ssid, '\0', sizeof(evt.ssid)) != NULL);
+        CHECK(memchr(evt.password, '\0', sizeof(evt.password)) != NULL);
+        CHECK(evt.ssid[0] != '\0');
+        // Un SSID con NUL interni verrebbe troncato dalla riserializzazione
+        if (memchr(buf, '\0', size) == NULL) {
+            check_roundtrip(&evt);
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+#ifndef CONFIG_PARSER_LIBFUZZER
+// — driver standalone —
+
+static const char *const k_text_seeds[] = {
+    "%%Casa%%pw123456%%",
+    "%%Ospiti%%%%",
+    "%%%%nossid%%",
+    "%%Casa%%pw",
+    "%%Casa",
+    "%%",
+    "%%0123456789abcdef0123456789abcdef%%0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef%%",
+};
+
+static const uint8_t k_tlv_seed[] = {
+    CONFIG_TLV_SSID, 4, 'C', 'a', 's', 'a',
+    CONFIG_TLV_PASSWORD, 8, 'p', 'w', '1', '2', '3', '4', '5', '6',
+};
+
+static const uint8_t k_tlv_unknown[] = {
+    0x7f, 3, 1, 2, 3,
+    CONFIG_TLV_PASSWORD, 0,
+    CONFIG_TLV_SSID, 3, 'L', 'a', 'b',
+};
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static size_t mutate(uint8_t *buf, size_t len, size_t cap) {
+    int rounds = 1 + (int)(rnd() % 4);
+    for (int r = 0; r < rounds; r++) {
+        switch (rnd() % 6) {
+            case 0:     // bit flip
+                if (len) buf[rnd() % len] ^= (uint8_t)(1u << (rnd() % 8));
+                break;
+            case 1:     // byte casuale
+                if (len) buf[rnd() % len] = (uint8_t)rnd();
+                break;
+            case 2:     // troncamento
+                if (len) len = rnd() % len;
+                break;
+            case 3:     // inserimento
+                if (len < cap) {
+                    size_t at = len ? rnd() % (len + 1) : 0;
+                    memmove(&buf[at + 1], &buf[at], len - at);
+                    buf[at] = (uint8_t)rnd();
+                    len++;
+                }
+                break;
+            case 4:     // delimitatore o tipo TLV interessante
+                if (len) {
+                    static const uint8_t k_magic[] = { '%', 0x00, 0x01, 0x02, 0x20, 0x21, 0x40, 0xff };
+                    buf[rnd() % len] = k_magic[rnd() % sizeof(k_magic)];
+                }
+                break;
+            case 5:     // rimozione
+                if (len) {
+                    size_t at = rnd() % len;
+                    memmove(&buf[at], &buf[at + 1], len - at - 1);
+                    len--;
+                }
+                break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    s_rng = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x12345678u;
+    if (s_rng == 0) {
+        s_rng = 1;
+    }
+
+    struct { const uint8_t *data; size_t len; } seeds[16];
+    size_t n_seeds = 0;
+    for (size_t i = 0; i < sizeof(k_text_seeds) / sizeof(k_text_seeds[0]); i++) {
+        seeds[n_seeds].data = (const uint8_t *)k_text_seeds[i];
+        seeds[n_seeds++].len = strlen(k_text_seeds[i]);
+    }
+    seeds[n_seeds].data = k_tlv_seed;
+    seeds[n_seeds++].len = sizeof(k_tlv_seed);
+    seeds[n_seeds].data = k_tlv_unknown;
+    seeds[n_seeds++].len = sizeof(k_tlv_unknown);
+
+    // I seed stessi devono passare senza mutazioni
+    for (size_t i = 0; i < n_seeds; i++) {
+        LLVMFuzzerTestOneInput(seeds[i].data, seeds[i].len);
+    }
+
+    uint8_t buf[256];
+    long ok = 0;
+    for (long it = 0; it < iterations; it++) {
+        size_t s = rnd() % n_seeds;
+        size_t len = seeds[s].len;
+        memcpy(buf, seeds[s].data, len);
+        len = mutate(buf, len, sizeof(buf));
+        LLVMFuzzerTestOneInput(buf, len);
+
+        ble_wifi_evt_t evt;
+        if (config_parse(buf, len, &evt) == CONFIG_PARSE_OK) {
+            ok++;
+        }
+    }
+    printf("%ld input, %ld accettati, nessuna invariante violata\n", iterations, ok);
+    return 0;
+}
+#endif
@@ -0,0 +1,29 @@
+// host/include/esp_bt.h
+#ifndef SIM_ESP_BT_H
+#define SIM_ESP_BT_H
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_BT_MODE_IDLE       = 0x00,
+    ESP_BT_MODE_BLE        = 0x01,
+    ESP_BT_MODE_CLASSIC_BT = 0x02,
+    ESP_BT_MODE_BTDM       = 0x03,
+} esp_bt_mode_t;
+
+typedef struct {
+    uint16_t controller_task_stack_size;
+    uint8_t  controller_task_prio;
+    uint8_t  mode;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() {       \
+    .controller_task_stack_size = 3584,             \
+    .controller_task_prio = 23,                     \
+    .mode = ESP_BT_MODE_BLE,                        \
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg);
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
+
+#endif // SIM_ESP_BT_H
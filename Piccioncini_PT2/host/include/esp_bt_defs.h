@@ -0,0 +1,31 @@
+// host/include/esp_bt_defs.h
+#ifndef SIM_ESP_BT_DEFS_H
+#define SIM_ESP_BT_DEFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ESP_BD_ADDR_LEN     6
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+
+#define ESP_UUID_LEN_16     2
+#define ESP_UUID_LEN_32     4
+#define ESP_UUID_LEN_128    16
+
+typedef struct {
+    uint16_t len;
+    union {
+        uint16_t uuid16;
+        uint32_t uuid32;
+        uint8_t  uuid128[ESP_UUID_LEN_128];
+    } uuid;
+} __attribute__((packed)) esp_bt_uuid_t;
+
+typedef enum {
+    BLE_ADDR_TYPE_PUBLIC     = 0x00,
+    BLE_ADDR_TYPE_RANDOM     = 0x01,
+    BLE_ADDR_TYPE_RPA_PUBLIC = 0x02,
+    BLE_ADDR_TYPE_RPA_RANDOM = 0x03,
+} esp_ble_addr_type_t;
+
+#endif // SIM_ESP_BT_DEFS_H
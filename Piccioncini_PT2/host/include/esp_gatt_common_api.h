@@ -0,0 +1,11 @@
+// host/include/esp_gatt_common_api.h
+#ifndef SIM_ESP_GATT_COMMON_API_H
+#define SIM_ESP_GATT_COMMON_API_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_gatt_defs.h"
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#endif // SIM_ESP_GATT_COMMON_API_H
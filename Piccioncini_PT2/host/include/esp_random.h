@@ -0,0 +1,9 @@
+// host/include/esp_random.h
+#ifndef SIM_ESP_RANDOM_H
+#define SIM_ESP_RANDOM_H
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif // SIM_ESP_RANDOM_H
@@ -0,0 +1,32 @@
+// host/include/esp_system.h
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// Heap modellato: capienza fissa meno la memoria contata da sim_mem_*
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+// Nel simulatore il chip "si spegne": il task chiamante resta fermo e il
+// banco lo vede con sim_restart_wait (host/sim/ota_sim.c)
+void esp_restart(void) __attribute__((noreturn));
+// ESP_RST_POWERON salvo sim_set_reset_reason
+esp_reset_reason_t esp_reset_reason(void);
+
+#endif // SIM_ESP_SYSTEM_H
@@ -0,0 +1,46 @@
+// host/include/freertos/FreeRTOS.h
+// Sostituto host del kernel FreeRTOS: tipi e macro usati dal firmware,
+// implementati sopra pthread in host/sim/freertos_sim.c
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+// Come su ESP-IDF: stack in byte
+typedef uint8_t  StackType_t;
+
+#define pdFALSE         ((BaseType_t)0)
+#define pdTRUE          ((BaseType_t)1)
+#define pdPASS          pdTRUE
+#define pdFAIL          pdFALSE
+#define errQUEUE_FULL   ((BaseType_t)0)
+#define errQUEUE_EMPTY  ((BaseType_t)0)
+
+// Stessa frequenza di tick di sdkconfig.firebeetle32 (CONFIG_FREERTOS_HZ=100)
+#define configTICK_RATE_HZ          100
+#define configMINIMAL_STACK_SIZE    768
+#define configMAX_PRIORITIES        25
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS          ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portNUM_PROCESSORS          2
+#define tskNO_AFFINITY              ((BaseType_t)0x7FFFFFFF)
+
+#define pdMS_TO_TICKS(xTimeInMs) \
+    ((TickType_t)(((uint64_t)(xTimeInMs) * (uint64_t)configTICK_RATE_HZ) / 1000U))
+
+#define configASSERT(x) assert(x)
+
+// Memoria per gli oggetti statici (xTaskCreateStatic & co.): grandi come
+// su ESP32 con IDF 5.x, cosi' la RAM statica del firmware torna con il
+// dispositivo. Il simulatore non ci scrive dentro.
+typedef struct { uint8_t opaque[352]; } StaticTask_t;
+typedef struct { uint8_t opaque[84]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#endif // SIM_FREERTOS_H
@@ -0,0 +1,33 @@
+// host/include/freertos/queue.h
+#ifndef SIM_FREERTOS_QUEUE_H
+#define SIM_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef struct sim_queue *QueueHandle_t;
+
+#define queueSEND_TO_BACK   ((BaseType_t)0)
+#define queueSEND_TO_FRONT  ((BaseType_t)1)
+#define queueOVERWRITE      ((BaseType_t)2)
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+// Gli elementi stanno nel buffer del chiamante
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize,
+                                 uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue);
+void vQueueDelete(QueueHandle_t xQueue);
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void *pvItemToQueue,
+                             TickType_t xTicksToWait, BaseType_t xCopyPosition);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+
+#define xQueueSend(q, item, ticks)          xQueueGenericSend((q), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToBack(q, item, ticks)    xQueueGenericSend((q), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToFront(q, item, ticks)   xQueueGenericSend((q), (item), (ticks), queueSEND_TO_FRONT)
+#define xQueueOverwrite(q, item)            xQueueGenericSend((q), (item), 0, queueOVERWRITE)
+
+#endif // SIM_FREERTOS_QUEUE_H
@@ -0,0 +1,40 @@
+// host/include/freertos/task.h
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName,
+                       uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask);
+// Stack e TCB del chiamante: non contano nell'heap simulato
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char *pcName,
+                               uint32_t ulStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                               StackType_t *puxStackBuffer, StaticTask_t *pxTaskBuffer);
+// Il core viene registrato ma non applicato, come la priorita'
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName,
+                                   uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                                   TaskHandle_t *pxCreatedTask, BaseType_t xCoreID);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t pxTaskCode, const char *pcName,
+                                           uint32_t ulStackDepth, void *pvParameters,
+                                           UBaseType_t uxPriority, StackType_t *puxStackBuffer,
+                                           StaticTask_t *pxTaskBuffer, BaseType_t xCoreID);
+BaseType_t xTaskGetCoreID(TaskHandle_t xTask);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask);
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+void vTaskDelay(TickType_t xTicksToDelay);
+void vTaskYield(void);
+#define taskYIELD() vTaskYield()
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetName(TaskHandle_t xTaskToQuery);
+TaskHandle_t xTaskGetHandle(const char *pcNameToQuery);
+// Nel simulatore lo stack non si misura: ritorna la profondita' richiesta
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
+// Tempo di CPU del thread in us (CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER)
+uint32_t ulTaskGetRunTimeCounter(TaskHandle_t xTask);
+
+#endif // SIM_FREERTOS_TASK_H
@@ -0,0 +1,1156 @@
+// host/sim/bt_sim.c
+// Stack Bluedroid simulato. Le callback GAP/GATTS girano su un thread
+// "BTC_TASK" come nello stack vero, quindi le chiamate API fatte dentro una
+// callback producono eventi che arrivano dopo il suo ritorno. Il lato
+// "telefono" (central) e' pilotato dal banco di prova tramite sim.h.
+#include "sim.h"
+#include "ble_handler.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gatts_api.h"
+#include "esp_gatt_common_api.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#define SIM_BLE_MAX_ATTRS       64
+#define SIM_BLE_MAX_CONN        BLE_MAX_CONN  // limite del controller
+#define SIM_BTC_QUEUE_LEN       256
+#define SIM_BLE_GATTS_IF        3
+#define SIM_BLE_FIRST_HANDLE    40
+#define SIM_BLE_RSP_TIMEOUT_US  (1000 * 1000)
+#define SIM_BLE_MAX_BATCH       64
+
+// Costi modellati (ordine di grandezza su ESP32, non misure): init dello
+// stack e round trip BTC di ogni evento consegnato all'applicazione
+#define SIM_BT_CONTROLLER_INIT_US   (60 * 1000)
+#define SIM_BT_CONTROLLER_EN_US     (40 * 1000)
+#define SIM_BLUEDROID_INIT_US       (80 * 1000)
+#define SIM_BLUEDROID_EN_US         (120 * 1000)
+#define SIM_BTC_EVENT_COST_US       800
+
+typedef struct {
+    uint16_t handle;
+    uint16_t uuid16;
+    uint16_t char_uuid16;       // caratteristica di appartenenza
+    bool is_value;
+    bool is_cccd;
+    esp_gatt_perm_t perm;
+    esp_gatt_char_prop_t prop;
+    uint8_t auto_rsp;
+    bool has_storage;
+    uint16_t max_len;
+    uint16_t len;
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+} sim_attr_t;
+
+typedef struct {
+    bool used;
+    uint16_t conn_id;
+    uint16_t mtu;
+    sim_ble_link_t link;
+    int64_t connected_us;       // ancora degli eventi di connessione
+    bool link_pending;          // parametri nuovi in attesa dell'instant
+    sim_ble_link_t next_link;
+    int64_t next_link_us;
+    int64_t busy_until_us;
+    uint32_t pending_trans;
+    bool rsp_ready;
+    esp_gatt_status_t rsp_status;
+    uint16_t rsp_len;
+    uint8_t rsp_value[ESP_GATT_MAX_ATTR_LEN];
+} sim_conn_t;
+
+typedef enum {
+    BTC_MSG_GATTS,
+    BTC_MSG_GAP,
+} btc_msg_kind_t;
+
+typedef struct {
+    btc_msg_kind_t kind;
+    int event;
+    esp_gatt_if_t gatts_if;
+    union {
+        esp_ble_gatts_cb_param_t gatts;
+        esp_ble_gap_cb_param_t gap;
+    } param;
+    uint8_t *owned;
+} btc_msg_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static btc_msg_t s_btc_q[SIM_BTC_QUEUE_LEN];
+static unsigned s_btc_head;
+static unsigned s_btc_count;
+static bool s_btc_busy;
+static bool s_btc_running;
+
+static esp_gap_ble_cb_t s_gap_cb;
+static esp_gatts_cb_t s_gatts_cb;
+static bool s_controller_enabled;
+static bool s_bluedroid_enabled;
+
+static sim_attr_t s_attrs[SIM_BLE_MAX_ATTRS];
+static unsigned s_attr_count;
+static uint16_t s_next_handle = SIM_BLE_FIRST_HANDLE;
+static uint16_t s_last_char_uuid;
+
+static sim_conn_t s_conns[SIM_BLE_MAX_CONN];
+static uint32_t s_next_trans = 1;
+static uint16_t s_local_mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+
+static bool s_advertising;
+static int64_t s_adv_since_us = -1;
+static uint32_t s_adv_config_count;
+static uint32_t s_truncated;
+static int64_t s_cb_max_us;
+static uint32_t s_coex_deferred;
+static uint32_t s_coex_lost;
+
+static sim_ble_notify_cb_t s_notify_cb;
+static void *s_notify_ctx;
+
+static const sim_ble_link_t s_default_link = {
+    .conn_interval_us = 30000,
+    .pkts_per_event   = 4,
+    .ll_payload       = 27,
+    .latency          = 0,
+    .timeout_ms       = 4000,
+};
+
+// Un aggiornamento dei parametri entra in vigore all'"instant", almeno 6
+// eventi di connessione dopo la richiesta
+#define SIM_BLE_UPDATE_EVENTS   6
+
+// — thread BTC —
+
+__attribute__((constructor))
+static void btc_cond_init(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void *btc_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    while (1) {
+        while (s_btc_count == 0) {
+            pthread_cond_wait(&s_cond, &s_lock);
+        }
+        btc_msg_t msg = s_btc_q[s_btc_head];
+        s_btc_head = (s_btc_head + 1) % SIM_BTC_QUEUE_LEN;
+        s_btc_count--;
+        s_btc_busy = true;
+        pthread_mutex_unlock(&s_lock);
+
+        sim_sleep_us(SIM_BTC_EVENT_COST_US);
+
+        int64_t cb_start = sim_now_us();
+        if (msg.kind == BTC_MSG_GATTS && s_gatts_cb) {
+            s_gatts_cb((esp_gatts_cb_event_t)msg.event, msg.gatts_if, &msg.param.gatts);
+        } else if (msg.kind == BTC_MSG_GAP && s_gap_cb) {
+            s_gap_cb((esp_gap_ble_cb_event_t)msg.event, &msg.param.gap);
+        }
+        int64_t cb_us = sim_now_us() - cb_start;
+        free(msg.owned);
+
+        pthread_mutex_lock(&s_lock);
+        if (cb_us > s_cb_max_us) {
+            s_cb_max_us = cb_us;
+        }
+        s_btc_busy = false;
+        pthread_cond_broadcast(&s_cond);
+    }
+    return NULL;
+}
+
+// Chiamare con s_lock preso
+static void btc_post_locked(const btc_msg_t *msg) {
+    configASSERT(s_btc_count < SIM_BTC_QUEUE_LEN);
+    s_btc_q[(s_btc_head + s_btc_count) % SIM_BTC_QUEUE_LEN] = *msg;
+    s_btc_count++;
+    pthread_cond_broadcast(&s_cond);
+}
+
+static void post_gatts_locked(esp_gatts_cb_event_t event, const esp_ble_gatts_cb_param_t *param,
+                              uint8_t *owned) {
+    btc_msg_t msg = { .kind = BTC_MSG_GATTS, .event = event, .gatts_if = SIM_BLE_GATTS_IF,
+                      .param.gatts = *param, .owned = owned };
+    btc_post_locked(&msg);
+}
+
+static void post_gap_locked(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param) {
+    btc_msg_t msg = { .kind = BTC_MSG_GAP, .event = event };
+    if (param) {
+        msg.param.gap = *param;
+    }
+    btc_post_locked(&msg);
+}
+
+// Attende che il thread BTC abbia consumato tutti gli eventi in coda
+static void btc_flush(void) {
+    pthread_mutex_lock(&s_lock);
+    while (s_btc_count > 0 || s_btc_busy) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+// — controller e bluedroid —
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg) {
+    (void)cfg;
+    sim_sleep_us(SIM_BT_CONTROLLER_INIT_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+    if (mode != ESP_BT_MODE_BLE && mode != ESP_BT_MODE_BTDM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim_sleep_us(SIM_BT_CONTROLLER_EN_US);
+    s_controller_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void) {
+    if (!s_controller_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_sleep_us(SIM_BLUEDROID_INIT_US);
+    pthread_mutex_lock(&s_lock);
+    if (!s_btc_running) {
+        pthread_t th;
+        pthread_create(&th, NULL, btc_thread, NULL);
+        pthread_detach(th);
+        s_btc_running = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void) {
+    if (!s_btc_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_sleep_us(SIM_BLUEDROID_EN_US);
+    s_bluedroid_enabled = true;
+    return ESP_OK;
+}
+
+// — GAP —
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback) {
+    s_gap_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_device_name(const char *name) {
+    return (name && s_bluedroid_enabled) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t *adv_data) {
+    if (!s_bluedroid_enabled || adv_data == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_ble_gap_cb_param_t param = { .adv_data_cmpl.status = ESP_BT_STATUS_SUCCESS };
+    pthread_mutex_lock(&s_lock);
+    s_adv_config_count++;
+    post_gap_locked(adv_data->set_scan_rsp ? ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT
+                                           : ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT, &param);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params) {
+    (void)adv_params;
+    esp_ble_gap_cb_param_t param = { .adv_start_cmpl.status = ESP_BT_STATUS_SUCCESS };
+    pthread_mutex_lock(&s_lock);
+    if (!s_advertising) {
+        s_advertising = true;
+        if (s_adv_since_us < 0) {
+            s_adv_since_us = sim_now_us();
+        }
+    }
+    post_gap_locked(ESP_GAP_BLE_ADV_START_COMPLETE_EVT, &param);
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_advertising(void) {
+    esp_ble_gap_cb_param_t param = { .adv_stop_cmpl.status = ESP_BT_STATUS_SUCCESS };
+    pthread_mutex_lock(&s_lock);
+    s_advertising = false;
+    post_gap_locked(ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT, &param);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu) {
+    if (mtu < ESP_GATT_DEF_BLE_MTU_SIZE || mtu > ESP_GATT_MAX_MTU_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_local_mtu = mtu;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// — GATTS: database attributi —
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback) {
+    s_gatts_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id) {
+    if (!s_bluedroid_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_ble_gatts_cb_param_t param = { .reg = { .status = ESP_GATT_OK, .app_id = app_id } };
+    pthread_mutex_lock(&s_lock);
+    post_gatts_locked(ESP_GATTS_REG_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Chiamare con s_lock preso
+static sim_attr_t *attr_new_locked(uint16_t uuid16) {
+    if (s_attr_count == SIM_BLE_MAX_ATTRS) {
+        return NULL;
+    }
+    sim_attr_t *a = &s_attrs[s_attr_count++];
+    memset(a, 0, sizeof(*a));
+    a->handle = s_next_handle++;
+    a->uuid16 = uuid16;
+    return a;
+}
+
+static sim_attr_t *attr_find_locked(uint16_t handle) {
+    for (unsigned i = 0; i < s_attr_count; i++) {
+        if (s_attrs[i].handle == handle) {
+            return &s_attrs[i];
+        }
+    }
+    return NULL;
+}
+
+static void attr_init_value(sim_attr_t *a, const esp_attr_value_t *val, const esp_attr_control_t *ctrl) {
+    a->auto_rsp = ctrl ? ctrl->auto_rsp : ESP_GATT_RSP_BY_APP;
+    if (val) {
+        a->has_storage = true;
+        a->max_len = val->attr_max_len < ESP_GATT_MAX_ATTR_LEN ? val->attr_max_len : ESP_GATT_MAX_ATTR_LEN;
+        a->len = val->attr_len < a->max_len ? val->attr_len : a->max_len;
+        if (val->attr_value && a->len) {
+            memcpy(a->value, val->attr_value, a->len);
+        }
+    }
+}
+
+esp_err_t esp_ble_gatts_create_service(esp_gatt_if_t gatts_if, esp_gatt_srvc_id_t *service_id,
+                                       uint16_t num_handle) {
+    if (gatts_if != SIM_BLE_GATTS_IF || service_id == NULL || num_handle == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_attr_t *svc = attr_new_locked(ESP_GATT_UUID_PRI_SERVICE);
+    esp_ble_gatts_cb_param_t param = { .create = {
+        .status = svc ? ESP_GATT_OK : ESP_GATT_NO_RESOURCES,
+        .service_handle = svc ? svc->handle : 0,
+        .service_id = *service_id,
+    } };
+    post_gatts_locked(ESP_GATTS_CREATE_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_add_char(uint16_t service_handle, esp_bt_uuid_t *char_uuid,
+                                 esp_gatt_perm_t perm, esp_gatt_char_prop_t property,
+                                 esp_attr_value_t *char_val, esp_attr_control_t *control) {
+    if (char_uuid == NULL || char_uuid->len != ESP_UUID_LEN_16) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_attr_t *decl = attr_new_locked(ESP_GATT_UUID_CHAR_DECLARE);
+    sim_attr_t *val = decl ? attr_new_locked(char_uuid->uuid.uuid16) : NULL;
+    if (val) {
+        decl->char_uuid16 = char_uuid->uuid.uuid16;
+        val->char_uuid16 = char_uuid->uuid.uuid16;
+        val->is_value = true;
+        val->perm = perm;
+        val->prop = property;
+        attr_init_value(val, char_val, control);
+        s_last_char_uuid = char_uuid->uuid.uuid16;
+    }
+    esp_ble_gatts_cb_param_t param = { .add_char = {
+        .status = val ? ESP_GATT_OK : ESP_GATT_NO_RESOURCES,
+        .attr_handle = val ? val->handle : 0,
+        .service_handle = service_handle,
+        .char_uuid = *char_uuid,
+    } };
+    post_gatts_locked(ESP_GATTS_ADD_CHAR_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_add_char_descr(uint16_t service_handle, esp_bt_uuid_t *descr_uuid,
+                                       esp_gatt_perm_t perm, esp_attr_value_t *char_descr_val,
+                                       esp_attr_control_t *control) {
+    if (descr_uuid == NULL || descr_uuid->len != ESP_UUID_LEN_16) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_attr_t *d = attr_new_locked(descr_uuid->uuid.uuid16);
+    if (d) {
+        d->char_uuid16 = s_last_char_uuid;
+        d->is_cccd = descr_uuid->uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+        d->perm = perm;
+        attr_init_value(d, char_descr_val, control);
+    }
+    esp_ble_gatts_cb_param_t param = { .add_char_descr = {
+        .status = d ? ESP_GATT_OK : ESP_GATT_NO_RESOURCES,
+        .attr_handle = d ? d->handle : 0,
+        .service_handle = service_handle,
+        .descr_uuid = *descr_uuid,
+    } };
+    post_gatts_locked(ESP_GATTS_ADD_CHAR_DESCR_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static uint16_t attr_desc_uuid16(const esp_attr_desc_t *d) {
+    uint16_t uuid = 0;
+    if (d->uuid_length == ESP_UUID_LEN_16 && d->uuid_p) {
+        memcpy(&uuid, d->uuid_p, sizeof(uuid));
+    }
+    return uuid;
+}
+
+// Tabella intera in una volta: un solo evento con tutti gli handle, in ordine
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *gatts_attr_db, esp_gatt_if_t gatts_if,
+                                        uint16_t max_nb_attr, uint8_t srvc_inst_id) {
+    if (gatts_if != SIM_BLE_GATTS_IF || gatts_attr_db == NULL || max_nb_attr == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t *handles = calloc(max_nb_attr, sizeof(*handles));
+    esp_gatt_status_t status = ESP_GATT_OK;
+    esp_gatt_char_prop_t prop = 0;
+    bool after_decl = false;
+
+    pthread_mutex_lock(&s_lock);
+    for (uint16_t i = 0; i < max_nb_attr; i++) {
+        const esp_attr_desc_t *d = &gatts_attr_db[i].att_desc;
+        uint16_t uuid = attr_desc_uuid16(d);
+        if (uuid == 0 || (i == 0 && uuid != ESP_GATT_UUID_PRI_SERVICE)) {
+            status = ESP_GATT_ILLEGAL_PARAMETER;
+            break;
+        }
+        sim_attr_t *a = attr_new_locked(uuid);
+        if (a == NULL) {
+            status = ESP_GATT_NO_RESOURCES;
+            break;
+        }
+        handles[i] = a->handle;
+        if (uuid == ESP_GATT_UUID_PRI_SERVICE) {
+            continue;
+        }
+        if (uuid == ESP_GATT_UUID_CHAR_DECLARE) {
+            prop = (d->value && d->length) ? d->value[0] : 0;
+            after_decl = true;
+            continue;
+        }
+        if (after_decl) {
+            // l'attributo che segue la dichiarazione e' il valore
+            a->is_value = true;
+            a->prop = prop;
+            s_last_char_uuid = uuid;
+            after_decl = false;
+        } else {
+            a->is_cccd = uuid == ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+        }
+        a->char_uuid16 = s_last_char_uuid;
+        a->perm = d->perm;
+        esp_attr_value_t val = { .attr_max_len = d->max_length, .attr_len = d->length,
+                                 .attr_value = d->value };
+        attr_init_value(a, &val, &gatts_attr_db[i].attr_control);
+    }
+    // il valore della dichiarazione di servizio e' l'UUID del servizio
+    const esp_attr_desc_t *svc = &gatts_attr_db[0].att_desc;
+    uint16_t svc_uuid = 0;
+    if (svc->value && svc->length == sizeof(svc_uuid)) {
+        memcpy(&svc_uuid, svc->value, sizeof(svc_uuid));
+    }
+    esp_ble_gatts_cb_param_t param = { .add_attr_tab = {
+        .status = status,
+        .svc_uuid = { .len = ESP_UUID_LEN_16, .uuid.uuid16 = svc_uuid },
+        .svc_inst_id = srvc_inst_id,
+        .num_handle = status == ESP_GATT_OK ? max_nb_attr : 0,
+        .handles = handles,
+    } };
+    post_gatts_locked(ESP_GATTS_CREAT_ATTR_TAB_EVT, &param, (uint8_t *)handles);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_start_service(uint16_t service_handle) {
+    esp_ble_gatts_cb_param_t param = { .start = { .status = ESP_GATT_OK,
+                                                  .service_handle = service_handle } };
+    pthread_mutex_lock(&s_lock);
+    post_gatts_locked(ESP_GATTS_START_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t attr_handle, uint16_t length, const uint8_t *value) {
+    pthread_mutex_lock(&s_lock);
+    sim_attr_t *a = attr_find_locked(attr_handle);
+    esp_gatt_status_t status = ESP_GATT_OK;
+    if (a == NULL) {
+        status = ESP_GATT_INVALID_HANDLE;
+    } else if (!a->has_storage || length > a->max_len) {
+        status = ESP_GATT_INVALID_ATTR_LEN;
+    } else {
+        memcpy(a->value, value, length);
+        a->len = length;
+    }
+    esp_ble_gatts_cb_param_t param = { .set_attr_val = { .attr_handle = attr_handle,
+                                                         .status = status } };
+    post_gatts_locked(ESP_GATTS_SET_ATTR_VAL_EVT, &param, NULL);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_get_attr_value(uint16_t attr_handle, uint16_t *length, const uint8_t **value) {
+    pthread_mutex_lock(&s_lock);
+    sim_attr_t *a = attr_find_locked(attr_handle);
+    esp_err_t err = ESP_FAIL;
+    if (a && a->has_storage) {
+        *length = a->len;
+        *value = a->value;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+// — GATTS: collegamento —
+
+static sim_conn_t *conn_find_locked(uint16_t conn_id) {
+    for (int i = 0; i < SIM_BLE_MAX_CONN; i++) {
+        if (s_conns[i].used && s_conns[i].conn_id == conn_id) {
+            return &s_conns[i];
+        }
+    }
+    return NULL;
+}
+
+// Istante del prossimo evento di connessione utile a partire da 'from';
+// 'every' > 1 conta solo un evento ogni 'every' (periferica in latency)
+static int64_t next_conn_event_locked(const sim_conn_t *c, int64_t from, uint32_t every) {
+    int64_t interval = (int64_t)c->link.conn_interval_us * (every ? every : 1);
+    int64_t since = from - c->connected_us;
+    if (since < 0) {
+        return c->connected_us;
+    }
+    int64_t k = (since + interval - 1) / interval;
+    return c->connected_us + k * interval;
+}
+
+static void conn_bda(const sim_conn_t *c, esp_bd_addr_t bda) {
+    static const esp_bd_addr_t base = { 0x5A, 0x11, 0x22, 0x33, 0x44, 0x00 };
+    memcpy(bda, base, sizeof(base));
+    bda[5] = (uint8_t)c->conn_id;
+}
+
+static sim_conn_t *conn_find_bda_locked(const esp_bd_addr_t bda) {
+    for (int i = 0; i < SIM_BLE_MAX_CONN; i++) {
+        esp_bd_addr_t b;
+        if (s_conns[i].used) {
+            conn_bda(&s_conns[i], b);
+            if (memcmp(b, bda, sizeof(b)) == 0) {
+                return &s_conns[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+// Applica i parametri in attesa se il loro instant e' passato
+static void link_apply_locked(sim_conn_t *c, int64_t now) {
+    if (c->link_pending && now >= c->next_link_us) {
+        c->link = c->next_link;
+        c->connected_us = c->next_link_us;
+        c->link_pending = false;
+    }
+}
+
+// Occupa il link per 'bytes' di payload ATT e ritorna l'istante di consegna.
+// Dal telefono (from_central) con il link fermo la periferica ascolta solo
+// un evento ogni latency + 1.
+static int64_t air_schedule_locked(sim_conn_t *c, uint32_t bytes, bool confirm, bool from_central) {
+    int64_t now = sim_now_us();
+    link_apply_locked(c, c->busy_until_us > now ? c->busy_until_us : now);
+    uint32_t every = from_central ? (uint32_t)c->link.latency + 1 : 1;
+    int64_t start = c->busy_until_us > now ? c->busy_until_us : next_conn_event_locked(c, now, every);
+    // header L2CAP (4) + opcode/handle ATT (3)
+    uint32_t pdu = bytes + 4 + 3;
+    uint32_t pkts = (pdu + c->link.ll_payload - 1) / c->link.ll_payload;
+    int64_t slot = c->link.conn_interval_us / (c->link.pkts_per_event ? c->link.pkts_per_event : 1);
+    // Un pacchetto che cade mentre la scansione Wi-Fi tiene la radio
+    // aspetta il primo evento utile dopo il dwell
+    int64_t done = start;
+    for (uint32_t i = 0; i < pkts; i++) {
+        int64_t free_at = sim_wifi_coex_free_at(done);
+        if (free_at != done) {
+            done = next_conn_event_locked(c, free_at, every);
+            s_coex_deferred++;
+        }
+        done += slot;
+    }
+    c->busy_until_us = done;
+    return confirm ? done + c->link.conn_interval_us : done;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+                                      uint16_t value_len, uint8_t *value, bool need_confirm) {
+    if (gatts_if != SIM_BLE_GATTS_IF) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (value_len > ESP_GATT_MAX_ATTR_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    esp_ble_gatts_cb_param_t conf = { .conf = { .conn_id = conn_id, .handle = attr_handle } };
+    if (c == NULL) {
+        conf.conf.status = ESP_GATT_ILLEGAL_PARAMETER;
+        post_gatts_locked(ESP_GATTS_CONF_EVT, &conf, NULL);
+        pthread_mutex_unlock(&s_lock);
+        return ESP_OK;
+    }
+    // Lo stack tronca le notifiche a MTU - 3
+    uint16_t len = value_len;
+    if (len > c->mtu - 3) {
+        len = (uint16_t)(c->mtu - 3);
+        s_truncated++;
+    }
+    int64_t delivered = air_schedule_locked(c, len, need_confirm, false);
+    sim_ble_notify_cb_t cb = s_notify_cb;
+    void *ctx = s_notify_ctx;
+    conf.conf.status = ESP_GATT_OK;
+    conf.conf.len = len;
+    post_gatts_locked(ESP_GATTS_CONF_EVT, &conf, NULL);
+    pthread_mutex_unlock(&s_lock);
+
+    if (cb) {
+        cb(conn_id, attr_handle, value, len, delivered, ctx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+                                      esp_gatt_status_t status, esp_gatt_rsp_t *rsp) {
+    (void)gatts_if;
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c == NULL || c->pending_trans != trans_id) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_FAIL;
+    }
+    c->rsp_status = status;
+    c->rsp_len = 0;
+    if (rsp) {
+        c->rsp_len = rsp->attr_value.len;
+        memcpy(c->rsp_value, rsp->attr_value.value, c->rsp_len);
+    }
+    c->rsp_ready = true;
+    c->pending_trans = 0;
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// — lato central, pilotato dal banco di prova —
+
+void sim_ble_set_notify_cb(sim_ble_notify_cb_t cb, void *ctx) {
+    pthread_mutex_lock(&s_lock);
+    s_notify_cb = cb;
+    s_notify_ctx = ctx;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void deadline_after_us(struct timespec *ts, int64_t us) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += us / 1000000;
+    ts->tv_nsec += (us % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+bool sim_ble_wait_advertising(uint32_t timeout_ms) {
+    struct timespec deadline;
+    deadline_after_us(&deadline, (int64_t)timeout_ms * 1000);
+    pthread_mutex_lock(&s_lock);
+    while (!s_advertising) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool adv = s_advertising;
+    pthread_mutex_unlock(&s_lock);
+    btc_flush();
+    return adv;
+}
+
+int64_t sim_ble_advertising_since_us(void) {
+    pthread_mutex_lock(&s_lock);
+    int64_t t = s_adv_since_us;
+    pthread_mutex_unlock(&s_lock);
+    return t;
+}
+
+uint32_t sim_ble_adv_config_count(void) {
+    pthread_mutex_lock(&s_lock);
+    uint32_t n = s_adv_config_count;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+uint32_t sim_ble_notifications_truncated(void) {
+    pthread_mutex_lock(&s_lock);
+    uint32_t n = s_truncated;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+uint16_t sim_ble_connect(void) {
+    static uint16_t next_conn_id;
+    pthread_mutex_lock(&s_lock);
+    configASSERT(s_advertising);
+    sim_conn_t *c = NULL;
+    for (int i = 0; i < SIM_BLE_MAX_CONN; i++) {
+        if (!s_conns[i].used) {
+            c = &s_conns[i];
+            break;
+        }
+    }
+    configASSERT(c != NULL);
+    memset(c, 0, sizeof(*c));
+    c->used = true;
+    c->conn_id = next_conn_id++;
+    c->mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+    c->link = s_default_link;
+    c->connected_us = sim_now_us();
+    // L'advertising connectable si ferma alla connessione
+    s_advertising = false;
+
+    esp_ble_gatts_cb_param_t param = { .connect = {
+        .conn_id = c->conn_id,
+        // conn_params in unita' del controller, come nello stack vero
+        .conn_params = { .interval = (uint16_t)(c->link.conn_interval_us / 1250),
+                         .latency = c->link.latency, .timeout = (uint16_t)(c->link.timeout_ms / 10) },
+        .conn_handle = c->conn_id,
+    } };
+    conn_bda(c, param.connect.remote_bda);
+    post_gatts_locked(ESP_GATTS_CONNECT_EVT, &param, NULL);
+    uint16_t id = c->conn_id;
+    pthread_mutex_unlock(&s_lock);
+    btc_flush();
+    return id;
+}
+
+void sim_ble_disconnect(uint16_t conn_id) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c) {
+        c->used = false;
+        esp_ble_gatts_cb_param_t param = { .disconnect = {
+            .conn_id = conn_id,
+            .reason = ESP_GATT_CONN_TERMINATE_PEER_USER,
+        } };
+        post_gatts_locked(ESP_GATTS_DISCONNECT_EVT, &param, NULL);
+    }
+    pthread_mutex_unlock(&s_lock);
+    btc_flush();
+}
+
+void sim_ble_exchange_mtu(uint16_t conn_id, uint16_t mtu) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c) {
+        c->mtu = mtu < s_local_mtu ? mtu : s_local_mtu;
+        if (c->mtu < ESP_GATT_DEF_BLE_MTU_SIZE) {
+            c->mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+        }
+        esp_ble_gatts_cb_param_t param = { .mtu = { .conn_id = conn_id, .mtu = c->mtu } };
+        post_gatts_locked(ESP_GATTS_MTU_EVT, &param, NULL);
+    }
+    pthread_mutex_unlock(&s_lock);
+    btc_flush();
+}
+
+void sim_ble_get_link(uint16_t conn_id, sim_ble_link_t *link) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c) {
+        link_apply_locked(c, sim_now_us());
+    }
+    *link = c ? c->link : s_default_link;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_ble_set_link(uint16_t conn_id, const sim_ble_link_t *link) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c) {
+        c->link = *link;
+        c->link_pending = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+uint16_t sim_ble_find_char(uint16_t uuid16) {
+    uint16_t handle = 0;
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_attr_count; i++) {
+        if (s_attrs[i].is_value && s_attrs[i].uuid16 == uuid16) {
+            handle = s_attrs[i].handle;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return handle;
+}
+
+uint16_t sim_ble_find_cccd(uint16_t uuid16) {
+    uint16_t handle = 0;
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_attr_count; i++) {
+        if (s_attrs[i].is_cccd && s_attrs[i].char_uuid16 == uuid16) {
+            handle = s_attrs[i].handle;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return handle;
+}
+
+// Attende la risposta dell'app alla transazione pendente
+static esp_gatt_status_t wait_app_response_locked(sim_conn_t *c) {
+    struct timespec deadline;
+    deadline_after_us(&deadline, SIM_BLE_RSP_TIMEOUT_US);
+    while (!c->rsp_ready) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) == ETIMEDOUT) {
+            c->pending_trans = 0;
+            return ESP_GATT_ERROR;
+        }
+    }
+    return c->rsp_status;
+}
+
+// Consegna all'app una scrittura arrivata; con need_rsp attende la risposta
+static esp_gatt_status_t deliver_write_locked(sim_conn_t *c, uint16_t handle, const void *data,
+                                              uint16_t len, bool need_rsp) {
+    sim_attr_t *a = attr_find_locked(handle);
+    if (a == NULL) {
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    if (len > c->mtu - 3) {
+        return ESP_GATT_INVALID_ATTR_LEN;
+    }
+    bool by_stack = a->auto_rsp == ESP_GATT_AUTO_RSP;
+    if (by_stack) {
+        if (len > a->max_len) {
+            return ESP_GATT_INVALID_ATTR_LEN;
+        }
+        memcpy(a->value, data, len);
+        a->len = len;
+    }
+
+    // Il buffer dello stack vero non e' terminato; qui aggiungiamo uno zero
+    // in coda solo per non introdurre letture fuori limite nel simulatore
+    uint8_t *copy = malloc((size_t)len + 1);
+    memcpy(copy, data, len);
+    copy[len] = 0;
+    esp_ble_gatts_cb_param_t param = { .write = {
+        .conn_id = c->conn_id,
+        .handle = handle,
+        .need_rsp = need_rsp && !by_stack,
+        .len = len,
+        .value = copy,
+    } };
+    if (param.write.need_rsp) {
+        param.write.trans_id = s_next_trans++;
+        c->pending_trans = param.write.trans_id;
+        c->rsp_ready = false;
+    }
+    post_gatts_locked(ESP_GATTS_WRITE_EVT, &param, copy);
+
+    if (param.write.need_rsp) {
+        return wait_app_response_locked(c);
+    }
+    return ESP_GATT_OK;
+}
+
+static esp_gatt_status_t do_write(uint16_t conn_id, uint16_t handle, const void *data,
+                                  uint16_t len, bool need_rsp) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_GATT_ERROR;
+    }
+    // Il pacchetto parte al prossimo evento di connessione
+    int64_t arrive = air_schedule_locked(c, len, false, true);
+    pthread_mutex_unlock(&s_lock);
+    sim_sleep_us(arrive - sim_now_us());
+
+    pthread_mutex_lock(&s_lock);
+    esp_gatt_status_t status = deliver_write_locked(c, handle, data, len, need_rsp);
+    pthread_mutex_unlock(&s_lock);
+    return status;
+}
+
+esp_gatt_status_t sim_ble_write(uint16_t conn_id, uint16_t handle, const void *data, uint16_t len) {
+    return do_write(conn_id, handle, data, len, true);
+}
+
+void sim_ble_write_nr(uint16_t conn_id, uint16_t handle, const void *data, uint16_t len) {
+    do_write(conn_id, handle, data, len, false);
+}
+
+void sim_ble_write_nr_many(uint16_t conn_id, const sim_ble_write_t *writes, size_t count) {
+    int64_t arrive[SIM_BLE_MAX_BATCH];
+    if (count > SIM_BLE_MAX_BATCH) {
+        count = SIM_BLE_MAX_BATCH;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+    // Tutto gia' in coda nel controller del telefono: i pacchetti si
+    // susseguono negli stessi eventi di connessione
+    for (size_t i = 0; i < count; i++) {
+        arrive[i] = air_schedule_locked(c, writes[i].len, false, true);
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        sim_sleep_us(arrive[i] - sim_now_us());
+        pthread_mutex_lock(&s_lock);
+        deliver_write_locked(c, writes[i].handle, writes[i].data, writes[i].len, false);
+        pthread_mutex_unlock(&s_lock);
+    }
+}
+
+// Read (offset 0) o read blob: l'app riceve offset e is_long
+static int do_read(uint16_t conn_id, uint16_t handle, uint16_t offset, uint8_t *buf,
+                   uint16_t max_len, esp_gatt_status_t *status) {
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    sim_attr_t *a = attr_find_locked(handle);
+    if (c == NULL || a == NULL) {
+        *status = ESP_GATT_INVALID_HANDLE;
+        pthread_mutex_unlock(&s_lock);
+        return -1;
+    }
+    const uint8_t *src;
+    uint16_t len;
+    if (a->auto_rsp == ESP_GATT_AUTO_RSP) {
+        if (offset > a->len) {
+            *status = ESP_GATT_INVALID_OFFSET;
+            pthread_mutex_unlock(&s_lock);
+            return -1;
+        }
+        src = a->value + offset;
+        len = (uint16_t)(a->len - offset);
+        *status = ESP_GATT_OK;
+    } else {
+        esp_ble_gatts_cb_param_t param = { .read = {
+            .conn_id = conn_id,
+            .trans_id = s_next_trans++,
+            .handle = handle,
+            .offset = offset,
+            .is_long = offset > 0,
+            .need_rsp = true,
+        } };
+        c->pending_trans = param.read.trans_id;
+        c->rsp_ready = false;
+        post_gatts_locked(ESP_GATTS_READ_EVT, &param, NULL);
+        *status = wait_app_response_locked(c);
+        src = c->rsp_value;
+        len = c->rsp_len;
+    }
+    if (*status != ESP_GATT_OK) {
+        pthread_mutex_unlock(&s_lock);
+        return -1;
+    }
+    // Una read singola restituisce al massimo MTU - 1 byte
+    if (len > c->mtu - 1) {
+        len = (uint16_t)(c->mtu - 1);
+    }
+    if (len > max_len) {
+        len = max_len;
+    }
+    memcpy(buf, src, len);
+    pthread_mutex_unlock(&s_lock);
+    return len;
+}
+
+int sim_ble_read(uint16_t conn_id, uint16_t handle, uint8_t *buf, uint16_t max_len,
+                 esp_gatt_status_t *status) {
+    return do_read(conn_id, handle, 0, buf, max_len, status);
+}
+
+int sim_ble_read_long(uint16_t conn_id, uint16_t handle, uint8_t *buf, uint16_t max_len,
+                      esp_gatt_status_t *status) {
+    uint16_t mtu = 0;
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_locked(conn_id);
+    if (c) {
+        mtu = c->mtu;
+    }
+    pthread_mutex_unlock(&s_lock);
+    uint16_t total = 0;
+    for (;;) {
+        int n = do_read(conn_id, handle, total, buf + total, (uint16_t)(max_len - total), status);
+        if (n < 0) {
+            return total ? total : -1;
+        }
+        total = (uint16_t)(total + n);
+        // una risposta piu' corta di MTU - 1 chiude la lettura lunga
+        if (n < mtu - 1 || total == max_len) {
+            return total;
+        }
+    }
+}
+
+void sim_ble_coex_blackout(int64_t blackout_us) {
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < SIM_BLE_MAX_CONN; i++) {
+        sim_conn_t *c = &s_conns[i];
+        if (!c->used) {
+            continue;
+        }
+        link_apply_locked(c, sim_now_us());
+        if (blackout_us < (int64_t)c->link.timeout_ms * 1000) {
+            continue;
+        }
+        c->used = false;
+        s_coex_lost++;
+        esp_ble_gatts_cb_param_t param = { .disconnect = {
+            .conn_id = c->conn_id,
+            .reason = ESP_GATT_CONN_TIMEOUT,
+        } };
+        post_gatts_locked(ESP_GATTS_DISCONNECT_EVT, &param, NULL);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_ble_coex_stats(uint32_t *deferred, uint32_t *lost) {
+    pthread_mutex_lock(&s_lock);
+    *deferred = s_coex_deferred;
+    *lost = s_coex_lost;
+    pthread_mutex_unlock(&s_lock);
+}
+
+int64_t sim_ble_callback_max_us(bool reset) {
+    pthread_mutex_lock(&s_lock);
+    int64_t v = s_cb_max_us;
+    if (reset) {
+        s_cb_max_us = 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return v;
+}
+
+// L'evento di aggiornamento arriva all'instant, come dal controller vero
+typedef struct {
+    int64_t at_us;
+    esp_ble_gap_cb_param_t param;
+} gap_later_t;
+
+static void *gap_later_thread(void *arg) {
+    gap_later_t *later = arg;
+    sim_sleep_us(later->at_us - sim_now_us());
+    pthread_mutex_lock(&s_lock);
+    post_gap_locked(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &later->param);
+    pthread_mutex_unlock(&s_lock);
+    free(later);
+    return NULL;
+}
+
+// Il telefono accetta qualsiasi richiesta valida e sceglie l'intervallo
+// minimo; i nuovi parametri valgono dall'instant, 6 eventi piu' avanti
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params) {
+    if (params == NULL || params->min_int < 6 || params->min_int > params->max_int ||
+        params->max_int > 3200) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_bda_locked(params->bda);
+    esp_ble_gap_cb_param_t param = { .update_conn_params = {
+        .status = c ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL,
+        .min_int = params->min_int, .max_int = params->max_int,
+        .latency = params->latency, .conn_int = params->min_int, .timeout = params->timeout,
+    } };
+    memcpy(param.update_conn_params.bda, params->bda, sizeof(esp_bd_addr_t));
+    if (c) {
+        int64_t now = sim_now_us();
+        link_apply_locked(c, now);
+        sim_ble_link_t next = c->link;
+        next.conn_interval_us = (uint32_t)params->min_int * 1250;
+        next.latency = params->latency;
+        next.timeout_ms = (uint16_t)(params->timeout * 10);
+        next.updates++;
+        c->next_link = next;
+        c->next_link_us = next_conn_event_locked(c, now, 1)
+                          + (int64_t)SIM_BLE_UPDATE_EVENTS * c->link.conn_interval_us;
+        c->link_pending = true;
+
+        gap_later_t *later = malloc(sizeof(*later));
+        configASSERT(later != NULL);
+        later->at_us = c->next_link_us;
+        later->param = param;
+        pthread_t th;
+        pthread_create(&th, NULL, gap_later_thread, later);
+        pthread_detach(th);
+    } else {
+        post_gap_locked(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &param);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length) {
+    if (tx_data_length < 27 || tx_data_length > 251) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_conn_t *c = conn_find_bda_locked(remote_device);
+    esp_ble_gap_cb_param_t param = { .pkt_data_length_cmpl = {
+        .status = c ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL,
+        .params = { .rx_len = tx_data_length, .tx_len = tx_data_length },
+    } };
+    if (c) {
+        c->link.ll_payload = tx_data_length;
+        if (c->link_pending) {
+            c->next_link.ll_payload = tx_data_length;
+        }
+    }
+    post_gap_locked(ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, &param);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,419 @@
+// host/sim/esp_sim.c
+// Servizi di sistema ESP-IDF simulati: tempo, timer one-shot, numeri
+// casuali, log, codici d'errore, loop eventi di default (task "sys_evt")
+// ed esp_netif. L'NVS sta in nvs_sim.c, flash, OTA ed esp_restart in
+// ota_sim.c, il client HTTP in http_sim.c.
+#include "sim.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// — tempo —
+
+static struct timespec s_boot;
+
+__attribute__((constructor))
+static void sim_clock_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &s_boot);
+}
+
+int64_t sim_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - s_boot.tv_sec) * 1000000LL +
+           (now.tv_nsec - s_boot.tv_nsec) / 1000;
+}
+
+void sim_sleep_us(int64_t us) {
+    if (us <= 0) {
+        return;
+    }
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+int64_t esp_timer_get_time(void) {
+    return sim_now_us();
+}
+
+// — esp_timer one-shot —
+// Ogni avvio lancia un thread che dorme e poi chiama la callback; un
+// contatore di generazione annulla le attese superate da stop/start.
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    pthread_mutex_t lock;
+    uint32_t gen;
+    bool active;
+};
+
+typedef struct {
+    esp_timer_handle_t timer;
+    uint32_t gen;
+    uint64_t timeout_us;
+} timer_shot_t;
+
+static void *timer_thread(void *arg) {
+    timer_shot_t shot = *(timer_shot_t *)arg;
+    free(arg);
+    sim_sleep_us((int64_t)shot.timeout_us);
+
+    esp_timer_handle_t t = shot.timer;
+    pthread_mutex_lock(&t->lock);
+    bool fire = t->active && t->gen == shot.gen;
+    if (fire) {
+        t->active = false;
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (fire) {
+        t->args.callback(t->args.arg);
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_handle_t t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->args = *create_args;
+    pthread_mutex_init(&t->lock, NULL);
+    *out_handle = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    timer_shot_t *shot = malloc(sizeof(*shot));
+    if (shot == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_lock(&timer->lock);
+    if (timer->active) {
+        pthread_mutex_unlock(&timer->lock);
+        free(shot);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    shot->timer = timer;
+    shot->gen = ++timer->gen;
+    shot->timeout_us = timeout_us;
+    pthread_mutex_unlock(&timer->lock);
+
+    pthread_t th;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&th, &attr, timer_thread, shot);
+    pthread_attr_destroy(&attr);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    bool was_active = timer->active;
+    timer->active = false;
+    timer->gen++;
+    pthread_mutex_unlock(&timer->lock);
+    return was_active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&timer->lock);
+    return active;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (esp_timer_is_active(timer)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // I thread di attese annullate possono ancora leggere il timer: il
+    // simulatore non lo libera mai (il firmware ne crea pochi e per sempre)
+    return ESP_OK;
+}
+
+// — numeri casuali —
+
+uint32_t esp_random(void) {
+    static _Atomic uint32_t state = 0x9E3779B9u;
+    uint32_t x = atomic_load(&state), next;
+    do {
+        next = x;
+        next ^= next << 13;
+        next ^= next >> 17;
+        next ^= next << 5;
+    } while (!atomic_compare_exchange_weak(&state, &x, next));
+    return next;
+}
+
+// — contabilita' —
+
+static atomic_size_t s_mem_current;
+static atomic_size_t s_mem_peak;
+static atomic_uint_fast64_t s_copy_bytes;
+
+void sim_mem_note_alloc(size_t bytes) {
+    size_t now = atomic_fetch_add(&s_mem_current, bytes) + bytes;
+    size_t peak = atomic_load(&s_mem_peak);
+    while (now > peak && !atomic_compare_exchange_weak(&s_mem_peak, &peak, now)) {
+    }
+}
+
+void sim_mem_note_free(size_t bytes) {
+    atomic_fetch_sub(&s_mem_current, bytes);
+}
+
+size_t sim_mem_current(void) { return atomic_load(&s_mem_current); }
+size_t sim_mem_peak(void)    { return atomic_load(&s_mem_peak); }
+
+// Heap libero di un ESP32 con Bluedroid e Wi-Fi avviati, prima del firmware
+#define SIM_HEAP_FREE_AT_BOOT   (160 * 1024)
+
+uint32_t esp_get_free_heap_size(void) {
+    return (uint32_t)(SIM_HEAP_FREE_AT_BOOT - sim_mem_current());
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return (uint32_t)(SIM_HEAP_FREE_AT_BOOT - sim_mem_peak());
+}
+
+void sim_stats_add_copy_bytes(size_t bytes) {
+    atomic_fetch_add(&s_copy_bytes, bytes);
+}
+
+uint64_t sim_stats_copy_bytes(void) {
+    return atomic_load(&s_copy_bytes);
+}
+
+// — log —
+
+#define SIM_LOG_MAX_TAGS 16
+// Console UART a 115200 baud, 10 bit per carattere: chi scrive una riga
+// aspetta che esca (la FIFO da 128 byte si riempie subito)
+#define SIM_LOG_UART_BAUD 115200
+
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static esp_log_level_t s_log_default = ESP_LOG_INFO;
+static struct {
+    char tag[24];
+    esp_log_level_t level;
+} s_log_tags[SIM_LOG_MAX_TAGS];
+static int s_log_tag_count;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    pthread_mutex_lock(&s_log_lock);
+    if (strcmp(tag, "*") == 0) {
+        s_log_default = level;
+        s_log_tag_count = 0;
+    } else {
+        int i;
+        for (i = 0; i < s_log_tag_count; i++) {
+            if (strcmp(s_log_tags[i].tag, tag) == 0) {
+                break;
+            }
+        }
+        if (i < SIM_LOG_MAX_TAGS) {
+            strncpy(s_log_tags[i].tag, tag, sizeof(s_log_tags[i].tag) - 1);
+            s_log_tags[i].level = level;
+            if (i == s_log_tag_count) {
+                s_log_tag_count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    pthread_mutex_lock(&s_log_lock);
+    esp_log_level_t limit = s_log_default;
+    for (int i = 0; i < s_log_tag_count; i++) {
+        if (strcmp(s_log_tags[i].tag, tag) == 0) {
+            limit = s_log_tags[i].level;
+            break;
+        }
+    }
+    if (level <= limit) {
+        va_list ap;
+        va_start(ap, format);
+        int n = vfprintf(stdout, format, ap);
+        va_end(ap);
+        fflush(stdout);
+        if (n > 0) {
+            sim_sleep_us((int64_t)n * 10 * 1000000 / SIM_LOG_UART_BAUD);
+        }
+    }
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+// — errori —
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+        case ESP_ERR_OTA_ROLLBACK_FAILED: return "ESP_ERR_OTA_ROLLBACK_FAILED";
+        case ESP_ERR_HTTP_CONNECT:      return "ESP_ERR_HTTP_CONNECT";
+        case ESP_ERR_HTTP_WRITE_DATA:   return "ESP_ERR_HTTP_WRITE_DATA";
+        case ESP_ERR_WIFI_NOT_INIT:     return "ESP_ERR_WIFI_NOT_INIT";
+        case ESP_ERR_WIFI_NOT_STARTED:  return "ESP_ERR_WIFI_NOT_STARTED";
+        case ESP_ERR_WIFI_STATE:        return "ESP_ERR_WIFI_STATE";
+        case ESP_ERR_WIFI_CONN:         return "ESP_ERR_WIFI_CONN";
+        case ESP_ERR_NVS_NOT_FOUND:     return "ESP_ERR_NVS_NOT_FOUND";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+// — loop eventi di default —
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+#define SIM_EVENT_MAX_HANDLERS  16
+#define SIM_EVENT_MAX_DATA      96
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    uint8_t data[SIM_EVENT_MAX_DATA];
+} sim_event_t;
+
+static struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} s_handlers[SIM_EVENT_MAX_HANDLERS];
+static int s_handler_count;
+static pthread_mutex_t s_handler_lock = PTHREAD_MUTEX_INITIALIZER;
+static QueueHandle_t s_event_q;
+
+static void sys_evt_task(void *arg) {
+    sim_event_t evt;
+    while (1) {
+        if (xQueueReceive(s_event_q, &evt, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        pthread_mutex_lock(&s_handler_lock);
+        int count = s_handler_count;
+        pthread_mutex_unlock(&s_handler_lock);
+        for (int i = 0; i < count; i++) {
+            if ((s_handlers[i].base == ESP_EVENT_ANY_BASE || s_handlers[i].base == evt.base) &&
+                (s_handlers[i].id == ESP_EVENT_ANY_ID || s_handlers[i].id == evt.id) &&
+                s_handlers[i].handler != NULL) {
+                s_handlers[i].handler(s_handlers[i].arg, evt.base, evt.id,
+                                      evt.size ? evt.data : NULL);
+            }
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (s_event_q != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_q = xQueueCreate(32, sizeof(sim_event_t));
+    if (s_event_q == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    sim_queue_mark_internal(s_event_q);
+    xTaskCreate(sys_evt_task, "sys_evt", 2304, NULL, 20, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id,
+                                     esp_event_handler_t handler, void *arg) {
+    pthread_mutex_lock(&s_handler_lock);
+    if (s_handler_count == SIM_EVENT_MAX_HANDLERS) {
+        pthread_mutex_unlock(&s_handler_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_handlers[s_handler_count].base = base;
+    s_handlers[s_handler_count].id = id;
+    s_handlers[s_handler_count].handler = handler;
+    s_handlers[s_handler_count].arg = arg;
+    s_handler_count++;
+    pthread_mutex_unlock(&s_handler_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t base, int32_t id,
+                                       esp_event_handler_t handler) {
+    pthread_mutex_lock(&s_handler_lock);
+    for (int i = 0; i < s_handler_count; i++) {
+        if (s_handlers[i].base == base && s_handlers[i].id == id &&
+            s_handlers[i].handler == handler) {
+            s_handlers[i].handler = NULL;
+        }
+    }
+    pthread_mutex_unlock(&s_handler_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data,
+                         size_t size, TickType_t ticks) {
+    if (s_event_q == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (size > SIM_EVENT_MAX_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim_event_t evt = { .base = base, .id = id, .size = size };
+    if (size) {
+        memcpy(evt.data, data, size);
+    }
+    return xQueueSend(s_event_q, &evt, ticks) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// — netif —
+
+struct esp_netif_obj {
+    int unused;
+};
+
+static struct esp_netif_obj s_sta_netif;
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+    return &s_sta_netif;
+}
@@ -0,0 +1,512 @@
+// host/sim/freertos_sim.c
+// Kernel FreeRTOS minimale sopra pthread: code bloccanti con timeout in tick,
+// mutex, task come thread detached, tick derivato dal clock monotonic.
+// Priorita' e core vengono registrati ma non applicati (scheduler di Linux).
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    uint8_t        *storage;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    bool            internal;   // coda del simulatore, esclusa dalle statistiche
+    bool            static_mem; // storage del chiamante (xQueueCreateStatic)
+};
+
+struct sim_task {
+    pthread_t       thread;
+    TaskFunction_t  code;
+    void           *arg;
+    UBaseType_t     priority;
+    BaseType_t      core;       // xTaskCreatePinnedToCore, o tskNO_AFFINITY
+    uint32_t        stack_depth;
+    char            name[16];
+    bool            alive;
+    bool            static_mem; // stack del chiamante: fuori dall'heap simulato
+    struct sim_task *next;      // registro per xTaskGetHandle
+};
+
+struct sim_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t  released;
+    bool            taken;
+};
+
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    EventBits_t     bits;
+};
+
+static __thread struct sim_task *s_current_task;
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task *s_tasks;
+
+// — tempo —
+
+static void deadline_from_ticks(struct timespec *ts, TickType_t ticks) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+    ts->tv_sec  += (time_t)(ns / 1000000000ULL);
+    ts->tv_nsec += (long)(ns % 1000000000ULL);
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static pthread_cond_t *cond_init_monotonic(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return cond;
+}
+
+// Attende su cond fino al deadline; ritorna false allo scadere del timeout
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock,
+                       TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+// — code —
+
+static struct sim_queue *queue_init(UBaseType_t length, UBaseType_t item_size, uint8_t *storage) {
+    struct sim_queue *q = calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->static_mem = storage != NULL;
+    q->storage = storage ? storage : calloc(length, item_size ? item_size : 1);
+    if (q->storage == NULL) {
+        free(q);
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    pthread_mutex_init(&q->lock, NULL);
+    cond_init_monotonic(&q->not_empty);
+    cond_init_monotonic(&q->not_full);
+    return q;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    struct sim_queue *q = queue_init(uxQueueLength, uxItemSize, NULL);
+    if (q != NULL) {
+        sim_mem_note_alloc(uxQueueLength * uxItemSize + sizeof(*q));
+    }
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize,
+                                 uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue) {
+    configASSERT(pucQueueStorage != NULL && pxStaticQueue != NULL);
+    return queue_init(uxQueueLength, uxItemSize, pucQueueStorage);
+}
+
+void vQueueDelete(QueueHandle_t q) {
+    if (q == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    if (!q->static_mem) {
+        sim_mem_note_free(q->length * q->item_size + sizeof(*q));
+        free(q->storage);
+    }
+    free(q);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void *item,
+                             TickType_t ticks, BaseType_t position) {
+    struct timespec deadline;
+    deadline_from_ticks(&deadline, ticks == portMAX_DELAY ? 0 : ticks);
+
+    pthread_mutex_lock(&q->lock);
+    if (position == queueOVERWRITE) {
+        configASSERT(q->length == 1);
+        q->head = 0;
+        q->count = 0;
+    }
+    while (q->count == q->length) {
+        if (!wait_until(&q->not_full, &q->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&q->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    UBaseType_t slot;
+    if (position == queueSEND_TO_FRONT) {
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    } else {
+        slot = (q->head + q->count) % q->length;
+    }
+    memcpy(q->storage + slot * q->item_size, item, q->item_size);
+    q->count++;
+    if (!q->internal) {
+        sim_stats_add_copy_bytes(q->item_size);
+    }
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_take(QueueHandle_t q, void *buffer, TickType_t ticks, bool remove) {
+    struct timespec deadline;
+    deadline_from_ticks(&deadline, ticks == portMAX_DELAY ? 0 : ticks);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        if (!wait_until(&q->not_empty, &q->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+    memcpy(buffer, q->storage + q->head * q->item_size, q->item_size);
+    if (!q->internal) {
+        sim_stats_add_copy_bytes(q->item_size);
+    }
+    if (remove) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *buffer, TickType_t ticks) {
+    return queue_take(q, buffer, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *buffer, TickType_t ticks) {
+    return queue_take(q, buffer, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->length - q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+void sim_queue_mark_internal(QueueHandle_t q) {
+    q->internal = true;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    q->head = 0;
+    q->count = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+// — mutex —
+// Senza ereditarieta' di priorita': sull'host le priorita' non contano
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct sim_semaphore *m = calloc(1, sizeof(*m));
+    if (m == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    cond_init_monotonic(&m->released);
+    return m;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf) {
+    configASSERT(buf != NULL);
+    return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t ticks) {
+    struct timespec deadline;
+    deadline_from_ticks(&deadline, ticks);
+    pthread_mutex_lock(&m->lock);
+    while (m->taken) {
+        if (!wait_until(&m->released, &m->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&m->lock);
+            return pdFALSE;
+        }
+    }
+    m->taken = true;
+    pthread_mutex_unlock(&m->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+    pthread_mutex_lock(&m->lock);
+    bool was_taken = m->taken;
+    m->taken = false;
+    pthread_cond_signal(&m->released);
+    pthread_mutex_unlock(&m->lock);
+    return was_taken ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t m) {
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->released);
+    free(m);
+}
+
+// — event group —
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct sim_event_group *g = calloc(1, sizeof(*g));
+    if (g == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&g->lock, NULL);
+    cond_init_monotonic(&g->changed);
+    sim_mem_note_alloc(sizeof(*g));
+    return g;
+}
+
+void vEventGroupDelete(EventGroupHandle_t g) {
+    if (g == NULL) {
+        return;
+    }
+    sim_mem_note_free(sizeof(*g));
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->changed);
+    free(g);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits) {
+    pthread_mutex_lock(&g->lock);
+    g->bits |= bits;
+    EventBits_t now = g->bits;
+    pthread_cond_broadcast(&g->changed);
+    pthread_mutex_unlock(&g->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits) {
+    pthread_mutex_lock(&g->lock);
+    EventBits_t before = g->bits;
+    g->bits &= ~bits;
+    pthread_mutex_unlock(&g->lock);
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g) {
+    pthread_mutex_lock(&g->lock);
+    EventBits_t now = g->bits;
+    pthread_mutex_unlock(&g->lock);
+    return now;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t wait_for, BaseType_t clear_on_exit,
+                                BaseType_t wait_all, TickType_t ticks) {
+    struct timespec deadline;
+    deadline_from_ticks(&deadline, ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        EventBits_t hit = g->bits & wait_for;
+        if (wait_all ? hit == wait_for : hit != 0) {
+            break;
+        }
+        if (!wait_until(&g->changed, &g->lock, ticks, &deadline)) {
+            break;
+        }
+    }
+    // Come FreeRTOS: ritorna i bit al momento dell'uscita, prima dell'eventuale clear
+    EventBits_t now = g->bits;
+    EventBits_t hit = now & wait_for;
+    if (clear_on_exit && (wait_all ? hit == wait_for : hit != 0)) {
+        g->bits &= ~wait_for;
+    }
+    pthread_mutex_unlock(&g->lock);
+    return now;
+}
+
+// — task —
+
+static void *task_trampoline(void *arg) {
+    struct sim_task *t = arg;
+    s_current_task = t;
+    t->code(t->arg);
+    // Un task FreeRTOS non deve mai ritornare
+    configASSERT(!"task returned without vTaskDelete");
+    return NULL;
+}
+
+static struct sim_task *task_start(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, BaseType_t core, bool static_mem) {
+    struct sim_task *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->static_mem = static_mem;
+    t->code = code;
+    t->arg = arg;
+    t->priority = priority;
+    t->core = core;
+    t->stack_depth = stack_depth;
+    strncpy(t->name, name ? name : "", sizeof(t->name) - 1);
+
+    t->alive = true;
+
+    // registrato prima dell'avvio: il task puo' cercarsi subito per nome
+    pthread_mutex_lock(&s_tasks_lock);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&t->thread, &attr, task_trampoline, t);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        pthread_mutex_unlock(&s_tasks_lock);
+        free(t);
+        return NULL;
+    }
+    t->next = s_tasks;
+    s_tasks = t;
+    pthread_mutex_unlock(&s_tasks_lock);
+    return t;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+    configASSERT(core == tskNO_AFFINITY || (core >= 0 && core < portNUM_PROCESSORS));
+    // Lo stack si conta prima dell'avvio: il task puo' terminare subito
+    sim_mem_note_alloc(stack_depth);
+    struct sim_task *t = task_start(code, name, stack_depth, arg, priority, core, false);
+    if (t == NULL) {
+        sim_mem_note_free(stack_depth);
+        return pdFAIL;
+    }
+    if (created) {
+        *created = t;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *created) {
+    return xTaskCreatePinnedToCore(code, name, stack_depth, arg, priority, created, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                                           void *arg, UBaseType_t priority, StackType_t *stack,
+                                           StaticTask_t *tcb, BaseType_t core) {
+    configASSERT(stack != NULL && tcb != NULL);
+    configASSERT(core == tskNO_AFFINITY || (core >= 0 && core < portNUM_PROCESSORS));
+    return task_start(code, name, stack_depth, arg, priority, core, true);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                               void *arg, UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb) {
+    return xTaskCreateStaticPinnedToCore(code, name, stack_depth, arg, priority, stack, tcb,
+                                         tskNO_AFFINITY);
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task) {
+    struct sim_task *t = task ? task : s_current_task;
+    return t ? t->core : tskNO_AFFINITY;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    struct sim_task *t = task ? task : s_current_task;
+    return t ? t->priority : 0;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == s_current_task) {
+        // la struttura resta nel registro, il thread no
+        if (s_current_task) {
+            pthread_mutex_lock(&s_tasks_lock);
+            s_current_task->alive = false;
+            pthread_mutex_unlock(&s_tasks_lock);
+            if (!s_current_task->static_mem) {
+                sim_mem_note_free(s_current_task->stack_depth);
+            }
+        }
+        pthread_exit(NULL);
+    }
+    // La cancellazione di un altro task non serve al firmware
+    configASSERT(!"vTaskDelete on another task is not simulated");
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_sleep_us((int64_t)ticks * (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskYield(void) {
+    sched_yield();
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(sim_now_us() / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return s_current_task;
+}
+
+char *pcTaskGetName(TaskHandle_t task) {
+    struct sim_task *t = task ? task : s_current_task;
+    return t ? t->name : "main";
+}
+
+TaskHandle_t xTaskGetHandle(const char *name) {
+    pthread_mutex_lock(&s_tasks_lock);
+    struct sim_task *t = s_tasks;
+    while (t && !(t->alive && strncmp(t->name, name, sizeof(t->name) - 1) == 0)) {
+        t = t->next;
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    return t;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    struct sim_task *t = task ? task : s_current_task;
+    return t ? t->stack_depth : 0;
+}
+
+uint32_t ulTaskGetRunTimeCounter(TaskHandle_t task) {
+    struct sim_task *t = task ? task : s_current_task;
+    clockid_t clk;
+    struct timespec ts;
+    pthread_mutex_lock(&s_tasks_lock);
+    bool ok = t && t->alive && pthread_getcpuclockid(t->thread, &clk) == 0
+              && clock_gettime(clk, &ts) == 0;
+    pthread_mutex_unlock(&s_tasks_lock);
+    if (!ok) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u);
+}
@@ -0,0 +1,241 @@
+// host/sim/http_sim.c
+// esp_http_client su socket POSIX veri: GET HTTP/1.1 con header aggiuntivi,
+// intestazioni passate alla callback (HTTP_EVENT_ON_HEADER) e corpo letto a
+// pezzi. Basta un server HTTP locale (ota_bench ne avvia uno). Niente TLS,
+// redirect, chunked ne' keep-alive: ogni open e' una connessione nuova.
+#include "sim.h"
+#include "esp_http_client.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HTTP_SIM_URL_MAX        256
+#define HTTP_SIM_EXTRA_MAX      512
+#define HTTP_SIM_HEAD_MAX       4096
+// Finestra TCP di lwIP (CONFIG_LWIP_TCP_WND_DEFAULT): se il firmware smette
+// di leggere, il server si ferma dopo questi byte, come sul dispositivo
+#define HTTP_SIM_TCP_WND        5760
+
+struct esp_http_client {
+    esp_http_client_config_t cfg;
+    char host[128];
+    char port[8];
+    char path[HTTP_SIM_URL_MAX];
+    char extra[HTTP_SIM_EXTRA_MAX];     // header aggiunti, gia' "K: V\r\n"
+    int fd;
+    int status;
+    int64_t content_length;             // -1 se il server non la dichiara
+    int64_t received;
+    char head[HTTP_SIM_HEAD_MAX];
+    size_t pending_off;                 // corpo gia' letto insieme agli header
+    size_t pending_len;
+};
+
+static bool parse_url(esp_http_client_handle_t c, const char *url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        return false;
+    }
+    const char *host = url + 7;
+    const char *path = strchr(host, '/');
+    size_t host_len = path ? (size_t)(path - host) : strlen(host);
+    const char *colon = memchr(host, ':', host_len);
+    size_t name_len = colon ? (size_t)(colon - host) : host_len;
+    if (name_len == 0 || name_len >= sizeof(c->host)) {
+        return false;
+    }
+    memcpy(c->host, host, name_len);
+    c->host[name_len] = '\0';
+    if (colon) {
+        size_t port_len = host_len - name_len - 1;
+        if (port_len == 0 || port_len >= sizeof(c->port)) {
+            return false;
+        }
+        memcpy(c->port, colon + 1, port_len);
+        c->port[port_len] = '\0';
+    } else {
+        snprintf(c->port, sizeof(c->port), "80");
+    }
+    snprintf(c->path, sizeof(c->path), "%s", path ? path : "/");
+    return true;
+}
+
+static void emit(esp_http_client_handle_t c, esp_http_client_event_id_t id, char *key, char *value) {
+    if (c->cfg.event_handler == NULL) {
+        return;
+    }
+    esp_http_client_event_t evt = {
+        .event_id = id, .client = c, .user_data = c->cfg.user_data,
+        .header_key = key, .header_value = value,
+    };
+    c->cfg.event_handler(&evt);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    if (config == NULL || config->url == NULL) {
+        return NULL;
+    }
+    esp_http_client_handle_t c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    c->cfg = *config;
+    c->fd = -1;
+    c->content_length = -1;
+    if (!parse_url(c, config->url)) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    size_t used = strlen(client->extra);
+    int n = snprintf(client->extra + used, sizeof(client->extra) - used, "%s: %s\r\n", key, value);
+    return n > 0 && (size_t)n < sizeof(client->extra) - used ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(client->host, client->port, &hints, &res) != 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int ms = client->cfg.timeout_ms > 0 ? client->cfg.timeout_ms : 5000;
+        struct timeval tv = { .tv_sec = ms / 1000, .tv_usec = (ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int wnd = HTTP_SIM_TCP_WND;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &wnd, sizeof(wnd));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    client->fd = fd;
+    emit(client, HTTP_EVENT_ON_CONNECTED, NULL, NULL);
+
+    char req[HTTP_SIM_URL_MAX + HTTP_SIM_EXTRA_MAX + 256];
+    int n = snprintf(req, sizeof(req),
+                     "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n"
+                     "Connection: close\r\n%s\r\n",
+                     client->path, client->host, client->extra);
+    if (n <= 0 || (size_t)n >= sizeof(req) || send(fd, req, (size_t)n, MSG_NOSIGNAL) != n) {
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    emit(client, HTTP_EVENT_HEADERS_SENT, NULL, NULL);
+    return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    size_t len = 0;
+    char *end = NULL;
+    while (end == NULL) {
+        if (len == sizeof(client->head) - 1) {
+            return ESP_FAIL;
+        }
+        ssize_t n = recv(client->fd, client->head + len, sizeof(client->head) - 1 - len, 0);
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        len += (size_t)n;
+        client->head[len] = '\0';
+        end = strstr(client->head, "\r\n\r\n");
+    }
+    client->pending_off = (size_t)(end - client->head) + 4;
+    client->pending_len = len - client->pending_off;
+
+    *end = '\0';
+    char *save = NULL;
+    char *line = strtok_r(client->head, "\r\n", &save);
+    if (line == NULL || sscanf(line, "HTTP/%*d.%*d %d", &client->status) != 1) {
+        return ESP_FAIL;
+    }
+    while ((line = strtok_r(NULL, "\r\n", &save)) != NULL) {
+        char *colon = strchr(line, ':');
+        if (colon == NULL) {
+            continue;
+        }
+        *colon = '\0';
+        char *value = colon + 1;
+        while (isspace((unsigned char)*value)) {
+            value++;
+        }
+        if (strcasecmp(line, "Content-Length") == 0) {
+            client->content_length = strtoll(value, NULL, 10);
+        }
+        emit(client, HTTP_EVENT_ON_HEADER, line, value);
+    }
+    return client->content_length < 0 ? 0 : client->content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return client->content_length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+    if (client->content_length >= 0 && client->received >= client->content_length) {
+        return 0;
+    }
+    if (client->content_length >= 0 && client->content_length - client->received < len) {
+        len = (int)(client->content_length - client->received);
+    }
+    int n;
+    if (client->pending_len > 0) {
+        n = (size_t)len < client->pending_len ? len : (int)client->pending_len;
+        // head[] e' stato spezzato da strtok solo prima del corpo
+        memcpy(buffer, client->head + client->pending_off, (size_t)n);
+        client->pending_off += (size_t)n;
+        client->pending_len -= (size_t)n;
+    } else {
+        ssize_t got = recv(client->fd, buffer, (size_t)len, 0);
+        if (got < 0) {
+            emit(client, HTTP_EVENT_ERROR, NULL, NULL);
+            return ESP_FAIL;
+        }
+        n = (int)got;
+    }
+    client->received += n;
+    return n;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+    return client->content_length >= 0 && client->received >= client->content_length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        emit(client, HTTP_EVENT_DISCONNECTED, NULL, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,274 @@
+// host/sim/nvs_sim.c
+// NVS simulato: coppie namespace/chiave -> blob in memoria. Con
+// sim_nvs_set_file() il contenuto viene caricato da un file e riscritto a
+// ogni nvs_commit(), cosi' un processo successivo "riavvia" con la stessa
+// flash.
+#include "sim.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_NVS_MAX_ENTRIES  32
+#define SIM_NVS_MAX_HANDLES  8
+#define SIM_NVS_NAME_LEN     16     // 15 caratteri + terminatore, come l'IDF
+#define SIM_NVS_MAX_BLOB     1984
+
+// Costi modellati (ordine di grandezza su ESP32, non misure)
+#define SIM_NVS_INIT_US      (15 * 1000)    // montaggio della partizione
+#define SIM_NVS_WRITE_US     (4 * 1000)     // scrittura di un blob in flash
+
+typedef struct {
+    char ns[SIM_NVS_NAME_LEN];
+    char key[SIM_NVS_NAME_LEN];
+    uint8_t *data;
+    size_t len;
+} nvs_entry_t;
+
+typedef struct {
+    char ns[SIM_NVS_NAME_LEN];
+    nvs_open_mode_t mode;
+    bool used;
+} nvs_open_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t s_entries[SIM_NVS_MAX_ENTRIES];
+static nvs_open_t s_handles[SIM_NVS_MAX_HANDLES];
+static bool s_mounted;
+static char s_file[256];
+
+static bool valid_name(const char *name) {
+    return name && name[0] && strlen(name) < SIM_NVS_NAME_LEN;
+}
+
+static nvs_entry_t *find_locked(const char *ns, const char *key) {
+    for (size_t i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        nvs_entry_t *e = &s_entries[i];
+        if (e->data && strcmp(e->ns, ns) == 0 && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void clear_locked(void) {
+    for (size_t i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        free(s_entries[i].data);
+        memset(&s_entries[i], 0, sizeof(s_entries[i]));
+    }
+}
+
+// Formato del file: per ogni voce [ns 16][key 16][len u32][dati]
+static void save_locked(void) {
+    if (s_file[0] == '\0') {
+        return;
+    }
+    FILE *f = fopen(s_file, "wb");
+    if (f == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        const nvs_entry_t *e = &s_entries[i];
+        if (e->data == NULL) {
+            continue;
+        }
+        uint32_t len = (uint32_t)e->len;
+        fwrite(e->ns, 1, SIM_NVS_NAME_LEN, f);
+        fwrite(e->key, 1, SIM_NVS_NAME_LEN, f);
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(e->data, 1, e->len, f);
+    }
+    fclose(f);
+}
+
+static void load_locked(void) {
+    clear_locked();
+    FILE *f = fopen(s_file, "rb");
+    if (f == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        nvs_entry_t *e = &s_entries[i];
+        uint32_t len;
+        if (fread(e->ns, 1, SIM_NVS_NAME_LEN, f) != SIM_NVS_NAME_LEN ||
+            fread(e->key, 1, SIM_NVS_NAME_LEN, f) != SIM_NVS_NAME_LEN ||
+            fread(&len, sizeof(len), 1, f) != 1 || len == 0 || len > SIM_NVS_MAX_BLOB) {
+            memset(e, 0, sizeof(*e));
+            break;
+        }
+        e->ns[SIM_NVS_NAME_LEN - 1] = '\0';
+        e->key[SIM_NVS_NAME_LEN - 1] = '\0';
+        e->data = malloc(len);
+        e->len = len;
+        if (e->data == NULL || fread(e->data, 1, len, f) != len) {
+            free(e->data);
+            memset(e, 0, sizeof(*e));
+            break;
+        }
+    }
+    fclose(f);
+}
+
+void sim_nvs_set_file(const char *path) {
+    pthread_mutex_lock(&s_lock);
+    snprintf(s_file, sizeof(s_file), "%s", path ? path : "");
+    if (s_file[0]) {
+        load_locked();
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+// — API nvs_flash / nvs —
+
+esp_err_t nvs_flash_init(void) {
+    sim_sleep_us(SIM_NVS_INIT_US);
+    pthread_mutex_lock(&s_lock);
+    s_mounted = true;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&s_lock);
+    clear_locked();
+    save_locked();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!valid_name(namespace_name) || out_handle == NULL) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (!s_mounted) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    for (size_t i = 0; i < SIM_NVS_MAX_HANDLES; i++) {
+        if (!s_handles[i].used) {
+            snprintf(s_handles[i].ns, sizeof(s_handles[i].ns), "%s", namespace_name);
+            s_handles[i].mode = open_mode;
+            s_handles[i].used = true;
+            *out_handle = (nvs_handle_t)(i + 1);
+            pthread_mutex_unlock(&s_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+static nvs_open_t *handle_locked(nvs_handle_t handle) {
+    if (handle == 0 || handle > SIM_NVS_MAX_HANDLES || !s_handles[handle - 1].used) {
+        return NULL;
+    }
+    return &s_handles[handle - 1];
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_lock);
+    nvs_open_t *h = handle_locked(handle);
+    if (h) {
+        h->used = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    if (!valid_name(key) || length == NULL) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_lock);
+    nvs_open_t *h = handle_locked(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t *e = find_locked(h->ns, key);
+    esp_err_t err = ESP_OK;
+    if (e == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = e->len;
+    } else if (*length < e->len) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, e->data, e->len);
+        *length = e->len;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (!valid_name(key)) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (length == 0 || length > SIM_NVS_MAX_BLOB) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    pthread_mutex_lock(&s_lock);
+    nvs_open_t *h = handle_locked(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (h->mode != NVS_READWRITE) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    nvs_entry_t *e = find_locked(h->ns, key);
+    if (e == NULL) {
+        for (size_t i = 0; i < SIM_NVS_MAX_ENTRIES && e == NULL; i++) {
+            if (s_entries[i].data == NULL) {
+                e = &s_entries[i];
+            }
+        }
+    }
+    uint8_t *data = e ? malloc(length) : NULL;
+    if (data == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    memcpy(data, value, length);
+    free(e->data);
+    snprintf(e->ns, sizeof(e->ns), "%s", h->ns);
+    snprintf(e->key, sizeof(e->key), "%s", key);
+    e->data = data;
+    e->len = length;
+    pthread_mutex_unlock(&s_lock);
+    sim_sleep_us(SIM_NVS_WRITE_US);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&s_lock);
+    nvs_open_t *h = handle_locked(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t *e = find_locked(h->ns, key);
+    if (e == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(e->data);
+    memset(e, 0, sizeof(*e));
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = handle_locked(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    if (err == ESP_OK) {
+        save_locked();
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
@@ -0,0 +1,561 @@
+// host/sim/ota_sim.c
+// Flash SPI e bootloader simulati per ota_update e journal: le partizioni
+// otadata, ota_0, ota_1 e spiffs di partitions_ota.csv stanno in un file
+// agli stessi indirizzi, cosi' un processo successivo "riavvia" con la stessa flash
+// (come sim_nvs_set_file per l'NVS). Senza file se ne usa uno temporaneo.
+//
+// La scrittura e' NOR: puo' solo portare bit da 1 a 0, quindi un settore va
+// cancellato prima; una scrittura che vorrebbe rialzare un bit si conta in
+// dirty_writes (sul chip corromperebbe l'immagine in silenzio). Cancellazione
+// e programmazione costano il tempo modellato, nel task che le chiede.
+// sim_flash_power_cut toglie la corrente a meta' di una scrittura.
+//
+// Il bootloader gira all'apertura della flash: un'immagine NEW diventa
+// PENDING_VERIFY, una ancora PENDING_VERIFY al riavvio successivo (il
+// firmware non l'ha confermata) si scarta e si torna all'altro slot, come
+// con CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE. otadata non ha il formato
+// dell'IDF (due settori con numero di sequenza e CRC): qui basta un record.
+//
+// Verifica delle immagini: intestazione, segmenti e checksum sono quelli
+// dell'IDF; al posto dello SHA-256 in coda c'e' un CRC32 nei primi 4 byte
+// dei 32 (sim_ota_build_image scrive immagini in questo formato).
+#include "sim.h"
+#include "esp_app_desc.h"
+#include "esp_app_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_OTADATA_MAGIC       0x4F544131u     // "OTA1"
+#define SIM_PAGE_LEN            256
+#define SIM_FLASH_SECTORS       (0x400000 / SPI_FLASH_SEC_SIZE)
+
+// Costi modellati: cancellazione di un settore e programmazione di una
+// pagina su una flash SPI da 4 MB tipica delle schede ESP32 (valori tipici
+// da datasheet, non misure)
+#define SIM_FLASH_ERASE_US      45000
+#define SIM_FLASH_PAGE_US       600
+
+#define SIM_IMAGE_CHECKSUM_SEED 0xEF
+#define SIM_IMAGE_HASH_LEN      32
+
+typedef enum {
+    PART_OTADATA,
+    PART_OTA_0,
+    PART_OTA_1,
+    PART_SPIFFS,
+    PART_COUNT
+} sim_part_t;
+
+static const esp_partition_t s_parts[PART_COUNT] = {
+    [PART_OTADATA] = { NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA,
+                       0xF000, 0x2000, SPI_FLASH_SEC_SIZE, "otadata", false, false },
+    [PART_OTA_0]   = { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0,
+                       0x20000, 0x1E0000, SPI_FLASH_SEC_SIZE, "ota_0", false, false },
+    [PART_OTA_1]   = { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1,
+                       0x200000, 0x1E0000, SPI_FLASH_SEC_SIZE, "ota_1", false, false },
+    [PART_SPIFFS]  = { NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+                       0x3E0000, 0x20000, SPI_FLASH_SEC_SIZE, "spiffs", false, false },
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_slot;         // 0 = ota_0
+    uint32_t state[2];          // esp_ota_img_states_t per slot
+} sim_otadata_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *s_flash;
+static sim_otadata_t s_otadata;
+static int s_running;
+static sim_flash_timing_t s_timing = { SIM_FLASH_ERASE_US, SIM_FLASH_PAGE_US };
+static sim_flash_stats_t s_stats;
+static uint32_t s_sector_erases[SIM_FLASH_SECTORS];
+static uint32_t s_cut_left;         // byte da scrivere prima dello spegnimento, 0 mai
+static esp_app_desc_t s_desc;
+
+static atomic_bool s_restarted;
+static esp_reset_reason_t s_reset_reason = ESP_RST_POWERON;
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// — accesso al file —
+
+static void raw_read_locked(uint32_t addr, void *dst, size_t len) {
+    memset(dst, 0xFF, len);
+    if (fseek(s_flash, addr, SEEK_SET) == 0) {
+        // oltre la fine del file la flash e' ancora cancellata
+        (void)fread(dst, 1, len, s_flash);
+    }
+}
+
+static void raw_write_locked(uint32_t addr, const void *src, size_t len) {
+    if (fseek(s_flash, addr, SEEK_SET) == 0) {
+        fwrite(src, 1, len, s_flash);
+        fflush(s_flash);
+    }
+}
+
+static void otadata_save_locked(void) {
+    raw_write_locked(s_parts[PART_OTADATA].address, &s_otadata, sizeof(s_otadata));
+}
+
+static int slot_of(const esp_partition_t *p) {
+    if (p == &s_parts[PART_OTA_0] || (p && p->address == s_parts[PART_OTA_0].address)) {
+        return 0;
+    }
+    if (p == &s_parts[PART_OTA_1] || (p && p->address == s_parts[PART_OTA_1].address)) {
+        return 1;
+    }
+    return -1;
+}
+
+static const esp_partition_t *slot_part(int slot) {
+    return &s_parts[PART_OTA_0 + slot];
+}
+
+// Percorre l'immagine nello slot: ESP_OK se intestazione, segmenti,
+// checksum e CRC tornano; *desc riceve la descrizione dell'app
+static esp_err_t image_verify_locked(int slot, esp_app_desc_t *desc) {
+    const esp_partition_t *part = slot_part(slot);
+    esp_image_header_t hdr;
+    raw_read_locked(part->address, &hdr, sizeof(hdr));
+    if (hdr.magic != ESP_IMAGE_HEADER_MAGIC || hdr.segment_count == 0 ||
+        hdr.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    uint32_t crc = crc32_update(0, (const uint8_t *)&hdr, sizeof(hdr));
+    uint8_t checksum = SIM_IMAGE_CHECKSUM_SEED;
+    uint32_t pos = sizeof(hdr);
+    static uint8_t buf[4096];
+    for (int s = 0; s < hdr.segment_count; s++) {
+        esp_image_segment_header_t seg;
+        if (pos + sizeof(seg) > part->size) {
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        raw_read_locked(part->address + pos, &seg, sizeof(seg));
+        crc = crc32_update(crc, (const uint8_t *)&seg, sizeof(seg));
+        pos += sizeof(seg);
+        if (seg.data_len % 4 != 0 || seg.data_len > part->size - pos) {
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (s == 0) {
+            if (seg.data_len < sizeof(*desc)) {
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+            raw_read_locked(part->address + pos, desc, sizeof(*desc));
+        }
+        for (uint32_t done = 0; done < seg.data_len;) {
+            uint32_t n = seg.data_len - done < sizeof(buf) ? seg.data_len - done : sizeof(buf);
+            raw_read_locked(part->address + pos + done, buf, n);
+            crc = crc32_update(crc, buf, n);
+            for (uint32_t i = 0; i < n; i++) {
+                checksum ^= buf[i];
+            }
+            done += n;
+        }
+        pos += seg.data_len;
+    }
+    // padding fino all'ultimo byte di un blocco da 16, che e' il checksum
+    uint32_t tail = 16 - pos % 16;
+    if (pos + tail + SIM_IMAGE_HASH_LEN > part->size) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    raw_read_locked(part->address + pos, buf, tail);
+    crc = crc32_update(crc, buf, tail);
+    if (buf[tail - 1] != checksum) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    pos += tail;
+    if (hdr.hash_appended) {
+        uint32_t stored;
+        raw_read_locked(part->address + pos, &stored, sizeof(stored));
+        if (stored != crc) {
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+    }
+    if (desc->magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    return ESP_OK;
+}
+
+// Accensione: decide lo slot come il bootloader e legge la versione
+static void bootloader_locked(void) {
+    raw_read_locked(s_parts[PART_OTADATA].address, &s_otadata, sizeof(s_otadata));
+    if (s_otadata.magic != SIM_OTADATA_MAGIC || s_otadata.boot_slot > 1) {
+        // flash appena scritta via USB: si parte da ota_0
+        s_otadata.magic = SIM_OTADATA_MAGIC;
+        s_otadata.boot_slot = 0;
+        s_otadata.state[0] = s_otadata.state[1] = ESP_OTA_IMG_UNDEFINED;
+        otadata_save_locked();
+    }
+    int slot = (int)s_otadata.boot_slot;
+    if (s_otadata.state[slot] == ESP_OTA_IMG_NEW) {
+        s_otadata.state[slot] = ESP_OTA_IMG_PENDING_VERIFY;
+        otadata_save_locked();
+    } else if (s_otadata.state[slot] == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGW("sim", "bootloader: immagine non confermata in ota_%d, rollback", slot);
+        s_otadata.state[slot] = ESP_OTA_IMG_ABORTED;
+        slot ^= 1;
+        s_otadata.boot_slot = (uint32_t)slot;
+        otadata_save_locked();
+    }
+    s_running = slot;
+
+    memset(&s_desc, 0, sizeof(s_desc));
+    esp_app_desc_t desc;
+    if (image_verify_locked(slot, &desc) == ESP_OK) {
+        s_desc = desc;
+    } else {
+        // l'immagine scritta via USB non e' nel file
+        s_desc.magic_word = ESP_APP_DESC_MAGIC_WORD;
+        snprintf(s_desc.version, sizeof(s_desc.version), "%s", "factory");
+        snprintf(s_desc.project_name, sizeof(s_desc.project_name), "%s", SIM_PROJECT_NAME);
+    }
+}
+
+static void flash_open_locked(const char *path) {
+    if (s_flash != NULL) {
+        fclose(s_flash);
+    }
+    if (path != NULL) {
+        s_flash = fopen(path, "r+b");
+        if (s_flash == NULL) {
+            s_flash = fopen(path, "w+b");
+        }
+    } else {
+        s_flash = tmpfile();
+    }
+    if (s_flash == NULL) {
+        perror("sim flash");
+        abort();
+    }
+    bootloader_locked();
+}
+
+static void ensure_open_locked(void) {
+    if (s_flash == NULL) {
+        flash_open_locked(NULL);
+    }
+}
+
+void sim_flash_set_file(const char *path) {
+    pthread_mutex_lock(&s_lock);
+    flash_open_locked(path);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_flash_set_timing(const sim_flash_timing_t *timing) {
+    pthread_mutex_lock(&s_lock);
+    s_timing = *timing;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_flash_get_timing(sim_flash_timing_t *timing) {
+    pthread_mutex_lock(&s_lock);
+    *timing = s_timing;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_flash_get_stats(sim_flash_stats_t *stats) {
+    pthread_mutex_lock(&s_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+uint32_t sim_flash_sector_erases(uint32_t addr) {
+    pthread_mutex_lock(&s_lock);
+    uint32_t n = addr / SPI_FLASH_SEC_SIZE < SIM_FLASH_SECTORS ? s_sector_erases[addr / SPI_FLASH_SEC_SIZE] : 0;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+void sim_flash_power_cut(uint32_t bytes) {
+    pthread_mutex_lock(&s_lock);
+    s_cut_left = bytes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+int sim_ota_running_slot(void) {
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    int slot = s_running;
+    pthread_mutex_unlock(&s_lock);
+    return slot;
+}
+
+// — esp_partition —
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char *label) {
+    for (int i = 0; i < PART_COUNT; i++) {
+        const esp_partition_t *p = &s_parts[i];
+        if (p->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype)
+            && (label == NULL || strcmp(p->label, label) == 0)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static bool part_range_ok(const esp_partition_t *p, size_t offset, size_t size) {
+    return p != NULL && offset <= p->size && size <= p->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset,
+                             void *dst, size_t size) {
+    if (!part_range_ok(partition, src_offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    raw_read_locked(partition->address + src_offset, dst, size);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (!part_range_ok(partition, offset, size) || offset % SPI_FLASH_SEC_SIZE != 0 ||
+        size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    static const uint8_t blank[SPI_FLASH_SEC_SIZE] = { [0 ... SPI_FLASH_SEC_SIZE - 1] = 0xFF };
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    for (size_t done = 0; done < size; done += SPI_FLASH_SEC_SIZE) {
+        uint32_t addr = partition->address + (uint32_t)(offset + done);
+        raw_write_locked(addr, blank, sizeof(blank));
+        s_sector_erases[addr / SPI_FLASH_SEC_SIZE]++;
+    }
+    uint32_t sectors = (uint32_t)(size / SPI_FLASH_SEC_SIZE);
+    int64_t cost = (int64_t)sectors * s_timing.erase_us;
+    s_stats.erases += sectors;
+    s_stats.busy_us += cost;
+    pthread_mutex_unlock(&s_lock);
+    sim_sleep_us(cost);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset,
+                              const void *src, size_t size) {
+    if (!part_range_ok(partition, dst_offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t cur[SIM_PAGE_LEN];
+    const uint8_t *in = src;
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    uint32_t addr = partition->address + (uint32_t)dst_offset;
+    uint32_t pages = 0;
+    for (size_t done = 0; done < size;) {
+        // a pagine, come il comando Page Program della flash
+        size_t n = SIM_PAGE_LEN - (addr + done) % SIM_PAGE_LEN;
+        if (n > size - done) {
+            n = size - done;
+        }
+        bool cut = s_cut_left != 0 && n >= s_cut_left;
+        if (cut) {
+            n = s_cut_left;
+        }
+        raw_read_locked(addr + done, cur, n);
+        bool dirty = false;
+        for (size_t i = 0; i < n; i++) {
+            dirty |= (in[done + i] & ~cur[i]) != 0;
+            cur[i] &= in[done + i];
+        }
+        s_stats.dirty_writes += dirty;
+        raw_write_locked(addr + done, cur, n);
+        if (cut) {
+            // raw_write_locked ha gia' svuotato il buffer del file
+            _exit(SIM_POWER_CUT_EXIT);
+        }
+        s_cut_left -= s_cut_left != 0 ? (uint32_t)n : 0;
+        done += n;
+        pages++;
+    }
+    int64_t cost = (int64_t)pages * s_timing.page_us;
+    s_stats.written += size;
+    s_stats.busy_us += cost;
+    pthread_mutex_unlock(&s_lock);
+    sim_sleep_us(cost);
+    return ESP_OK;
+}
+
+// — esp_ota_ops —
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return slot_part(sim_ota_running_slot());
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void) {
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    const esp_partition_t *p = slot_part((int)s_otadata.boot_slot);
+    pthread_mutex_unlock(&s_lock);
+    return p;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    int slot = start_from ? slot_of(start_from) : sim_ota_running_slot();
+    return slot < 0 ? NULL : slot_part(slot ^ 1);
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state) {
+    int slot = slot_of(partition);
+    if (slot < 0 || ota_state == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    *ota_state = (esp_ota_img_states_t)s_otadata.state[slot];
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    int slot = slot_of(partition);
+    if (slot < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    esp_app_desc_t desc;
+    esp_err_t err = image_verify_locked(slot, &desc);
+    if (err == ESP_OK) {
+        s_otadata.boot_slot = (uint32_t)slot;
+        s_otadata.state[slot] = ESP_OTA_IMG_NEW;
+        otadata_save_locked();
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    s_otadata.state[s_running] = ESP_OTA_IMG_VALID;
+    otadata_save_locked();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void) {
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    if (s_otadata.state[s_running ^ 1] == ESP_OTA_IMG_UNDEFINED &&
+        image_verify_locked(s_running ^ 1, &(esp_app_desc_t){ 0 }) != ESP_OK) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_OTA_ROLLBACK_FAILED;
+    }
+    s_otadata.state[s_running] = ESP_OTA_IMG_INVALID;
+    s_otadata.boot_slot = (uint32_t)(s_running ^ 1);
+    otadata_save_locked();
+    pthread_mutex_unlock(&s_lock);
+    esp_restart();
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    pthread_mutex_lock(&s_lock);
+    ensure_open_locked();
+    pthread_mutex_unlock(&s_lock);
+    return &s_desc;
+}
+
+// — riavvio —
+
+void esp_restart(void) {
+    atomic_store(&s_restarted, true);
+    // Il chip e' gia' in reset: il task non torna mai
+    while (1) {
+        pause();
+    }
+}
+
+void sim_set_reset_reason(esp_reset_reason_t reason) {
+    s_reset_reason = reason;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return s_reset_reason;
+}
+
+bool sim_restart_wait(uint32_t timeout_ms) {
+    int64_t deadline = sim_now_us() + (int64_t)timeout_ms * 1000;
+    while (!atomic_load(&s_restarted) && sim_now_us() < deadline) {
+        sim_sleep_us(2000);
+    }
+    return atomic_load(&s_restarted);
+}
+
+// — immagini per i banchi di prova —
+
+size_t sim_ota_build_image(uint8_t *buf, size_t len, const char *project, const char *version,
+                           uint32_t seed) {
+    const size_t fixed = sizeof(esp_image_header_t) + 2 * sizeof(esp_image_segment_header_t) +
+                         sizeof(esp_app_desc_t) + 16 + SIM_IMAGE_HASH_LEN;
+    if (len < fixed + 4) {
+        return 0;
+    }
+    uint32_t seg1_len = (uint32_t)((len - fixed) & ~3u);
+    uint8_t *p = buf;
+
+    esp_image_header_t hdr = { .magic = ESP_IMAGE_HEADER_MAGIC, .segment_count = 2,
+                               .entry_addr = 0x40080000, .hash_appended = 1 };
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+
+    esp_image_segment_header_t seg = { 0x3F400020, sizeof(esp_app_desc_t) };
+    memcpy(p, &seg, sizeof(seg));
+    p += sizeof(seg);
+    esp_app_desc_t desc = { .magic_word = ESP_APP_DESC_MAGIC_WORD };
+    snprintf(desc.version, sizeof(desc.version), "%s", version);
+    snprintf(desc.project_name, sizeof(desc.project_name), "%s", project);
+    memcpy(p, &desc, sizeof(desc));
+    p += sizeof(desc);
+
+    seg = (esp_image_segment_header_t){ 0x400D0020, seg1_len };
+    memcpy(p, &seg, sizeof(seg));
+    p += sizeof(seg);
+    uint32_t x = seed ? seed : 1;
+    for (uint32_t i = 0; i < seg1_len; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *p++ = (uint8_t)x;
+    }
+
+    uint8_t checksum = SIM_IMAGE_CHECKSUM_SEED;
+    for (size_t i = 0; i < sizeof(desc); i++) {
+        checksum ^= ((const uint8_t *)&desc)[i];
+    }
+    for (const uint8_t *q = p - seg1_len; q < p; q++) {
+        checksum ^= *q;
+    }
+    size_t tail = 16 - (size_t)(p - buf) % 16;
+    memset(p, 0, tail);
+    p[tail - 1] = checksum;
+    p += tail;
+    uint32_t crc = crc32_update(0, buf, (size_t)(p - buf));
+    memset(p, 0, SIM_IMAGE_HASH_LEN);
+    memcpy(p, &crc, sizeof(crc));
+    p += SIM_IMAGE_HASH_LEN;
+    return (size_t)(p - buf);
+}
@@ -0,0 +1,185 @@
+// host/sim/sim.h
+// API di controllo del simulatore host: il banco di prova la usa per
+// pilotare la radio Wi-Fi finta e per fare da "telefono" (central BLE)
+// verso i veri handler del firmware.
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_wifi.h"
+#include "esp_gatt_defs.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// — tempo —
+int64_t sim_now_us(void);
+void sim_sleep_us(int64_t us);
+
+// — contabilita' (memoria e byte copiati dalle code) —
+void sim_mem_note_alloc(size_t bytes);
+void sim_mem_note_free(size_t bytes);
+size_t sim_mem_current(void);
+size_t sim_mem_peak(void);
+void sim_stats_add_copy_bytes(size_t bytes);
+uint64_t sim_stats_copy_bytes(void);
+// Esclude una coda interna del simulatore dal conteggio dei byte copiati
+void sim_queue_mark_internal(QueueHandle_t q);
+
+// — NVS —
+// Carica l'NVS simulato da 'path' e lo riscrive a ogni nvs_commit():
+// un processo successivo con lo stesso file "riavvia" con la stessa flash
+void sim_nvs_set_file(const char *path);
+
+// — flash e OTA (ota_sim.c) —
+// Nome del progetto nelle immagini simulate, come in esp_app_desc_t
+#define SIM_PROJECT_NAME "Piccioncini_PT2"
+
+// Flash da 'path' (creato se manca): le partizioni OTA e il diario
+// sopravvivono ai "riavvii" fra processi. L'apertura esegue il bootloader simulato: va
+// chiamata prima di avviare il firmware.
+void sim_flash_set_file(const char *path);
+
+typedef struct {
+    uint32_t erase_us;          // cancellazione di un settore da 4 KB
+    uint32_t page_us;           // programmazione di una pagina da 256 byte
+} sim_flash_timing_t;
+
+typedef struct {
+    uint32_t erases;            // settori cancellati
+    uint64_t written;           // byte programmati
+    uint32_t dirty_writes;      // pagine scritte senza cancellare: dati corrotti
+    int64_t busy_us;            // tempo modellato di cancellazione e scrittura
+} sim_flash_stats_t;
+
+void sim_flash_set_timing(const sim_flash_timing_t *timing);
+void sim_flash_get_timing(sim_flash_timing_t *timing);
+void sim_flash_get_stats(sim_flash_stats_t *stats);
+// Cancellazioni, in questo processo, del settore che contiene 'addr'
+// (indirizzo assoluto nella flash)
+uint32_t sim_flash_sector_erases(uint32_t addr);
+// Corrente tolta durante una programmazione: dopo altri 'bytes' byte
+// scritti la scrittura in corso si ferma a meta' (il resto della pagina
+// resta com'era) e il processo esce con SIM_POWER_CUT_EXIT. 0 disarma. Le
+// cancellazioni interrotte non si simulano.
+#define SIM_POWER_CUT_EXIT 86
+void sim_flash_power_cut(uint32_t bytes);
+// Slot scelto dal bootloader simulato (0 = ota_0)
+int sim_ota_running_slot(void);
+// Scrive in buf un'immagine verificabile di circa len byte (dati casuali da
+// seed); ritorna la lunghezza esatta, 0 se len e' troppo piccolo
+size_t sim_ota_build_image(uint8_t *buf, size_t len, const char *project, const char *version,
+                           uint32_t seed);
+// Causa dell'avvio vista da esp_reset_reason() (il banco la sceglie per
+// ogni processo figlio: ESP_RST_SW dopo esp_restart, ESP_RST_PANIC ...)
+void sim_set_reset_reason(esp_reset_reason_t reason);
+// Attende che il firmware chiami esp_restart(); il task chiamante resta
+// fermo per sempre, il banco chiude il processo
+bool sim_restart_wait(uint32_t timeout_ms);
+
+// — radio Wi-Fi —
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+    bool enabled;
+} sim_ap_t;
+
+typedef struct {
+    uint32_t active_dwell_ms;   // usato se scan_time.active.max == 0
+    uint32_t passive_dwell_ms;  // usato se scan_time.passive == 0
+    uint32_t home_dwell_ms;     // ritorno sul canale dell'AP quando connessi
+    uint32_t assoc_ms;          // auth + assoc + 4-way handshake
+    uint32_t dhcp_ms;           // STA_CONNECTED -> IP_EVENT_STA_GOT_IP
+} sim_wifi_timing_t;
+
+typedef struct {
+    uint32_t scans;
+    uint64_t scan_radio_us;     // tempo radio totale speso in scansione
+    uint32_t connects;
+    uint32_t scan_rejected;     // esp_wifi_scan_start rifiutati (radio occupata)
+    uint32_t got_ip;            // IP_EVENT_STA_GOT_IP pubblicati
+    int64_t last_got_ip_us;     // istante dell'ultimo GOT_IP (sim_now_us)
+    int64_t coex_max_blackout_us;   // tratto piu' lungo senza radio per il BLE
+} sim_wifi_stats_t;
+
+void sim_wifi_clear_aps(void);
+int  sim_wifi_add_ap(const sim_ap_t *ap);
+// Genera 'count' AP su canali 1..13; con ssid_groups < count piu' BSSID
+// condividono lo stesso SSID (mesh / reti enterprise)
+void sim_wifi_generate_aps(unsigned count, unsigned ssid_groups, uint32_t seed);
+void sim_wifi_set_ap_enabled(const char *ssid, bool enabled);
+// Il telefono si allontana o si avvicina: vale per scansioni e link in corso
+void sim_wifi_set_ap_rssi(const char *ssid, int8_t rssi);
+void sim_wifi_set_timing(const sim_wifi_timing_t *timing);
+void sim_wifi_get_timing(sim_wifi_timing_t *timing);
+void sim_wifi_get_stats(sim_wifi_stats_t *stats);
+// Interrompe il link corrente come farebbe un AP che sparisce
+void sim_wifi_drop_link(uint8_t reason);
+bool sim_wifi_is_scanning(void);
+// Coesistenza: primo istante >= t in cui la scansione lascia la radio al
+// BLE (t stesso se non c'e' nessuna scansione in quel momento)
+int64_t sim_wifi_coex_free_at(int64_t t);
+
+// — central BLE —
+typedef void (*sim_ble_notify_cb_t)(uint16_t conn_id, uint16_t handle,
+                                    const uint8_t *data, uint16_t len,
+                                    int64_t delivered_us, void *ctx);
+
+typedef struct {
+    uint32_t conn_interval_us;  // intervallo di connessione
+    uint8_t  pkts_per_event;    // pacchetti LL per evento di connessione
+    uint16_t ll_payload;        // 27 senza DLE, 251 con DLE
+    uint16_t latency;           // slave latency: eventi che la periferica salta da ferma
+    uint16_t timeout_ms;        // supervision timeout
+    uint32_t updates;           // aggiornamenti dei parametri accettati
+} sim_ble_link_t;
+
+void sim_ble_set_notify_cb(sim_ble_notify_cb_t cb, void *ctx);
+bool sim_ble_wait_advertising(uint32_t timeout_ms);
+int64_t sim_ble_advertising_since_us(void);
+uint32_t sim_ble_adv_config_count(void);
+uint16_t sim_ble_connect(void);
+void sim_ble_disconnect(uint16_t conn_id);
+void sim_ble_exchange_mtu(uint16_t conn_id, uint16_t mtu);
+void sim_ble_get_link(uint16_t conn_id, sim_ble_link_t *link);
+void sim_ble_set_link(uint16_t conn_id, const sim_ble_link_t *link);
+// Handle del valore della caratteristica con UUID a 16 bit (0 se assente)
+uint16_t sim_ble_find_char(uint16_t uuid16);
+// Handle del CCCD associato alla caratteristica (0 se assente)
+uint16_t sim_ble_find_cccd(uint16_t uuid16);
+// Write request: attende la risposta ATT (dall'app o automatica)
+esp_gatt_status_t sim_ble_write(uint16_t conn_id, uint16_t handle,
+                                const void *data, uint16_t len);
+// Write command (senza risposta)
+void sim_ble_write_nr(uint16_t conn_id, uint16_t handle, const void *data, uint16_t len);
+// Write command gia' accodati tutti insieme dal telefono: partono uno dietro
+// l'altro negli stessi eventi di connessione (al massimo 64)
+typedef struct {
+    uint16_t handle;
+    const void *data;
+    uint16_t len;
+} sim_ble_write_t;
+void sim_ble_write_nr_many(uint16_t conn_id, const sim_ble_write_t *writes, size_t count);
+// Read: ritorna i byte letti oppure -1 con *status valorizzato
+int sim_ble_read(uint16_t conn_id, uint16_t handle, uint8_t *buf, uint16_t max_len,
+                 esp_gatt_status_t *status);
+// Read lunga: read seguita da read blob finche' la risposta non e' corta
+int sim_ble_read_long(uint16_t conn_id, uint16_t handle, uint8_t *buf, uint16_t max_len,
+                      esp_gatt_status_t *status);
+uint32_t sim_ble_notifications_truncated(void);
+// Dalla radio Wi-Fi: il BLE e' senza radio da blackout_us di fila. Le
+// connessioni con supervision timeout piu' corto cadono (reason 0x08).
+void sim_ble_coex_blackout(int64_t blackout_us);
+// Eventi di connessione saltati per la scansione e link caduti per timeout
+void sim_ble_coex_stats(uint32_t *deferred, uint32_t *lost);
+// Durata massima di una callback GATT/GAP dell'app sul thread BTC: se
+// cresce, lo stack e' rimasto fermo dietro il firmware
+int64_t sim_ble_callback_max_us(bool reset);
+
+#endif // SIM_H
@@ -0,0 +1,691 @@
+// host/sim/wifi_sim.c
+// Driver Wi-Fi simulato: un insieme di AP finti su canali 1..13, scansione
+// canale per canale con tempi di dwell realistici, connessione con
+// auth/assoc/DHCP temporizzati. Gli eventi passano dal loop di default,
+// come nel driver vero.
+//
+// Coesistenza (modello pessimista): mentre la radio e' su un canale in
+// scansione il BLE non trasmette. Il tempo sul canale di casa (da connessi)
+// resta al BLE. bt_sim chiede a sim_wifi_coex_free_at quando puo' usare
+// un evento di connessione.
+#include "sim.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_WIFI_MAX_APS     128
+#define SIM_WIFI_CHANNELS    13
+
+// Costi modellati (ordine di grandezza su ESP32, non misure)
+#define SIM_WIFI_INIT_US     (120 * 1000)
+#define SIM_WIFI_START_US    (60 * 1000)
+
+typedef enum {
+    LINK_IDLE,
+    LINK_CONNECTING,
+    LINK_CONNECTED,
+} link_state_t;
+
+typedef struct {
+    wifi_scan_config_t cfg;
+    uint8_t ssid[33];
+    uint8_t bssid[6];
+    uint32_t gen;
+} scan_job_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_ap_t s_aps[SIM_WIFI_MAX_APS];
+static unsigned s_ap_count;
+static sim_wifi_timing_t s_timing = {
+    .active_dwell_ms  = 120,
+    .passive_dwell_ms = 360,
+    .home_dwell_ms    = 30,
+    .assoc_ms         = 150,
+    .dhcp_ms          = 350,
+};
+static sim_wifi_stats_t s_stats;
+
+static bool s_inited;
+static bool s_started;
+static wifi_mode_t s_mode;
+static wifi_config_t s_sta_cfg;
+
+static wifi_ap_record_t s_results[SIM_WIFI_MAX_APS];
+static uint16_t s_result_count;
+static uint16_t s_result_next;
+static bool s_scanning;
+static uint32_t s_scan_gen;
+static uint8_t s_scan_id;
+
+// Piano della scansione in corso: il canale i occupa la radio da
+// start + i * step per dwell, poi (da connessi) home sul canale dell'AP
+typedef struct {
+    int64_t start_us;
+    int64_t end_us;             // fine prevista o istante dello stop
+    int64_t dwell_us;
+    int64_t step_us;
+} coex_plan_t;
+static coex_plan_t s_coex;
+
+static link_state_t s_link;
+static int s_link_ap = -1;
+static uint32_t s_link_gen;
+static uint32_t s_rng = 0x12345678;
+
+static uint32_t rng_next(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void spawn(void *(*fn)(void *), void *arg) {
+    pthread_t th;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&th, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+}
+
+// — controllo dal banco di prova —
+
+void sim_wifi_clear_aps(void) {
+    pthread_mutex_lock(&s_lock);
+    s_ap_count = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+int sim_wifi_add_ap(const sim_ap_t *ap) {
+    pthread_mutex_lock(&s_lock);
+    if (s_ap_count == SIM_WIFI_MAX_APS) {
+        pthread_mutex_unlock(&s_lock);
+        return -1;
+    }
+    int idx = (int)s_ap_count++;
+    s_aps[idx] = *ap;
+    pthread_mutex_unlock(&s_lock);
+    return idx;
+}
+
+void sim_wifi_generate_aps(unsigned count, unsigned ssid_groups, uint32_t seed) {
+    static const wifi_auth_mode_t modes[] = {
+        WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK,
+        WIFI_AUTH_WPA2_WPA3_PSK, WIFI_AUTH_OPEN, WIFI_AUTH_WPA2_ENTERPRISE,
+    };
+    if (ssid_groups == 0 || ssid_groups > count) {
+        ssid_groups = count;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_rng = seed ? seed : 1;
+    for (unsigned i = 0; i < count && s_ap_count < SIM_WIFI_MAX_APS; i++) {
+        sim_ap_t *ap = &s_aps[s_ap_count++];
+        memset(ap, 0, sizeof(*ap));
+        unsigned group = i % ssid_groups;
+        snprintf(ap->ssid, sizeof(ap->ssid), "SIM-NET-%02u", group);
+        snprintf(ap->password, sizeof(ap->password), "password-%02u", group);
+        ap->bssid[0] = 0x02;
+        ap->bssid[1] = 0x51;
+        ap->bssid[2] = 0x4D;
+        ap->bssid[3] = (uint8_t)(i >> 8);
+        ap->bssid[4] = (uint8_t)i;
+        ap->bssid[5] = (uint8_t)rng_next();
+        ap->channel = (uint8_t)(1 + rng_next() % SIM_WIFI_CHANNELS);
+        ap->rssi = (int8_t)(-35 - (int)(rng_next() % 60));
+        ap->authmode = modes[group % (sizeof(modes) / sizeof(modes[0]))];
+        ap->enabled = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_wifi_set_timing(const sim_wifi_timing_t *timing) {
+    pthread_mutex_lock(&s_lock);
+    s_timing = *timing;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_wifi_get_timing(sim_wifi_timing_t *timing) {
+    pthread_mutex_lock(&s_lock);
+    *timing = s_timing;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_wifi_get_stats(sim_wifi_stats_t *stats) {
+    pthread_mutex_lock(&s_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+bool sim_wifi_is_scanning(void) {
+    pthread_mutex_lock(&s_lock);
+    bool scanning = s_scanning;
+    pthread_mutex_unlock(&s_lock);
+    return scanning;
+}
+
+// Chiamare con s_lock preso; l'evento va pubblicato dopo aver rilasciato
+// il lock, perche' gli handler rientrano nell'API esp_wifi
+static wifi_event_sta_disconnected_t make_disconnected_locked(int ap_idx, const uint8_t *ssid,
+                                                              uint8_t reason) {
+    wifi_event_sta_disconnected_t dis = { .reason = reason, .rssi = -127 };
+    size_t len = strnlen((const char *)ssid, sizeof(dis.ssid));
+    memcpy(dis.ssid, ssid, len);
+    dis.ssid_len = (uint8_t)len;
+    if (ap_idx >= 0) {
+        memcpy(dis.bssid, s_aps[ap_idx].bssid, sizeof(dis.bssid));
+        dis.rssi = s_aps[ap_idx].rssi;
+    }
+    return dis;
+}
+
+static void post_disconnected(const wifi_event_sta_disconnected_t *dis) {
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, dis, sizeof(*dis), portMAX_DELAY);
+}
+
+void sim_wifi_drop_link(uint8_t reason) {
+    pthread_mutex_lock(&s_lock);
+    bool dropped = s_link != LINK_IDLE;
+    wifi_event_sta_disconnected_t dis = make_disconnected_locked(s_link_ap, s_sta_cfg.sta.ssid, reason);
+    s_link = LINK_IDLE;
+    s_link_ap = -1;
+    s_link_gen++;
+    pthread_mutex_unlock(&s_lock);
+    if (dropped) {
+        post_disconnected(&dis);
+    }
+}
+
+void sim_wifi_set_ap_rssi(const char *ssid, int8_t rssi) {
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_ap_count; i++) {
+        if (strcmp(s_aps[i].ssid, ssid) == 0) {
+            s_aps[i].rssi = rssi;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_wifi_set_ap_enabled(const char *ssid, bool enabled) {
+    bool drop = false;
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_ap_count; i++) {
+        if (strcmp(s_aps[i].ssid, ssid) == 0) {
+            s_aps[i].enabled = enabled;
+            if (!enabled && s_link == LINK_CONNECTED && s_link_ap == (int)i) {
+                drop = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (drop) {
+        sim_wifi_drop_link(WIFI_REASON_BEACON_TIMEOUT);
+    }
+}
+
+// — API esp_wifi —
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    if (config == NULL || config->magic != WIFI_INIT_CONFIG_MAGIC) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim_sleep_us(SIM_WIFI_INIT_US);
+    s_inited = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    s_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    (void)storage;  // la configurazione del simulatore vive solo in RAM
+    return s_inited ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface != WIFI_IF_STA || s_mode == WIFI_MODE_AP) {
+        return ESP_ERR_WIFI_IF;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_sta_cfg = *conf;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf) {
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_WIFI_IF;
+    }
+    pthread_mutex_lock(&s_lock);
+    *conf = s_sta_cfg;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    sim_sleep_us(SIM_WIFI_START_US);
+    s_started = true;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    esp_wifi_disconnect();
+    s_started = false;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static bool ap_matches_scan(const sim_ap_t *ap, const scan_job_t *job, uint8_t channel) {
+    if (!ap->enabled || ap->channel != channel) {
+        return false;
+    }
+    if (ap->ssid[0] == '\0' && !job->cfg.show_hidden) {
+        return false;
+    }
+    if (job->cfg.ssid && strcmp((const char *)job->ssid, ap->ssid) != 0) {
+        return false;
+    }
+    if (job->cfg.bssid && memcmp(job->bssid, ap->bssid, 6) != 0) {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t scan_dwell_ms(const wifi_scan_config_t *cfg) {
+    if (cfg->scan_type == WIFI_SCAN_TYPE_PASSIVE) {
+        return cfg->scan_time.passive ? cfg->scan_time.passive : s_timing.passive_dwell_ms;
+    }
+    return cfg->scan_time.active.max ? cfg->scan_time.active.max : s_timing.active_dwell_ms;
+}
+
+// Canali della scansione in ordine: quello fisso, quelli della bitmap o
+// tutti; ritorna quanti
+static unsigned scan_channels(const wifi_scan_config_t *cfg, uint8_t *out) {
+    unsigned n = 0;
+    if (cfg->channel) {
+        out[n++] = cfg->channel;
+        return n;
+    }
+    for (uint8_t ch = 1; ch <= SIM_WIFI_CHANNELS; ch++) {
+        if (cfg->channel_bitmap.ghz_2_channels == 0 || (cfg->channel_bitmap.ghz_2_channels & (1u << ch))) {
+            out[n++] = ch;
+        }
+    }
+    return n;
+}
+
+int64_t sim_wifi_coex_free_at(int64_t t) {
+    pthread_mutex_lock(&s_lock);
+    coex_plan_t plan = s_coex;
+    pthread_mutex_unlock(&s_lock);
+    while (plan.step_us > 0 && t >= plan.start_us && t < plan.end_us) {
+        int64_t i = (t - plan.start_us) / plan.step_us;
+        int64_t busy_until = plan.start_us + i * plan.step_us + plan.dwell_us;
+        if (t >= busy_until) {
+            break;                  // sul canale di casa
+        }
+        t = busy_until;
+    }
+    return t;
+}
+
+static void run_scan(scan_job_t *job) {
+    uint8_t channels[SIM_WIFI_CHANNELS];
+    unsigned count = scan_channels(&job->cfg, channels);
+    wifi_ap_record_t found[SIM_WIFI_MAX_APS];
+    uint16_t n = 0;
+    int64_t start = sim_now_us();
+
+    pthread_mutex_lock(&s_lock);
+    uint32_t dwell = scan_dwell_ms(&job->cfg);
+    uint32_t home = s_link == LINK_CONNECTED
+                  ? (job->cfg.home_chan_dwell_time ? job->cfg.home_chan_dwell_time
+                                                   : s_timing.home_dwell_ms)
+                  : 0;
+    // Il piano e' fissato all'avvio: scadenze assolute, cosi' il BLE vede
+    // le stesse finestre che la scansione usa davvero
+    s_coex = (coex_plan_t){
+        .start_us = start,
+        .end_us = start + (int64_t)count * (dwell + home) * 1000 - (int64_t)home * 1000,
+        .dwell_us = (int64_t)dwell * 1000,
+        .step_us = (int64_t)(dwell + home) * 1000,
+    };
+    // Buco piu' lungo per il BLE: un dwell, o tutta la scansione se non
+    // si torna mai sul canale di casa
+    int64_t blackout = home ? s_coex.dwell_us : s_coex.end_us - start;
+    if (blackout > s_stats.coex_max_blackout_us) {
+        s_stats.coex_max_blackout_us = blackout;
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    for (unsigned c = 0; c < count; c++) {
+        uint8_t ch = channels[c];
+        int64_t busy_until = start + (int64_t)c * (dwell + home) * 1000 + (int64_t)dwell * 1000;
+        sim_sleep_us(busy_until - sim_now_us());
+        // Il telefono non sente la periferica da tutto questo tempo
+        sim_ble_coex_blackout(home ? (int64_t)dwell * 1000 : busy_until - start);
+        if (home && c + 1 < count) {
+            sim_sleep_us((int64_t)home * 1000);
+        }
+
+        pthread_mutex_lock(&s_lock);
+        if (job->gen != s_scan_gen) {
+            pthread_mutex_unlock(&s_lock);
+            return;
+        }
+        for (unsigned i = 0; i < s_ap_count; i++) {
+            if (!ap_matches_scan(&s_aps[i], job, ch)) {
+                continue;
+            }
+            wifi_ap_record_t *rec = &found[n++];
+            memset(rec, 0, sizeof(*rec));
+            memcpy(rec->bssid, s_aps[i].bssid, 6);
+            memcpy(rec->ssid, s_aps[i].ssid, sizeof(rec->ssid));
+            rec->primary = ch;
+            rec->rssi = (int8_t)(s_aps[i].rssi + (int)(rng_next() % 7) - 3);
+            rec->authmode = s_aps[i].authmode;
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    memcpy(s_results, found, n * sizeof(found[0]));
+    s_result_count = n;
+    s_result_next = 0;
+    s_scanning = false;
+    s_stats.scans++;
+    s_stats.scan_radio_us += (uint64_t)(sim_now_us() - start);
+    wifi_event_sta_scan_done_t done = { .status = 0, .number = (uint8_t)n, .scan_id = ++s_scan_id };
+    pthread_mutex_unlock(&s_lock);
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &done, sizeof(done), portMAX_DELAY);
+}
+
+static void *scan_thread(void *arg) {
+    scan_job_t *job = arg;
+    run_scan(job);
+    free(job);
+    return NULL;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block) {
+    if (!s_started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    scan_job_t *job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (config) {
+        job->cfg = *config;
+        if (config->ssid) {
+            strncpy((char *)job->ssid, (const char *)config->ssid, sizeof(job->ssid) - 1);
+        }
+        if (config->bssid) {
+            memcpy(job->bssid, config->bssid, 6);
+        }
+    } else {
+        job->cfg.show_hidden = false;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    // Come il driver vero: niente scansione mentre e' in corso un'altra
+    // scansione o una connessione
+    if (s_scanning || s_link == LINK_CONNECTING) {
+        s_stats.scan_rejected++;
+        pthread_mutex_unlock(&s_lock);
+        free(job);
+        return ESP_ERR_WIFI_STATE;
+    }
+    s_scanning = true;
+    job->gen = ++s_scan_gen;
+    pthread_mutex_unlock(&s_lock);
+
+    if (block) {
+        run_scan(job);
+        free(job);
+    } else {
+        spawn(scan_thread, job);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_stop(void) {
+    pthread_mutex_lock(&s_lock);
+    bool stopped = s_scanning;
+    wifi_event_sta_scan_done_t done = { .status = 1, .number = 0 };
+    if (stopped) {
+        s_scan_gen++;
+        s_scanning = false;
+        s_result_count = 0;
+        s_coex.end_us = sim_now_us();
+        done.scan_id = ++s_scan_id;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (stopped) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &done, sizeof(done), portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number) {
+    pthread_mutex_lock(&s_lock);
+    *number = (uint16_t)(s_result_count - s_result_next);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records) {
+    pthread_mutex_lock(&s_lock);
+    uint16_t avail = (uint16_t)(s_result_count - s_result_next);
+    if (*number > avail) {
+        *number = avail;
+    }
+    memcpy(ap_records, &s_results[s_result_next], *number * sizeof(wifi_ap_record_t));
+    // Il driver libera la lista dopo la lettura
+    s_result_count = 0;
+    s_result_next = 0;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_record(wifi_ap_record_t *ap_record) {
+    pthread_mutex_lock(&s_lock);
+    if (s_result_next >= s_result_count) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_FAIL;
+    }
+    *ap_record = s_results[s_result_next++];
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_clear_ap_list(void) {
+    pthread_mutex_lock(&s_lock);
+    s_result_count = 0;
+    s_result_next = 0;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static bool ap_matches_sta(const sim_ap_t *ap, const wifi_sta_config_t *sta) {
+    if (!ap->enabled || strncmp(ap->ssid, (const char *)sta->ssid, sizeof(sta->ssid)) != 0) {
+        return false;
+    }
+    if (sta->bssid_set && memcmp(ap->bssid, sta->bssid, 6) != 0) {
+        return false;
+    }
+    return ap->authmode >= sta->threshold.authmode;
+}
+
+static void *connect_thread(void *arg) {
+    uint32_t gen = (uint32_t)(uintptr_t)arg;
+
+    pthread_mutex_lock(&s_lock);
+    wifi_sta_config_t sta = s_sta_cfg.sta;
+    sim_wifi_timing_t timing = s_timing;
+    pthread_mutex_unlock(&s_lock);
+
+    // Scansione di ricerca: solo il canale indicato se noto, altrimenti
+    // 1..13 fermandosi al primo match (WIFI_FAST_SCAN) o tutti (ALL_CHANNEL)
+    uint8_t first = sta.channel ? sta.channel : 1;
+    uint8_t last  = sta.channel ? sta.channel : SIM_WIFI_CHANNELS;
+    int best = -1;
+    for (uint8_t ch = first; ch <= last; ch++) {
+        sim_sleep_us((int64_t)timing.active_dwell_ms * 1000);
+        pthread_mutex_lock(&s_lock);
+        if (gen != s_link_gen) {
+            pthread_mutex_unlock(&s_lock);
+            return NULL;
+        }
+        for (unsigned i = 0; i < s_ap_count; i++) {
+            if (s_aps[i].channel == ch && ap_matches_sta(&s_aps[i], &sta) &&
+                (best < 0 || s_aps[i].rssi > s_aps[best].rssi)) {
+                best = (int)i;
+            }
+        }
+        pthread_mutex_unlock(&s_lock);
+        if (best >= 0 && sta.scan_method == WIFI_FAST_SCAN) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s_lock);
+    if (gen != s_link_gen) {
+        pthread_mutex_unlock(&s_lock);
+        return NULL;
+    }
+    if (best < 0) {
+        s_link = LINK_IDLE;
+        wifi_event_sta_disconnected_t dis = make_disconnected_locked(-1, sta.ssid, WIFI_REASON_NO_AP_FOUND);
+        pthread_mutex_unlock(&s_lock);
+        post_disconnected(&dis);
+        return NULL;
+    }
+    bool auth_ok = s_aps[best].authmode == WIFI_AUTH_OPEN ||
+                   strncmp(s_aps[best].password, (const char *)sta.password,
+                           sizeof(sta.password)) == 0;
+    pthread_mutex_unlock(&s_lock);
+
+    sim_sleep_us((int64_t)timing.assoc_ms * 1000);
+    if (!auth_ok) {
+        // Il 4-way handshake scade dopo circa un secondo
+        sim_sleep_us(1000 * 1000);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    if (gen != s_link_gen) {
+        pthread_mutex_unlock(&s_lock);
+        return NULL;
+    }
+    if (!auth_ok) {
+        s_link = LINK_IDLE;
+        wifi_event_sta_disconnected_t dis = make_disconnected_locked(best, sta.ssid,
+                                                                     WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT);
+        pthread_mutex_unlock(&s_lock);
+        post_disconnected(&dis);
+        return NULL;
+    }
+    s_link = LINK_CONNECTED;
+    s_link_ap = best;
+    wifi_event_sta_connected_t con = { .channel = s_aps[best].channel,
+                                       .authmode = s_aps[best].authmode, .aid = 1 };
+    size_t len = strnlen(s_aps[best].ssid, sizeof(con.ssid));
+    memcpy(con.ssid, s_aps[best].ssid, len);
+    con.ssid_len = (uint8_t)len;
+    memcpy(con.bssid, s_aps[best].bssid, 6);
+    pthread_mutex_unlock(&s_lock);
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &con, sizeof(con), portMAX_DELAY);
+
+    sim_sleep_us((int64_t)timing.dhcp_ms * 1000);
+
+    pthread_mutex_lock(&s_lock);
+    bool still_up = gen == s_link_gen && s_link == LINK_CONNECTED;
+    if (still_up) {
+        s_stats.got_ip++;
+        s_stats.last_got_ip_us = sim_now_us();
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (still_up) {
+        ip_event_got_ip_t got = { .esp_netif = esp_netif_create_default_wifi_sta() };
+        got.ip_info.ip.addr      = 0x0001A8C0u | ((uint32_t)(100 + best % 100) << 24); // 192.168.1.x
+        got.ip_info.netmask.addr = 0x00FFFFFFu;
+        got.ip_info.gw.addr      = 0x0101A8C0u;
+        got.ip_changed = true;
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got, sizeof(got), portMAX_DELAY);
+    }
+    return NULL;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    if (!s_inited) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!s_started) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    pthread_mutex_lock(&s_lock);
+    bool was_connected = s_link == LINK_CONNECTED;
+    wifi_event_sta_disconnected_t dis = make_disconnected_locked(s_link_ap, s_sta_cfg.sta.ssid,
+                                                                 WIFI_REASON_ASSOC_LEAVE);
+    s_link = LINK_CONNECTING;
+    s_link_ap = -1;
+    uint32_t gen = ++s_link_gen;
+    s_stats.connects++;
+    pthread_mutex_unlock(&s_lock);
+    if (was_connected) {
+        post_disconnected(&dis);
+    }
+
+    spawn(connect_thread, (void *)(uintptr_t)gen);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    sim_wifi_drop_link(WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    pthread_mutex_lock(&s_lock);
+    if (s_link != LINK_CONNECTED || s_link_ap < 0) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_WIFI_CONN;
+    }
+    const sim_ap_t *ap = &s_aps[s_link_ap];
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, ap->bssid, 6);
+    memcpy(ap_info->ssid, ap->ssid, sizeof(ap_info->ssid));
+    ap_info->primary = ap->channel;
+    ap_info->rssi = (int8_t)(ap->rssi + (int)(rng_next() % 5) - 2);
+    ap_info->authmode = ap->authmode;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi) {
+    wifi_ap_record_t info;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&info);
+    if (err == ESP_OK) {
+        *rssi = info.rssi;
+    }
+    return err;
+}
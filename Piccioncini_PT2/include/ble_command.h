@@ -0,0 +1,63 @@
+// ble_command.h
+#ifndef BLE_COMMAND_H
+#define BLE_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Comandi binari su COMMAND_UUID (FF11). Una write ne contiene uno o piu',
+// eseguiti in ordine:
+//   [opcode u8][len u8][argomenti, len byte] [opcode u8][len u8] ...
+// Per ogni comando il telefono iscritto al CCCD di FF11 riceve una notifica
+//   [indice nella write u8][opcode u8][stato u8][dati ...]
+// Un opcode sconosciuto ha comunque la sua lunghezza: si risponde
+// CMD_STATUS_UNKNOWN e si passa al successivo. OK vuol dire accettato: le
+// azioni sul Wi-Fi le esegue poi wifi_task, nell'ordine della write.
+//
+// Compatibilita': una write di un solo byte o che inizia con un carattere
+// stampabile e' il vecchio "qualsiasi contenuto = scansione", senza risposta.
+#define CMD_OP_SCAN             0x01    // [flag u8]? CMD_SCAN_FRESH ignora la cache
+#define CMD_OP_DISCONNECT       0x02    // lascia la rete e non ritenta
+#define CMD_OP_FORGET           0x03    // [ssid]: come NET_OP_REMOVE su FF22
+#define CMD_OP_STATS            0x04    // risposta: CMD_STATS_LEN byte, sotto
+#define CMD_OP_FACTORY_RESET    0x05    // [CMD_FACTORY_RESET_CONFIRM]
+#define CMD_OP_OTA              0x06    // [url] o [CMD_OTA_START]: aggiorna; vuoto: avanzamento
+
+#define CMD_SCAN_FRESH          0x01
+#define CMD_FACTORY_RESET_CONFIRM 0xA5
+// Riparte con l'ultimo URL configurato (include/ota_update.h)
+#define CMD_OTA_START           0x01
+
+// Primo byte da cui una write si legge come testo (vecchio comando)
+#define CMD_LEGACY_MIN          0x20
+
+typedef enum {
+    CMD_STATUS_OK,
+    CMD_STATUS_UNKNOWN,         // opcode non previsto
+    CMD_STATUS_BAD_LEN,         // argomenti troppo corti o lunghi
+    CMD_STATUS_BAD_ARG,
+    CMD_STATUS_BUSY,            // coda verso wifi_task piena: si riprova
+    CMD_STATUS_TRUNCATED,       // la write finisce a meta' comando: il resto e' ignorato
+} cmd_status_t;
+
+// Risposta di CMD_OP_STATS, little-endian:
+//   [uptime ms u32][heap libero u32][stato Wi-Fi u8][rssi i8][reti salvate u8]
+//   [eventi ble_to_wifi rifiutati u16][righe di log perse u16]
+// Con l'intestazione sta in una notifica anche con l'MTU minimo.
+#define CMD_STATS_LEN           15
+// Risposta di CMD_OP_OTA (sempre, anche quando avvia):
+//   [ota_state_t u8][byte scritti u32][lunghezza immagine u32][riprese u8]
+// BUSY: sessione gia' in corso o immagine in prova; BAD_ARG: URL non
+// http(s) o nessun URL salvato.
+#define CMD_OTA_LEN             10
+#define CMD_REPLY_HDR_LEN       3
+#define CMD_REPLY_MAX_LEN       (CMD_REPLY_HDR_LEN + CMD_STATS_LEN)
+
+// Consegna la risposta di un comando al telefono conn_id
+typedef void (*ble_command_reply_t)(uint16_t conn_id, const uint8_t *rsp, size_t len);
+
+// Esegue i comandi di una write (dalla callback GATTS: non blocca).
+// Ritorna il numero di comandi letti.
+int ble_command_dispatch(uint16_t conn_id, const uint8_t *v, uint16_t len, ble_command_reply_t reply);
+
+#endif // BLE_COMMAND_H
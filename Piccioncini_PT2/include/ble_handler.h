@@ -7,7 +7,30 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
-// Inizializza il modulo BLE
-void ble_handler_init(UBaseType_t task_priority);
+// Telefoni collegati insieme: quanti ne accetta il controller
+// (CONFIG_BTDM_CTRL_BLE_MAX_CONN, 3 in sdkconfig.firebeetle32; il valore
+// di riserva vale per le build host). Finche' c'e' uno slot libero
+// l'advertising resta attivo.
+#ifndef BLE_MAX_CONN
+#ifdef CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#define BLE_MAX_CONN CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#else
+#define BLE_MAX_CONN 3
+#endif
+#endif
+
+#if defined(CONFIG_BTDM_CTRL_BLE_MAX_CONN) && BLE_MAX_CONN > CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#error "BLE_MAX_CONN oltre il limite del controller (CONFIG_BTDM_CTRL_BLE_MAX_CONN)"
+#endif
+
+// Stack di BLE_TASK (byte): il frammento piu' grande (MTU 517) sta sullo
+// stack durante l'invio, la lista serializzata no. Il margine reale lo dice
+// la telemetria (stack mai usato).
+#ifndef BLE_TASK_STACK
+#define BLE_TASK_STACK 3072
+#endif
+
+// Inizializza il modulo BLE; priorita' e core di BLE_TASK in task_plan.h
+void ble_handler_init(void);
 
 #endif // BLE_HANDLER_H
\ No newline at end of file
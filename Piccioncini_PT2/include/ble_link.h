@@ -0,0 +1,91 @@
+// ble_link.h
+#ifndef BLE_LINK_H
+#define BLE_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_defs.h"
+
+// Parametri del link BLE per connessione. Durante un trasferimento lungo
+// (lista reti, telemetria) si chiedono intervallo corto e DLE a 251 byte;
+// dopo BLE_LINK_IDLE_AFTER_MS senza trasferimenti si torna a un intervallo
+// lungo con slave latency, cosi' la radio resta quasi sempre spenta.
+//
+// I profili rispettano le regole di Apple (Accessory Design Guidelines):
+// min >= 15 ms, min + 15 ms <= max, latency <= 30,
+// max * (latency + 1) <= 2 s, timeout > 3 * max * (latency + 1).
+// Gli intervalli sono in unita' da 1.25 ms, il timeout in unita' da 10 ms.
+#define BLE_LINK_BULK_MIN_INT       12      // 15 ms
+#define BLE_LINK_BULK_MAX_INT       24      // 30 ms
+#define BLE_LINK_BULK_LATENCY       0
+#define BLE_LINK_BULK_TIMEOUT       400     // 4 s
+
+#define BLE_LINK_IDLE_MIN_INT       80      // 100 ms
+#define BLE_LINK_IDLE_MAX_INT       120     // 150 ms
+#define BLE_LINK_IDLE_LATENCY       3
+#define BLE_LINK_IDLE_TIMEOUT       500     // 5 s
+
+#ifndef BLE_LINK_IDLE_AFTER_MS
+#define BLE_LINK_IDLE_AFTER_MS      2000
+#endif
+
+// Un trasferimento annunciato (comando di scansione) tiene il link veloce
+// al massimo per questo tempo, anche se la lista non arriva mai
+#ifndef BLE_LINK_BULK_HOLD_MS
+#define BLE_LINK_BULK_HOLD_MS       10000
+#endif
+
+// Payload LL chiesto con DLE (massimo del controller)
+#define BLE_LINK_DLE_TX_OCTETS      251
+
+// Dopo tanti rifiuti del telefono non si chiede piu' nulla su quel link
+#define BLE_LINK_MAX_REJECTS        2
+
+typedef enum {
+    BLE_LINK_DEFAULT,           // quelli scelti dal telefono
+    BLE_LINK_BULK,
+    BLE_LINK_IDLE,
+    BLE_LINK_PROFILE_COUNT
+} ble_link_profile_t;
+
+typedef struct {
+    ble_link_profile_t profile;     // profilo in vigore
+    bool update_pending;            // richiesta in attesa della risposta
+    uint16_t interval;              // unita' da 1.25 ms
+    uint16_t latency;
+    uint16_t timeout;               // unita' da 10 ms
+    uint16_t mtu;
+    uint16_t tx_octets;             // payload LL: 27 finche' DLE non e' attivo
+    uint16_t updates;               // aggiornamenti accettati
+    uint16_t rejects;
+} ble_link_params_t;
+
+void ble_link_init(void);
+
+// Dagli eventi GATTS: connessione, chiusura, MTU negoziato
+void ble_link_connected(uint16_t conn_id, const esp_bd_addr_t bda, const esp_gatt_conn_params_t *params);
+void ble_link_disconnected(uint16_t conn_id);
+void ble_link_mtu(uint16_t conn_id, uint16_t mtu);
+
+// Da gap_event_handler: gestisce UPDATE_CONN_PARAMS e SET_PKT_LENGTH_COMPLETE
+void ble_link_gap_event(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param);
+
+// Trasferimento lungo su tutte le connessioni: begin/end vanno in coppia
+// (anche annidate), il link si rilassa BLE_LINK_IDLE_AFTER_MS dopo l'ultimo
+// end. expect annuncia un trasferimento che partira' piu' tardi (la lista
+// dopo il comando) senza bisogno di chiuderlo.
+void ble_link_bulk_begin(void);
+void ble_link_bulk_end(void);
+void ble_link_bulk_expect(void);
+
+// Parametri attivi di una connessione; false se conn_id non e' collegato
+bool ble_link_get(uint16_t conn_id, ble_link_params_t *out);
+
+// Connessioni aperte; se max_interval non e' NULL ci scrive l'intervallo
+// piu' lungo fra loro (unita' da 1.25 ms, 0 senza connessioni)
+int ble_link_active(uint16_t *max_interval);
+
+const char *ble_link_profile_name(ble_link_profile_t profile);
+
+#endif // BLE_LINK_H
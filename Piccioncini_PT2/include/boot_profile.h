@@ -0,0 +1,55 @@
+// boot_profile.h
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Avvio a fasi con dipendenze esplicite: ogni fase gira in un proprio task
+// non appena le fasi da cui dipende sono finite, quindi quelle indipendenti
+// (Bluedroid e Wi-Fi) si inizializzano in parallelo. Ogni fase e ogni
+// traguardo vengono marcati in microsecondi da esp_timer_get_time().
+typedef enum {
+    BOOT_PHASE_NVS,
+    BOOT_PHASE_QUEUES,
+    BOOT_PHASE_BLE,
+    BOOT_PHASE_WIFI,
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Traguardi raggiunti dopo l'avvio, segnalati dai moduli
+typedef enum {
+    BOOT_MARK_ADVERTISING,      // primo ADV_START_COMPLETE
+    BOOT_MARK_GOT_IP,           // primo IP_EVENT_STA_GOT_IP
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+#define BOOT_AFTER(phase)   (1u << (phase))
+
+typedef struct {
+    boot_phase_t phase;
+    void (*run)(void);
+    uint32_t after;             // BOOT_AFTER(...) delle fasi da attendere
+    uint32_t stack;             // stack del task della fase (0 = default)
+} boot_step_t;
+
+// Tempi in us dall'accensione; 0 = non (ancora) raggiunto
+typedef struct {
+    int64_t start_us[BOOT_PHASE_COUNT];
+    int64_t end_us[BOOT_PHASE_COUNT];
+    int64_t mark_us[BOOT_MARK_COUNT];
+    int64_t done_us;            // tutte le fasi concluse
+} boot_profile_t;
+
+// Esegue le fasi rispettando le dipendenze; ritorna quando sono tutte
+// concluse. La riga di profilo si stampa quando c'e' anche l'advertising.
+void boot_run(const boot_step_t *steps, size_t count);
+
+// Registra un traguardo (solo la prima volta); chiamabile da qualsiasi task
+void boot_mark(boot_mark_t mark);
+
+void boot_profile_get(boot_profile_t *out);
+
+const char *boot_phase_name(boot_phase_t phase);
+
+#endif // BOOT_PROFILE_H
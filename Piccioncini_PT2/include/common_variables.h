@@ -8,8 +8,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
-// — flag globale che indica se siamo connessi al Wi‑Fi — 
-extern bool g_wifi_connected; 
+// Lo stato della connessione Wi-Fi e' in wifi_status.h
 
 // — le due queue condivise fra BLE e Wi‑Fi — 
 // IMPORTANTE: usa "extern" per DICHIARARE le variabili nel .h
@@ -18,30 +17,124 @@ extern QueueHandle_t wifi_to_ble_q;
 
 typedef enum { 
     BLE_WIFI_EVT_BTN_PRESS,  // Start Wi‑Fi scan 
-    BLE_WIFI_EVT_CONNECT     // Connect to given SSID/PASSWORD 
+    BLE_WIFI_EVT_CONNECT,    // Connect to given SSID/PASSWORD 
+    BLE_WIFI_EVT_SCAN_DONE,  // interno: WIFI_EVENT_SCAN_DONE inoltrato a wifi_task 
+    BLE_WIFI_EVT_NET_ADD,    // Salva/aggiorna una rete conosciuta (ssid, password, priority)
+    BLE_WIFI_EVT_NET_REMOVE, // Dimentica la rete ssid
+    BLE_WIFI_EVT_NET_CLEAR,  // Dimentica tutte le reti salvate
+    BLE_WIFI_EVT_AUTOJOIN,   // interno: scansione + collegamento alla miglior rete salvata
+    BLE_WIFI_EVT_SCAN_FRESH, // Scansione nuova anche con la cache valida
+    BLE_WIFI_EVT_DISCONNECT, // Lascia la rete e resta fermo
+    BLE_WIFI_EVT_FACTORY_RESET, // Dimentica reti, ultimo AP e lista in cache
+    // interni: eventi del driver inoltrati dal loop eventi a wifi_task
+    BLE_WIFI_EVT_STA_START,
+    BLE_WIFI_EVT_STA_CONNECTED,
+    BLE_WIFI_EVT_STA_DISCONNECTED,
+    BLE_WIFI_EVT_GOT_IP
 } ble_wifi_evt_type_t; 
  
 // — Payload for BLE → Wi‑Fi events — 
 typedef struct { 
     ble_wifi_evt_type_t type; 
-    char ssid[32]; 
-    char password[64]; 
+    char ssid[33];          // terminata da NUL: fino a 32 caratteri
+    char password[65];      // fino a 64 (PSK esadecimale)
+    uint8_t priority;       // solo BLE_WIFI_EVT_NET_ADD
+    // eventi del driver; ssid anche per STA_CONNECTED
+    uint8_t bssid[6];       // STA_CONNECTED
+    uint8_t channel;        // STA_CONNECTED, 0 = info dell'AP non lette
+    uint8_t authmode;       // STA_CONNECTED
+    int8_t rssi;            // STA_CONNECTED, STA_DISCONNECTED
+    uint8_t reason;         // STA_DISCONNECTED
+    uint32_t ip;            // GOT_IP
 } ble_wifi_evt_t; 
 
 typedef enum { 
     WIFI_BLE_EVT_SCAN_DONE, 
-    WIFI_BLE_EVT_CONNECT_STATUS 
+    WIFI_BLE_EVT_CONNECT_STATUS  // stato Wi-Fi cambiato: senza dati, si legge da wifi_status_get
 } wifi_ble_evt_type_t; 
  
-#define MAX_WIFI_SCAN_RESULTS 10 
+#define MAX_WIFI_SCAN_RESULTS 32 
+
+// — Una rete trovata dalla scansione — 
+typedef struct { 
+    char ssid[33];          // terminata da NUL
+    uint8_t bssid[6]; 
+    int8_t rssi; 
+    uint8_t channel; 
+    uint8_t authmode;       // wifi_auth_mode_t
+} wifi_scan_record_t; 
  
 // — Payload for Wi‑Fi → BLE events — 
 typedef struct { 
     wifi_ble_evt_type_t type; 
-    uint8_t ssid_count; 
-    char ssid_list[MAX_WIFI_SCAN_RESULTS][32]; 
+    uint8_t ap_count; 
+    bool partial;           // SCAN_DONE a meta' scansione, ne segue un'altra
+    wifi_scan_record_t ap_list[MAX_WIFI_SCAN_RESULTS]; 
 } wifi_ble_evt_t;
 
+// — passaggio dei messaggi fra i task —
+// Le code trasportano puntatori a messaggi di pool statici (msg_pool.h): il
+// contenuto viene scritto una volta nello slot e nessuno lo copia.
+// Chi produce (callback GATT/GAP, loop eventi, timer) non deve mai restare
+// fermo dietro wifi_task o ble_task: ogni coda ha una politica di overflow.
+//
+// ble_to_wifi_q:
+//   - BTN_PRESS, SCAN_DONE, AUTOJOIN, SCAN_FRESH, DISCONNECT e
+//     FACTORY_RESET sono richieste senza dati
+//     (ble_wifi_request): non usano il pool e, se una e' gia' in coda, la
+//     nuova viene fusa con quella (coalesced)
+//   - gli altri eventi portano dati (ble_wifi_alloc + ble_wifi_post): a pool
+//     esaurito vengono rifiutati (rejected); dal GATT il rifiuto torna al
+//     telefono come errore
+//   - di CONNECT conta solo l'ultimo: uno non ancora letto da wifi_task
+//     viene sostituito dal nuovo (superseded)
+//   - gli eventi del driver (STA_*, GOT_IP) hanno un pool tutto loro
+//     (ble_wifi_alloc_driver): i comandi del telefono non lo esauriscono e
+//     non se ne fonde nessuno, perche' conta l'ordine
+// wifi_to_ble_q:
+//   - una lista reti nuova rende inutile quella vecchia: a coda piena o a
+//     pool esaurito si scartano le liste ancora in coda (dropped)
+//   - CONNECT_STATUS e' una richiesta fusa (wifi_ble_request) con uno slot
+//     riservato: non scarta liste e non viene mai scartata
+typedef struct {
+    uint32_t posted;        // eventi accodati
+    uint32_t coalesced;     // fusi con uno identico gia' in coda
+    uint32_t superseded;    // CONNECT sostituiti da uno piu' recente
+    uint32_t rejected;      // rifiutati per coda o pool pieni
+    uint32_t dropped;       // scartati dalla coda per far posto (drop-oldest)
+    uint16_t waiting;       // messaggi in coda adesso
+    uint16_t high_water;    // massima occupazione osservata
+    uint16_t depth;         // capacita' della coda
+    uint8_t pool_in_use;    // slot del pool occupati adesso
+    uint8_t pool_peak;      // massimo di slot occupati
+    uint8_t pool_size;
+} queue_stats_t;
+
+// BLE -> Wi-Fi. Nessuna di queste blocca.
+bool ble_wifi_request(ble_wifi_evt_type_t type);
+// Slot azzerato da riempire sul posto; NULL (e rejected) se il pool e' esaurito
+ble_wifi_evt_t *ble_wifi_alloc(void);
+// Come ble_wifi_alloc, dal pool degli eventi del driver (solo loop eventi)
+ble_wifi_evt_t *ble_wifi_alloc_driver(void);
+// Cede lo slot alla coda; su errore lo rilascia e ritorna false
+bool ble_wifi_post(ble_wifi_evt_t *evt);
+// Lato wifi_task: NULL allo scadere di ticks; ogni evento ricevuto va
+// restituito con ble_wifi_release
+const ble_wifi_evt_t *ble_wifi_receive(TickType_t ticks);
+void ble_wifi_release(const ble_wifi_evt_t *evt);
+
+// Wi-Fi -> BLE. Solo richieste senza dati, da qualsiasi task; non blocca.
+bool wifi_ble_request(wifi_ble_evt_type_t type);
+// Lo slot allocato e' del chiamante finche' non lo rilascia;
+// wifi_ble_post aggiunge il riferimento della coda, quindi dopo il post il
+// messaggio non va piu' modificato.
+wifi_ble_evt_t *wifi_ble_alloc(void);
+bool wifi_ble_post(const wifi_ble_evt_t *evt);
+const wifi_ble_evt_t *wifi_ble_receive(TickType_t ticks);
+void wifi_ble_release(const wifi_ble_evt_t *evt);
+
+void queues_get_stats(queue_stats_t *ble_to_wifi, queue_stats_t *wifi_to_ble);
+
 void queues_init(void);
  
 #endif // COMMON_VARIABLES_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+// config_parser.h
+#ifndef CONFIG_PARSER_H
+#define CONFIG_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common_variables.h"
+
+// Decodifica delle credenziali scritte su WIFI_CONFIG_UUID, in un solo
+// passaggio, senza allocazioni e senza mai leggere oltre 'len' (il valore
+// che arriva da Bluedroid non e' terminato da NUL).
+//
+// Formato binario (TLV), ripetibile in qualsiasi ordine:
+//   [tipo u8][lunghezza u8][valore]
+//   CONFIG_TLV_SSID      1..32 byte, obbligatorio
+//   CONFIG_TLV_PASSWORD  0..64 byte
+// I tipi sconosciuti vengono saltati, per compatibilita' con app future.
+//
+// Formato storico, riconosciuto dal primo "%%":
+//   %%ssid%%password%%
+#define CONFIG_TLV_SSID      0x01
+#define CONFIG_TLV_PASSWORD  0x02
+
+typedef enum {
+    CONFIG_PARSE_OK = 0,
+    CONFIG_PARSE_EMPTY,         // scrittura vuota
+    CONFIG_PARSE_TRUNCATED,     // TLV o delimitatore "%%" mancante
+    CONFIG_PARSE_TOO_LONG,      // campo oltre la dimensione di ble_wifi_evt_t
+    CONFIG_PARSE_NO_SSID,       // SSID assente o vuoto
+    CONFIG_PARSE_DUPLICATE,     // stesso campo ripetuto
+} config_parse_status_t;
+
+// Riempie evt->ssid/evt->password (terminati da NUL) e imposta
+// evt->type = BLE_WIFI_EVT_CONNECT. Su errore evt non e' significativo.
+config_parse_status_t config_parse(const uint8_t *buf, size_t len, ble_wifi_evt_t *evt);
+
+const char *config_parse_status_name(config_parse_status_t status);
+
+#endif // CONFIG_PARSER_H
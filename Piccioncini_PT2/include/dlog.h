@@ -0,0 +1,101 @@
+// dlog.h
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include "esp_log.h"
+
+// Log differito: chi scrive copia in un anello lock-free solo il formato
+// (il puntatore alla stringa costante), gli argomenti grezzi e le stringhe
+// %s; un task a bassa priorita' formatta e scrive sulla UART. Le callback
+// di Bluedroid e del Wi-Fi non pagano ne' la formattazione ne' la seriale.
+//
+// Argomenti ammessi: interi (anche l, ll, z), %p e %s; niente float ne' '*'.
+// Le stringhe %s si copiano troncate: in tutto DLOG_STR_LEN byte per riga.
+
+// Moduli: il nome e' il tag di esp_log, quindi esp_log_level_set funziona
+// ancora a runtime
+typedef enum {
+    DLOG_TAG_BLE,               // "BLE_HANDLER"
+    DLOG_TAG_LINK,              // "BLE_LINK"
+    DLOG_TAG_WIFI,              // "WIFI_TAG"
+    DLOG_TAG_STATUS,            // "WIFI_STATUS"
+    DLOG_TAG_STORE,             // "WIFI_STORE"
+    DLOG_TAG_QUEUE,             // "QUEUE"
+    DLOG_TAG_BOOT,              // "BOOT"
+    DLOG_TAG_OTA,               // "OTA"
+    DLOG_TAG_JOURNAL,           // "JOURNAL"
+    DLOG_TAG_COUNT
+} dlog_tag_t;
+
+// Livello massimo compilato, per modulo: le chiamate sopra spariscono dal
+// binario (es. -DDLOG_LEVEL_WIFI=ESP_LOG_WARN)
+#ifndef DLOG_LEVEL_DEFAULT
+#define DLOG_LEVEL_DEFAULT      ESP_LOG_INFO
+#endif
+#ifndef DLOG_LEVEL_BLE
+#define DLOG_LEVEL_BLE          DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_LINK
+#define DLOG_LEVEL_LINK         DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_WIFI
+#define DLOG_LEVEL_WIFI         DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_STATUS
+#define DLOG_LEVEL_STATUS       DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_STORE
+#define DLOG_LEVEL_STORE        DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_QUEUE
+#define DLOG_LEVEL_QUEUE        DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_BOOT
+#define DLOG_LEVEL_BOOT         DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_OTA
+#define DLOG_LEVEL_OTA          DLOG_LEVEL_DEFAULT
+#endif
+#ifndef DLOG_LEVEL_JOURNAL
+#define DLOG_LEVEL_JOURNAL      DLOG_LEVEL_DEFAULT
+#endif
+
+// Righe in attesa (potenza di 2): a anello pieno le nuove si perdono e si contano
+#ifndef DLOG_RING_LEN
+#define DLOG_RING_LEN           32
+#endif
+#define DLOG_MAX_WORDS          12      // argomenti a 32 bit (ll e %p su 64 bit ne usano 2)
+#define DLOG_STR_LEN            40
+
+#define DLOG(level, mod, format, ...)                                              \
+    do {                                                                           \
+        if ((level) <= DLOG_LEVEL_##mod) {                                         \
+            dlog_write((level), DLOG_TAG_##mod, format, ##__VA_ARGS__);            \
+        }                                                                          \
+    } while (0)
+
+#define DLOGE(mod, format, ...) DLOG(ESP_LOG_ERROR, mod, format, ##__VA_ARGS__)
+#define DLOGW(mod, format, ...) DLOG(ESP_LOG_WARN,  mod, format, ##__VA_ARGS__)
+#define DLOGI(mod, format, ...) DLOG(ESP_LOG_INFO,  mod, format, ##__VA_ARGS__)
+#define DLOGD(mod, format, ...) DLOG(ESP_LOG_DEBUG, mod, format, ##__VA_ARGS__)
+
+// Avvia il task che svuota l'anello; prima le righe restano in attesa
+void dlog_init(void);
+
+// 'format' deve restare valido per sempre (stringa letterale)
+void dlog_write(esp_log_level_t level, dlog_tag_t tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Attende che il task abbia scritto tutto (prima di un riavvio)
+void dlog_flush(uint32_t timeout_ms);
+
+typedef struct {
+    uint32_t written;           // righe accodate
+    uint32_t dropped;           // perse ad anello pieno
+    uint32_t peak;              // massimo di righe in attesa
+} dlog_stats_t;
+
+void dlog_get_stats(dlog_stats_t *out);
+
+#endif // DLOG_H
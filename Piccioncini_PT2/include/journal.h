@@ -0,0 +1,107 @@
+// journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Diario degli eventi sulla partizione "spiffs" (partitions_ota.csv): un
+// anello di settori da 4 KB scritto solo in coda, che sopravvive ai riavvii
+// e si legge via BLE (JOURNAL_UUID, FF31) senza cavo.
+//
+// journal_log copia il record in un buffer in RAM e ritorna: nessun accesso
+// alla flash da chi registra. Il task JOURNAL scrive il buffer a blocchi
+// (JOURNAL_FLUSH_BYTES o JOURNAL_FLUSH_MS dal record piu' vecchio in
+// attesa). Un settore si cancella solo quando l'anello ci torna sopra,
+// quindi l'usura e' uniforme: una cancellazione per settore ogni
+// JOURNAL_SECTORS settori scritti. A corrente tolta si perde al massimo cio'
+// che era ancora in RAM; un record scritto a meta' si riconosce dal CRC, e
+// al montaggio il resto del suo settore si lascia e si riparte dal
+// successivo.
+//
+// Posizioni: ogni byte del diario ha una posizione logica a 32 bit che
+// cresce sempre (settore * 4096 + offset); e' il cursore da cui si legge.
+//
+// Settore:  [JOURNAL_MAGIC u32][numero del settore u32] record...
+// Record:   [tipo u8][len u8][avvio u16][ms dall'avvio u32][dati, len byte][crc8]
+// little-endian; "avvio" conta le accensioni, dal diario stesso.
+
+#define JOURNAL_MAGIC           0x314E524Au     // "JRN1"
+#define JOURNAL_SECTOR_LEN      4096
+#define JOURNAL_SECTOR_HDR_LEN  8
+#define JOURNAL_REC_HDR_LEN     8
+#define JOURNAL_PAYLOAD_MAX     32
+#define JOURNAL_REC_MAX_LEN     (JOURNAL_REC_HDR_LEN + JOURNAL_PAYLOAD_MAX + 1)
+
+// Record in attesa di scrittura (byte, potenza di 2): a buffer pieno i
+// nuovi si perdono e si contano
+#ifndef JOURNAL_RAM_LEN
+#define JOURNAL_RAM_LEN         2048
+#endif
+
+// Si scrive quando in RAM ci sono almeno questi byte (una pagina della
+// flash)...
+#ifndef JOURNAL_FLUSH_BYTES
+#define JOURNAL_FLUSH_BYTES     256
+#endif
+
+// ...o quando il record piu' vecchio aspetta da tanto
+#ifndef JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_MS        30000
+#endif
+
+// Una pagina letta da FF31: [posizione u32][posizione successiva u32]
+// seguiti da record interi. Non oltre i 512 byte di un attributo ATT.
+#define JOURNAL_PAGE_HDR_LEN    8
+#define JOURNAL_PAGE_LEN        512
+
+typedef enum {
+    JOURNAL_EV_BOOT = 1,        // [esp_reset_reason_t u8][versione dell'app]
+    JOURNAL_EV_BOOT_PROFILE,    // [ms u16] x fasi (boot_phase_t), [init ms u16][adv ms u16]
+    JOURNAL_EV_WIFI_CONNECT,    // [canale u8][rssi i8][tentativi u8][ms u16][bssid 6]
+    JOURNAL_EV_WIFI_DISCONNECT, // [reason u8][era connesso u8][rssi i8]
+    JOURNAL_EV_SCAN,            // [ok u8][inviate u8][viste u16][unite u16][ms u16][richieste u8]
+    JOURNAL_EV_BLE_CONNECT,     // [conn_id u8][connessi u8]
+    JOURNAL_EV_BLE_DISCONNECT,  // [conn_id u8][reason u16]
+    JOURNAL_EV_COUNT
+} journal_event_t;
+
+typedef struct {
+    uint32_t appended;          // record accettati
+    uint32_t dropped;           // persi: buffer pieno o partizione assente
+    uint32_t flushes;           // scritture a blocco
+    uint32_t erases;            // settori cancellati
+    uint32_t bytes_written;     // byte scritti in flash (intestazioni comprese)
+    uint32_t head;              // posizione del prossimo record
+    uint32_t oldest;            // posizione del record piu' vecchio
+    uint32_t pending;           // byte ancora solo in RAM
+    uint16_t boot;              // numero di questa accensione
+} journal_stats_t;
+
+// Monta il diario (legge le intestazioni dei settori e l'ultimo settore),
+// registra JOURNAL_EV_BOOT e avvia il task di scrittura. Senza partizione
+// il diario resta spento e journal_log scarta tutto.
+void journal_init(void);
+
+// Aggiunge un record (len <= JOURNAL_PAYLOAD_MAX); non tocca la flash.
+// Da qualsiasi task, non da ISR. false se il record si e' perso.
+bool journal_log(journal_event_t type, const void *payload, size_t len);
+
+// Scrive subito cio' che e' in RAM e attende, al massimo timeout_ms (prima
+// di esp_restart)
+void journal_flush(uint32_t timeout_ms);
+
+// Copia in buf record interi a partire da pos (una posizione piu' vecchia
+// del diario vale come la piu' vecchia). Ritorna i byte copiati; *next e' la
+// posizione da cui continuare (uguale a pos a diario finito).
+size_t journal_read(uint32_t pos, uint8_t *buf, size_t cap, uint32_t *next);
+
+// Pagina per FF31 (JOURNAL_PAGE_LEN al massimo); avanza *cursor
+size_t journal_read_page(uint32_t *cursor, uint8_t *page, size_t cap);
+
+void journal_get_stats(journal_stats_t *out);
+
+const char *journal_event_name(journal_event_t type);
+
+#endif // JOURNAL_H
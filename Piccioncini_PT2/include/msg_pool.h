@@ -0,0 +1,45 @@
+// msg_pool.h
+#ifndef MSG_POOL_H
+#define MSG_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Pool statico di messaggi a dimensione fissa con conteggio dei riferimenti.
+// Le code trasportano solo il puntatore: il contenuto viene scritto una
+// volta, direttamente nello slot, e nessuno lo copia piu'.
+//   - msg_pool_alloc: slot azzerato con un riferimento, NULL se esaurito
+//   - msg_pool_ref / msg_pool_release: il rilascio dell'ultimo
+//     riferimento rimette lo slot nel pool
+//   - uno slot con piu' riferimenti e' in sola lettura per tutti
+// Un puntatore che non appartiene al pool (es. un messaggio const statico)
+// viene ignorato da ref e release.
+typedef struct {
+    uint8_t *items;
+    _Atomic uint8_t *refs;
+    size_t item_size;
+    uint8_t count;
+    _Atomic uint8_t in_use;
+    _Atomic uint8_t peak;
+    _Atomic uint32_t exhausted;     // allocazioni fallite
+} msg_pool_t;
+
+// Definisce un pool statico 'name' di 'n' elementi di tipo 'type'
+#define MSG_POOL_DEFINE(name, type, n)                                      \
+    static type name##_items[n];                                            \
+    static _Atomic uint8_t name##_refs[n];                                  \
+    static msg_pool_t name = {                                              \
+        .items = (uint8_t *)name##_items,                                   \
+        .refs = name##_refs,                                                \
+        .item_size = sizeof(type),                                          \
+        .count = (n),                                                       \
+    }
+
+void *msg_pool_alloc(msg_pool_t *pool);
+void msg_pool_ref(msg_pool_t *pool, const void *msg);
+void msg_pool_release(msg_pool_t *pool, const void *msg);
+bool msg_pool_is_member(const msg_pool_t *pool, const void *msg);
+
+#endif // MSG_POOL_H
@@ -0,0 +1,91 @@
+// ota_update.h
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Aggiornamento del firmware via HTTP(S) nello slot OTA non in esecuzione
+// (partitions_ota.csv: ota_0 e ota_1). L'immagine non passa mai tutta in
+// RAM: un task scarica in OTA_CHUNK_BUFS buffer da un settore ciascuno, un
+// secondo task li cancella e scrive in flash mentre il primo riempie il
+// successivo, quindi il download procede alla velocita' della flash.
+//
+// Ripresa: ogni OTA_CHECKPOINT_BYTES scritti la posizione si salva in NVS
+// insieme a URL, lunghezza ed ETag; dopo una rete caduta o un riavvio il
+// download riparte da li' con una richiesta Range (If-Range sull'ETag: se
+// l'immagine sul server e' cambiata si ricomincia da zero).
+//
+// Verifica e rollback: l'intestazione deve essere di questo progetto,
+// esp_ota_set_boot_partition controlla l'immagine intera (checksum e
+// SHA-256) prima di cambiare slot. Al primo avvio la nuova immagine e' in
+// prova (CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE): si conferma quando e'
+// tornata in rete e in advertising; se non ci arriva entro
+// OTA_CONFIRM_TIMEOUT_MS, o se si riavvia prima, il bootloader torna
+// all'immagine precedente.
+
+// Un settore della flash: cancellazione e scrittura sempre allineate
+#define OTA_CHUNK_LEN           4096
+
+// Buffer in volo fra download e scrittura (2 = doppio buffer)
+#ifndef OTA_CHUNK_BUFS
+#define OTA_CHUNK_BUFS          2
+#endif
+
+#ifndef OTA_CHECKPOINT_BYTES
+#define OTA_CHECKPOINT_BYTES    (64 * 1024)
+#endif
+
+#ifndef OTA_CONFIRM_TIMEOUT_MS
+#define OTA_CONFIRM_TIMEOUT_MS  60000
+#endif
+
+#ifndef OTA_HTTP_TIMEOUT_MS
+#define OTA_HTTP_TIMEOUT_MS     10000
+#endif
+
+// Tentativi di fila senza progresso prima di rinunciare (la ripresa resta
+// salvata per il prossimo avvio o comando)
+#ifndef OTA_MAX_RETRIES
+#define OTA_MAX_RETRIES         5
+#endif
+
+// Attesa dell'IP prima di rinunciare a una sessione
+#ifndef OTA_WAIT_IP_MS
+#define OTA_WAIT_IP_MS          60000
+#endif
+
+#define OTA_URL_MAX             128
+
+typedef enum {
+    OTA_STATE_IDLE,
+    OTA_STATE_DOWNLOADING,      // anche in attesa dell'IP o fra due tentativi
+    OTA_STATE_VERIFYING,
+    OTA_STATE_REBOOTING,
+    OTA_STATE_FAILED,           // vedi ota_progress_t.err
+    OTA_STATE_PENDING_VERIFY,   // immagine nuova in prova, non ancora confermata
+    OTA_STATE_COUNT
+} ota_state_t;
+
+typedef struct {
+    ota_state_t state;
+    uint32_t written;           // byte gia' in flash
+    uint32_t total;             // lunghezza dell'immagine, 0 finche' non si sa
+    uint8_t resumes;            // richieste Range di questa sessione
+    esp_err_t err;              // ultimo errore
+} ota_progress_t;
+
+// Dopo l'avvio (NVS pronta): conferma o annulla l'immagine in prova e
+// riprende un download interrotto
+void ota_update_init(void);
+
+// Avvia una sessione; url NULL = l'ultimo URL configurato. Non blocca.
+// ESP_ERR_INVALID_STATE se una sessione e' gia' in corso o l'immagine
+// attuale non e' ancora confermata, ESP_ERR_NOT_FOUND senza URL.
+esp_err_t ota_update_start(const char *url);
+
+void ota_update_get(ota_progress_t *out);
+
+const char *ota_state_name(ota_state_t state);
+
+#endif // OTA_UPDATE_H
@@ -0,0 +1,29 @@
+// perf_gate.h
+#ifndef PERF_GATE_H
+#define PERF_GATE_H
+
+// Build per il perf gate (perf_gate.py, env firebeetle32_qemu): il firmware
+// gira nel QEMU esp32 di Espressif, che non emula la radio. Con
+// APP_PERF_GATE=1 controller BT, Bluedroid e driver Wi-Fi non si avviano;
+// tutto il resto (NVS, code, task, diario, OTA) parte come sul dispositivo
+// e l'advertising si marca appena finito l'init BLE.
+//
+// Dopo PERF_GATE_SETTLE_MS il main task stampa sulla console una riga
+// "PERF <metrica> <valore>" per ogni misura e chiude con "PERF fine":
+//   boot.<fase>_ms, boot.init_ms, boot.adv_ms   profilo di avvio (boot_profile.h)
+//   heap.free, heap.min_free                    byte dell'heap
+//   stack.<task>                                byte di stack mai usati
+// Le metriche e le soglie stanno in perf_baseline.csv.
+#ifndef APP_PERF_GATE
+#define APP_PERF_GATE 0
+#endif
+
+#ifndef PERF_GATE_SETTLE_MS
+#define PERF_GATE_SETTLE_MS 3000
+#endif
+
+// Attende PERF_GATE_SETTLE_MS e stampa il rapporto; con APP_PERF_GATE=0
+// non fa nulla
+void perf_gate_report(void);
+
+#endif // PERF_GATE_H
@@ -0,0 +1,75 @@
+// rtos_static.h
+#ifndef RTOS_STATIC_H
+#define RTOS_STATIC_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "task_plan.h"
+
+// Task, code e mutex che vivono quanto il firmware, in RAM statica invece
+// che nell'heap. Con APP_STATIC_ALLOC=1 stack, TCB e buffer delle code sono
+// in .bss: la mappa del link li attribuisce al modulo che li definisce
+// (mem_budget.py li confronta con mem_budget.csv) e l'heap resta a
+// Bluedroid, driver Wi-Fi e lwIP, senza buchi lasciati da oggetti nostri.
+// Con APP_STATIC_ALLOC=0 si torna a xTaskCreate & co., per confrontare
+// l'heap minimo con la telemetria.
+//
+// Serve CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION (attivo nello sdkconfig).
+// Su ESP-IDF gli stack si misurano in byte (StackType_t e' uint8_t).
+// Restano nell'heap gli esp_timer (non hanno una variante statica), i task
+// delle fasi di avvio, che terminano prima che il firmware vada a regime, e
+// task, code e buffer di ota_update, che esistono solo durante un download.
+#ifndef APP_STATIC_ALLOC
+#define APP_STATIC_ALLOC 1
+#endif
+
+typedef struct {
+    StackType_t *stack;
+    uint32_t stack_len;             // byte
+    StaticTask_t *tcb;
+} rtos_task_mem_t;
+
+typedef struct {
+    uint8_t *storage;
+    UBaseType_t depth;
+    UBaseType_t item_size;
+    StaticQueue_t *queue;
+} rtos_queue_mem_t;
+
+#if APP_STATIC_ALLOC
+#define RTOS_TASK_DEFINE(name, stack_bytes)                                     \
+    static StackType_t name##_stack[(stack_bytes) / sizeof(StackType_t)];       \
+    static StaticTask_t name##_tcb;                                             \
+    static rtos_task_mem_t name = { name##_stack, (stack_bytes), &name##_tcb }
+
+#define RTOS_QUEUE_DEFINE(name, depth, item_size)                               \
+    static uint8_t name##_storage[(depth) * (item_size)];                       \
+    static StaticQueue_t name##_queue;                                          \
+    static rtos_queue_mem_t name = { name##_storage, (depth), (item_size), &name##_queue }
+
+#define RTOS_MUTEX_DEFINE(name)                                                 \
+    static StaticSemaphore_t name##_buf;                                        \
+    static StaticSemaphore_t *const name = &name##_buf
+#else
+#define RTOS_TASK_DEFINE(name, stack_bytes)                                     \
+    static rtos_task_mem_t name = { NULL, (stack_bytes), NULL }
+
+#define RTOS_QUEUE_DEFINE(name, depth, item_size)                               \
+    static rtos_queue_mem_t name = { NULL, (depth), (item_size), NULL }
+
+#define RTOS_MUTEX_DEFINE(name)                                                 \
+    static StaticSemaphore_t *const name = NULL
+#endif
+
+// Come xTaskCreate / xQueueCreate / xSemaphoreCreateMutex, sulla memoria
+// definita con le macro sopra. Una mancanza di memoria qui e' un errore di
+// configurazione: configASSERT, nessun ritorno NULL da gestire.
+// Nome, priorita' e core del task vengono da task_plan.h (APP_TASK_PLACEMENT).
+TaskHandle_t rtos_task_create(rtos_task_mem_t *mem, TaskFunction_t fn, void *arg, task_plan_id_t id);
+QueueHandle_t rtos_queue_create(rtos_queue_mem_t *mem);
+SemaphoreHandle_t rtos_mutex_create(StaticSemaphore_t *buf);
+
+#endif // RTOS_STATIC_H
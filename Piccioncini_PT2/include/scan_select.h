@@ -0,0 +1,27 @@
+// scan_select.h
+#ifndef SCAN_SELECT_H
+#define SCAN_SELECT_H
+
+#include <stdint.h>
+#include "common_variables.h"
+
+// Selezione delle migliori K reti mentre si leggono i record dal driver,
+// uno alla volta: memoria fissa (il buffer di K record) qualunque sia il
+// numero di AP visti.
+//   - a parita' di SSID resta solo il BSSID con RSSI migliore
+//   - le reti nascoste (SSID vuoto) non vengono unite fra loro
+//   - piena la tabella, un nuovo record entra solo se batte il peggiore
+typedef struct {
+    wifi_scan_record_t *heap;   // min-heap per RSSI: heap[0] e' il peggiore
+    uint8_t count;
+    uint8_t cap;
+    uint16_t seen;              // record offerti in totale
+    uint16_t merged;            // duplicati di SSID assorbiti
+} scan_select_t;
+
+void scan_select_init(scan_select_t *s, wifi_scan_record_t *buf, uint8_t cap);
+void scan_select_add(scan_select_t *s, const wifi_scan_record_t *rec);
+// Ordina il buffer per RSSI decrescente e ritorna il numero di record
+uint8_t scan_select_finish(scan_select_t *s);
+
+#endif // SCAN_SELECT_H
@@ -0,0 +1,52 @@
+// scan_stream.h
+#ifndef SCAN_STREAM_H
+#define SCAN_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common_variables.h"
+
+// Formato binario della lista reti notificata su WIFI_SCAN_LIST_UUID.
+//
+// Ogni notifica e' un frammento:   [seq u8][flags u8][payload ...]
+//   seq    indice del frammento nel flusso, riparte da 0 a ogni lista
+//   flags  SCAN_STREAM_FLAG_FIRST sul primo frammento,
+//          SCAN_STREAM_FLAG_LAST sull'ultimo (marcatore di fine),
+//          SCAN_STREAM_FLAG_PARTIAL su tutti i frammenti di una lista
+//          parziale: la scansione continua e ne arrivera' un'altra
+// Il payload e' lungo al massimo MTU - 3 - 2 byte. Concatenando i payload
+// in ordine di seq si ottiene il corpo:
+//   [versione u8][numero record u8]
+//   per ogni record: [len ssid u8][ssid][rssi i8][canale u8][authmode u8][bssid 6]
+#define SCAN_STREAM_VERSION         1
+#define SCAN_STREAM_FLAG_FIRST      0x01
+#define SCAN_STREAM_FLAG_LAST       0x02
+#define SCAN_STREAM_FLAG_PARTIAL    0x04
+#define SCAN_STREAM_CHUNK_HDR_LEN   2
+#define SCAN_STREAM_BODY_HDR_LEN    2
+#define SCAN_STREAM_RECORD_MAX_LEN  (1 + 32 + 1 + 1 + 1 + 6)
+#define SCAN_STREAM_BODY_MAX_LEN    (SCAN_STREAM_BODY_HDR_LEN + \
+                                     MAX_WIFI_SCAN_RESULTS * SCAN_STREAM_RECORD_MAX_LEN)
+
+// Serializza i record nel corpo del flusso; ritorna i byte scritti
+// (0 se 'cap' non basta)
+size_t scan_stream_encode(const wifi_scan_record_t *recs, uint8_t count,
+                          uint8_t *out, size_t cap);
+
+// Taglia il corpo in frammenti della dimensione giusta per l'MTU
+typedef struct {
+    const uint8_t *body;
+    size_t len;
+    size_t off;
+    uint8_t seq;
+    uint8_t flags;              // aggiunti a ogni frammento (es. PARTIAL)
+    bool done;
+} scan_stream_chunker_t;
+
+void scan_stream_chunker_init(scan_stream_chunker_t *c, const uint8_t *body, size_t len,
+                              uint8_t flags);
+// Scrive il prossimo frammento in 'out' (almeno mtu - 3 byte); ritorna la
+// lunghezza del frammento o 0 quando il flusso e' finito
+size_t scan_stream_next_chunk(scan_stream_chunker_t *c, uint16_t mtu, uint8_t *out);
+
+#endif // SCAN_STREAM_H
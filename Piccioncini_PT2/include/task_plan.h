@@ -0,0 +1,100 @@
+// task_plan.h
+#ifndef TASK_PLAN_H
+#define TASK_PLAN_H
+
+#include "freertos/FreeRTOS.h"
+
+// Dove girano i task del firmware e con che priorita'. Un solo posto: gli
+// init dei moduli passano solo l'identificativo a rtos_task_create.
+//
+// Fasce di priorita' (configMAX_PRIORITIES = 25) su ESP-IDF 5.x:
+//   24      ipc, uno per core                                    IDF
+//   23      controller BT e task del driver Wi-Fi, core 0       IDF
+//   22      esp_timer (callback dei timer), core 0               IDF
+//   19..20  BTC/BTU di Bluedroid e loop eventi di default        IDF
+//   18      tcpip di lwIP, senza affinita'                       IDF
+//   3..9    task dell'applicazione che servono una coda          APP
+//   1..2    sottofondo: log e diario, fasi di avvio, main, OTA   BG
+//   0       idle
+// Nessun task nostro sale sopra la fascia APP: le callback GATTS e gli
+// eventi Wi-Fi girano nei task IDF e devono poterci interrompere.
+// Dentro la fascia BLE_TASK sta sopra WIFI_TASK: le sue notifiche sono
+// brevi, mentre wifi_task puo' restare a lungo in una scrittura NVS.
+//
+// Core: con lo sdkconfig del progetto Bluedroid, controller e driver Wi-Fi
+// sono tutti sul core 0 (CONFIG_BT_BLUEDROID_PINNED_TO_CORE,
+// CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_0). Le politiche:
+//   TASK_PLACE_APP_CPU    task dell'applicazione sul core 1, lontano dalla
+//                         radio (predefinita)
+//   TASK_PLACE_RADIO_CPU  ogni task sul core dello stack che lo alimenta
+//   TASK_PLACE_FLOAT      senza affinita', come xTaskCreate
+// I numeri dietro la scelta li da' host/bench/sched_bench.c; sul
+// dispositivo la telemetria misura l'attesa in coda (TELEMETRY_LAT_WAKE_*).
+typedef enum {
+    TASK_PLACE_APP_CPU,
+    TASK_PLACE_RADIO_CPU,
+    TASK_PLACE_FLOAT,
+    TASK_PLACE_COUNT
+} task_place_policy_t;
+
+#ifndef APP_TASK_PLACEMENT
+#define APP_TASK_PLACEMENT      TASK_PLACE_APP_CPU
+#endif
+
+#ifndef BLE_TASK_PRIORITY
+#define BLE_TASK_PRIORITY       4
+#endif
+#ifndef WIFI_TASK_PRIORITY
+#define WIFI_TASK_PRIORITY      3
+#endif
+#ifndef DLOG_TASK_PRIORITY
+#define DLOG_TASK_PRIORITY      1
+#endif
+#ifndef JOURNAL_TASK_PRIORITY
+#define JOURNAL_TASK_PRIORITY   1
+#endif
+// Download e scrittura OTA: sopra il log, che non deve rallentare la flash
+#ifndef OTA_TASK_PRIORITY
+#define OTA_TASK_PRIORITY       2
+#endif
+#ifndef OTA_FLASH_TASK_PRIORITY
+#define OTA_FLASH_TASK_PRIORITY 2
+#endif
+
+// Core degli stack radio, dallo sdkconfig (incluso da FreeRTOS.h su IDF)
+#ifdef CONFIG_BT_BLUEDROID_PINNED_TO_CORE
+#define TASK_PLAN_BT_CORE       CONFIG_BT_BLUEDROID_PINNED_TO_CORE
+#else
+#define TASK_PLAN_BT_CORE       0
+#endif
+#ifdef CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1
+#define TASK_PLAN_WIFI_CORE     1
+#else
+#define TASK_PLAN_WIFI_CORE     0
+#endif
+// Il core lasciato all'applicazione
+#define TASK_PLAN_APP_CORE      1
+
+typedef enum {
+    TASK_PLAN_BLE,              // BLE_TASK: consuma wifi_to_ble_q
+    TASK_PLAN_WIFI,             // WIFI_TASK: consuma ble_to_wifi_q
+    TASK_PLAN_DLOG,             // DLOG_TASK: svuota l'anello del log
+    TASK_PLAN_JOURNAL,          // JOURNAL: scrive il diario in flash a blocchi
+    TASK_PLAN_OTA,              // OTA_TASK: scarica l'immagine (solo durante un OTA)
+    TASK_PLAN_OTA_FLASH,        // OTA_FLASH: la scrive nello slot libero
+    TASK_PLAN_COUNT
+} task_plan_id_t;
+
+typedef struct {
+    const char *name;
+    UBaseType_t priority;
+    BaseType_t core;            // 0, 1 o tskNO_AFFINITY
+} task_place_t;
+
+// Posizione del task con la politica data; con un solo core (o
+// CONFIG_FREERTOS_UNICORE) il core e' sempre tskNO_AFFINITY
+task_place_t task_plan_get(task_plan_id_t id, task_place_policy_t policy);
+
+const char *task_plan_policy_name(task_place_policy_t policy);
+
+#endif // TASK_PLAN_H
@@ -0,0 +1,57 @@
+// telemetry.h
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Telemetria di esercizio letta dal telefono sulla caratteristica
+// TELEMETRY_UUID. Gli istogrammi si aggiornano dal percorso caldo con un
+// solo incremento atomico; CPU, stack, heap e code si campionano solo
+// quando si costruisce un'istantanea.
+
+// Periodo delle notifiche quando il telefono e' iscritto
+#ifndef TELEMETRY_PERIOD_MS
+#define TELEMETRY_PERIOD_MS 1000
+#endif
+
+typedef enum {
+    TELEMETRY_LAT_SCAN,         // write COMMAND -> prima lista reti (anche parziale) allo stack
+    TELEMETRY_LAT_WIFI_EVT,     // wifi_task: gestione di un evento BLE -> Wi-Fi
+    TELEMETRY_LAT_GATTS_CB,     // durata di una callback GATTS sul task BTC
+    // Attesa in coda: post su coda vuota -> ricezione del consumatore. Con il
+    // consumatore fermo sulla receive e' il tempo di risveglio (task_plan.h)
+    TELEMETRY_LAT_WAKE_WIFI,    // ble_to_wifi_q -> WIFI_TASK
+    TELEMETRY_LAT_WAKE_BLE,     // wifi_to_ble_q -> BLE_TASK
+    TELEMETRY_LAT_COUNT
+} telemetry_lat_t;
+
+// Bucket logaritmici: il bucket k conta le durate sotto 2^(k+7) us
+// (128 us, 256 us, ... ~2.1 s); l'ultimo raccoglie tutto il resto
+#define TELEMETRY_HIST_BUCKETS  16
+
+// Istantanea binaria, little-endian:
+//   [versione u8][task u8][uptime ms u32][heap libero u32][heap minimo u32]
+//   per task (BLE_TASK, WIFI_TASK): [CPU per mille u16][stack mai usato, byte u16]
+//   per coda (ble_to_wifi, wifi_to_ble): [in coda u8][picco u8][pool in uso u8][picco pool u8]
+//   [istogrammi u8][bucket u8] poi per istogramma i bucket u16 (saturati)
+// La CPU e' la quota di un core dall'istantanea precedente.
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_TASKS         2
+#define TELEMETRY_SNAPSHOT_LEN  (2 + 12 + TELEMETRY_TASKS * 4 + 2 * 4 + 2 + \
+                                 TELEMETRY_LAT_COUNT * TELEMETRY_HIST_BUCKETS * 2)
+
+void telemetry_init(void);
+
+// Registra una durata nell'istogramma
+void telemetry_record(telemetry_lat_t lat, uint32_t us);
+
+// Intervalli che iniziano e finiscono in task diversi: begin tiene solo il
+// primo inizio ancora aperto, end chiude e registra (se c'era un inizio)
+void telemetry_begin(telemetry_lat_t lat);
+void telemetry_end(telemetry_lat_t lat);
+
+// Scrive l'istantanea in 'out'; ritorna i byte scritti (0 se cap non basta)
+size_t telemetry_snapshot(uint8_t *out, size_t cap);
+
+#endif // TELEMETRY_H
@@ -7,7 +7,83 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
-// Inizializza il modulo WiFi in modalità Station
-void wifi_init_sta(UBaseType_t task_priority);
+// Per quanto tempo una scansione resta valida: le richieste che arrivano
+// entro il TTL ricevono subito la lista in cache, senza usare la radio
+#ifndef WIFI_SCAN_CACHE_TTL_MS
+#define WIFI_SCAN_CACHE_TTL_MS 15000
+#endif
+
+// Oltre questo tempo una scansione in corso si considera persa
+#ifndef WIFI_SCAN_TIMEOUT_MS
+#define WIFI_SCAN_TIMEOUT_MS 8000
+#endif
+
+// Scansione a gruppi di canali con un telefono collegato. Radio, antenna
+// e RF sono condivise con il BLE: durante il dwell su un canale diverso da
+// quello del Wi-Fi il controller BT salta i suoi eventi di connessione, e
+// con 13 canali di fila il telefono resta senza risposta per piu' di un
+// secondo. A gruppi di WIFI_SCAN_GROUP_CHANNELS canali (i piu' usati per
+// primi), con dwell corti e una pausa fra un gruppo e l'altro di almeno
+// WIFI_SCAN_GAP_EVENTS eventi di connessione; dopo ogni gruppo i telefoni
+// ricevono la lista parziale (SCAN_STREAM_FLAG_PARTIAL). Senza telefoni
+// collegati la scansione resta unica. 0 torna sempre alla scansione unica.
+#ifndef WIFI_SCAN_SPLIT
+#define WIFI_SCAN_SPLIT 1
+#endif
+
+#ifndef WIFI_SCAN_GROUP_CHANNELS
+#define WIFI_SCAN_GROUP_CHANNELS 3
+#endif
+
+// Dwell attivo per canale nei gruppi: i beacon arrivano ogni ~100 ms, ma
+// una probe response arriva entro pochi ms dalla probe request
+#ifndef WIFI_SCAN_COEX_DWELL_MIN_MS
+#define WIFI_SCAN_COEX_DWELL_MIN_MS 20
+#endif
+
+#ifndef WIFI_SCAN_COEX_DWELL_MS
+#define WIFI_SCAN_COEX_DWELL_MS 60
+#endif
+
+#ifndef WIFI_SCAN_GROUP_GAP_MS
+#define WIFI_SCAN_GROUP_GAP_MS 100
+#endif
+
+#ifndef WIFI_SCAN_GAP_EVENTS
+#define WIFI_SCAN_GAP_EVENTS 4
+#endif
+
+// Riconnessione dopo un fallimento: attesa casuale in [finestra/2, finestra],
+// con la finestra che raddoppia a ogni tentativo fino al tetto
+#ifndef WIFI_RETRY_BASE_MS
+#define WIFI_RETRY_BASE_MS 500
+#endif
+
+#ifndef WIFI_RETRY_MAX_MS
+#define WIFI_RETRY_MAX_MS 30000
+#endif
+
+// Stack di WIFI_TASK (byte): le scritture NVS delle reti salvate sono la
+// catena di chiamate piu' profonda
+#ifndef WIFI_TASK_STACK
+#define WIFI_TASK_STACK 3584
+#endif
+
+// Richieste che wifi_task ha assorbito invece di usare la radio; la
+// fusione in coda e i CONNECT sostituiti sono in queue_stats_t
+typedef struct {
+    uint32_t scans_started;         // scansioni radio avviate
+    uint32_t scans_joined;          // richieste agganciate a una scansione in corso
+    uint32_t scans_cached;          // richieste servite dalla cache
+    uint32_t connects;              // CONNECT eseguiti
+    uint32_t connects_redundant;    // CONNECT verso la rete gia' collegata o in collegamento
+    uint32_t autojoins_dropped;     // auto-join annullati da un CONNECT esplicito
+} wifi_cmd_stats_t;
+
+// Inizializza il modulo WiFi in modalità Station; priorita' e core di
+// WIFI_TASK in task_plan.h
+void wifi_init_sta(void);
+
+void wifi_get_cmd_stats(wifi_cmd_stats_t *out);
 
 #endif // WIFI_HANDLER_H
\ No newline at end of file
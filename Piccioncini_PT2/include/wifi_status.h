@@ -0,0 +1,62 @@
+// wifi_status.h
+#ifndef WIFI_STATUS_H
+#define WIFI_STATUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stato della connessione Wi-Fi in una parola atomica: wifi_handler la
+// aggiorna dal loop eventi e da wifi_task, ogni cambiamento sveglia ble_task
+// (WIFI_BLE_EVT_CONNECT_STATUS) che lo notifica su WIFI_STATUS_UUID.
+typedef enum {
+    WIFI_STATE_IDLE,            // nessuna rete da provare, o lasciata su richiesta
+    WIFI_STATE_CONNECTING,      // tentativo in corso
+    WIFI_STATE_ASSOCIATED,      // link su, IP non ancora assegnato
+    WIFI_STATE_GOT_IP,
+    WIFI_STATE_FAILED,          // tentativo fallito o link perso: vedi reason
+    WIFI_STATE_COUNT
+} wifi_state_t;
+
+// L'RSSI si campiona ogni WIFI_STATUS_RSSI_PERIOD_MS mentre si e' collegati
+// e si pubblica solo se si sposta di almeno WIFI_STATUS_RSSI_DELTA dB
+// dall'ultimo valore notificato
+#ifndef WIFI_STATUS_RSSI_PERIOD_MS
+#define WIFI_STATUS_RSSI_PERIOD_MS 5000
+#endif
+
+#ifndef WIFI_STATUS_RSSI_DELTA
+#define WIFI_STATUS_RSSI_DELTA 5
+#endif
+
+typedef struct {
+    wifi_state_t state;
+    uint8_t reason;             // wifi_err_reason_t in FAILED e nel CONNECTING che segue
+    int8_t rssi;                // dBm, 0 finche' non si e' associati
+    uint8_t seq;                // cresce a ogni cambiamento: il telefono vede i salti
+    uint32_t ip;                // esp_ip4_addr_t.addr, solo in GOT_IP
+} wifi_status_t;
+
+// Valore di WIFI_STATUS_UUID (letto o notificato):
+//   [versione u8][stato u8][reason u8][rssi i8][seq u8][ip a.b.c.d]
+#define WIFI_STATUS_VERSION     1
+#define WIFI_STATUS_VALUE_LEN   9
+
+// IDLE, CONNECTING, FAILED: azzerano RSSI e IP. CONNECTING ignora reason e
+// conserva quello dell'ultimo fallimento.
+void wifi_status_set(wifi_state_t state, uint8_t reason);
+void wifi_status_associated(int8_t rssi);
+void wifi_status_got_ip(uint32_t ip);
+// Nuovo campione di RSSI del link; ignorato se non si e' collegati
+void wifi_status_rssi(int8_t rssi);
+
+void wifi_status_get(wifi_status_t *out);
+// Associati (con o senza IP): sostituisce il vecchio flag g_wifi_connected
+bool wifi_status_is_connected(void);
+
+// Scrive il valore della caratteristica; ritorna i byte scritti (0 se cap non basta)
+size_t wifi_status_encode(const wifi_status_t *st, uint8_t *out, size_t cap);
+
+const char *wifi_state_name(wifi_state_t state);
+
+#endif // WIFI_STATUS_H
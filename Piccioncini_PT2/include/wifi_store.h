@@ -0,0 +1,56 @@
+// wifi_store.h
+#ifndef WIFI_STORE_H
+#define WIFI_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "common_variables.h"
+
+// Reti conosciute, salvate in NVS come un unico blob. A parita' di
+// visibilita' vince la priorita' piu' alta, poi l'RSSI.
+#ifndef WIFI_STORE_MAX_NETWORKS
+#define WIFI_STORE_MAX_NETWORKS 8
+#endif
+
+// Lista letta dal telefono (mai le password):
+//   [versione u8][numero reti u8]
+//   per ogni rete: [priorita' u8][flag u8][len ssid u8][ssid]
+#define WIFI_STORE_LIST_VERSION     1
+#define WIFI_STORE_FLAG_HAS_PASS    0x01
+#define WIFI_STORE_LIST_MAX_LEN     (2 + WIFI_STORE_MAX_NETWORKS * (3 + 32))
+
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t priority;
+} wifi_store_entry_t;
+
+// Carica le reti dall'NVS (da chiamare dopo nvs_flash_init)
+void wifi_store_init(void);
+
+// Le modifiche vanno fatte solo da WIFI_TASK; lettura e match sono sicuri
+// da qualunque task.
+// Aggiunge o aggiorna una rete; con keep_priority una rete gia' presente
+// mantiene la sua priorita'. A memoria piena si sostituisce la rete con
+// priorita' piu' bassa.
+esp_err_t wifi_store_upsert(const char *ssid, const char *password, uint8_t priority,
+                            bool keep_priority);
+esp_err_t wifi_store_remove(const char *ssid);
+esp_err_t wifi_store_clear(void);
+uint8_t wifi_store_count(void);
+
+// Sceglie la rete salvata migliore fra quelle viste in scansione: prima le
+// reti con meno connessioni fallite, poi la priorita', poi l'RSSI.
+// Ritorna false se nessuna rete salvata e' visibile.
+bool wifi_store_match(const wifi_scan_record_t *recs, uint8_t count,
+                      wifi_store_entry_t *net, const wifi_scan_record_t **rec);
+
+// Esito di una connessione a una rete salvata (contatore solo in RAM)
+void wifi_store_note_result(const char *ssid, bool ok);
+
+// Serializza la lista per la lettura via GATT; ritorna i byte scritti
+size_t wifi_store_describe(uint8_t *out, size_t cap);
+
+#endif // WIFI_STORE_H
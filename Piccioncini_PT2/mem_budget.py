@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# mem_budget.py
+# Rapporto RAM/flash per modulo del firmware, confrontato con i budget di
+# mem_budget.csv: la build fallisce se un modulo o il totale li supera.
+#
+# Per modulo (un file di src/), dai file oggetto con 'size':
+#   RAM   = data + bss   (variabili, pool, stack e code statici: rtos_static.h)
+#   flash = text + data  (codice, costanti e valori iniziali di .data)
+# Il linker con --gc-sections puo' solo togliere: i numeri sono un tetto.
+# L'heap non c'e': lo misura la telemetria a runtime (heap minimo).
+#
+# PlatformIO: extra_scripts = post:mem_budget.py  (gira dopo il link)
+# A mano:     python3 mem_budget.py [--size xtensa-esp32-elf-size]
+#                                   [--budget mem_budget.csv] [--report-only] file.o ...
+
+import argparse
+import os
+import subprocess
+import sys
+
+TOTAL = "TOTALE"
+DEFAULT = "*"
+
+
+def module_name(path):
+    # ble_handler.c.obj, ble_handler.c.o, ble_handler.o -> ble_handler
+    return os.path.basename(path).split(".")[0]
+
+
+def load_budget(path):
+    budget = {}
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = [x.strip() for x in line.split(",")]
+            if len(fields) != 3:
+                raise SystemExit("%s:%d: attesi 'modulo, ram, flash'" % (path, lineno))
+            budget[fields[0]] = (int(fields[1], 0), int(fields[2], 0))
+    return budget
+
+
+def measure(size_tool, objects):
+    out = subprocess.run([size_tool, "-B"] + objects, check=True, capture_output=True,
+                         text=True).stdout
+    usage = {}
+    for line in out.splitlines()[1:]:
+        cols = line.split()
+        if len(cols) < 6:
+            continue
+        text, data, bss = int(cols[0]), int(cols[1]), int(cols[2])
+        ram, flash = usage.get(module_name(cols[5]), (0, 0))
+        usage[module_name(cols[5])] = (ram + data + bss, flash + text + data)
+    return usage
+
+
+def report(usage, budget):
+    over = []
+    rows = sorted(usage.items(), key=lambda kv: -kv[1][0])
+    total = (sum(u[0] for u in usage.values()), sum(u[1] for u in usage.values()))
+    print("%-20s %8s %8s %5s   %8s %8s %5s" % ("modulo", "RAM", "budget", "%", "flash", "budget", "%"))
+    for name, used in rows + [(TOTAL, total)]:
+        limit = budget.get(name, budget.get(DEFAULT) if name != TOTAL else None)
+        cells = []
+        for kind, u, b in (("RAM", used[0], limit and limit[0]), ("flash", used[1], limit and limit[1])):
+            cells += [u, b if b else "-", "%d" % (100 * u // b) if b else "-"]
+            if b and u > b:
+                over.append("%s: %s %d B oltre il budget di %d B" % (name, kind, u, b))
+        print("%-20s %8s %8s %5s   %8s %8s %5s" % tuple([name] + cells))
+    for name in sorted(set(budget) - set(usage) - {TOTAL, DEFAULT}):
+        print("(budget per %s, modulo non trovato)" % name)
+    return over
+
+
+def run(objects, size_tool, budget_path, report_only):
+    if not objects:
+        print("mem_budget: nessun file oggetto")
+        return 1
+    over = report(measure(size_tool, objects), load_budget(budget_path))
+    for line in over:
+        print("mem_budget: " + line)
+    if over and not report_only:
+        print("mem_budget: budget superato (aggiornare %s solo se voluto)" % os.path.basename(budget_path))
+        return 1
+    return 0
+
+
+def find_objects(build_dir, modules):
+    # Con framework = espidf gli oggetti di src/ stanno sotto la build CMake
+    # (.../__idf_src.dir/ble_handler.c.obj): si cercano per nome
+    found = []
+    for root, _, files in os.walk(build_dir):
+        for f in files:
+            if f.endswith((".o", ".obj")) and module_name(f) in modules:
+                found.append(os.path.join(root, f))
+    return found
+
+
+try:
+    Import("env")  # noqa: F821 (definito da SCons)
+except NameError:
+    env = None
+
+if env is not None:
+    def _mem_budget(source, target, env):
+        project = env.subst("$PROJECT_DIR")
+        src = env.subst("$PROJECT_SRC_DIR")
+        modules = {module_name(f) for f in os.listdir(src) if f.endswith(".c")}
+        objects = find_objects(env.subst("$BUILD_DIR"), modules)
+        return run(objects, env.subst("$SIZETOOL") or "size",
+                   os.path.join(project, "mem_budget.csv"), False)
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", _mem_budget)
+elif __name__ == "__main__":
+    ap = argparse.ArgumentParser(description="RAM/flash per modulo contro mem_budget.csv")
+    ap.add_argument("--size", default="size", help="strumento size (es. xtensa-esp32-elf-size)")
+    ap.add_argument("--budget", default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                     "mem_budget.csv"))
+    ap.add_argument("--report-only", action="store_true", help="non fallisce sui budget superati")
+    ap.add_argument("objects", nargs="*")
+    args = ap.parse_args()
+    sys.exit(run(args.objects, args.size, args.budget, args.report_only))
@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+# perf_gate.py
+# Perf gate da far girare prima di flashare: il firmware si avvia nel QEMU
+# esp32 di Espressif (build con APP_PERF_GATE=1, radio spenta: vedi
+# include/perf_gate.h) e le misure si confrontano con perf_baseline.csv.
+# Fallisce se una metrica peggiora oltre la sua tolleranza, se il firmware
+# va in panic o se il rapporto non arriva entro il timeout.
+#
+# Metriche:
+#   size.*    sezioni dell'immagine, dall'ELF con 'size -A', e il .bin
+#   boot.*    profilo di avvio in ms (boot_profile.h)
+#   heap.*    heap libero e minimo, byte
+#   stack.*   stack mai usato per task, byte
+# Peggiorare vuol dire crescere per size.* e boot.*, calare per heap.* e
+# stack.*. I tempi sono quelli di QEMU, non della scheda: si confrontano
+# solo con una baseline presa sulla stessa macchina.
+#
+# PlatformIO: extra_scripts = post:perf_gate.py aggiunge il target
+#   pio run -e firebeetle32_qemu -t perf_gate
+# (QEMU da $QEMU_ESP32 o qemu-system-xtensa nel PATH; PERF_GATE_UPDATE=1
+# riscrive la baseline invece di confrontare).
+# A mano:
+#   python3 perf_gate.py --elf firmware.elf [--bin firmware.bin] [--size xtensa-esp32-elf-size]
+#                        [--flash flash.bin [--qemu qemu-system-xtensa] | --log console.txt]
+#                        [--baseline perf_baseline.csv] [--update]
+
+import argparse
+import os
+import selectors
+import subprocess
+import sys
+import time
+
+NOT_MEASURED = "-"
+PANIC_MARKS = ("Guru Meditation", "abort() was called", "Stack canary watchpoint triggered")
+REPORT_PREFIX = "PERF "
+REPORT_END = "PERF fine"
+
+# Sezioni ESP32 per metrica, per prefisso del nome
+SECTION_GROUPS = (
+    ("size.iram", (".iram0",)),
+    ("size.dram_data", (".dram0.data",)),
+    ("size.dram_bss", (".dram0.bss", ".dram0.noinit")),
+    ("size.flash_text", (".flash.text",)),
+    ("size.flash_rodata", (".flash.rodata", ".flash.appdesc")),
+    ("size.rtc", (".rtc",)),
+)
+
+# Tolleranza per le metriche nuove scritte da --update
+DEFAULT_TOLERANCE = {"size": "2%", "boot": "50", "heap": "4096", "stack": "256"}
+
+
+def lower_is_worse(name):
+    return name.startswith(("heap.", "stack."))
+
+
+def load_baseline(path):
+    # Ritorna (righe di commento in testa, {metrica: (valore o None, tolleranza)})
+    header, base = [], {}
+    if not os.path.exists(path):
+        return header, base
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            text = line.split("#", 1)[0].strip()
+            if not text:
+                if not base:
+                    header.append(line.rstrip("\n"))
+                continue
+            fields = [x.strip() for x in text.split(",")]
+            if len(fields) != 3:
+                raise SystemExit("%s:%d: attesi 'metrica, valore, tolleranza'" % (path, lineno))
+            value = None if fields[1] == NOT_MEASURED else int(fields[1], 0)
+            base[fields[0]] = (value, fields[2])
+    return header, base
+
+
+def save_baseline(path, header, base, measured):
+    merged = dict(base)
+    for name, value in measured.items():
+        tol = base[name][1] if name in base else DEFAULT_TOLERANCE[name.split(".")[0]]
+        merged[name] = (value, tol)
+    with open(path, "w") as f:
+        for line in header:
+            f.write(line + "\n")
+        for name in sorted(merged):
+            value, tol = merged[name]
+            f.write("%-24s %8s,  %s\n" % (name + ",", NOT_MEASURED if value is None else value, tol))
+
+
+def allowance(base, tol):
+    if tol.endswith("%"):
+        return base * float(tol[:-1]) / 100
+    return int(tol, 0)
+
+
+def measure_sizes(size_tool, elf, binary):
+    out = subprocess.run([size_tool, "-A", elf], check=True, capture_output=True, text=True).stdout
+    sizes = {}
+    for line in out.splitlines():
+        cols = line.split()
+        if len(cols) < 2 or not cols[0].startswith(".") or not cols[1].isdigit():
+            continue
+        for metric, prefixes in SECTION_GROUPS:
+            if cols[0].startswith(prefixes):
+                sizes[metric] = sizes.get(metric, 0) + int(cols[1])
+                break
+    if binary:
+        sizes["size.image"] = os.path.getsize(binary)
+    return sizes
+
+
+def parse_report(lines):
+    # Ritorna (metriche, errore o None)
+    measured = {}
+    for line in lines:
+        if any(mark in line for mark in PANIC_MARKS):
+            return measured, "panic del firmware: " + line.strip()
+        if line.startswith(REPORT_END):
+            return measured, None
+        if line.startswith(REPORT_PREFIX):
+            cols = line.split()
+            if len(cols) == 3:
+                measured[cols[1]] = int(cols[2])
+    return measured, "rapporto incompleto (manca '%s')" % REPORT_END
+
+
+def run_qemu(qemu, flash, timeout_s):
+    cmd = [qemu, "-nographic", "-machine", "esp32",
+           "-drive", "file=%s,if=mtd,format=raw" % flash]
+    print("perf_gate: " + " ".join(cmd))
+    proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT, text=True, errors="replace")
+    lines = []
+    sel = selectors.DefaultSelector()
+    sel.register(proc.stdout, selectors.EVENT_READ)
+    deadline = time.monotonic() + timeout_s
+    try:
+        while time.monotonic() < deadline:
+            if not sel.select(deadline - time.monotonic()):
+                continue
+            line = proc.stdout.readline()
+            if not line:
+                break
+            lines.append(line)
+            if line.startswith(REPORT_END) or any(mark in line for mark in PANIC_MARKS):
+                break
+    finally:
+        proc.kill()
+        proc.wait()
+    return lines
+
+
+def app_offset(partitions_csv):
+    # Il bootloader avvia la prima app della tabella (otadata vuota)
+    with open(partitions_csv) as f:
+        for line in f:
+            cols = [x.strip() for x in line.split("#", 1)[0].split(",")]
+            if len(cols) >= 4 and cols[1] == "app":
+                return int(cols[3], 0)
+    raise SystemExit("perf_gate: nessuna partizione app in " + partitions_csv)
+
+
+def make_flash(esptool, build_dir, partitions_csv, out):
+    # Immagine intera per QEMU (che vuole 2, 4, 8 o 16 MB)
+    cmd = esptool + ["--chip", "esp32", "merge_bin", "-o", out, "--fill-flash-size", "4MB",
+                     "0x1000", os.path.join(build_dir, "bootloader.bin"),
+                     "0x8000", os.path.join(build_dir, "partitions.bin"),
+                     hex(app_offset(partitions_csv)), os.path.join(build_dir, "firmware.bin")]
+    subprocess.run(cmd, check=True)
+
+
+def compare(measured, base):
+    worse = []
+    print("%-24s %10s %10s %10s" % ("metrica", "misura", "baseline", "limite"))
+    for name in sorted(set(measured) | set(base)):
+        value = measured.get(name)
+        ref, tol = base.get(name, (None, None))
+        if ref is None:
+            print("%-24s %10s %10s %10s" % (name, NOT_MEASURED if value is None else value, NOT_MEASURED,
+                                            "(nuova)"))
+            continue
+        if value is None:
+            print("%-24s %10s %10s %10s" % (name, NOT_MEASURED, ref, "(non misurata)"))
+            continue
+        if lower_is_worse(name):
+            limit = ref - allowance(ref, tol)
+            bad = value < limit
+        else:
+            limit = ref + allowance(ref, tol)
+            bad = value > limit
+        print("%-24s %10d %10d %10d%s" % (name, value, ref, limit, "  PEGGIORATA" if bad else ""))
+        if bad:
+            worse.append("%s: %d contro %d (tolleranza %s)" % (name, value, ref, tol))
+    return worse
+
+
+def run(args):
+    measured = {}
+    if args.elf:
+        measured.update(measure_sizes(args.size, args.elf, args.bin))
+    if args.log or args.flash:
+        if args.log:
+            with open(args.log, errors="replace") as f:
+                lines = f.readlines()
+        else:
+            lines = run_qemu(args.qemu, args.flash, args.timeout)
+        report, err = parse_report(lines)
+        measured.update(report)
+        if err:
+            for line in lines[-20:]:
+                print("  | " + line.rstrip())
+            print("perf_gate: " + err)
+            return 1
+    if not measured:
+        print("perf_gate: niente da misurare (servono --elf, --flash o --log)")
+        return 1
+
+    header, base = load_baseline(args.baseline)
+    if args.update:
+        save_baseline(args.baseline, header, base, measured)
+        print("perf_gate: %d metriche scritte in %s" % (len(measured), args.baseline))
+        return 0
+    worse = compare(measured, base)
+    # Una riga "-" misurata in questo giro non e' controllata da nessuno:
+    # --update la scrive, quindi si fallisce invece di passare in silenzio
+    unset = sorted(name for name, (ref, _) in base.items()
+                   if ref is None and measured.get(name) is not None)
+    if unset:
+        print("perf_gate: *** BASELINE NON INIZIALIZZATA: %d metriche senza valore in %s (%s) ***"
+              % (len(unset), os.path.basename(args.baseline), ", ".join(unset)))
+        print("perf_gate: senza baseline il gate non vede regressioni; scriverla con "
+              "--update (o PERF_GATE_UPDATE=1) da una build buona")
+        return 1
+    for line in worse:
+        print("perf_gate: " + line)
+    if worse:
+        print("perf_gate: regressione (aggiornare %s solo se voluta)" % os.path.basename(args.baseline))
+        return 1
+    return 0
+
+
+def parser(project):
+    ap = argparse.ArgumentParser(description="Avvio in QEMU e dimensioni contro perf_baseline.csv")
+    ap.add_argument("--elf", help="firmware.elf per le dimensioni delle sezioni")
+    ap.add_argument("--bin", help="firmware.bin per size.image")
+    ap.add_argument("--size", default="size", help="strumento size (es. xtensa-esp32-elf-size)")
+    ap.add_argument("--flash", help="immagine intera della flash da avviare in QEMU")
+    ap.add_argument("--qemu", default=os.environ.get("QEMU_ESP32", "qemu-system-xtensa"))
+    ap.add_argument("--log", help="console gia' catturata, al posto di QEMU")
+    ap.add_argument("--timeout", type=float, default=60, help="secondi per il rapporto")
+    ap.add_argument("--baseline", default=os.path.join(project, "perf_baseline.csv"))
+    ap.add_argument("--update", action="store_true", help="scrive le misure nella baseline")
+    return ap
+
+
+try:
+    Import("env")  # noqa: F821 (definito da SCons)
+except NameError:
+    env = None
+
+if env is not None:
+    def _perf_gate(target, source, env):
+        project = env.subst("$PROJECT_DIR")
+        build = env.subst("$BUILD_DIR")
+        tool = os.path.join(env.PioPlatform().get_package_dir("tool-esptoolpy"), "esptool.py")
+        flash = os.path.join(build, "qemu_flash.bin")
+        make_flash([env.subst("$PYTHONEXE"), tool], build,
+                   os.path.join(project, env.GetProjectOption("board_build.partitions")), flash)
+        args = parser(project).parse_args([
+            "--elf", os.path.join(build, env.subst("${PROGNAME}.elf")),
+            "--bin", os.path.join(build, env.subst("${PROGNAME}.bin")),
+            "--size", env.subst("$SIZETOOL") or "size",
+            "--flash", flash,
+        ] + (["--update"] if os.environ.get("PERF_GATE_UPDATE") == "1" else []))
+        return run(args)
+
+    env.AddCustomTarget(
+        name="perf_gate",
+        dependencies="$BUILD_DIR/${PROGNAME}.bin",
+        actions=_perf_gate,
+        title="Perf gate",
+        description="Avvio in QEMU, heap, stack e dimensioni contro perf_baseline.csv")
+elif __name__ == "__main__":
+    sys.exit(run(parser(os.path.dirname(os.path.abspath(__file__))).parse_args()))
@@ -0,0 +1,185 @@
+// ble_command.c
+#include "ble_command.h"
+#include "ble_link.h"
+#include "common_variables.h"
+#include "dlog.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "ota_update.h"
+#include "telemetry.h"
+#include "wifi_status.h"
+#include "wifi_store.h"
+
+#include <string.h>
+
+// Un gestore legge gli argomenti (gia' controllati contro min/max) e puo'
+// scrivere fino a CMD_STATS_LEN byte di dati nella risposta
+typedef cmd_status_t (*cmd_handler_t)(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+
+typedef struct {
+    cmd_handler_t handler;
+    uint8_t min_len;
+    uint8_t max_len;
+} cmd_entry_t;
+
+static cmd_status_t cmd_scan(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+static cmd_status_t cmd_disconnect(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+static cmd_status_t cmd_forget(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+static cmd_status_t cmd_stats(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+static cmd_status_t cmd_factory_reset(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+static cmd_status_t cmd_ota(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len);
+
+// Indicizzata per opcode: un comando nuovo e' una riga qui e un gestore
+static const cmd_entry_t commands[] = {
+    [CMD_OP_SCAN]          = { cmd_scan,          0, 1 },
+    [CMD_OP_DISCONNECT]    = { cmd_disconnect,    0, 0 },
+    [CMD_OP_FORGET]        = { cmd_forget,        1, 32 },
+    [CMD_OP_STATS]         = { cmd_stats,         0, 0 },
+    [CMD_OP_FACTORY_RESET] = { cmd_factory_reset, 1, 1 },
+    [CMD_OP_OTA]           = { cmd_ota,           0, OTA_URL_MAX - 1 },
+};
+
+static const cmd_entry_t *cmd_find(uint8_t op) {
+    if (op >= sizeof(commands) / sizeof(commands[0]) || commands[op].handler == NULL) {
+        return NULL;
+    }
+    return &commands[op];
+}
+
+static size_t put_u16(uint8_t *out, size_t pos, uint32_t v) {
+    out[pos++] = (uint8_t)v;
+    out[pos++] = (uint8_t)(v >> 8);
+    return pos;
+}
+
+static size_t put_u32(uint8_t *out, size_t pos, uint32_t v) {
+    pos = put_u16(out, pos, v);
+    return put_u16(out, pos, v >> 16);
+}
+
+static cmd_status_t cmd_scan(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    bool fresh = len > 0 && (args[0] & CMD_SCAN_FRESH) != 0;
+    if (len > 0 && (args[0] & ~CMD_SCAN_FRESH) != 0) {
+        return CMD_STATUS_BAD_ARG;
+    }
+    telemetry_begin(TELEMETRY_LAT_SCAN);
+    // La lista arriva tra qualche secondo: il link si accorcia mentre il
+    // Wi-Fi scansiona
+    ble_link_bulk_expect();
+    // Una scansione gia' in coda assorbe le richieste successive
+    return ble_wifi_request(fresh ? BLE_WIFI_EVT_SCAN_FRESH : BLE_WIFI_EVT_BTN_PRESS)
+        ? CMD_STATUS_OK : CMD_STATUS_BUSY;
+}
+
+static cmd_status_t cmd_disconnect(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    return ble_wifi_request(BLE_WIFI_EVT_DISCONNECT) ? CMD_STATUS_OK : CMD_STATUS_BUSY;
+}
+
+static cmd_status_t cmd_forget(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    ble_wifi_evt_t *evt = ble_wifi_alloc();
+    if (evt == NULL) {
+        return CMD_STATUS_BUSY;
+    }
+    evt->type = BLE_WIFI_EVT_NET_REMOVE;
+    memcpy(evt->ssid, args, len);
+    return ble_wifi_post(evt) ? CMD_STATUS_OK : CMD_STATUS_BUSY;
+}
+
+static cmd_status_t cmd_stats(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    wifi_status_t st;
+    queue_stats_t bw;
+    dlog_stats_t ls;
+    wifi_status_get(&st);
+    queues_get_stats(&bw, NULL);
+    dlog_get_stats(&ls);
+    size_t pos = 0;
+    pos = put_u32(out, pos, (uint32_t)(esp_timer_get_time() / 1000));
+    pos = put_u32(out, pos, esp_get_free_heap_size());
+    out[pos++] = (uint8_t)st.state;
+    out[pos++] = (uint8_t)st.rssi;
+    out[pos++] = wifi_store_count();
+    // Saturati: al telefono basta sapere che qualcosa si e' perso
+    pos = put_u16(out, pos, bw.rejected > UINT16_MAX ? UINT16_MAX : bw.rejected);
+    pos = put_u16(out, pos, ls.dropped > UINT16_MAX ? UINT16_MAX : ls.dropped);
+    *out_len = pos;
+    return CMD_STATUS_OK;
+}
+
+static cmd_status_t cmd_factory_reset(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    // Il byte di conferma evita che una write sbagliata cancelli tutto
+    if (args[0] != CMD_FACTORY_RESET_CONFIRM) {
+        return CMD_STATUS_BAD_ARG;
+    }
+    return ble_wifi_request(BLE_WIFI_EVT_FACTORY_RESET) ? CMD_STATUS_OK : CMD_STATUS_BUSY;
+}
+
+static cmd_status_t cmd_ota(const uint8_t *args, uint8_t len, uint8_t *out, size_t *out_len) {
+    cmd_status_t status = CMD_STATUS_OK;
+    if (len > 0) {
+        esp_err_t err;
+        if (len == 1 && args[0] == CMD_OTA_START) {
+            err = ota_update_start(NULL);
+        } else {
+            char url[OTA_URL_MAX];
+            memcpy(url, args, len);
+            url[len] = '\0';
+            err = ota_update_start(url);
+        }
+        status = err == ESP_OK ? CMD_STATUS_OK
+               : err == ESP_ERR_INVALID_STATE || err == ESP_ERR_NO_MEM ? CMD_STATUS_BUSY
+               : CMD_STATUS_BAD_ARG;
+    }
+    ota_progress_t p;
+    ota_update_get(&p);
+    size_t pos = 0;
+    out[pos++] = (uint8_t)p.state;
+    pos = put_u32(out, pos, p.written);
+    pos = put_u32(out, pos, p.total);
+    out[pos++] = p.resumes;
+    *out_len = pos;
+    return status;
+}
+
+int ble_command_dispatch(uint16_t conn_id, const uint8_t *v, uint16_t len, ble_command_reply_t reply) {
+    if (len == 0) {
+        return 0;
+    }
+    if (len == 1 || v[0] >= CMD_LEGACY_MIN) {
+        size_t none = 0;
+        cmd_scan(NULL, 0, NULL, &none);
+        DLOGD(BLE, "Comando in queue");
+        return 1;
+    }
+
+    int index = 0;
+    uint16_t pos = 0;
+    while (pos < len) {
+        uint8_t rsp[CMD_REPLY_MAX_LEN];
+        size_t data_len = 0;
+        cmd_status_t status;
+        uint8_t op = v[pos];
+        if (len - pos < 2 || len - pos - 2 < v[pos + 1]) {
+            status = CMD_STATUS_TRUNCATED;
+            pos = len;
+        } else {
+            const uint8_t *args = &v[pos + 2];
+            uint8_t args_len = v[pos + 1];
+            pos += 2 + args_len;
+            const cmd_entry_t *e = cmd_find(op);
+            if (e == NULL) {
+                status = CMD_STATUS_UNKNOWN;
+            } else if (args_len < e->min_len || args_len > e->max_len) {
+                status = CMD_STATUS_BAD_LEN;
+            } else {
+                status = e->handler(args, args_len, &rsp[CMD_REPLY_HDR_LEN], &data_len);
+            }
+        }
+        DLOGI(BLE, "Comando %d (op 0x%02x) da conn %u: stato %u", index, op, conn_id, status);
+        rsp[0] = (uint8_t)index;
+        rsp[1] = op;
+        rsp[2] = (uint8_t)status;
+        reply(conn_id, rsp, CMD_REPLY_HDR_LEN + data_len);
+        index++;
+    }
+    return index;
+}
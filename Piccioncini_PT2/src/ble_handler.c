@@ -1,26 +1,82 @@
 /* src/ble_handler.c */
 
 #include "ble_handler.h"
+#include "ble_command.h"
+#include "ble_link.h"
+#include "boot_profile.h"
 #include "common_variables.h"
 #include "esp_bt.h"
 #include "esp_bt_main.h"
 #include "esp_gap_ble_api.h"
 #include "esp_gatts_api.h"
-#include "esp_log.h"
+#include "esp_gatt_common_api.h"
+#include "dlog.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "rtos_static.h"
+#include "config_parser.h"
+#include "journal.h"
+#include "perf_gate.h"
+#include "scan_stream.h"
+#include "telemetry.h"
+#include "wifi_status.h"
+#include "wifi_store.h"
 #include <string.h>
 
-static const char* BLE_TAG = "BLE_HANDLER";
+// Iscrizioni (CCCD) di una connessione
+#define BLE_SUB_SCAN          0x01
+#define BLE_SUB_STATUS        0x02
+#define BLE_SUB_TELEMETRY     0x04
+#define BLE_SUB_COMMAND       0x08
+
+// Valore piu' lungo fra quelli che una connessione legge a read blob
+#define BLE_MAX(a, b)         ((a) > (b) ? (a) : (b))
+#define BLE_LONG_READ_MAX     BLE_MAX(BLE_MAX(WIFI_STORE_LIST_MAX_LEN, TELEMETRY_SNAPSHOT_LEN), \
+                                      JOURNAL_PAGE_LEN)
+
+// Contesto di un telefono collegato. I campi della connessione li scrive il
+// task BTC sotto conn_lock; tx e' il flusso in corso verso questo telefono
+// ed e' solo di ble_task, rd la read lunga in corso ed e' solo del task BTC.
+typedef struct {
+    bool used;
+    uint16_t conn_id;
+    uint16_t mtu;
+    bool congested;
+    uint8_t subscribed;             // BLE_SUB_*
+    uint32_t journal_pos;           // prossima pagina di JOURNAL_UUID
+    struct {
+        uint16_t handle;            // caratteristica copiata, 0 = nessuna
+        uint16_t len;
+        uint8_t buf[BLE_LONG_READ_MAX];
+    } rd;
+    struct {
+        bool active;
+        uint16_t conn_id;           // connessione per cui e' partito il flusso
+        uint16_t mtu;               // fissato all'inizio del flusso
+        uint16_t waited_ms;         // attesa per congestione dall'ultimo frammento
+        int sent;
+        scan_stream_chunker_t chunker;
+    } tx;
+} ble_conn_t;
 
-// BLE connection/context
-static uint16_t ble_conn_id = 0;
 static esp_gatt_if_t global_ble_gatts_if = 0;
+static ble_conn_t ble_conns[BLE_MAX_CONN];
+static SemaphoreHandle_t conn_lock;
+RTOS_MUTEX_DEFINE(conn_lock_mem);
+RTOS_TASK_DEFINE(ble_task_mem, BLE_TASK_STACK);
 
 // GATT characteristic handles
 static uint16_t service_handle = 0;
 static uint16_t wifi_scan_handle = 0;
 static uint16_t command_handle = 0;
+static uint16_t command_cccd_handle = 0;
 static uint16_t wifi_config_handle = 0;
 static uint16_t wifi_status_handle = 0;
+static uint16_t wifi_status_cccd_handle = 0;
+static uint16_t wifi_networks_handle = 0;
+static uint16_t telemetry_handle = 0;
+static uint16_t telemetry_cccd_handle = 0;
+static uint16_t journal_handle = 0;
 
 typedef struct {
     uint16_t char_handle;
@@ -36,6 +92,57 @@ ble_characteristic_t wifi_scan_characteristic;
 #define COMMAND_UUID          0xFF11
 #define WIFI_SCAN_LIST_UUID   0xFF20
 #define WIFI_CONFIG_UUID      0xFF21
+#define WIFI_NETWORKS_UUID    0xFF22
+#define TELEMETRY_UUID        0xFF30
+#define JOURNAL_UUID          0xFF31
+
+// Diario (include/journal.h) letto a pagine: ogni read dall'offset 0 serve
+// la pagina successiva della connessione, le read blob il resto della
+// stessa. Una write [posizione u32] sposta il cursore (0 = dal piu'
+// vecchio); una pagina senza record vuol dire diario finito.
+
+// Operazioni sulle reti salvate (write su WIFI_NETWORKS_UUID):
+//   [0x01][priorita' u8][len ssid u8][ssid][len password u8][password]
+//   [0x02][len ssid u8][ssid]
+//   [0x03]
+// La read restituisce l'elenco (vedi wifi_store.h), senza password.
+#define NET_OP_ADD            0x01
+#define NET_OP_REMOVE         0x02
+#define NET_OP_CLEAR          0x03
+
+// MTU offerto al telefono: la lista reti viaggia in frammenti da MTU - 3
+#define BLE_LOCAL_MTU         ESP_GATT_MAX_MTU_SIZE
+// Attesa massima quando lo stack segnala congestione durante l'invio
+#define BLE_CONGEST_WAIT_MS   500
+
+// Indici della tabella attributi: l'ordine e' quello degli handle assegnati
+enum {
+    IDX_SVC,
+    IDX_STATUS_CHAR,
+    IDX_STATUS_VAL,
+    IDX_STATUS_CCCD,
+    IDX_COMMAND_CHAR,
+    IDX_COMMAND_VAL,
+    IDX_COMMAND_CCCD,
+    IDX_SCAN_CHAR,
+    IDX_SCAN_VAL,
+    IDX_SCAN_CCCD,
+    IDX_CONFIG_CHAR,
+    IDX_CONFIG_VAL,
+    IDX_NETWORKS_CHAR,
+    IDX_NETWORKS_VAL,
+    IDX_TELEMETRY_CHAR,
+    IDX_TELEMETRY_VAL,
+    IDX_TELEMETRY_CCCD,
+    IDX_JOURNAL_CHAR,
+    IDX_JOURNAL_VAL,
+    IDX_NB,
+};
+
+// Lunghezze massime dei valori tenuti dallo stack (ESP_GATT_AUTO_RSP)
+// Un lotto di comandi in una write (ble_command.h)
+#define COMMAND_MAX_LEN       128
+#define WIFI_SCAN_MAX_LEN     256
 
 // Task prototype
 static void ble_task(void* arg);
@@ -45,9 +152,117 @@ static void ble_task(void* arg);
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void advertizer_config(void);
-
-void ble_handler_init(UBaseType_t task_priority) {
-
+static void ble_send_stream(uint16_t handle, uint8_t sub, const uint8_t *body, size_t len,
+                            uint8_t flags);
+static void ble_send_stream_chunks(uint16_t handle, uint8_t sub, const uint8_t *body, size_t len,
+                                   uint8_t flags);
+static void ble_send_telemetry(void);
+static void ble_publish_wifi_status(void);
+static void ble_command_reply(uint16_t conn_id, const uint8_t *rsp, size_t len);
+static esp_gatt_status_t ble_parse_network_op(const uint8_t *v, uint16_t len, ble_wifi_evt_t *evt);
+
+static esp_ble_adv_params_t adv_params = {
+    .adv_int_min = 0x20,
+    .adv_int_max = 0x40,
+    .adv_type = ADV_TYPE_IND,
+    .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+    .channel_map = ADV_CHNL_ALL,
+    .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY
+};
+
+static const uint16_t primary_service_uuid = ESP_GATT_UUID_PRI_SERVICE;
+static const uint16_t char_declaration_uuid = ESP_GATT_UUID_CHAR_DECLARE;
+static const uint16_t char_client_config_uuid = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+static const uint16_t service_uuid = SERVICE_UUID;
+static const uint16_t wifi_status_uuid = WIFI_STATUS_UUID;
+static const uint16_t command_uuid = COMMAND_UUID;
+static const uint16_t wifi_scan_uuid = WIFI_SCAN_LIST_UUID;
+static const uint16_t wifi_config_uuid = WIFI_CONFIG_UUID;
+static const uint16_t wifi_networks_uuid = WIFI_NETWORKS_UUID;
+static const uint16_t telemetry_uuid = TELEMETRY_UUID;
+static const uint16_t journal_uuid = JOURNAL_UUID;
+
+static const uint8_t prop_write = ESP_GATT_CHAR_PROP_BIT_WRITE;
+static const uint8_t prop_write_nr_notify = ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR |
+                                           ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t prop_read_notify = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t prop_read_write = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE;
+static const uint8_t cccd_default[2] = {0x00, 0x00};
+// Valore di WIFI_STATUS_UUID prima del primo cambiamento (IDLE, seq 0)
+static const uint8_t wifi_status_idle[WIFI_STATUS_VALUE_LEN] = {WIFI_STATUS_VERSION, WIFI_STATE_IDLE};
+
+#define GATT_DECL(prop)                                                            \
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_declaration_uuid,     \
+      ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&(prop)}}
+
+// Servizio intero in una sola chiamata: lo stack crea tutti gli attributi e
+// risponde da solo a status, scan list, CCCD e command. Restano all'app le
+// scritture che vanno validate (config, reti) e la read lunga delle reti.
+static const esp_gatts_attr_db_t gatt_db[IDX_NB] = {
+    [IDX_SVC] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&primary_service_uuid,
+        ESP_GATT_PERM_READ, sizeof(service_uuid), sizeof(service_uuid), (uint8_t *)&service_uuid}},
+
+    // 1) WiFi Status (read + notify): ble_task aggiorna il valore a ogni
+    //    cambiamento, cosi' le read le serve lo stack
+    [IDX_STATUS_CHAR] = GATT_DECL(prop_read_notify),
+    [IDX_STATUS_VAL] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&wifi_status_uuid,
+        ESP_GATT_PERM_READ, WIFI_STATUS_VALUE_LEN, sizeof(wifi_status_idle), (uint8_t *)wifi_status_idle}},
+    [IDX_STATUS_CCCD] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(cccd_default), sizeof(cccd_default),
+        (uint8_t *)cccd_default}},
+
+    // 2) Command (write o writeWithoutResponse + notify): l'ATT risponde
+    //    subito, l'esito di ogni comando arriva come notifica
+    [IDX_COMMAND_CHAR] = GATT_DECL(prop_write_nr_notify),
+    [IDX_COMMAND_VAL] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&command_uuid,
+        ESP_GATT_PERM_WRITE, COMMAND_MAX_LEN, 0, NULL}},
+    [IDX_COMMAND_CCCD] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(cccd_default), sizeof(cccd_default),
+        (uint8_t *)cccd_default}},
+
+    // 3) WiFi Scan List (read + notify) con il suo CCCD
+    [IDX_SCAN_CHAR] = GATT_DECL(prop_read_notify),
+    [IDX_SCAN_VAL] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&wifi_scan_uuid,
+        ESP_GATT_PERM_READ, WIFI_SCAN_MAX_LEN, 0, NULL}},
+    [IDX_SCAN_CCCD] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(cccd_default), sizeof(cccd_default),
+        (uint8_t *)cccd_default}},
+
+    // 4) WiFi Config (write): lo stato dipende dal parser
+    [IDX_CONFIG_CHAR] = GATT_DECL(prop_write),
+    [IDX_CONFIG_VAL] = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&wifi_config_uuid,
+        ESP_GATT_PERM_WRITE, 0, 0, NULL}},
+
+    // 5) WiFi Networks (read elenco + write operazioni)
+    [IDX_NETWORKS_CHAR] = GATT_DECL(prop_read_write),
+    [IDX_NETWORKS_VAL] = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&wifi_networks_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 0, 0, NULL}},
+
+    // 6) Telemetria (read + notify): l'istantanea si costruisce alla lettura
+    [IDX_TELEMETRY_CHAR] = GATT_DECL(prop_read_notify),
+    [IDX_TELEMETRY_VAL] = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&telemetry_uuid,
+        ESP_GATT_PERM_READ, 0, 0, NULL}},
+    [IDX_TELEMETRY_CCCD] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(cccd_default), sizeof(cccd_default),
+        (uint8_t *)cccd_default}},
+
+    // 7) Diario (read a pagine + write del cursore)
+    [IDX_JOURNAL_CHAR] = GATT_DECL(prop_read_write),
+    [IDX_JOURNAL_VAL] = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&journal_uuid,
+        ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 0, 0, NULL}},
+};
+
+void ble_handler_init(void) {
+    conn_lock = rtos_mutex_create(conn_lock_mem);
+    ble_link_init();
+
+#if APP_PERF_GATE
+    // QEMU non emula la radio: niente controller ne' Bluedroid, e
+    // l'advertising conta come partito a init finito (perf_gate.h)
+    boot_mark(BOOT_MARK_ADVERTISING);
+    (void)gap_event_handler;
+    (void)gatts_event_handler;
+#else
     // Initialize BLE controller and Bluedroid
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_bt_controller_init(&bt_cfg));
@@ -60,34 +275,335 @@ void ble_handler_init(UBaseType_t task_priority) {
     ESP_ERROR_CHECK(esp_ble_gap_register_callback(gap_event_handler));
     ESP_ERROR_CHECK(esp_ble_gatts_register_callback(gatts_event_handler));
     ESP_ERROR_CHECK(esp_ble_gatts_app_register(0));
+    ESP_ERROR_CHECK(esp_ble_gatt_set_local_mtu(BLE_LOCAL_MTU));
+#endif
+
+    telemetry_init();
 
     // Create BLE task
-    xTaskCreate(ble_task, "BLE_TASK", 4096, NULL, task_priority, NULL);
-    ESP_LOGI(BLE_TAG, "BLE handler initialized");
+    rtos_task_create(&ble_task_mem, ble_task, NULL, TASK_PLAN_BLE);
+    DLOGI(BLE, "BLE handler initialized");
 }
 
 
+// — tabella delle connessioni (conn_lock) —
+
+static ble_conn_t *ble_conn_find(uint16_t conn_id) {
+    for (int i = 0; i < BLE_MAX_CONN; i++) {
+        if (ble_conns[i].used && ble_conns[i].conn_id == conn_id) {
+            return &ble_conns[i];
+        }
+    }
+    return NULL;
+}
+
+static uint16_t ble_conn_mtu(uint16_t conn_id) {
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    ble_conn_t *c = ble_conn_find(conn_id);
+    uint16_t mtu = c ? c->mtu : ESP_GATT_DEF_BLE_MTU_SIZE;
+    xSemaphoreGive(conn_lock);
+    return mtu;
+}
+
+// Connessioni iscritte a 'sub'; se ids non e' NULL ne scrive gli id
+static int ble_conns_subscribed(uint8_t sub, uint16_t *ids) {
+    int n = 0;
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    for (int i = 0; i < BLE_MAX_CONN; i++) {
+        if (ble_conns[i].used && (ble_conns[i].subscribed & sub) != 0) {
+            if (ids != NULL) {
+                ids[n] = ble_conns[i].conn_id;
+            }
+            n++;
+        }
+    }
+    xSemaphoreGive(conn_lock);
+    return n;
+}
+
+// Scrittura di un CCCD da parte di una connessione
+static bool ble_conn_subscribe(uint16_t conn_id, uint8_t sub, const uint8_t *cccd) {
+    bool on = (cccd[0] & 0x01) != 0;
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    ble_conn_t *c = ble_conn_find(conn_id);
+    if (c != NULL) {
+        c->subscribed = on ? (c->subscribed | sub) : (c->subscribed & ~sub);
+    }
+    xSemaphoreGive(conn_lock);
+    return on;
+}
+
 static void ble_task(void* arg) {
-    wifi_ble_evt_t evt;
+    // statico: il corpo serializzato (~1.4 KB) non sta nello stack; la lista
+    // invece si legge direttamente dal pool, senza copiarla
+    static uint8_t scan_body[SCAN_STREAM_BODY_MAX_LEN];
+    int64_t telemetry_due_us = 0;
     while (1) {
-        if (xQueueReceive(wifi_to_ble_q, &evt, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(BLE_TAG, "WIFI_BLE recived");
-            if (evt.type == WIFI_BLE_EVT_SCAN_DONE) {
-                ESP_LOGI(BLE_TAG, "Risultati scansione ricevuti");
-                char wifi_list[256] = "";
-                int max = evt.ssid_count;
-                if (max > 6) max = 6;
-                for (int i = 0; i < max; i++) {
-                    strncat(wifi_list, evt.ssid_list[i], sizeof(wifi_list) - strlen(wifi_list) - 1);
-                    if (i < max - 1) {
-                        strncat(wifi_list, ", ", sizeof(wifi_list) - strlen(wifi_list) - 1);
-                    }
+        // Il timeout scandisce anche le notifiche di telemetria
+        const wifi_ble_evt_t *evt = wifi_ble_receive(pdMS_TO_TICKS(TELEMETRY_PERIOD_MS));
+        // Controllato a ogni risveglio, non solo su CONNECT_STATUS: una
+        // richiesta rifiutata a coda piena si recupera entro un periodo
+        ble_publish_wifi_status();
+        if (ble_conns_subscribed(BLE_SUB_TELEMETRY, NULL) > 0 && esp_timer_get_time() >= telemetry_due_us) {
+            telemetry_due_us = esp_timer_get_time() + (int64_t)TELEMETRY_PERIOD_MS * 1000;
+            ble_send_telemetry();
+        }
+        if (evt == NULL) {
+            continue;
+        }
+        DLOGD(BLE, "WIFI_BLE recived");
+        if (evt->type == WIFI_BLE_EVT_SCAN_DONE) {
+            DLOGI(BLE, "Risultati scansione ricevuti: %u reti%s", evt->ap_count,
+                  evt->partial ? " (parziale)" : "");
+            size_t len = scan_stream_encode(evt->ap_list, evt->ap_count, scan_body, sizeof(scan_body));
+            uint8_t flags = evt->partial ? SCAN_STREAM_FLAG_PARTIAL : 0;
+            wifi_ble_release(evt);
+            ble_send_stream(wifi_scan_handle, BLE_SUB_SCAN, scan_body, len, flags);
+            // Il primo flusso chiude la misura, anche se parziale: e' quando
+            // il telefono comincia a mostrare le reti
+            telemetry_end(TELEMETRY_LAT_SCAN);
+        } else {
+            wifi_ble_release(evt);
+        }
+    }
+}
+
+// Invia un corpo (lista reti o telemetria) a tutte le connessioni iscritte
+// a 'sub', in frammenti grandi quanto l'MTU di ciascuna e con l'intestazione
+// [seq][flags] di scan_stream. Un frammento per connessione a giro: un
+// telefono lento o congestionato non ferma gli altri. Il link resta nel
+// profilo veloce per tutto il flusso (ble_link.h).
+static void ble_send_stream(uint16_t handle, uint8_t sub, const uint8_t *body, size_t len,
+                            uint8_t flags) {
+    ble_link_bulk_begin();
+    ble_send_stream_chunks(handle, sub, body, len, flags);
+    ble_link_bulk_end();
+}
+
+static void ble_send_stream_chunks(uint16_t handle, uint8_t sub, const uint8_t *body, size_t len,
+                                   uint8_t flags) {
+    int active = 0;
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    for (int i = 0; i < BLE_MAX_CONN; i++) {
+        ble_conn_t *c = &ble_conns[i];
+        c->tx.active = c->used && (c->subscribed & sub) != 0;
+        if (c->tx.active) {
+            c->tx.conn_id = c->conn_id;
+            c->tx.mtu = c->mtu;
+            c->tx.waited_ms = 0;
+            c->tx.sent = 0;
+            scan_stream_chunker_init(&c->tx.chunker, body, len, flags);
+            active++;
+        }
+    }
+    xSemaphoreGive(conn_lock);
+    if (active == 0) {
+        DLOGW(BLE, "Nessun client iscritto, flusso su handle %u scartato", handle);
+        return;
+    }
+
+    uint8_t chunk[ESP_GATT_MAX_MTU_SIZE];
+    while (active > 0) {
+        bool progressed = false;
+        for (int i = 0; i < BLE_MAX_CONN; i++) {
+            ble_conn_t *c = &ble_conns[i];
+            if (!c->tx.active) {
+                continue;
+            }
+            xSemaphoreTake(conn_lock, portMAX_DELAY);
+            bool gone = !c->used || c->conn_id != c->tx.conn_id;
+            bool congested = !gone && c->congested;
+            xSemaphoreGive(conn_lock);
+            if (congested && c->tx.waited_ms < BLE_CONGEST_WAIT_MS) {
+                continue;
+            }
+            size_t n = gone ? 0 : scan_stream_next_chunk(&c->tx.chunker, c->tx.mtu, chunk);
+            esp_err_t err = ESP_OK;
+            if (n > 0) {
+                err = esp_ble_gatts_send_indicate(global_ble_gatts_if, c->tx.conn_id, handle,
+                                                  n, chunk, false);
+                if (err == ESP_OK) {
+                    c->tx.sent++;
+                    c->tx.waited_ms = 0;
+                    progressed = true;
+                    continue;
                 }
-                ESP_LOGI(BLE_TAG, "Notifying WiFi list: %s", wifi_list);
-                esp_ble_gatts_set_attr_value(wifi_scan_handle, strlen(wifi_list), (uint8_t*)wifi_list);
-                esp_ble_gatts_send_indicate(global_ble_gatts_if, ble_conn_id, wifi_scan_handle, strlen(wifi_list), (uint8_t*)wifi_list, false);
-            }        
+            }
+            // Flusso finito, telefono scollegato o invio fallito
+            if (err != ESP_OK) {
+                DLOGE(BLE, "Invio frammento %d a conn %u fallito: %s", c->tx.sent,
+                      c->tx.conn_id, esp_err_to_name(err));
+            } else if (gone) {
+                DLOGW(BLE, "Conn %u chiusa durante il flusso", c->tx.conn_id);
+            } else {
+                DLOGI(BLE, "Flusso su handle %u a conn %u: %u byte in %d notifiche (MTU %u)",
+                      handle, c->tx.conn_id, (unsigned)len, c->tx.sent, c->tx.mtu);
+            }
+            c->tx.active = false;
+            active--;
+        }
+        if (!progressed && active > 0) {
+            // Tutte le connessioni rimaste sono congestionate
+            vTaskDelay(pdMS_TO_TICKS(10));
+            for (int i = 0; i < BLE_MAX_CONN; i++) {
+                ble_conns[i].tx.waited_ms += ble_conns[i].tx.active ? 10 : 0;
+            }
+        }
+    }
+}
+
+// Aggiorna il valore di WIFI_STATUS_UUID e lo notifica a chi e' iscritto,
+// solo se lo stato e' cambiato dall'ultima volta
+static void ble_publish_wifi_status(void) {
+    static uint8_t published_seq = 0;       // quello di wifi_status_idle
+    wifi_status_t st;
+    wifi_status_get(&st);
+    if (st.seq == published_seq || wifi_status_handle == 0) {
+        return;
+    }
+    published_seq = st.seq;
+    uint8_t value[WIFI_STATUS_VALUE_LEN];
+    size_t len = wifi_status_encode(&st, value, sizeof(value));
+    esp_ble_gatts_set_attr_value(wifi_status_handle, len, value);
+    // 9 byte: stanno in una notifica anche con l'MTU minimo
+    uint16_t ids[BLE_MAX_CONN];
+    int n = ble_conns_subscribed(BLE_SUB_STATUS, ids);
+    for (int i = 0; i < n; i++) {
+        esp_ble_gatts_send_indicate(global_ble_gatts_if, ids[i], wifi_status_handle, len, value, false);
+    }
+}
+
+// Esito di un comando: solo al telefono che l'ha scritto, se iscritto.
+// Al massimo CMD_REPLY_MAX_LEN byte: sta in una notifica con l'MTU minimo.
+static void ble_command_reply(uint16_t conn_id, const uint8_t *rsp, size_t len) {
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    ble_conn_t *c = ble_conn_find(conn_id);
+    bool on = c != NULL && (c->subscribed & BLE_SUB_COMMAND) != 0;
+    xSemaphoreGive(conn_lock);
+    if (on) {
+        esp_ble_gatts_send_indicate(global_ble_gatts_if, conn_id, command_handle, (uint16_t)len,
+                                    (uint8_t *)rsp, false);
+    }
+}
+
+static void ble_send_telemetry(void) {
+    uint8_t snapshot[TELEMETRY_SNAPSHOT_LEN];
+    size_t len = telemetry_snapshot(snapshot, sizeof(snapshot));
+    ble_send_stream(telemetry_handle, BLE_SUB_TELEMETRY, snapshot, len, 0);
+}
+
+// Risponde a una read (o read blob) servendo 'buf' dall'offset richiesto
+static void ble_respond_long_read(esp_gatt_if_t gatts_if, const esp_ble_gatts_cb_param_t *param,
+                                  const uint8_t *buf, size_t len) {
+    // statico: esp_gatt_rsp_t supera i 600 byte, troppi per lo stack BTC
+    static esp_gatt_rsp_t rsp;
+    esp_gatt_status_t status = ESP_GATT_OK;
+    memset(&rsp, 0, sizeof(rsp.attr_value));
+    rsp.attr_value.handle = param->read.handle;
+    if (param->read.offset > len) {
+        status = ESP_GATT_INVALID_OFFSET;
+    } else {
+        // read blob: il telefono continua dall'offset finche' la risposta e' piena
+        size_t n = len - param->read.offset;
+        uint16_t mtu = ble_conn_mtu(param->read.conn_id);
+        if (n > (size_t)(mtu - 1)) {
+            n = mtu - 1;
+        }
+        rsp.attr_value.offset = param->read.offset;
+        rsp.attr_value.len = (uint16_t)n;
+        memcpy(rsp.attr_value.value, &buf[param->read.offset], n);
+    }
+    esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id,
+                                status, status == ESP_GATT_OK ? &rsp : NULL);
+}
+
+// Read lunga servita dalla copia della connessione: all'offset 0 'fill'
+// ricostruisce il valore, le read blob continuano sulla stessa copia anche
+// se intanto un altro telefono rilegge la caratteristica. Una read blob
+// senza la sua read all'offset 0 riceve INVALID_OFFSET.
+static void ble_respond_conn_read(esp_gatt_if_t gatts_if, const esp_ble_gatts_cb_param_t *param,
+                                  size_t (*fill)(ble_conn_t *c, uint8_t *buf, size_t size)) {
+    // Gli slot li libera solo il task BTC, che e' quello che sta rispondendo
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    ble_conn_t *c = ble_conn_find(param->read.conn_id);
+    xSemaphoreGive(conn_lock);
+    if (c == NULL) {
+        ble_respond_long_read(gatts_if, param, (const uint8_t *)"", 0);
+        return;
+    }
+    if (param->read.offset == 0) {
+        c->rd.handle = param->read.handle;
+        c->rd.len = (uint16_t)fill(c, c->rd.buf, sizeof(c->rd.buf));
+    } else if (c->rd.handle != param->read.handle) {
+        ble_respond_long_read(gatts_if, param, (const uint8_t *)"", 0);
+        return;
+    }
+    ble_respond_long_read(gatts_if, param, c->rd.buf, c->rd.len);
+}
+
+static size_t ble_read_networks(ble_conn_t *c, uint8_t *buf, size_t size) {
+    return wifi_store_describe(buf, size);
+}
+
+static size_t ble_read_telemetry(ble_conn_t *c, uint8_t *buf, size_t size) {
+    return telemetry_snapshot(buf, size);
+}
+
+// La pagina si legge dalla flash solo all'offset 0 e sposta il cursore
+static size_t ble_read_journal(ble_conn_t *c, uint8_t *buf, size_t size) {
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    uint32_t cursor = c->journal_pos;
+    xSemaphoreGive(conn_lock);
+    size_t len = journal_read_page(&cursor, buf, size);
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    c->journal_pos = cursor;
+    xSemaphoreGive(conn_lock);
+    return len;
+}
+
+// Decodifica una scrittura su WIFI_NETWORKS_UUID nell'evento per wifi_task
+static esp_gatt_status_t ble_parse_network_op(const uint8_t *v, uint16_t len, ble_wifi_evt_t *evt) {
+    if (len < 1) {
+        return ESP_GATT_INVALID_ATTR_LEN;
+    }
+    uint16_t pos = 1;
+    switch (v[0]) {
+        case NET_OP_ADD: {
+            if (len < pos + 2) {
+                return ESP_GATT_INVALID_ATTR_LEN;
+            }
+            evt->type = BLE_WIFI_EVT_NET_ADD;
+            evt->priority = v[pos++];
+            uint8_t ssid_len = v[pos++];
+            if (ssid_len == 0 || ssid_len >= sizeof(evt->ssid) || len < pos + ssid_len + 1) {
+                return ESP_GATT_INVALID_ATTR_LEN;
+            }
+            memcpy(evt->ssid, &v[pos], ssid_len);
+            pos += ssid_len;
+            uint8_t pass_len = v[pos++];
+            if (pass_len >= sizeof(evt->password) || len != pos + pass_len) {
+                return ESP_GATT_INVALID_ATTR_LEN;
+            }
+            memcpy(evt->password, &v[pos], pass_len);
+            return ESP_GATT_OK;
         }
+        case NET_OP_REMOVE: {
+            if (len < pos + 1) {
+                return ESP_GATT_INVALID_ATTR_LEN;
+            }
+            evt->type = BLE_WIFI_EVT_NET_REMOVE;
+            uint8_t ssid_len = v[pos++];
+            if (ssid_len == 0 || ssid_len >= sizeof(evt->ssid) || len != pos + ssid_len) {
+                return ESP_GATT_INVALID_ATTR_LEN;
+            }
+            memcpy(evt->ssid, &v[pos], ssid_len);
+            return ESP_GATT_OK;
+        }
+        case NET_OP_CLEAR:
+            evt->type = BLE_WIFI_EVT_NET_CLEAR;
+            return len == 1 ? ESP_GATT_OK : ESP_GATT_INVALID_ATTR_LEN;
+        default:
+            return ESP_GATT_REQ_NOT_SUPPORTED;
     }
 }
 
@@ -105,238 +621,260 @@ static void advertizer_config(void) {
 }
 
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
-    if (event == ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT) {
-        esp_ble_gap_start_advertising(&(esp_ble_adv_params_t){
-            .adv_int_min = 0x20,
-            .adv_int_max = 0x40,
-            .adv_type = ADV_TYPE_IND,
-            .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
-            .channel_map = ADV_CHNL_ALL,
-            .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY
-        });
+    static bool adv_logged = false;
+    switch (event) {
+        case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
+            esp_ble_gap_start_advertising(&adv_params);
+            break;
+
+        case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+            if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                DLOGE(BLE, "Avvio advertising fallito (%d)", param->adv_start_cmpl.status);
+            } else if (!adv_logged) {
+                // Tempo dal boot a dispositivo visibile: riferimento per i confronti
+                adv_logged = true;
+                boot_mark(BOOT_MARK_ADVERTISING);
+                DLOGI(BLE, "Advertising attivo a %lld ms dal boot",
+                      (long long)(esp_timer_get_time() / 1000));
+            }
+            break;
+
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+            ble_link_gap_event(event, param);
+            break;
+
+        default:
+            break;
     }
 }
 
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+    int64_t cb_start_us = esp_timer_get_time();
     switch (event) {
         case ESP_GATTS_REG_EVT:
-            esp_ble_gatts_create_service(gatts_if, &(esp_gatt_srvc_id_t){
-                .id = {.uuid = {.len = ESP_UUID_LEN_16, .uuid.uuid16 = SERVICE_UUID}},
-                .is_primary = true
-            }, 20);
+            global_ble_gatts_if = gatts_if;
+            esp_ble_gatts_create_attr_tab(gatt_db, gatts_if, IDX_NB, 0);
             break;
 
-        case ESP_GATTS_CREATE_EVT:
-            service_handle = param->create.service_handle;
-
-            // 1) WiFi Status (read)
-            {
-            esp_bt_uuid_t uuid = { .len = ESP_UUID_LEN_16,
-                                    .uuid.uuid16 = WIFI_STATUS_UUID };
-            esp_ble_gatts_add_char(
-                service_handle, &uuid,
-                ESP_GATT_PERM_READ,
-                ESP_GATT_CHAR_PROP_BIT_READ,
-                NULL, NULL
-            );
+        case ESP_GATTS_CREAT_ATTR_TAB_EVT:
+            if (param->add_attr_tab.status != ESP_GATT_OK || param->add_attr_tab.num_handle != IDX_NB) {
+                DLOGE(BLE, "Creazione tabella attributi fallita (0x%02x, %u handle)",
+                      param->add_attr_tab.status, param->add_attr_tab.num_handle);
+                break;
             }
+            service_handle = param->add_attr_tab.handles[IDX_SVC];
+            wifi_status_handle = param->add_attr_tab.handles[IDX_STATUS_VAL];
+            wifi_status_cccd_handle = param->add_attr_tab.handles[IDX_STATUS_CCCD];
+            command_handle = param->add_attr_tab.handles[IDX_COMMAND_VAL];
+            command_cccd_handle = param->add_attr_tab.handles[IDX_COMMAND_CCCD];
+            wifi_scan_handle = param->add_attr_tab.handles[IDX_SCAN_VAL];
+            wifi_config_handle = param->add_attr_tab.handles[IDX_CONFIG_VAL];
+            wifi_networks_handle = param->add_attr_tab.handles[IDX_NETWORKS_VAL];
+            wifi_scan_characteristic.char_handle = wifi_scan_handle;
+            wifi_scan_characteristic.cccd_handle = param->add_attr_tab.handles[IDX_SCAN_CCCD];
+            telemetry_handle = param->add_attr_tab.handles[IDX_TELEMETRY_VAL];
+            telemetry_cccd_handle = param->add_attr_tab.handles[IDX_TELEMETRY_CCCD];
+            journal_handle = param->add_attr_tab.handles[IDX_JOURNAL_VAL];
+            DLOGI(BLE, "Tabella attributi creata: servizio %d, status %d, command %d, scan %d "
+                  "(CCCD %d), config %d, networks %d, telemetry %d", service_handle, wifi_status_handle,
+                  command_handle, wifi_scan_handle, wifi_scan_characteristic.cccd_handle,
+                  wifi_config_handle, wifi_networks_handle, telemetry_handle);
+            esp_ble_gatts_start_service(service_handle);
+            // Dati di advertising configurati una volta sola, a servizio pronto
+            advertizer_config();
+            break;
 
-            // 2) Command (write o writeWithoutResponse)
-            {
-            esp_bt_uuid_t uuid = { .len = ESP_UUID_LEN_16,
-                                    .uuid.uuid16 = COMMAND_UUID };
-            esp_ble_gatts_add_char(
-                service_handle, &uuid,
-                ESP_GATT_PERM_WRITE,
-                ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR,
-                NULL, NULL
-            );
+        case ESP_GATTS_CONNECT_EVT: {
+            int count = 0;
+            ble_conn_t *slot = NULL;
+            xSemaphoreTake(conn_lock, portMAX_DELAY);
+            for (int i = 0; i < BLE_MAX_CONN; i++) {
+                if (!ble_conns[i].used && slot == NULL) {
+                    slot = &ble_conns[i];
+                    slot->used = true;
+                    slot->conn_id = param->connect.conn_id;
+                    slot->mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+                    slot->congested = false;
+                    slot->subscribed = 0;
+                    slot->journal_pos = 0;
+                    slot->rd.handle = 0;
+                }
+                count += ble_conns[i].used;
             }
-
-            // 3) WiFi Scan List (read + notify)
-            {
-            esp_bt_uuid_t uuid = { .len = ESP_UUID_LEN_16,
-                                    .uuid.uuid16 = WIFI_SCAN_LIST_UUID };
-            esp_attr_value_t att = {
-                .attr_max_len = 256,
-                .attr_len     = 0,
-                .attr_value   = NULL
-            };
-            esp_ble_gatts_add_char(
-                service_handle, &uuid,
-                ESP_GATT_PERM_READ,
-                ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY,
-                &att, NULL
-            );
-            // descriptor per il notify
-            esp_ble_gatts_add_char_descr(
-                service_handle,
-                &(esp_bt_uuid_t){ .len=ESP_UUID_LEN_16,
-                                .uuid.uuid16=ESP_GATT_UUID_CHAR_CLIENT_CONFIG },
-                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
-                NULL, NULL
-            );
+            xSemaphoreGive(conn_lock);
+            if (slot == NULL) {
+                // Non dovrebbe succedere: a tabella piena l'advertising e' fermo
+                DLOGW(BLE, "Nessuno slot per conn_id=%d, ignorata", param->connect.conn_id);
+                break;
             }
-
-            // 4) WiFi Config (write)
-            {
-            esp_bt_uuid_t uuid = { .len = ESP_UUID_LEN_16,
-                                    .uuid.uuid16 = WIFI_CONFIG_UUID };
-            esp_ble_gatts_add_char(
-                service_handle, &uuid,
-                ESP_GATT_PERM_WRITE,
-                ESP_GATT_CHAR_PROP_BIT_WRITE,
-                NULL, NULL
-            );
+            DLOGI(BLE, "Client connected: conn_id=%d (%d/%d)", param->connect.conn_id,
+                  count, BLE_MAX_CONN);
+            uint8_t rec[2] = { (uint8_t)param->connect.conn_id, (uint8_t)count };
+            journal_log(JOURNAL_EV_BLE_CONNECT, rec, sizeof(rec));
+            ble_link_connected(param->connect.conn_id, param->connect.remote_bda,
+                               &param->connect.conn_params);
+            // Il controller ferma l'advertising alla connessione: si riparte
+            // finche' un altro telefono puo' ancora entrare
+            if (count < BLE_MAX_CONN) {
+                esp_ble_gap_start_advertising(&adv_params);
             }
+            break;
+        }
 
-    // Solo dopo aver aggiunto TUTTE le caratteristiche:
-    esp_ble_gatts_start_service(service_handle);
-    break;
-
-
-        case ESP_GATTS_ADD_CHAR_EVT:
-            ESP_LOGI(BLE_TAG, "Caratteristica aggiunta, avviando servizio...");
-            if (param->add_char.char_uuid.uuid.uuid16 == WIFI_STATUS_UUID) {
-                wifi_status_handle = param->add_char.attr_handle;
-                ESP_LOGI("GATTS_DEMO", "WiFi_Status aggiunta, handle = %d", wifi_status_handle);
-            } else if (param->add_char.char_uuid.uuid.uuid16 == COMMAND_UUID) {
-                command_handle = param->add_char.attr_handle;
-                ESP_LOGI("GATTS_DEMO", "Command aggiunta, handle = %d", command_handle);
-            } else if (param->add_char.char_uuid.uuid.uuid16 == WIFI_SCAN_LIST_UUID) {
-                wifi_scan_handle = param->add_char.attr_handle;
-                ESP_LOGI(BLE_TAG, "WiFi_Scan aggiunta, handle = %d", wifi_scan_handle);
-            } else if (param->add_char.char_uuid.uuid.uuid16 == WIFI_CONFIG_UUID) {
-                wifi_config_handle = param->add_char.attr_handle;
-                ESP_LOGI(BLE_TAG, "WiFi_Config aggiunta, handle = %d", wifi_config_handle);
+        case ESP_GATTS_MTU_EVT: {
+            xSemaphoreTake(conn_lock, portMAX_DELAY);
+            ble_conn_t *c = ble_conn_find(param->mtu.conn_id);
+            if (c != NULL) {
+                c->mtu = param->mtu.mtu;
             }
-            advertizer_config();
+            xSemaphoreGive(conn_lock);
+            ble_link_mtu(param->mtu.conn_id, param->mtu.mtu);
+            DLOGI(BLE, "MTU negoziato con conn %u: %u", param->mtu.conn_id, param->mtu.mtu);
             break;
+        }
 
-        case ESP_GATTS_ADD_CHAR_DESCR_EVT:
-            if (param->add_char_descr.descr_uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG) {
-                wifi_scan_characteristic.cccd_handle = param->add_char_descr.attr_handle;
-                ESP_LOGI(BLE_TAG, "CCCD descriptor handle: %d", wifi_scan_characteristic.cccd_handle);
+        case ESP_GATTS_CONGEST_EVT: {
+            xSemaphoreTake(conn_lock, portMAX_DELAY);
+            ble_conn_t *c = ble_conn_find(param->congest.conn_id);
+            if (c != NULL) {
+                c->congested = param->congest.congested;
             }
+            xSemaphoreGive(conn_lock);
             break;
+        }
 
-        case ESP_GATTS_CONNECT_EVT:
-            ble_conn_id = param->connect.conn_id;
-            global_ble_gatts_if = gatts_if;
-            ESP_LOGI(BLE_TAG, "Client connected: conn_id=%d", ble_conn_id);
+        case ESP_GATTS_DISCONNECT_EVT: {
+            bool was_full = true;
+            xSemaphoreTake(conn_lock, portMAX_DELAY);
+            for (int i = 0; i < BLE_MAX_CONN; i++) {
+                was_full = was_full && ble_conns[i].used;
+            }
+            ble_conn_t *c = ble_conn_find(param->disconnect.conn_id);
+            if (c != NULL) {
+                c->used = false;
+            }
+            xSemaphoreGive(conn_lock);
+            ble_link_disconnected(param->disconnect.conn_id);
+            DLOGI(BLE, "Client disconnected: conn_id=%d", param->disconnect.conn_id);
+            uint8_t rec[3] = { (uint8_t)param->disconnect.conn_id, (uint8_t)param->disconnect.reason,
+                               (uint8_t)(param->disconnect.reason >> 8) };
+            journal_log(JOURNAL_EV_BLE_DISCONNECT, rec, sizeof(rec));
+            // Con uno slot libero l'advertising era gia' attivo
+            if (was_full && c != NULL) {
+                esp_ble_gap_start_advertising(&adv_params);
+            }
             break;
+        }
 
-        case ESP_GATTS_DISCONNECT_EVT:
-            ESP_LOGI(BLE_TAG, "Client disconnected");
-            ble_conn_id = 0;
-            global_ble_gatts_if = 0;
-            esp_ble_gap_start_advertising(&(esp_ble_adv_params_t){
-                .adv_int_min=0x20, .adv_int_max=0x40, .adv_type=ADV_TYPE_IND, .own_addr_type=BLE_ADDR_TYPE_PUBLIC, .channel_map=ADV_CHNL_ALL, .adv_filter_policy=ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY
-            });
+        case ESP_GATTS_READ_EVT:
+            if (param->read.handle == wifi_networks_handle && param->read.need_rsp) {
+                ble_respond_conn_read(gatts_if, param, ble_read_networks);
+            } else if (param->read.handle == telemetry_handle && param->read.need_rsp) {
+                // Nuova istantanea solo all'offset 0: le read blob successive
+                // devono vedere gli stessi byte
+                ble_respond_conn_read(gatts_if, param, ble_read_telemetry);
+            } else if (param->read.handle == journal_handle && param->read.need_rsp) {
+                // Come la telemetria: le read blob finiscono la stessa pagina
+                ble_respond_conn_read(gatts_if, param, ble_read_journal);
+            }
             break;
 
         case ESP_GATTS_WRITE_EVT:
-            ESP_LOGI(BLE_TAG, "Evento scrittura ricevuto %s", param->write.value);
-
-            if(param->write.handle == wifi_scan_characteristic.cccd_handle && param->write.len == 2){
-                ESP_LOGI(BLE_TAG, "Conferma iscrizione notifiche");
-                esp_ble_gatts_send_response(
-                    gatts_if,
-                    param->write.conn_id,
-                    param->write.trans_id,
-                    ESP_GATT_OK,
-                    NULL
-                    );
+            DLOGD(BLE, "Evento scrittura ricevuto (handle %d, %d byte)", param->write.handle, param->write.len);
+
+            // CCCD e command hanno ESP_GATT_AUTO_RSP: lo stack ha gia' risposto
+            // Iscrizioni per connessione: il valore del CCCD nello stack e'
+            // unico per tutti i telefoni
+            if (param->write.handle == wifi_scan_characteristic.cccd_handle && param->write.len == 2) {
+                bool on = ble_conn_subscribe(param->write.conn_id, BLE_SUB_SCAN, param->write.value);
+                DLOGI(BLE, "Notifiche lista reti %s (conn %u)", on ? "attive" : "disattivate",
+                      param->write.conn_id);
+            }
+            if (param->write.handle == wifi_status_cccd_handle && param->write.len == 2) {
+                // Lo stato corrente il telefono lo legge una volta dopo l'iscrizione
+                bool on = ble_conn_subscribe(param->write.conn_id, BLE_SUB_STATUS, param->write.value);
+                DLOGI(BLE, "Notifiche stato Wi-Fi %s (conn %u)", on ? "attive" : "disattivate",
+                      param->write.conn_id);
+            }
+            if (param->write.handle == telemetry_cccd_handle && param->write.len == 2) {
+                bool on = ble_conn_subscribe(param->write.conn_id, BLE_SUB_TELEMETRY, param->write.value);
+                DLOGI(BLE, "Notifiche telemetria %s (conn %u)", on ? "attive" : "disattivate",
+                      param->write.conn_id);
+            }
+            if (param->write.handle == command_cccd_handle && param->write.len == 2) {
+                bool on = ble_conn_subscribe(param->write.conn_id, BLE_SUB_COMMAND, param->write.value);
+                DLOGI(BLE, "Risposte ai comandi %s (conn %u)", on ? "attive" : "disattivate",
+                      param->write.conn_id);
             }
 
             if (param->write.handle == command_handle) {
-                // Risposta immediata
-                esp_ble_gatts_send_response( gatts_if, param->write.conn_id, param->write.trans_id, ESP_GATT_OK, NULL);
-                ESP_LOGI(BLE_TAG, "Risposta inviata");
-                // Elabora il comando dopo aver inviato la risposta
-                if (param->write.len > 0) {
-                    char cmd[param->write.len + 1];
-                    memcpy(cmd, param->write.value, param->write.len);
-                    cmd[param->write.len] = '\0';
-                    
-                    ble_wifi_evt_t evt = {
-                        .type = BLE_WIFI_EVT_BTN_PRESS,
-                    };
-                    xQueueSend(ble_to_wifi_q, &evt, portMAX_DELAY);
-                    ESP_LOGI(BLE_TAG, "Comando in queue");
+                // Ogni comando del lotto risponde da se': l'ATT e' gia' OK
+                ble_command_dispatch(param->write.conn_id, param->write.value, param->write.len,
+                                     ble_command_reply);
+            }
+            else if (param->write.handle == wifi_networks_handle) {
+                // Decodifica direttamente nello slot del pool
+                ble_wifi_evt_t *evt = ble_wifi_alloc();
+                esp_gatt_status_t status = ESP_GATT_BUSY;   // wifi_task e' indietro: si riprova
+                if (evt != NULL) {
+                    status = ble_parse_network_op(param->write.value, param->write.len, evt);
+                    if (status != ESP_GATT_OK) {
+                        DLOGW(BLE, "Operazione reti non valida (0x%02x)", status);
+                        ble_wifi_release(evt);
+                    } else if (!ble_wifi_post(evt)) {
+                        status = ESP_GATT_BUSY;
+                    }
+                }
+                if (param->write.need_rsp) {
+                    esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                                status, NULL);
+                }
+            }
+            else if (param->write.handle == journal_handle) {
+                esp_gatt_status_t status = ESP_GATT_INVALID_ATTR_LEN;
+                if (param->write.len == 4) {
+                    const uint8_t *v = param->write.value;
+                    xSemaphoreTake(conn_lock, portMAX_DELAY);
+                    ble_conn_t *c = ble_conn_find(param->write.conn_id);
+                    if (c != NULL) {
+                        c->journal_pos = (uint32_t)v[0] | (uint32_t)v[1] << 8 |
+                                         (uint32_t)v[2] << 16 | (uint32_t)v[3] << 24;
+                    }
+                    xSemaphoreGive(conn_lock);
+                    status = ESP_GATT_OK;
+                }
+                if (param->write.need_rsp) {
+                    esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                                status, NULL);
                 }
             }
             else if (param->write.handle == wifi_config_handle) {
-                // Nuovo codice per gestione WiFi Config
-                ESP_LOGI(BLE_TAG, "credenziali: %s", (char *)param->write.value);
-                    // Nuovo codice per gestione WiFi Config
-                    esp_ble_gatts_send_response(
-                        gatts_if,
-                        param->write.conn_id,
-                        param->write.trans_id,
-                        ESP_GATT_OK,
-                        NULL
-                    );
-                    
-                    if (param->write.len > 0) {
-                        // Alloca memoria e aggiungi terminatore null
-                        const char *to_decode=(char *)param->write.value;
-
-                        char *start1 = strstr(to_decode, "%%");
-                        if (start1==NULL){
-                            ESP_LOGI(BLE_TAG, "Errore all'inizio");
-                        }
-                        start1+=2;
-                        char *end1=strstr(start1, "%%");
-                        if (end1==NULL){
-                            ESP_LOGI(BLE_TAG, "Non trovo l fine di ssid");
-                        }
-                        size_t len1=end1-start1;
-                        char *ssid=malloc(len1+1);
-                        strncpy(ssid, start1, len1);
-                        ssid[len1]='\0';
-
-                        char *start2 = end1 + 2;
-    
-                        // Trova la fine di string2
-                        char *end2 = strstr(start2, "%%");
-                        if (end2 == NULL) {
-                            printf("Formato non valido per string2!\n");
-                        }
-                        
-                        // Estrae string2
-                        size_t len2 = end2 - start2;
-                        char *password = malloc(len2 + 1);
-                        strncpy(password, start2, len2);
-                        password[len2] = '\0';
-
-                        ESP_LOGI(BLE_TAG, "SSID: %s, Password: %s", ssid, password);
-                        
-                        if (ssid != NULL && password != NULL) {
-                            ESP_LOGI(BLE_TAG, "SSID: %s, Password: %s", ssid, password);
-                            
-                            ble_wifi_evt_t evt = {
-                                .type = BLE_WIFI_EVT_CONNECT,
-                            };
-
-                            // Copia le stringhe negli array della struct
-                            strncpy(evt.ssid, ssid, sizeof(evt.ssid) - 1);
-                            evt.ssid[sizeof(evt.ssid) - 1] = '\0';
-
-                            strncpy(evt.password, password, sizeof(evt.password) - 1);
-                            evt.password[sizeof(evt.password) - 1] = '\0';
-
-                            xQueueSend(ble_to_wifi_q, &evt, portMAX_DELAY);
-
-                            // Libera la memoria allocata
-                            free(ssid);
-                            free(password);
-                        }
+                // Il valore non e' terminato da NUL: config_parse non legge oltre len
+                ble_wifi_evt_t *evt = ble_wifi_alloc();
+                esp_gatt_status_t status = ESP_GATT_BUSY;
+                if (evt != NULL) {
+                    config_parse_status_t st = config_parse(param->write.value, param->write.len, evt);
+                    if (st != CONFIG_PARSE_OK) {
+                        DLOGW(BLE, "Credenziali scartate (%s, %u byte)",
+                              config_parse_status_name(st), param->write.len);
+                        ble_wifi_release(evt);
+                        status = ESP_GATT_INVALID_ATTR_LEN;
+                    } else {
+                        // La password non finisce nel log
+                        DLOGI(BLE, "Credenziali per SSID: %s", evt->ssid);
+                        status = ble_wifi_post(evt) ? ESP_GATT_OK : ESP_GATT_BUSY;
                     }
                 }
+                if (param->write.need_rsp) {
+                    esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                                status, NULL);
+                }
+            }
             break;
 
         default:
             break;
     }
+    telemetry_record(TELEMETRY_LAT_GATTS_CB, (uint32_t)(esp_timer_get_time() - cb_start_us));
 }
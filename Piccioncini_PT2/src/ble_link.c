@@ -0,0 +1,323 @@
+// ble_link.c
+#include "ble_link.h"
+#include "ble_handler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "rtos_static.h"
+#include "dlog.h"
+#include "esp_timer.h"
+
+#include <string.h>
+
+// Uno per connessione di ble_handler
+#define BLE_LINK_SLOTS          BLE_MAX_CONN
+
+// Payload LL prima di DLE (Bluetooth 4.0)
+#define BLE_LINK_LL_DEFAULT     27
+
+typedef struct {
+    bool used;
+    uint16_t conn_id;
+    esp_bd_addr_t bda;
+    ble_link_profile_t wanted;      // profilo da raggiungere
+    ble_link_profile_t requested;   // profilo dell'ultima richiesta inviata
+    bool dle_requested;
+    bool dle_pending;
+    ble_link_params_t params;
+} link_conn_t;
+
+typedef struct {
+    uint16_t min_int;
+    uint16_t max_int;
+    uint16_t latency;
+    uint16_t timeout;
+} link_profile_t;
+
+static const link_profile_t profiles[BLE_LINK_PROFILE_COUNT] = {
+    [BLE_LINK_BULK] = { BLE_LINK_BULK_MIN_INT, BLE_LINK_BULK_MAX_INT,
+                        BLE_LINK_BULK_LATENCY, BLE_LINK_BULK_TIMEOUT },
+    [BLE_LINK_IDLE] = { BLE_LINK_IDLE_MIN_INT, BLE_LINK_IDLE_MAX_INT,
+                        BLE_LINK_IDLE_LATENCY, BLE_LINK_IDLE_TIMEOUT },
+};
+
+static const char *const profile_names[BLE_LINK_PROFILE_COUNT] = {
+    [BLE_LINK_DEFAULT] = "default",
+    [BLE_LINK_BULK]    = "bulk",
+    [BLE_LINK_IDLE]    = "idle",
+};
+
+// Tabella e stato dei trasferimenti: li toccano task BTC (eventi),
+// ble_task (begin/end) e il task di esp_timer (rilassamento)
+static SemaphoreHandle_t link_lock;
+RTOS_MUTEX_DEFINE(link_lock_mem);
+static link_conn_t links[BLE_LINK_SLOTS];
+static int bulk_depth;
+static int64_t hold_until_us;
+static esp_timer_handle_t idle_timer;
+
+const char *ble_link_profile_name(ble_link_profile_t profile) {
+    return profile < BLE_LINK_PROFILE_COUNT ? profile_names[profile] : "?";
+}
+
+static link_conn_t *link_find(uint16_t conn_id) {
+    for (int i = 0; i < BLE_LINK_SLOTS; i++) {
+        if (links[i].used && links[i].conn_id == conn_id) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+static link_conn_t *link_find_bda(const esp_bd_addr_t bda) {
+    for (int i = 0; i < BLE_LINK_SLOTS; i++) {
+        if (links[i].used && memcmp(links[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+// Una richiesta alla volta per link: la successiva parte alla risposta.
+// Le API GAP accodano al task BTC, quindi si possono chiamare sotto link_lock.
+static void link_request_locked(link_conn_t *l, ble_link_profile_t profile) {
+    l->wanted = profile;
+    if (l->params.update_pending || l->params.rejects >= BLE_LINK_MAX_REJECTS
+        || l->params.profile == profile || profile == BLE_LINK_DEFAULT) {
+        return;
+    }
+    const link_profile_t *p = &profiles[profile];
+    esp_ble_conn_update_params_t req = {
+        .min_int = p->min_int,
+        .max_int = p->max_int,
+        .latency = p->latency,
+        .timeout = p->timeout,
+    };
+    memcpy(req.bda, l->bda, sizeof(esp_bd_addr_t));
+    esp_err_t err = esp_ble_gap_update_conn_params(&req);
+    if (err != ESP_OK) {
+        DLOGW(LINK, "Richiesta profilo %s su conn %u fallita: %s", profile_names[profile],
+              l->conn_id, esp_err_to_name(err));
+        return;
+    }
+    l->requested = profile;
+    l->params.update_pending = true;
+}
+
+static void link_request_dle_locked(link_conn_t *l) {
+    if (l->dle_requested) {
+        return;
+    }
+    l->dle_requested = true;
+    if (esp_ble_gap_set_pkt_data_len(l->bda, BLE_LINK_DLE_TX_OCTETS) == ESP_OK) {
+        l->dle_pending = true;
+    }
+}
+
+static void link_request_all_locked(ble_link_profile_t profile) {
+    for (int i = 0; i < BLE_LINK_SLOTS; i++) {
+        if (links[i].used) {
+            link_request_locked(&links[i], profile);
+        }
+    }
+}
+
+// Intervallo corto e DLE: quest'ultimo resta attivo fino alla disconnessione
+static void link_go_bulk_locked(void) {
+    for (int i = 0; i < BLE_LINK_SLOTS; i++) {
+        if (links[i].used) {
+            link_request_locked(&links[i], BLE_LINK_BULK);
+            link_request_dle_locked(&links[i]);
+        }
+    }
+}
+
+// Scade BLE_LINK_IDLE_AFTER_MS dopo l'ultimo trasferimento (o a fine hold)
+static void link_idle_cb(void *arg) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    if (bulk_depth == 0) {
+        hold_until_us = 0;
+        link_request_all_locked(BLE_LINK_IDLE);
+    }
+    xSemaphoreGive(link_lock);
+}
+
+// Riarma il rilassamento: non prima di BLE_LINK_IDLE_AFTER_MS ne' della fine dell'hold
+static void link_arm_idle_locked(void) {
+    int64_t delay = (int64_t)BLE_LINK_IDLE_AFTER_MS * 1000;
+    int64_t hold = hold_until_us - esp_timer_get_time();
+    if (hold > delay) {
+        delay = hold;
+    }
+    esp_timer_stop(idle_timer);
+    esp_timer_start_once(idle_timer, (uint64_t)delay);
+}
+
+void ble_link_init(void) {
+    link_lock = rtos_mutex_create(link_lock_mem);
+    const esp_timer_create_args_t idle_args = {
+        .callback = link_idle_cb,
+        .name = "ble_link_idle",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&idle_args, &idle_timer));
+}
+
+void ble_link_connected(uint16_t conn_id, const esp_bd_addr_t bda, const esp_gatt_conn_params_t *params) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    link_conn_t *l = NULL;
+    for (int i = 0; i < BLE_LINK_SLOTS && l == NULL; i++) {
+        l = links[i].used ? NULL : &links[i];
+    }
+    if (l != NULL) {
+        memset(l, 0, sizeof(*l));
+        l->used = true;
+        l->conn_id = conn_id;
+        memcpy(l->bda, bda, sizeof(esp_bd_addr_t));
+        l->params.interval = params->interval;
+        l->params.latency = params->latency;
+        l->params.timeout = params->timeout;
+        l->params.mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+        l->params.tx_octets = BLE_LINK_LL_DEFAULT;
+        if (bulk_depth > 0) {
+            link_request_locked(l, BLE_LINK_BULK);
+            link_request_dle_locked(l);
+        } else {
+            // Discovery e iscrizioni restano ai parametri del telefono
+            link_arm_idle_locked();
+        }
+    }
+    xSemaphoreGive(link_lock);
+    if (l == NULL) {
+        DLOGW(LINK, "Nessuno slot per conn %u", conn_id);
+    }
+}
+
+void ble_link_disconnected(uint16_t conn_id) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    link_conn_t *l = link_find(conn_id);
+    if (l != NULL) {
+        l->used = false;
+    }
+    xSemaphoreGive(link_lock);
+}
+
+// Lo scambio MTU lo avvia il telefono: qui si registra soltanto il valore
+void ble_link_mtu(uint16_t conn_id, uint16_t mtu) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    link_conn_t *l = link_find(conn_id);
+    if (l != NULL) {
+        l->params.mtu = mtu;
+    }
+    xSemaphoreGive(link_lock);
+}
+
+void ble_link_gap_event(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param) {
+    if (event == ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT) {
+        const struct ble_update_conn_params_evt_param *u = &param->update_conn_params;
+        xSemaphoreTake(link_lock, portMAX_DELAY);
+        link_conn_t *l = link_find_bda(u->bda);
+        if (l == NULL) {
+            xSemaphoreGive(link_lock);
+            return;
+        }
+        bool ours = l->params.update_pending;
+        l->params.update_pending = false;
+        if (u->status == ESP_BT_STATUS_SUCCESS) {
+            // Il telefono sceglie l'intervallo nella finestra: vale il suo
+            l->params.interval = u->conn_int;
+            l->params.latency = u->latency;
+            l->params.timeout = u->timeout;
+            l->params.profile = ours ? l->requested : BLE_LINK_DEFAULT;
+            l->params.updates++;
+        } else if (ours) {
+            l->params.rejects++;
+        }
+        ble_link_params_t p = l->params;
+        uint16_t conn_id = l->conn_id;
+        // Il profilo voluto puo' essere cambiato mentre la richiesta era in volo
+        link_request_locked(l, l->wanted);
+        xSemaphoreGive(link_lock);
+        if (u->status == ESP_BT_STATUS_SUCCESS) {
+            DLOGI(LINK, "Conn %u: profilo %s, intervallo %u.%02u ms, latency %u, timeout %u ms",
+                  conn_id, profile_names[p.profile], p.interval * 125 / 100, (p.interval * 125) % 100,
+                  p.latency, p.timeout * 10);
+        } else {
+            DLOGW(LINK, "Conn %u: parametri rifiutati (%d), %u rifiuti", conn_id, u->status,
+                  p.rejects);
+        }
+    } else if (event == ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT) {
+        // L'evento non dice la connessione: le richieste DLE partono una per
+        // link e le risposte arrivano nello stesso ordine
+        xSemaphoreTake(link_lock, portMAX_DELAY);
+        link_conn_t *l = NULL;
+        for (int i = 0; i < BLE_LINK_SLOTS && l == NULL; i++) {
+            l = links[i].used && links[i].dle_pending ? &links[i] : NULL;
+        }
+        if (l != NULL) {
+            l->dle_pending = false;
+            if (param->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                l->params.tx_octets = param->pkt_data_length_cmpl.params.tx_len;
+            }
+            DLOGI(LINK, "Conn %u: DLE %s, payload LL %u byte", l->conn_id,
+                  param->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS ? "attivo" : "rifiutato",
+                  l->params.tx_octets);
+        }
+        xSemaphoreGive(link_lock);
+    }
+}
+
+void ble_link_bulk_begin(void) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    bulk_depth++;
+    esp_timer_stop(idle_timer);
+    link_go_bulk_locked();
+    xSemaphoreGive(link_lock);
+}
+
+void ble_link_bulk_end(void) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    if (bulk_depth > 0 && --bulk_depth == 0) {
+        // Il trasferimento annunciato da expect e' questo: l'hold non serve piu'
+        hold_until_us = 0;
+        link_arm_idle_locked();
+    }
+    xSemaphoreGive(link_lock);
+}
+
+void ble_link_bulk_expect(void) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    hold_until_us = esp_timer_get_time() + (int64_t)BLE_LINK_BULK_HOLD_MS * 1000;
+    link_go_bulk_locked();
+    if (bulk_depth == 0) {
+        link_arm_idle_locked();
+    }
+    xSemaphoreGive(link_lock);
+}
+
+bool ble_link_get(uint16_t conn_id, ble_link_params_t *out) {
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    link_conn_t *l = link_find(conn_id);
+    if (l != NULL) {
+        *out = l->params;
+    }
+    xSemaphoreGive(link_lock);
+    return l != NULL;
+}
+
+int ble_link_active(uint16_t *max_interval) {
+    int n = 0;
+    uint16_t longest = 0;
+    xSemaphoreTake(link_lock, portMAX_DELAY);
+    for (int i = 0; i < BLE_LINK_SLOTS; i++) {
+        if (links[i].used) {
+            n++;
+            if (links[i].params.interval > longest) {
+                longest = links[i].params.interval;
+            }
+        }
+    }
+    xSemaphoreGive(link_lock);
+    if (max_interval != NULL) {
+        *max_interval = longest;
+    }
+    return n;
+}
@@ -0,0 +1,137 @@
+// boot_profile.c
+#include "boot_profile.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "dlog.h"
+#include "journal.h"
+#include "esp_timer.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Come il main task (ESP_TASK_MAIN_PRIO / CONFIG_ESP_MAIN_TASK_STACK_SIZE)
+#define BOOT_TASK_PRIORITY      1
+#define BOOT_TASK_STACK         3584
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_NVS]    = "nvs",
+    [BOOT_PHASE_QUEUES] = "queues",
+    [BOOT_PHASE_BLE]    = "ble",
+    [BOOT_PHASE_WIFI]   = "wifi",
+};
+
+// Scritti una volta sola, letti da qualsiasi task
+static _Atomic int64_t phase_start_us[BOOT_PHASE_COUNT];
+static _Atomic int64_t phase_end_us[BOOT_PHASE_COUNT];
+static _Atomic int64_t mark_us[BOOT_MARK_COUNT];
+static _Atomic int64_t done_us;
+static atomic_bool profile_logged;
+
+// Bit BOOT_AFTER(fase) alzato a fase conclusa. Mai cancellato: l'ultimo
+// task di fase puo' essere ancora dentro xEventGroupSetBits quando
+// boot_run si sveglia.
+static EventGroupHandle_t phases_done;
+
+static void boot_profile_try_log(void);
+
+static void boot_step_task(void *arg) {
+    const boot_step_t *step = arg;
+    boot_phase_t phase = step->phase;
+    if (step->after != 0) {
+        xEventGroupWaitBits(phases_done, step->after, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    atomic_store(&phase_start_us[phase], esp_timer_get_time());
+    step->run();
+    atomic_store(&phase_end_us[phase], esp_timer_get_time());
+    xEventGroupSetBits(phases_done, BOOT_AFTER(phase));
+    vTaskDelete(NULL);
+}
+
+void boot_run(const boot_step_t *steps, size_t count) {
+    phases_done = xEventGroupCreate();
+    configASSERT(phases_done != NULL);
+
+    uint32_t all = 0;
+    for (size_t i = 0; i < count; i++) {
+        all |= BOOT_AFTER(steps[i].phase);
+    }
+    for (size_t i = 0; i < count; i++) {
+        // Una dipendenza assente o circolare bloccherebbe l'avvio per sempre
+        configASSERT(steps[i].phase < BOOT_PHASE_COUNT);
+        configASSERT((steps[i].after & ~all) == 0);
+        configASSERT((steps[i].after & BOOT_AFTER(steps[i].phase)) == 0);
+
+        char name[16];
+        snprintf(name, sizeof(name), "boot_%s", phase_names[steps[i].phase]);
+        BaseType_t ok = xTaskCreate(boot_step_task, name,
+                                    steps[i].stack ? steps[i].stack : BOOT_TASK_STACK,
+                                    (void *)&steps[i], BOOT_TASK_PRIORITY, NULL);
+        configASSERT(ok == pdPASS);
+    }
+    xEventGroupWaitBits(phases_done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    atomic_store(&done_us, esp_timer_get_time());
+    boot_profile_try_log();
+}
+
+void boot_mark(boot_mark_t mark) {
+    int64_t expected = 0;
+    if (atomic_compare_exchange_strong(&mark_us[mark], &expected, esp_timer_get_time())
+        && mark == BOOT_MARK_ADVERTISING) {
+        boot_profile_try_log();
+    }
+}
+
+void boot_profile_get(boot_profile_t *out) {
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        out->start_us[i] = atomic_load(&phase_start_us[i]);
+        out->end_us[i] = atomic_load(&phase_end_us[i]);
+    }
+    for (int i = 0; i < BOOT_MARK_COUNT; i++) {
+        out->mark_us[i] = atomic_load(&mark_us[i]);
+    }
+    out->done_us = atomic_load(&done_us);
+}
+
+const char *boot_phase_name(boot_phase_t phase) {
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+static void put_ms(uint8_t *p, int64_t us) {
+    uint32_t ms = us > 0 ? (uint32_t)(us / 1000) : 0;
+    ms = ms > UINT16_MAX ? UINT16_MAX : ms;
+    p[0] = (uint8_t)ms;
+    p[1] = (uint8_t)(ms >> 8);
+}
+
+// Appena fasi e advertising sono tutti marcati: l'IP puo' arrivare molto
+// piu' tardi (o mai) e resta leggibile da boot_profile_get. Una sola riga,
+// formattata dal task di log e non dalla callback GAP che chiama qui, e lo
+// stesso profilo nel diario.
+static void boot_profile_try_log(void) {
+    boot_profile_t p;
+    boot_profile_get(&p);
+    if (p.done_us == 0 || p.mark_us[BOOT_MARK_ADVERTISING] == 0
+        || atomic_exchange(&profile_logged, true)) {
+        return;
+    }
+    uint8_t rec[2 * BOOT_PHASE_COUNT + 4];
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        put_ms(&rec[2 * i], p.end_us[i] - p.start_us[i]);
+    }
+    put_ms(&rec[2 * BOOT_PHASE_COUNT], p.done_us);
+    put_ms(&rec[2 * BOOT_PHASE_COUNT + 2], p.mark_us[BOOT_MARK_ADVERTISING]);
+    journal_log(JOURNAL_EV_BOOT_PROFILE, rec, sizeof(rec));
+    // Fasi come inizio+durata, nell'ordine di boot_phase_t
+    _Static_assert(BOOT_PHASE_COUNT == 4, "aggiornare la riga del profilo");
+    int ms[2 * BOOT_PHASE_COUNT];
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        ms[2 * i] = (int)(p.start_us[i] / 1000);
+        ms[2 * i + 1] = (int)((p.end_us[i] - p.start_us[i]) / 1000);
+    }
+    DLOGI(BOOT, "Profilo avvio (ms): nvs %d+%d queues %d+%d ble %d+%d wifi %d+%d"
+          " init %d adv %d ip %d", ms[0], ms[1], ms[2], ms[3], ms[4], ms[5], ms[6], ms[7],
+          (int)(p.done_us / 1000), (int)(p.mark_us[BOOT_MARK_ADVERTISING] / 1000),
+          p.mark_us[BOOT_MARK_GOT_IP] != 0 ? (int)(p.mark_us[BOOT_MARK_GOT_IP] / 1000) : -1);
+}
@@ -1,24 +1,308 @@
 #include "common_variables.h"
+#include "msg_pool.h"
+#include "rtos_static.h"
+#include "dlog.h"
+#include "telemetry.h"
+#include <stdatomic.h>
 
-// definizione della flag globale
-bool g_wifi_connected = false;
+// ble_to_wifi_q: uno slot per ogni messaggio del pool piu' uno per ciascuna
+// richiesta fusa (ne puo' esserci al massimo una per tipo), quindi l'invio
+// non trova mai la coda piena
+#define BLE_WIFI_POOL_LEN    7
+#define BLE_WIFI_REQUESTS    7
+// Eventi del driver: un giro completo (START, CONNECTED, GOT_IP,
+// DISCONNECTED) anche con wifi_task fermo su una scrittura NVS
+#define BLE_WIFI_DRIVER_LEN  4
+#define BLE_WIFI_Q_DEPTH     (BLE_WIFI_POOL_LEN + BLE_WIFI_DRIVER_LEN + BLE_WIFI_REQUESTS)
+// wifi_to_ble_q: lista in cache, quella che ble_task sta inviando e quella
+// nuova in costruzione; a pool esaurito si svuota la coda. In piu' lo slot
+// della richiesta di stato, che cosi' non toglie mai posto alle liste.
+#define WIFI_BLE_POOL_LEN    3
+#define WIFI_BLE_LISTS       2
+#define WIFI_BLE_REQUESTS    1
+#define WIFI_BLE_Q_DEPTH     (WIFI_BLE_LISTS + WIFI_BLE_REQUESTS)
 
 // definizione delle queue
 QueueHandle_t ble_to_wifi_q = NULL;
 QueueHandle_t wifi_to_ble_q = NULL;
 
+// Le code trasportano solo puntatori: i buffer sono piccoli
+RTOS_QUEUE_DEFINE(ble_to_wifi_mem, BLE_WIFI_Q_DEPTH, sizeof(const ble_wifi_evt_t *));
+RTOS_QUEUE_DEFINE(wifi_to_ble_mem, WIFI_BLE_Q_DEPTH, sizeof(const wifi_ble_evt_t *));
+
+MSG_POOL_DEFINE(ble_wifi_pool, ble_wifi_evt_t, BLE_WIFI_POOL_LEN);
+MSG_POOL_DEFINE(ble_wifi_driver_pool, ble_wifi_evt_t, BLE_WIFI_DRIVER_LEN);
+MSG_POOL_DEFINE(wifi_ble_pool, wifi_ble_evt_t, WIFI_BLE_POOL_LEN);
+
+// Le richieste senza dati sono messaggi costanti, fuori dal pool
+static const ble_wifi_evt_t req_btn_press     = { .type = BLE_WIFI_EVT_BTN_PRESS };
+static const ble_wifi_evt_t req_scan_done     = { .type = BLE_WIFI_EVT_SCAN_DONE };
+static const ble_wifi_evt_t req_autojoin      = { .type = BLE_WIFI_EVT_AUTOJOIN };
+static const ble_wifi_evt_t req_scan_fresh    = { .type = BLE_WIFI_EVT_SCAN_FRESH };
+static const ble_wifi_evt_t req_disconnect    = { .type = BLE_WIFI_EVT_DISCONNECT };
+static const ble_wifi_evt_t req_factory_reset = { .type = BLE_WIFI_EVT_FACTORY_RESET };
+// Segnaposto in coda per l'ultimo CONNECT, che aspetta in pending_connect
+static const ble_wifi_evt_t req_connect       = { .type = BLE_WIFI_EVT_CONNECT };
+// Stato Wi-Fi cambiato: il contenuto lo legge ble_task da wifi_status
+static const wifi_ble_evt_t req_status        = { .type = WIFI_BLE_EVT_CONNECT_STATUS };
+
+// Vince solo l'ultimo CONNECT: uno nuovo sostituisce quello non ancora letto
+static _Atomic(ble_wifi_evt_t *) pending_connect;
+
+// Contatori aggiornati da piu' task (BTC, loop eventi, timer, wifi_task)
+typedef struct {
+    _Atomic uint32_t posted;
+    _Atomic uint32_t coalesced;
+    _Atomic uint32_t superseded;
+    _Atomic uint32_t rejected;
+    _Atomic uint32_t dropped;
+    _Atomic uint32_t high_water;
+} queue_counters_t;
+
+static queue_counters_t ble_to_wifi_cnt;
+static queue_counters_t wifi_to_ble_cnt;
+
+// Un bit per tipo di richiesta attualmente in ble_to_wifi_q / wifi_to_ble_q
+static _Atomic uint32_t ble_wifi_pending;
+static _Atomic uint32_t wifi_ble_pending;
+
+// Un post su coda vuota apre l'intervallo di attesa: lo chiude la prima
+// ricezione del consumatore (telemetry_end)
+static void note_posted(QueueHandle_t q, queue_counters_t *cnt, telemetry_lat_t wake) {
+    atomic_fetch_add(&cnt->posted, 1);
+    uint32_t used = uxQueueMessagesWaiting(q);
+    if (used == 1) {
+        telemetry_begin(wake);
+    }
+    uint32_t hw = atomic_load(&cnt->high_water);
+    while (used > hw && !atomic_compare_exchange_weak(&cnt->high_water, &hw, used)) {
+    }
+}
+
+// — BLE -> Wi-Fi —
+
+// Accoda msg a meno che uno dello stesso tipo non sia gia' in coda
+static bool ble_wifi_post_fused(const ble_wifi_evt_t *msg) {
+    uint32_t bit = 1u << msg->type;
+    if (atomic_fetch_or(&ble_wifi_pending, bit) & bit) {
+        atomic_fetch_add(&ble_to_wifi_cnt.coalesced, 1);
+        return true;
+    }
+    if (xQueueSend(ble_to_wifi_q, &msg, 0) != pdTRUE) {
+        atomic_fetch_and(&ble_wifi_pending, ~bit);
+        atomic_fetch_add(&ble_to_wifi_cnt.rejected, 1);
+        return false;
+    }
+    note_posted(ble_to_wifi_q, &ble_to_wifi_cnt, TELEMETRY_LAT_WAKE_WIFI);
+    return true;
+}
+
+bool ble_wifi_request(ble_wifi_evt_type_t type) {
+    switch (type) {
+        case BLE_WIFI_EVT_BTN_PRESS:     return ble_wifi_post_fused(&req_btn_press);
+        case BLE_WIFI_EVT_SCAN_DONE:     return ble_wifi_post_fused(&req_scan_done);
+        case BLE_WIFI_EVT_AUTOJOIN:      return ble_wifi_post_fused(&req_autojoin);
+        case BLE_WIFI_EVT_SCAN_FRESH:    return ble_wifi_post_fused(&req_scan_fresh);
+        case BLE_WIFI_EVT_DISCONNECT:    return ble_wifi_post_fused(&req_disconnect);
+        case BLE_WIFI_EVT_FACTORY_RESET: return ble_wifi_post_fused(&req_factory_reset);
+        default:
+            configASSERT(!"evento con dati: usare ble_wifi_alloc");
+            return false;
+    }
+}
+
+ble_wifi_evt_t *ble_wifi_alloc(void) {
+    ble_wifi_evt_t *evt = msg_pool_alloc(&ble_wifi_pool);
+    if (evt == NULL) {
+        uint32_t n = atomic_fetch_add(&ble_to_wifi_cnt.rejected, 1) + 1;
+        DLOGW(QUEUE, "ble_to_wifi piena, evento rifiutato (%u finora)", (unsigned)n);
+    }
+    return evt;
+}
+
+ble_wifi_evt_t *ble_wifi_alloc_driver(void) {
+    ble_wifi_evt_t *evt = msg_pool_alloc(&ble_wifi_driver_pool);
+    if (evt == NULL) {
+        atomic_fetch_add(&ble_to_wifi_cnt.rejected, 1);
+        DLOGE(QUEUE, "ble_to_wifi: pool eventi del driver esaurito, evento perso");
+    }
+    return evt;
+}
+
+bool ble_wifi_post(ble_wifi_evt_t *evt) {
+    if (evt->type == BLE_WIFI_EVT_CONNECT) {
+        // Prima il messaggio, poi il segnaposto: chi riceve il segnaposto
+        // trova sempre l'ultimo CONNECT arrivato
+        ble_wifi_evt_t *old = atomic_exchange(&pending_connect, evt);
+        if (old != NULL) {
+            // Il segnaposto del vecchio e' ancora da consumare: servira' questo
+            msg_pool_release(&ble_wifi_pool, old);
+            atomic_fetch_add(&ble_to_wifi_cnt.superseded, 1);
+            return true;
+        }
+        if (!ble_wifi_post_fused(&req_connect)) {
+            ble_wifi_evt_t *mine = evt;
+            if (atomic_compare_exchange_strong(&pending_connect, &mine, NULL)) {
+                msg_pool_release(&ble_wifi_pool, evt);
+            }
+            return false;
+        }
+        return true;
+    }
+    if (xQueueSend(ble_to_wifi_q, &evt, 0) != pdTRUE) {
+        ble_wifi_release(evt);
+        atomic_fetch_add(&ble_to_wifi_cnt.rejected, 1);
+        return false;
+    }
+    note_posted(ble_to_wifi_q, &ble_to_wifi_cnt, TELEMETRY_LAT_WAKE_WIFI);
+    return true;
+}
+
+const ble_wifi_evt_t *ble_wifi_receive(TickType_t ticks) {
+    const ble_wifi_evt_t *evt;
+    for (;;) {
+        if (xQueueReceive(ble_to_wifi_q, &evt, ticks) != pdTRUE) {
+            return NULL;
+        }
+        telemetry_end(TELEMETRY_LAT_WAKE_WIFI);
+        if (msg_pool_is_member(&ble_wifi_pool, evt) || msg_pool_is_member(&ble_wifi_driver_pool, evt)) {
+            return evt;
+        }
+        // Da qui in poi una richiesta uguale va accodata di nuovo: quella
+        // ricevuta non e' ancora stata servita, quindi nessuna si perde
+        atomic_fetch_and(&ble_wifi_pending, ~(1u << evt->type));
+        if (evt != &req_connect) {
+            return evt;
+        }
+        ble_wifi_evt_t *connect = atomic_exchange(&pending_connect, NULL);
+        if (connect != NULL) {
+            return connect;
+        }
+        // CONNECT gia' preso con il segnaposto precedente
+    }
+}
+
+void ble_wifi_release(const ble_wifi_evt_t *evt) {
+    // Ogni pool ignora i messaggi che non sono suoi
+    msg_pool_release(&ble_wifi_pool, evt);
+    msg_pool_release(&ble_wifi_driver_pool, evt);
+}
+
+// — Wi-Fi -> BLE —
+// Liste: produttore unico (wifi_task). Richieste di stato: loop eventi e
+// wifi_task. Consumatore unico (ble_task).
+
+bool wifi_ble_request(wifi_ble_evt_type_t type) {
+    configASSERT(type == WIFI_BLE_EVT_CONNECT_STATUS);
+    const wifi_ble_evt_t *msg = &req_status;
+    uint32_t bit = 1u << type;
+    if (atomic_fetch_or(&wifi_ble_pending, bit) & bit) {
+        atomic_fetch_add(&wifi_to_ble_cnt.coalesced, 1);
+        return true;
+    }
+    if (xQueueSend(wifi_to_ble_q, &msg, 0) != pdTRUE) {
+        atomic_fetch_and(&wifi_ble_pending, ~bit);
+        atomic_fetch_add(&wifi_to_ble_cnt.rejected, 1);
+        return false;
+    }
+    note_posted(wifi_to_ble_q, &wifi_to_ble_cnt, TELEMETRY_LAT_WAKE_BLE);
+    return true;
+}
+
+static void wifi_ble_drop_oldest(void) {
+    const wifi_ble_evt_t *old;
+    for (int i = 0; i < WIFI_BLE_Q_DEPTH && xQueueReceive(wifi_to_ble_q, &old, 0) == pdTRUE; i++) {
+        if (!msg_pool_is_member(&wifi_ble_pool, old)) {
+            // La richiesta di stato non si scarta: torna in fondo. Il suo bit
+            // resta alzato, quindi nessun altro puo' prenderle il posto.
+            xQueueSend(wifi_to_ble_q, &old, 0);
+            continue;
+        }
+        msg_pool_release(&wifi_ble_pool, old);
+        atomic_fetch_add(&wifi_to_ble_cnt.dropped, 1);
+        DLOGW(QUEUE, "wifi_to_ble piena, scartata la lista piu' vecchia");
+        return;
+    }
+}
+
+wifi_ble_evt_t *wifi_ble_alloc(void) {
+    wifi_ble_evt_t *evt = msg_pool_alloc(&wifi_ble_pool);
+    // Esaurito: le liste ancora in coda sono vecchie rispetto a quella nuova
+    while (evt == NULL && uxQueueMessagesWaiting(wifi_to_ble_q) > 0) {
+        wifi_ble_drop_oldest();
+        evt = msg_pool_alloc(&wifi_ble_pool);
+    }
+    return evt;
+}
+
+// Le liste lasciano libero lo slot della richiesta di stato se non e' in coda
+static bool wifi_ble_list_room(void) {
+    UBaseType_t reserved = atomic_load(&wifi_ble_pending) != 0 ? 0 : WIFI_BLE_REQUESTS;
+    return uxQueueSpacesAvailable(wifi_to_ble_q) > reserved;
+}
+
+bool wifi_ble_post(const wifi_ble_evt_t *evt) {
+    msg_pool_ref(&wifi_ble_pool, evt);
+    for (int attempt = 0; attempt <= WIFI_BLE_Q_DEPTH; attempt++) {
+        if (wifi_ble_list_room() && xQueueSend(wifi_to_ble_q, &evt, 0) == pdTRUE) {
+            note_posted(wifi_to_ble_q, &wifi_to_ble_cnt, TELEMETRY_LAT_WAKE_BLE);
+            return true;
+        }
+        wifi_ble_drop_oldest();
+    }
+    msg_pool_release(&wifi_ble_pool, evt);
+    atomic_fetch_add(&wifi_to_ble_cnt.rejected, 1);
+    return false;
+}
+
+const wifi_ble_evt_t *wifi_ble_receive(TickType_t ticks) {
+    const wifi_ble_evt_t *evt;
+    if (xQueueReceive(wifi_to_ble_q, &evt, ticks) != pdTRUE) {
+        return NULL;
+    }
+    telemetry_end(TELEMETRY_LAT_WAKE_BLE);
+    if (!msg_pool_is_member(&wifi_ble_pool, evt)) {
+        // Come per ble_wifi_receive: un cambiamento da qui in poi riaccoda
+        atomic_fetch_and(&wifi_ble_pending, ~(1u << evt->type));
+    }
+    return evt;
+}
+
+void wifi_ble_release(const wifi_ble_evt_t *evt) {
+    msg_pool_release(&wifi_ble_pool, evt);
+}
+
+// — statistiche —
+
+static void stats_read(const queue_counters_t *cnt, QueueHandle_t q, uint16_t depth, msg_pool_t *pool,
+                       queue_stats_t *out) {
+    out->posted = atomic_load(&cnt->posted);
+    out->coalesced = atomic_load(&cnt->coalesced);
+    out->superseded = atomic_load(&cnt->superseded);
+    out->rejected = atomic_load(&cnt->rejected);
+    out->dropped = atomic_load(&cnt->dropped);
+    out->waiting = q ? (uint16_t)uxQueueMessagesWaiting(q) : 0;
+    out->high_water = (uint16_t)atomic_load(&cnt->high_water);
+    out->depth = depth;
+    out->pool_in_use = atomic_load(&pool->in_use);
+    out->pool_peak = atomic_load(&pool->peak);
+    out->pool_size = pool->count;
+}
+
+void queues_get_stats(queue_stats_t *ble_to_wifi, queue_stats_t *wifi_to_ble) {
+    if (ble_to_wifi) {
+        stats_read(&ble_to_wifi_cnt, ble_to_wifi_q, BLE_WIFI_Q_DEPTH, &ble_wifi_pool, ble_to_wifi);
+    }
+    if (wifi_to_ble) {
+        stats_read(&wifi_to_ble_cnt, wifi_to_ble_q, WIFI_BLE_Q_DEPTH, &wifi_ble_pool, wifi_to_ble);
+    }
+}
+
 void queues_init(void) {
-    // crea la queue BLE→Wi‑Fi
-    ble_to_wifi_q = xQueueCreate(
-        /*depth*/      10, 
-        /*item size*/  sizeof(ble_wifi_evt_t)
-    );
-    configASSERT(ble_to_wifi_q != NULL);
-
-    // crea la queue Wi‑Fi→BLE
-    wifi_to_ble_q = xQueueCreate(
-        /*depth*/      10, 
-        /*item size*/  sizeof(wifi_ble_evt_t)
-    );
-    configASSERT(wifi_to_ble_q != NULL);
+    // crea la queue BLE→Wi‑Fi: solo puntatori, i messaggi stanno nel pool
+    ble_to_wifi_q = rtos_queue_create(&ble_to_wifi_mem);
+
+    // crea la queue Wi‑Fi→BLE: puntatori alle liste (~1.4 KB l'una) nel pool
+    // e alla richiesta di stato
+    wifi_to_ble_q = rtos_queue_create(&wifi_to_ble_mem);
 }
\ No newline at end of file
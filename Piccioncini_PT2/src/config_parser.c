@@ -0,0 +1,105 @@
+// config_parser.c
+#include "config_parser.h"
+#include <string.h>
+
+static config_parse_status_t put_field(char *dst, size_t cap, const uint8_t *src, size_t len,
+                                       bool *seen) {
+    if (*seen) {
+        return CONFIG_PARSE_DUPLICATE;
+    }
+    if (len >= cap) {
+        return CONFIG_PARSE_TOO_LONG;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    *seen = true;
+    return CONFIG_PARSE_OK;
+}
+
+static config_parse_status_t parse_tlv(const uint8_t *buf, size_t len, ble_wifi_evt_t *evt) {
+    bool have_ssid = false, have_pass = false;
+    size_t pos = 0;
+    while (pos < len) {
+        if (len - pos < 2) {
+            return CONFIG_PARSE_TRUNCATED;
+        }
+        uint8_t type = buf[pos];
+        uint8_t vlen = buf[pos + 1];
+        pos += 2;
+        if (vlen > len - pos) {
+            return CONFIG_PARSE_TRUNCATED;
+        }
+        config_parse_status_t st = CONFIG_PARSE_OK;
+        if (type == CONFIG_TLV_SSID) {
+            st = put_field(evt->ssid, sizeof(evt->ssid), &buf[pos], vlen, &have_ssid);
+        } else if (type == CONFIG_TLV_PASSWORD) {
+            st = put_field(evt->password, sizeof(evt->password), &buf[pos], vlen, &have_pass);
+        }
+        if (st != CONFIG_PARSE_OK) {
+            return st;
+        }
+        pos += vlen;
+    }
+    return have_ssid && evt->ssid[0] ? CONFIG_PARSE_OK : CONFIG_PARSE_NO_SSID;
+}
+
+// Prossimo "%%" a partire da 'from'; ritorna len se non c'e'
+static size_t find_delim(const uint8_t *buf, size_t len, size_t from) {
+    for (size_t i = from; i + 1 < len; i++) {
+        if (buf[i] == '%' && buf[i + 1] == '%') {
+            return i;
+        }
+    }
+    return len;
+}
+
+// %%ssid%%password%%: il contenuto dopo l'ultimo "%%" viene ignorato,
+// come faceva il parser originale
+static config_parse_status_t parse_legacy(const uint8_t *buf, size_t len, ble_wifi_evt_t *evt) {
+    bool have_ssid = false, have_pass = false;
+    size_t ssid_start = 2;
+    size_t ssid_end = find_delim(buf, len, ssid_start);
+    if (ssid_end == len) {
+        return CONFIG_PARSE_TRUNCATED;
+    }
+    size_t pass_start = ssid_end + 2;
+    size_t pass_end = find_delim(buf, len, pass_start);
+    if (pass_end == len) {
+        return CONFIG_PARSE_TRUNCATED;
+    }
+    config_parse_status_t st = put_field(evt->ssid, sizeof(evt->ssid), &buf[ssid_start],
+                                         ssid_end - ssid_start, &have_ssid);
+    if (st == CONFIG_PARSE_OK) {
+        st = put_field(evt->password, sizeof(evt->password), &buf[pass_start],
+                       pass_end - pass_start, &have_pass);
+    }
+    if (st != CONFIG_PARSE_OK) {
+        return st;
+    }
+    return evt->ssid[0] ? CONFIG_PARSE_OK : CONFIG_PARSE_NO_SSID;
+}
+
+config_parse_status_t config_parse(const uint8_t *buf, size_t len, ble_wifi_evt_t *evt) {
+    if (buf == NULL || len == 0) {
+        return CONFIG_PARSE_EMPTY;
+    }
+    evt->type = BLE_WIFI_EVT_CONNECT;
+    evt->ssid[0] = '\0';
+    evt->password[0] = '\0';
+    if (len >= 2 && buf[0] == '%' && buf[1] == '%') {
+        return parse_legacy(buf, len, evt);
+    }
+    return parse_tlv(buf, len, evt);
+}
+
+const char *config_parse_status_name(config_parse_status_t status) {
+    switch (status) {
+        case CONFIG_PARSE_OK:        return "ok";
+        case CONFIG_PARSE_EMPTY:     return "vuota";
+        case CONFIG_PARSE_TRUNCATED: return "troncata";
+        case CONFIG_PARSE_TOO_LONG:  return "campo troppo lungo";
+        case CONFIG_PARSE_NO_SSID:   return "ssid mancante";
+        case CONFIG_PARSE_DUPLICATE: return "campo ripetuto";
+    }
+    return "?";
+}
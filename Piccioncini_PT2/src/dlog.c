@@ -0,0 +1,344 @@
+// dlog.c
+#include "dlog.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rtos_static.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DLOG_MASK               (DLOG_RING_LEN - 1)
+_Static_assert((DLOG_RING_LEN & DLOG_MASK) == 0, "DLOG_RING_LEN deve essere una potenza di 2");
+
+// Priorita' sotto tutti i task che scrivono (task_plan.h): formatta solo
+// quando la CPU e' libera
+#define DLOG_TASK_STACK         3072    // snprintf di newlib e la riga da DLOG_LINE_LEN
+#define DLOG_DRAIN_MS           10
+#define DLOG_LINE_LEN           192
+
+RTOS_TASK_DEFINE(dlog_task_mem, DLOG_TASK_STACK);
+
+static const char *const tag_names[DLOG_TAG_COUNT] = {
+    [DLOG_TAG_BLE]     = "BLE_HANDLER",
+    [DLOG_TAG_LINK]    = "BLE_LINK",
+    [DLOG_TAG_WIFI]    = "WIFI_TAG",
+    [DLOG_TAG_STATUS]  = "WIFI_STATUS",
+    [DLOG_TAG_STORE]   = "WIFI_STORE",
+    [DLOG_TAG_QUEUE]   = "QUEUE",
+    [DLOG_TAG_BOOT]    = "BOOT",
+    [DLOG_TAG_OTA]     = "OTA",
+    [DLOG_TAG_JOURNAL] = "JOURNAL",
+};
+
+typedef struct {
+    // Anello MPSC a sequenza per slot: seq == pos slot libero per chi ha
+    // preso pos, seq == pos + 1 riga pronta per il task. Si salva meno
+    // l'indice dello slot, cosi' l'anello azzerato e' gia' valido e si puo'
+    // scrivere anche prima di dlog_init.
+    _Atomic uint32_t seq;
+    uint32_t ts_ms;
+    const char *format;
+    uint8_t level;
+    uint8_t tag;
+    uint8_t nwords;
+    uint8_t nstr;
+    uint32_t words[DLOG_MAX_WORDS];
+    char str[DLOG_STR_LEN];
+} dlog_rec_t;
+
+static dlog_rec_t ring[DLOG_RING_LEN];
+static _Atomic uint32_t ring_head;     // prossima posizione da prendere
+static _Atomic uint32_t ring_tail;     // prossima da scrivere (solo il task la avanza)
+static _Atomic uint32_t stat_written;
+static _Atomic uint32_t stat_dropped;
+static _Atomic uint32_t stat_peak;
+
+static uint32_t seq_load(dlog_rec_t *r) {
+    return atomic_load_explicit(&r->seq, memory_order_acquire) + (uint32_t)(r - ring);
+}
+
+static void seq_store(dlog_rec_t *r, uint32_t seq) {
+    atomic_store_explicit(&r->seq, seq - (uint32_t)(r - ring), memory_order_release);
+}
+
+// Una specifica di conversione di printf, letta uguale da chi accoda e da
+// chi formatta
+typedef enum { ARG_INT, ARG_LONG, ARG_LLONG, ARG_SIZE, ARG_PTR, ARG_STR, ARG_NONE } arg_kind_t;
+
+typedef struct {
+    const char *start;          // '%'
+    const char *end;            // dopo la conversione
+    arg_kind_t kind;
+    bool is_signed;
+} spec_t;
+
+// Prossima specifica a partire da p; false a fine stringa. Una conversione
+// non ammessa ferma la lettura (il resto si stampa cosi' com'e').
+static bool spec_next(const char *p, spec_t *sp) {
+    while ((p = strchr(p, '%')) != NULL && p[1] == '%') {
+        p += 2;
+    }
+    if (p == NULL) {
+        return false;
+    }
+    sp->start = p++;
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    int longs = 0;
+    bool size = false;
+    while (*p == 'l' || *p == 'h' || *p == 'z') {
+        longs += *p == 'l';
+        size = size || *p == 'z';
+        p++;
+    }
+    char conv = *p;
+    sp->end = conv ? p + 1 : p;
+    sp->is_signed = conv == 'd' || conv == 'i';
+    if (conv && strchr("diuxXoc", conv)) {
+        sp->kind = size ? ARG_SIZE : longs >= 2 ? ARG_LLONG : longs == 1 ? ARG_LONG : ARG_INT;
+    } else if (conv == 's') {
+        sp->kind = ARG_STR;
+    } else if (conv == 'p') {
+        sp->kind = ARG_PTR;
+    } else {
+        sp->kind = ARG_NONE;
+    }
+    return true;
+}
+
+static unsigned kind_words(arg_kind_t kind) {
+    switch (kind) {
+        case ARG_LONG:  return sizeof(long) > 4 ? 2 : 1;
+        case ARG_LLONG: return 2;
+        case ARG_SIZE:  return sizeof(size_t) > 4 ? 2 : 1;
+        case ARG_PTR:   return sizeof(void *) > 4 ? 2 : 1;
+        default:        return 1;
+    }
+}
+
+// Copia gli argomenti grezzi nello slot seguendo il formato
+static void rec_capture(dlog_rec_t *r, const char *format, va_list ap) {
+    unsigned w = 0;
+    size_t s = 0;
+    spec_t sp;
+    r->nwords = 0;
+    r->nstr = 0;
+    for (const char *p = format; spec_next(p, &sp) && sp.kind != ARG_NONE; p = sp.end) {
+        if (sp.kind == ARG_STR) {
+            const char *str = va_arg(ap, const char *);
+            if (str == NULL) {
+                str = "(null)";
+            }
+            // Sempre terminata: se non c'e' spazio la stringa resta vuota
+            size_t room = s < DLOG_STR_LEN ? DLOG_STR_LEN - s - 1 : 0;
+            size_t n = strnlen(str, room);
+            if (s < DLOG_STR_LEN) {
+                memcpy(&r->str[s], str, n);
+                r->str[s + n] = '\0';
+                s += n + 1;
+            }
+            r->nstr++;
+            continue;
+        }
+        uint64_t v;
+        switch (sp.kind) {
+            case ARG_LONG:  v = (uint64_t)va_arg(ap, long); break;
+            case ARG_LLONG: v = (uint64_t)va_arg(ap, long long); break;
+            case ARG_SIZE:  v = (uint64_t)va_arg(ap, size_t); break;
+            case ARG_PTR:   v = (uint64_t)(uintptr_t)va_arg(ap, void *); break;
+            default:        v = (uint64_t)(uint32_t)va_arg(ap, int); break;
+        }
+        unsigned n = kind_words(sp.kind);
+        if (w + n > DLOG_MAX_WORDS) {
+            break;
+        }
+        r->words[w++] = (uint32_t)v;
+        if (n == 2) {
+            r->words[w++] = (uint32_t)(v >> 32);
+        }
+    }
+    r->nwords = (uint8_t)w;
+}
+
+void dlog_write(esp_log_level_t level, dlog_tag_t tag, const char *format, ...) {
+    uint32_t pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    dlog_rec_t *r;
+    while (1) {
+        r = &ring[pos & DLOG_MASK];
+        uint32_t seq = seq_load(r);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Anello pieno: chi scrive non aspetta mai
+            atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+    r->ts_ms = esp_log_timestamp();
+    r->format = format;
+    r->level = (uint8_t)level;
+    r->tag = (uint8_t)tag;
+    va_list ap;
+    va_start(ap, format);
+    rec_capture(r, format, ap);
+    va_end(ap);
+    seq_store(r, pos + 1);
+
+    atomic_fetch_add_explicit(&stat_written, 1, memory_order_relaxed);
+    uint32_t pending = pos + 1 - atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    uint32_t peak = atomic_load_explicit(&stat_peak, memory_order_relaxed);
+    while (pending > peak && !atomic_compare_exchange_weak(&stat_peak, &peak, pending)) {
+    }
+}
+
+// Testo fra due specifiche, con "%%" -> '%'; la riga resta terminata
+static size_t copy_text(char *line, size_t pos, size_t cap, const char *p, const char *end) {
+    while (p < end && pos + 1 < cap) {
+        line[pos++] = *p;
+        p += (p[0] == '%' && p[1] == '%') ? 2 : 1;
+    }
+    line[pos < cap ? pos : cap - 1] = '\0';
+    return pos;
+}
+
+// Formatta una riga dal record; solo il task di log
+static void rec_format(const dlog_rec_t *r, char *line, size_t cap) {
+    size_t pos = 0;
+    unsigned w = 0;
+    const char *str = r->str;
+    unsigned nstr = 0;
+    const char *p = r->format;
+    spec_t sp;
+    char spec[16];
+    while (pos < cap && spec_next(p, &sp) && sp.kind != ARG_NONE) {
+        pos = copy_text(line, pos, cap, p, sp.start);
+        p = sp.end;
+        if (pos >= cap) {
+            break;
+        }
+        size_t len = (size_t)(sp.end - sp.start);
+        if (len >= sizeof(spec)) {
+            break;
+        }
+        memcpy(spec, sp.start, len);
+        spec[len] = '\0';
+        int n;
+        if (sp.kind == ARG_STR) {
+            n = snprintf(&line[pos], cap - pos, spec, nstr < r->nstr ? str : "?");
+            if (nstr++ < r->nstr) {
+                str += strlen(str) + 1;
+                if (str >= r->str + DLOG_STR_LEN) {
+                    str = "";
+                }
+            }
+        } else {
+            unsigned words = kind_words(sp.kind);
+            if (w + words > r->nwords) {
+                n = snprintf(&line[pos], cap - pos, "?");
+            } else {
+                uint64_t v = r->words[w];
+                if (words == 2) {
+                    v |= (uint64_t)r->words[w + 1] << 32;
+                }
+                w += words;
+                switch (sp.kind) {
+                    case ARG_LONG:
+                        n = sp.is_signed ? snprintf(&line[pos], cap - pos, spec, (long)v)
+                                         : snprintf(&line[pos], cap - pos, spec, (unsigned long)v);
+                        break;
+                    case ARG_LLONG:
+                        n = snprintf(&line[pos], cap - pos, spec, (long long)v);
+                        break;
+                    case ARG_SIZE:
+                        n = snprintf(&line[pos], cap - pos, spec, (size_t)v);
+                        break;
+                    case ARG_PTR:
+                        n = snprintf(&line[pos], cap - pos, spec, (void *)(uintptr_t)v);
+                        break;
+                    default:
+                        n = snprintf(&line[pos], cap - pos, spec, (int)(uint32_t)v);
+                        break;
+                }
+            }
+        }
+        pos += n > 0 ? (size_t)n : 0;
+    }
+    copy_text(line, pos, cap, p, p + strlen(p));
+}
+
+static const char level_letter[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+// Scrive le righe pronte; ritorna quante
+static unsigned dlog_drain(void) {
+    static char line[DLOG_LINE_LEN];
+    unsigned count = 0;
+    uint32_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    while (1) {
+        dlog_rec_t *r = &ring[tail & DLOG_MASK];
+        if (seq_load(r) != tail + 1) {
+            break;
+        }
+        rec_format(r, line, sizeof(line));
+        esp_log_level_t level = (esp_log_level_t)r->level;
+        const char *tag = r->tag < DLOG_TAG_COUNT ? tag_names[r->tag] : "?";
+        esp_log_write(level, tag, "%c (%" PRIu32 ") %s: %s\n", level_letter[level % 6], r->ts_ms,
+                      tag, line);
+        seq_store(r, tail + DLOG_RING_LEN);
+        tail++;
+        atomic_store_explicit(&ring_tail, tail, memory_order_relaxed);
+        count++;
+    }
+    return count;
+}
+
+static void dlog_task(void *arg) {
+    uint32_t reported = 0;
+    while (1) {
+        dlog_drain();
+        uint32_t dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+        if (dropped != reported) {
+            esp_log_write(ESP_LOG_WARN, "DLOG", "W (%" PRIu32 ") DLOG: %" PRIu32 " righe perse\n",
+                          esp_log_timestamp(), dropped - reported);
+            reported = dropped;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+    }
+}
+
+void dlog_init(void) {
+    rtos_task_create(&dlog_task_mem, dlog_task, NULL, TASK_PLAN_DLOG);
+}
+
+void dlog_flush(uint32_t timeout_ms) {
+    for (uint32_t waited = 0; waited < timeout_ms; waited += DLOG_DRAIN_MS) {
+        if (atomic_load(&ring_tail) == atomic_load(&ring_head)) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+    }
+}
+
+void dlog_get_stats(dlog_stats_t *out) {
+    out->written = atomic_load_explicit(&stat_written, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+    out->peak = atomic_load_explicit(&stat_peak, memory_order_relaxed);
+}
@@ -0,0 +1,473 @@
+// journal.c
+#include "journal.h"
+#include "dlog.h"
+#include "rtos_static.h"
+
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define JOURNAL_MASK            (JOURNAL_RAM_LEN - 1)
+_Static_assert((JOURNAL_RAM_LEN & JOURNAL_MASK) == 0, "JOURNAL_RAM_LEN deve essere una potenza di 2");
+_Static_assert(JOURNAL_RAM_LEN >= 2 * JOURNAL_FLUSH_BYTES, "il buffer deve reggere un blocco in scrittura");
+
+// esp_partition_write e la cancellazione non usano molto stack; la
+// priorita' e' quella del log (task_plan.h)
+#define JOURNAL_TASK_STACK      2560
+#define JOURNAL_POLL_MS         100
+#define JOURNAL_FLUSH_WAIT_MS   10
+
+#define JOURNAL_TYPE_ERASED     0xFF
+
+RTOS_TASK_DEFINE(journal_task_mem, JOURNAL_TASK_STACK);
+RTOS_MUTEX_DEFINE(journal_lock_mem);
+
+static const char *const event_names[JOURNAL_EV_COUNT] = {
+    [JOURNAL_EV_BOOT]            = "boot",
+    [JOURNAL_EV_BOOT_PROFILE]    = "boot_profile",
+    [JOURNAL_EV_WIFI_CONNECT]    = "wifi_connect",
+    [JOURNAL_EV_WIFI_DISCONNECT] = "wifi_disconnect",
+    [JOURNAL_EV_SCAN]            = "scan",
+    [JOURNAL_EV_BLE_CONNECT]     = "ble_connect",
+    [JOURNAL_EV_BLE_DISCONNECT]  = "ble_disconnect",
+};
+
+// Tutto sotto journal_lock. ram[] rispecchia i byte del diario da
+// 'flushed' a 'head', alla posizione logica & JOURNAL_MASK: chi registra
+// scrive solo oltre head, il task legge solo sotto head, quindi la flash si
+// scrive direttamente da ram[] senza tenere il lock.
+static const esp_partition_t *part;
+static SemaphoreHandle_t journal_lock;
+static uint32_t sectors;
+static uint8_t ram[JOURNAL_RAM_LEN];
+static uint32_t head;
+static uint32_t flushed;
+static uint32_t first;              // record piu' vecchio trovato al montaggio
+static int64_t pending_since_us;    // primo record ancora solo in RAM
+static uint16_t boot;
+static journal_stats_t stats;
+static atomic_bool flush_requested;
+static _Atomic uint32_t dropped_off;    // registrati a diario spento
+
+static void put_le16(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint8_t crc8(const uint8_t *p, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Posizione logica -> offset nella partizione
+static size_t flash_offset(uint32_t pos) {
+    return (size_t)((pos / JOURNAL_SECTOR_LEN) % sectors) * JOURNAL_SECTOR_LEN + pos % JOURNAL_SECTOR_LEN;
+}
+
+static uint32_t sector_start(uint32_t pos) {
+    return pos - pos % JOURNAL_SECTOR_LEN;
+}
+
+// L'anello tiene 'sectors' settori: quello in scrittura e i precedenti
+static uint32_t oldest_locked(void) {
+    uint32_t sec = head / JOURNAL_SECTOR_LEN;
+    uint32_t min = sec >= sectors - 1 ? (sec - (sectors - 1)) * JOURNAL_SECTOR_LEN : 0;
+    uint32_t pos = first > min ? first : min;
+    return pos % JOURNAL_SECTOR_LEN < JOURNAL_SECTOR_HDR_LEN ? sector_start(pos) + JOURNAL_SECTOR_HDR_LEN : pos;
+}
+
+static bool record_valid(const uint8_t *rec) {
+    uint8_t type = rec[0];
+    uint8_t len = rec[1];
+    return type != 0 && type != JOURNAL_TYPE_ERASED && len <= JOURNAL_PAYLOAD_MAX
+        && crc8(rec, JOURNAL_REC_HDR_LEN + len) == rec[JOURNAL_REC_HDR_LEN + len];
+}
+
+// — montaggio —
+
+// Percorre i record del settore 'seq'. Ritorna la posizione dopo l'ultimo
+// record valido e in *clean se da li' alla fine il settore e' cancellato
+// (altrimenti c'e' un record interrotto o dati estranei). *last_boot
+// riceve l'avvio dell'ultimo record, se ce n'e' almeno uno.
+static uint32_t mount_walk(uint32_t seq, bool *clean, int32_t *last_boot) {
+    uint32_t pos = seq * JOURNAL_SECTOR_LEN + JOURNAL_SECTOR_HDR_LEN;
+    uint32_t end = (seq + 1) * JOURNAL_SECTOR_LEN;
+    uint8_t rec[JOURNAL_REC_MAX_LEN];
+    while (end - pos >= JOURNAL_REC_HDR_LEN + 1) {
+        esp_partition_read(part, flash_offset(pos), rec, JOURNAL_REC_HDR_LEN);
+        if (rec[0] == JOURNAL_TYPE_ERASED || rec[1] > JOURNAL_PAYLOAD_MAX
+            || end - pos < JOURNAL_REC_HDR_LEN + rec[1] + 1u) {
+            break;
+        }
+        esp_partition_read(part, flash_offset(pos) + JOURNAL_REC_HDR_LEN, &rec[JOURNAL_REC_HDR_LEN],
+                           rec[1] + 1u);
+        if (!record_valid(rec)) {
+            break;
+        }
+        *last_boot = rec[2] | rec[3] << 8;
+        pos += JOURNAL_REC_HDR_LEN + rec[1] + 1u;
+    }
+    *clean = true;
+    uint8_t blank[64];
+    for (uint32_t p = pos; p < end && *clean; p += sizeof(blank)) {
+        size_t n = end - p < sizeof(blank) ? end - p : sizeof(blank);
+        esp_partition_read(part, flash_offset(p), blank, n);
+        for (size_t i = 0; i < n; i++) {
+            *clean = *clean && blank[i] == 0xFF;
+        }
+    }
+    return pos;
+}
+
+static void journal_mount(void) {
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t i = 0; i < sectors; i++) {
+        uint8_t hdr[JOURNAL_SECTOR_HDR_LEN];
+        esp_partition_read(part, (size_t)i * JOURNAL_SECTOR_LEN, hdr, sizeof(hdr));
+        uint32_t seq = get_le32(&hdr[4]);
+        if (get_le32(hdr) == JOURNAL_MAGIC && seq % sectors == i && (!found || seq > newest)) {
+            newest = seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        // Partizione vergine o di un altro formato: si riparte dal settore 0
+        head = first = 0;
+        boot = 1;
+        return;
+    }
+    // Il piu' vecchio: risalendo da newest, il primo settore che manca
+    uint32_t oldest = newest;
+    while (newest - oldest < sectors - 1 && oldest > 0) {
+        uint8_t hdr[JOURNAL_SECTOR_HDR_LEN];
+        esp_partition_read(part, flash_offset((oldest - 1) * JOURNAL_SECTOR_LEN), hdr, sizeof(hdr));
+        if (get_le32(hdr) != JOURNAL_MAGIC || get_le32(&hdr[4]) != oldest - 1) {
+            break;
+        }
+        oldest--;
+    }
+    first = oldest * JOURNAL_SECTOR_LEN + JOURNAL_SECTOR_HDR_LEN;
+
+    bool clean;
+    int32_t last_boot = -1;
+    uint32_t end = mount_walk(newest, &clean, &last_boot);
+    // Dopo un record interrotto non si riscrive sopra: settore nuovo
+    head = clean ? end : (newest + 1) * JOURNAL_SECTOR_LEN;
+    if (last_boot < 0 && oldest < newest) {
+        bool ignored;
+        mount_walk(newest - 1, &ignored, &last_boot);
+    }
+    boot = last_boot < 0 ? 1 : (uint16_t)(last_boot + 1);
+    if (!clean) {
+        DLOGW(JOURNAL, "Record interrotto nel settore %u, si continua dal successivo",
+              (unsigned)newest);
+    }
+}
+
+// — scrittura —
+
+static void ram_put(uint32_t pos, const void *src, size_t len) {
+    const uint8_t *p = src;
+    for (size_t i = 0; i < len; i++) {
+        ram[(pos + i) & JOURNAL_MASK] = p[i];
+    }
+}
+
+bool journal_log(journal_event_t type, const void *payload, size_t len) {
+    if (journal_lock == NULL) {
+        atomic_fetch_add(&dropped_off, 1);
+        return false;
+    }
+    if (len > JOURNAL_PAYLOAD_MAX) {
+        return false;
+    }
+    uint8_t rec[JOURNAL_REC_MAX_LEN];
+    rec[0] = (uint8_t)type;
+    rec[1] = (uint8_t)len;
+    put_le16(&rec[2], boot);
+    put_le32(&rec[4], (uint32_t)(esp_timer_get_time() / 1000));
+    memcpy(&rec[JOURNAL_REC_HDR_LEN], payload, len);
+    size_t rec_len = JOURNAL_REC_HDR_LEN + len + 1;
+    rec[rec_len - 1] = crc8(rec, rec_len - 1);
+
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    // Un record non attraversa mai due settori: il resto resta cancellato
+    uint32_t off = head % JOURNAL_SECTOR_LEN;
+    uint32_t pad = off != 0 && off + rec_len > JOURNAL_SECTOR_LEN ? JOURNAL_SECTOR_LEN - off : 0;
+    uint32_t hdr_len = off == 0 || pad != 0 ? JOURNAL_SECTOR_HDR_LEN : 0;
+    uint32_t total = pad + hdr_len + (uint32_t)rec_len;
+    bool ok = head + total - flushed <= JOURNAL_RAM_LEN;
+    if (ok) {
+        uint32_t pos = head;
+        for (uint32_t i = 0; i < pad; i++) {
+            ram[(pos++) & JOURNAL_MASK] = 0xFF;
+        }
+        if (hdr_len != 0) {
+            uint8_t hdr[JOURNAL_SECTOR_HDR_LEN];
+            put_le32(hdr, JOURNAL_MAGIC);
+            put_le32(&hdr[4], pos / JOURNAL_SECTOR_LEN);
+            ram_put(pos, hdr, sizeof(hdr));
+            pos += sizeof(hdr);
+        }
+        ram_put(pos, rec, rec_len);
+        if (head == flushed) {
+            pending_since_us = esp_timer_get_time();
+        }
+        head += total;
+        stats.appended++;
+    } else {
+        stats.dropped++;
+    }
+    xSemaphoreGive(journal_lock);
+    return ok;
+}
+
+// Scrive ram[flushed..head): solo il task JOURNAL
+static void journal_write_out(void) {
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    uint32_t pos = flushed;
+    uint32_t end = head;
+    xSemaphoreGive(journal_lock);
+
+    uint32_t erases = 0;
+    while (pos < end) {
+        uint32_t sec_end = sector_start(pos) + JOURNAL_SECTOR_LEN;
+        uint32_t stop = end < sec_end ? end : sec_end;
+        if (pos % JOURNAL_SECTOR_LEN == 0) {
+            // Il settore piu' vecchio dell'anello: l'unica cancellazione
+            esp_err_t err = esp_partition_erase_range(part, flash_offset(pos), JOURNAL_SECTOR_LEN);
+            if (err != ESP_OK) {
+                DLOGE(JOURNAL, "Cancellazione settore fallita: %s", esp_err_to_name(err));
+            }
+            erases++;
+        }
+        while (pos < stop) {
+            // ram[] e' un anello: al piu' due pezzi contigui
+            uint32_t idx = pos & JOURNAL_MASK;
+            uint32_t n = stop - pos < JOURNAL_RAM_LEN - idx ? stop - pos : JOURNAL_RAM_LEN - idx;
+            esp_err_t err = esp_partition_write(part, flash_offset(pos), &ram[idx], n);
+            if (err != ESP_OK) {
+                DLOGE(JOURNAL, "Scrittura fallita: %s", esp_err_to_name(err));
+            }
+            pos += n;
+        }
+    }
+
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    stats.bytes_written += end - flushed;
+    stats.erases += erases;
+    stats.flushes++;
+    flushed = end;
+    if (head != flushed) {
+        // Arrivati durante la scrittura: il loro tempo parte da ora
+        pending_since_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(journal_lock);
+}
+
+static void journal_task(void *arg) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(JOURNAL_POLL_MS));
+        xSemaphoreTake(journal_lock, portMAX_DELAY);
+        uint32_t pending = head - flushed;
+        int64_t since = pending_since_us;
+        xSemaphoreGive(journal_lock);
+        bool requested = atomic_exchange(&flush_requested, false);
+        if (pending >= JOURNAL_FLUSH_BYTES || (pending > 0 && (requested ||
+            esp_timer_get_time() - since >= (int64_t)JOURNAL_FLUSH_MS * 1000))) {
+            journal_write_out();
+        }
+    }
+}
+
+void journal_flush(uint32_t timeout_ms) {
+    if (journal_lock == NULL) {
+        return;
+    }
+    atomic_store(&flush_requested, true);
+    for (uint32_t waited = 0; waited < timeout_ms; waited += JOURNAL_FLUSH_WAIT_MS) {
+        xSemaphoreTake(journal_lock, portMAX_DELAY);
+        bool done = flushed == head;
+        xSemaphoreGive(journal_lock);
+        if (done) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(JOURNAL_FLUSH_WAIT_MS));
+    }
+}
+
+void journal_init(void) {
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "spiffs");
+    if (part == NULL || part->size < 2 * JOURNAL_SECTOR_LEN) {
+        DLOGE(JOURNAL, "Partizione spiffs assente: diario spento");
+        return;
+    }
+    sectors = part->size / JOURNAL_SECTOR_LEN;
+    journal_mount();
+    flushed = head;
+    journal_lock = rtos_mutex_create(journal_lock_mem);
+    rtos_task_create(&journal_task_mem, journal_task, NULL, TASK_PLAN_JOURNAL);
+
+    uint8_t payload[1 + 16];
+    const esp_app_desc_t *app = esp_app_get_description();
+    size_t vlen = strnlen(app->version, sizeof(payload) - 1);
+    payload[0] = (uint8_t)esp_reset_reason();
+    memcpy(&payload[1], app->version, vlen);
+    journal_log(JOURNAL_EV_BOOT, payload, 1 + vlen);
+    // Il record di avvio va in flash subito: in un ciclo di reset piu'
+    // breve di JOURNAL_FLUSH_MS resterebbe sempre in RAM, e con lui il
+    // numero di avvio
+    atomic_store(&flush_requested, true);
+    DLOGI(JOURNAL, "Diario: avvio %u, reset %u, %u KB da %u a %u", boot, payload[0],
+          (unsigned)(head - oldest_locked()) / 1024, (unsigned)oldest_locked(), (unsigned)head);
+}
+
+// — lettura —
+
+// Copia len byte da pos: quelli non ancora scritti da ram[], sotto il lock,
+// gli altri dalla flash. Un settore riciclato nel frattempo non si legge.
+static bool journal_fetch(uint32_t pos, uint8_t *dst, size_t len) {
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    uint32_t from_ram = pos + len > flushed ? pos + (uint32_t)len - (pos > flushed ? pos : flushed) : 0;
+    for (uint32_t i = (uint32_t)len - from_ram; i < len; i++) {
+        dst[i] = ram[(pos + i) & JOURNAL_MASK];
+    }
+    bool recycled = pos < oldest_locked();
+    xSemaphoreGive(journal_lock);
+    if (from_ram < len && !recycled) {
+        esp_partition_read(part, flash_offset(pos), dst, len - from_ram);
+    }
+    return !recycled;
+}
+
+static uint32_t journal_clamp(uint32_t pos) {
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    uint32_t oldest = oldest_locked();
+    uint32_t end = head;
+    xSemaphoreGive(journal_lock);
+    // Anche un cursore "dal futuro" (diario cancellato) riparte dall'inizio
+    if (pos < oldest || pos > end) {
+        return oldest;
+    }
+    return pos == end ? pos : pos % JOURNAL_SECTOR_LEN < JOURNAL_SECTOR_HDR_LEN ? sector_start(pos) + JOURNAL_SECTOR_HDR_LEN : pos;
+}
+
+// Record interi e validi in testa a buf[0..len); *stop se dopo non ce ne
+// sono altri nel settore (cancellato, interrotto o fine del settore)
+static size_t parse_records(const uint8_t *buf, size_t len, uint32_t room, bool *stop) {
+    size_t used = 0;
+    *stop = false;
+    while (len - used >= JOURNAL_REC_HDR_LEN + 1) {
+        const uint8_t *rec = &buf[used];
+        size_t rec_len = JOURNAL_REC_HDR_LEN + rec[1] + 1u;
+        if (rec[0] == JOURNAL_TYPE_ERASED || rec[1] > JOURNAL_PAYLOAD_MAX || rec_len > room - used) {
+            *stop = true;
+            return used;
+        }
+        if (rec_len > len - used) {
+            break;
+        }
+        if (!record_valid(rec)) {
+            *stop = true;
+            return used;
+        }
+        used += rec_len;
+    }
+    *stop = room - used < JOURNAL_REC_HDR_LEN + 1;
+    return used;
+}
+
+size_t journal_read(uint32_t pos, uint8_t *buf, size_t cap, uint32_t *next) {
+    if (journal_lock == NULL) {
+        *next = pos;
+        return 0;
+    }
+    pos = journal_clamp(pos);
+    size_t out = 0;
+    while (1) {
+        xSemaphoreTake(journal_lock, portMAX_DELAY);
+        uint32_t end = head;
+        xSemaphoreGive(journal_lock);
+        if (pos >= end || cap - out < JOURNAL_REC_HDR_LEN + 1) {
+            break;
+        }
+        // Una sola lettura per tratto di settore, poi i record si
+        // controllano sul posto: ogni accesso alla flash ferma la cache
+        uint32_t sec_end = sector_start(pos) + JOURNAL_SECTOR_LEN;
+        size_t span = cap - out;
+        span = span < sec_end - pos ? span : sec_end - pos;
+        span = span < end - pos ? span : end - pos;
+        if (!journal_fetch(pos, &buf[out], span)) {
+            // Settore riciclato mentre si leggeva
+            pos = journal_clamp(pos);
+            continue;
+        }
+        bool stop;
+        size_t used = parse_records(&buf[out], span, sec_end - pos, &stop);
+        out += used;
+        pos += (uint32_t)used;
+        if (stop) {
+            pos = sec_end >= end ? end : journal_clamp(sec_end);
+        } else if (used == 0) {
+            break;      // il prossimo record non sta in buf
+        }
+    }
+    *next = pos;
+    return out;
+}
+
+size_t journal_read_page(uint32_t *cursor, uint8_t *page, size_t cap) {
+    if (cap > JOURNAL_PAGE_LEN) {
+        cap = JOURNAL_PAGE_LEN;
+    }
+    uint32_t pos = journal_lock != NULL ? journal_clamp(*cursor) : *cursor;
+    uint32_t next;
+    size_t n = journal_read(pos, &page[JOURNAL_PAGE_HDR_LEN], cap - JOURNAL_PAGE_HDR_LEN, &next);
+    put_le32(page, pos);
+    put_le32(&page[4], next);
+    *cursor = next;
+    return JOURNAL_PAGE_HDR_LEN + n;
+}
+
+void journal_get_stats(journal_stats_t *out) {
+    if (journal_lock == NULL) {
+        memset(out, 0, sizeof(*out));
+        out->dropped = atomic_load(&dropped_off);
+        return;
+    }
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    *out = stats;
+    out->dropped += atomic_load(&dropped_off);
+    out->head = head;
+    out->oldest = oldest_locked();
+    out->pending = head - flushed;
+    out->boot = boot;
+    xSemaphoreGive(journal_lock);
+}
+
+const char *journal_event_name(journal_event_t type) {
+    return type < JOURNAL_EV_COUNT && event_names[type] != NULL ? event_names[type] : "?";
+}
@@ -4,24 +4,53 @@
 
 #include "ble_handler.h"
 #include "wifi_handler.h"
+#include "boot_profile.h"
+#include "dlog.h"
+#include "journal.h"
+#include "ota_update.h"
+#include "perf_gate.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
 #include "esp_err.h"
 
 
-void app_main(void) {
-
-
+static void boot_nvs(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+}
+
+static void boot_ble(void) {
+    ble_handler_init();
+}
 
-    queues_init();
-    
-    ble_handler_init(4);
-    wifi_init_sta(3);
+static void boot_wifi(void) {
+    wifi_init_sta();
+}
+
+// Bluedroid e Wi-Fi non dipendono l'uno dall'altro: entrambi leggono la
+// calibrazione PHY da NVS e usano code e pool, nient'altro
+static const boot_step_t boot_steps[] = {
+    { .phase = BOOT_PHASE_NVS,    .run = boot_nvs },
+    { .phase = BOOT_PHASE_QUEUES, .run = queues_init },
+    { .phase = BOOT_PHASE_BLE,    .run = boot_ble,
+      .after = BOOT_AFTER(BOOT_PHASE_NVS) | BOOT_AFTER(BOOT_PHASE_QUEUES) },
+    { .phase = BOOT_PHASE_WIFI,   .run = boot_wifi,
+      .after = BOOT_AFTER(BOOT_PHASE_NVS) | BOOT_AFTER(BOOT_PHASE_QUEUES) },
+};
+
+void app_main(void) {
+    // Prima di tutto: le fasi di avvio scrivono gia' nel log differito
+    dlog_init();
+    // Subito dopo: la causa del reset apre il diario di questo avvio
+    journal_init();
+    boot_run(boot_steps, sizeof(boot_steps) / sizeof(boot_steps[0]));
+    // Dopo NVS e Wi-Fi: conferma l'immagine in prova, riprende un download
+    ota_update_init();
+    // Solo nella build per QEMU (APP_PERF_GATE): rapporto per perf_gate.py
+    perf_gate_report();
 }
\ No newline at end of file
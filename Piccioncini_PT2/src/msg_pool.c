@@ -0,0 +1,48 @@
+// msg_pool.c
+#include "msg_pool.h"
+#include <string.h>
+
+// Indice dello slot, -1 se msg non appartiene al pool
+static int slot_of(const msg_pool_t *pool, const void *msg) {
+    const uint8_t *p = msg;
+    if (p < pool->items || p >= pool->items + pool->count * pool->item_size) {
+        return -1;
+    }
+    return (int)((size_t)(p - pool->items) / pool->item_size);
+}
+
+void *msg_pool_alloc(msg_pool_t *pool) {
+    for (uint8_t i = 0; i < pool->count; i++) {
+        uint8_t free_ref = 0;
+        // Il primo che porta refs da 0 a 1 si prende lo slot
+        if (atomic_compare_exchange_strong(&pool->refs[i], &free_ref, 1)) {
+            uint8_t used = atomic_fetch_add(&pool->in_use, 1) + 1;
+            uint8_t peak = atomic_load(&pool->peak);
+            while (used > peak && !atomic_compare_exchange_weak(&pool->peak, &peak, used)) {
+            }
+            void *msg = pool->items + i * pool->item_size;
+            memset(msg, 0, pool->item_size);
+            return msg;
+        }
+    }
+    atomic_fetch_add(&pool->exhausted, 1);
+    return NULL;
+}
+
+void msg_pool_ref(msg_pool_t *pool, const void *msg) {
+    int i = slot_of(pool, msg);
+    if (i >= 0) {
+        atomic_fetch_add(&pool->refs[i], 1);
+    }
+}
+
+void msg_pool_release(msg_pool_t *pool, const void *msg) {
+    int i = slot_of(pool, msg);
+    if (i >= 0 && atomic_fetch_sub(&pool->refs[i], 1) == 1) {
+        atomic_fetch_sub(&pool->in_use, 1);
+    }
+}
+
+bool msg_pool_is_member(const msg_pool_t *pool, const void *msg) {
+    return slot_of(pool, msg) >= 0;
+}
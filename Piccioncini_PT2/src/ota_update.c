@@ -0,0 +1,601 @@
+// ota_update.c
+#include "ota_update.h"
+#include "boot_profile.h"
+#include "dlog.h"
+#include "journal.h"
+#include "task_plan.h"
+#include "wifi_status.h"
+
+#include "esp_app_desc.h"
+#include "esp_app_format.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define OTA_NVS_NAMESPACE       "ota"
+#define OTA_NVS_KEY_URL         "url"
+#define OTA_NVS_KEY_RESUME      "resume"
+#define OTA_RESUME_VERSION      1
+#define OTA_ETAG_MAX            48
+
+// Task transitori: esistono solo durante un download, quindi nell'heap
+// (rtos_static.h). Lo stack del download regge l'handshake TLS.
+#define OTA_TASK_STACK          8192
+#define OTA_FLASH_TASK_STACK    3072
+#define OTA_HTTP_BUF_LEN        1536
+
+// Controllo dell'immagine in prova
+#define OTA_CONFIRM_POLL_MS     1000
+#define OTA_IP_POLL_MS          500
+
+// Quanto serve per leggere nome e versione dell'immagine
+#define OTA_HEADER_LEN  (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + \
+                         sizeof(esp_app_desc_t))
+
+typedef struct {
+    uint32_t offset;            // nello slot, multiplo di OTA_CHUNK_LEN
+    uint32_t len;
+    uint8_t data[OTA_CHUNK_LEN];
+} ota_chunk_t;
+
+// Ripresa in NVS: written e' gia' in flash, il resto descrive l'immagine
+typedef struct {
+    uint8_t version;
+    char url[OTA_URL_MAX];
+    char etag[OTA_ETAG_MAX];
+    uint32_t part_addr;
+    uint32_t total;
+    uint32_t written;
+} ota_resume_t;
+
+// Una sessione alla volta (session_busy): i due task la condividono
+typedef struct {
+    const esp_partition_t *part;
+    QueueHandle_t free_q;       // buffer vuoti, verso il download
+    QueueHandle_t full_q;       // buffer pieni, verso la scrittura
+    ota_chunk_t *chunks;
+    _Atomic esp_err_t flash_err;
+    char etag[OTA_ETAG_MAX];    // dall'ultima risposta
+    bool save_url;              // ota_url nuovo da ota_update_start, non ancora in NVS
+} ota_session_t;
+
+static ota_session_t sess;
+static ota_resume_t resume;
+static char ota_url[OTA_URL_MAX];
+static atomic_bool session_busy;
+static atomic_bool pending_verify;
+
+static _Atomic int prog_state;
+static _Atomic uint32_t prog_written;
+static _Atomic uint32_t prog_total;
+static _Atomic uint8_t prog_resumes;
+static _Atomic esp_err_t prog_err;
+
+static esp_timer_handle_t confirm_timer;
+
+static const char *const state_names[OTA_STATE_COUNT] = {
+    [OTA_STATE_IDLE]           = "IDLE",
+    [OTA_STATE_DOWNLOADING]    = "DOWNLOADING",
+    [OTA_STATE_VERIFYING]      = "VERIFYING",
+    [OTA_STATE_REBOOTING]      = "REBOOTING",
+    [OTA_STATE_FAILED]         = "FAILED",
+    [OTA_STATE_PENDING_VERIFY] = "PENDING_VERIFY",
+};
+
+const char *ota_state_name(ota_state_t state) {
+    return state < OTA_STATE_COUNT ? state_names[state] : "?";
+}
+
+void ota_update_get(ota_progress_t *out) {
+    out->state = (ota_state_t)atomic_load(&prog_state);
+    out->written = atomic_load(&prog_written);
+    out->total = atomic_load(&prog_total);
+    out->resumes = atomic_load(&prog_resumes);
+    out->err = atomic_load(&prog_err);
+}
+
+// — NVS —
+
+static esp_err_t ota_nvs_set(const char *key, const void *value, size_t len) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = value ? nvs_set_blob(nvs, key, value, len) : nvs_erase_key(nvs, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        DLOGE(OTA, "Salvataggio di %s fallito: %s", key, esp_err_to_name(err));
+    }
+    return err;
+}
+
+static bool ota_nvs_get(const char *key, void *out, size_t len) {
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t got = len;
+    bool ok = nvs_get_blob(nvs, key, out, &got) == ESP_OK && got == len;
+    nvs_close(nvs);
+    return ok;
+}
+
+static void ota_resume_save(void) {
+    ota_nvs_set(OTA_NVS_KEY_RESUME, &resume, sizeof(resume));
+}
+
+static void ota_resume_erase(void) {
+    ota_nvs_set(OTA_NVS_KEY_RESUME, NULL, 0);
+}
+
+// Ripresa valida per l'URL corrente e per lo slot libero di adesso
+static bool ota_resume_load(const esp_partition_t *part) {
+    ota_resume_t r;
+    if (!ota_nvs_get(OTA_NVS_KEY_RESUME, &r, sizeof(r)) || r.version != OTA_RESUME_VERSION ||
+        r.url[sizeof(r.url) - 1] != '\0' || r.etag[sizeof(r.etag) - 1] != '\0' ||
+        strcmp(r.url, ota_url) != 0 || r.part_addr != part->address ||
+        r.written > r.total || r.written % OTA_CHUNK_LEN != 0) {
+        return false;
+    }
+    resume = r;
+    return true;
+}
+
+// — scrittura in flash —
+
+// Cancella e scrive un settore alla volta; dopo un errore restituisce
+// soltanto i buffer, il download se ne accorge al prossimo
+static void ota_flash_task(void *arg) {
+    ota_chunk_t *c;
+    while (xQueueReceive(sess.full_q, &c, portMAX_DELAY) == pdTRUE && c != NULL) {
+        if (atomic_load(&sess.flash_err) == ESP_OK) {
+            esp_err_t err = esp_partition_erase_range(sess.part, c->offset, OTA_CHUNK_LEN);
+            if (err == ESP_OK) {
+                err = esp_partition_write(sess.part, c->offset, c->data, c->len);
+            }
+            if (err != ESP_OK) {
+                DLOGE(OTA, "Scrittura a 0x%lx fallita: %s", (unsigned long)c->offset,
+                      esp_err_to_name(err));
+                atomic_store(&sess.flash_err, err);
+            } else {
+                uint32_t done = c->offset + c->len;
+                atomic_store(&prog_written, done);
+                if (done >= resume.written + OTA_CHECKPOINT_BYTES) {
+                    resume.written = done;
+                    ota_resume_save();
+                }
+            }
+        }
+        xQueueSend(sess.free_q, &c, portMAX_DELAY);
+    }
+    // NULL di ritorno: il download sa che questo task non tocca piu' niente
+    xQueueSend(sess.free_q, &c, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+// Riprende tutti i buffer: quando ritorna, cio' che e' stato consegnato e'
+// in flash (o la scrittura e' fallita)
+static void ota_drain(void) {
+    ota_chunk_t *held[OTA_CHUNK_BUFS];
+    for (int i = 0; i < OTA_CHUNK_BUFS; i++) {
+        xQueueReceive(sess.free_q, &held[i], portMAX_DELAY);
+    }
+    for (int i = 0; i < OTA_CHUNK_BUFS; i++) {
+        xQueueSend(sess.free_q, &held[i], portMAX_DELAY);
+    }
+}
+
+// — download —
+
+static esp_err_t ota_http_event(esp_http_client_event_t *evt) {
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "ETag") == 0) {
+        snprintf(sess.etag, sizeof(sess.etag), "%s", evt->header_value);
+    }
+    return ESP_OK;
+}
+
+// Prima di scrivere il settore 0: un'immagine di un altro progetto o per un
+// altro chip non deve nemmeno arrivare in flash
+static esp_err_t ota_check_header(const uint8_t *data) {
+    const esp_image_header_t *img = (const esp_image_header_t *)data;
+    const esp_app_desc_t *desc = (const esp_app_desc_t *)(data + sizeof(esp_image_header_t) +
+                                                          sizeof(esp_image_segment_header_t));
+    const esp_app_desc_t *running = esp_app_get_description();
+    if (img->magic != ESP_IMAGE_HEADER_MAGIC || desc->magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        DLOGE(OTA, "Non e' un'immagine ESP-IDF");
+        return ESP_ERR_INVALID_VERSION;
+    }
+#ifdef CONFIG_IDF_FIRMWARE_CHIP_ID
+    if (img->chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        DLOGE(OTA, "Immagine per il chip %u", img->chip_id);
+        return ESP_ERR_INVALID_VERSION;
+    }
+#endif
+    if (strncmp(desc->project_name, running->project_name, sizeof(desc->project_name)) != 0) {
+        DLOGE(OTA, "Immagine di un altro progetto: %.32s", desc->project_name);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    DLOGI(OTA, "Immagine versione %.32s (in esecuzione %.32s)", desc->version, running->version);
+    return ESP_OK;
+}
+
+// Ricomincia l'immagine da zero con la lunghezza e l'ETag della risposta
+static esp_err_t ota_restart_image(uint32_t *handed, int64_t len) {
+    ota_drain();
+    if (len <= 0) {
+        DLOGE(OTA, "Il server non dichiara la lunghezza: niente ripresa possibile");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((uint64_t)len > sess.part->size) {
+        DLOGE(OTA, "Immagine di %lld byte, lo slot ne ha %lu", (long long)len,
+              (unsigned long)sess.part->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *handed = 0;
+    resume.total = (uint32_t)len;
+    resume.written = 0;
+    snprintf(resume.etag, sizeof(resume.etag), "%s", sess.etag);
+    atomic_store(&prog_total, resume.total);
+    atomic_store(&prog_written, 0);
+    ota_resume_save();
+    return ESP_OK;
+}
+
+// Un tentativo HTTP da *handed in poi. *handed avanza con i settori
+// consegnati alla scrittura, anche se il tentativo fallisce.
+static esp_err_t ota_fetch(uint32_t *handed) {
+    esp_http_client_config_t cfg = {
+        .url = resume.url,
+        .timeout_ms = OTA_HTTP_TIMEOUT_MS,
+        .event_handler = ota_http_event,
+        .buffer_size = OTA_HTTP_BUF_LEN,
+#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+        .crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&cfg);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bool ranged = *handed > 0 && resume.total > 0;
+    if (ranged) {
+        char range[24];
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)*handed);
+        esp_http_client_set_header(client, "Range", range);
+        if (resume.etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-Range", resume.etag);
+        }
+        atomic_fetch_add(&prog_resumes, 1);
+        DLOGI(OTA, "Ripresa da %lu/%lu", (unsigned long)*handed, (unsigned long)resume.total);
+    }
+    sess.etag[0] = '\0';
+
+    ota_chunk_t *c = NULL;
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        DLOGW(OTA, "Connessione fallita: %s", esp_err_to_name(err));
+        goto out;
+    }
+    int64_t len = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+    if (ranged && status == 206 && len > 0 && *handed + len == resume.total) {
+        // prosegue da dove era arrivato
+    } else if (status == 200 || status == 206) {
+        // 200 a una richiesta Range: l'immagine e' cambiata (If-Range) o il
+        // server non sa riprendere
+        if (ranged) {
+            DLOGW(OTA, "Il server riparte da zero (HTTP %d)", status);
+        }
+        if (status == 206) {
+            err = ESP_FAIL;
+            goto out;
+        }
+        err = ota_restart_image(handed, len);
+        if (err != ESP_OK) {
+            goto out;
+        }
+    } else {
+        DLOGE(OTA, "HTTP %d da %s", status, resume.url);
+        err = status >= 400 && status < 500 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+        goto out;
+    }
+
+    while (*handed < resume.total) {
+        if (c == NULL) {
+            xQueueReceive(sess.free_q, &c, portMAX_DELAY);
+            err = atomic_load(&sess.flash_err);
+            if (err != ESP_OK) {
+                goto out;
+            }
+            c->offset = *handed;
+            c->len = 0;
+        }
+        uint32_t want = resume.total - c->offset;
+        if (want > OTA_CHUNK_LEN) {
+            want = OTA_CHUNK_LEN;
+        }
+        int n = esp_http_client_read(client, (char *)c->data + c->len, (int)(want - c->len));
+        if (n <= 0) {
+            DLOGW(OTA, "Download interrotto a %lu/%lu", (unsigned long)(*handed + c->len),
+                  (unsigned long)resume.total);
+            err = ESP_ERR_TIMEOUT;
+            goto out;
+        }
+        uint32_t before = c->len;
+        c->len += (uint32_t)n;
+        if (c->offset == 0 && before < OTA_HEADER_LEN && c->len >= OTA_HEADER_LEN) {
+            err = ota_check_header(c->data);
+            if (err != ESP_OK) {
+                goto out;
+            }
+        }
+        if (c->len == want) {
+            xQueueSend(sess.full_q, &c, portMAX_DELAY);
+            *handed += c->len;
+            c = NULL;
+        }
+    }
+    err = ESP_OK;
+
+out:
+    if (c != NULL) {
+        // settore a meta': si riscarica al prossimo tentativo
+        xQueueSend(sess.free_q, &c, portMAX_DELAY);
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+// Errori per cui riprovare non serve: immagine sbagliata o flash rotta
+static bool ota_err_fatal(esp_err_t err) {
+    return err == ESP_ERR_INVALID_VERSION || err == ESP_ERR_INVALID_SIZE ||
+           err == ESP_ERR_NOT_FOUND || err == ESP_ERR_NO_MEM ||
+           atomic_load(&sess.flash_err) != ESP_OK;
+}
+
+static bool ota_wait_ip(void) {
+    for (uint32_t waited = 0; waited < OTA_WAIT_IP_MS; waited += OTA_IP_POLL_MS) {
+        wifi_status_t st;
+        wifi_status_get(&st);
+        if (st.state == WIFI_STATE_GOT_IP) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(OTA_IP_POLL_MS));
+    }
+    return false;
+}
+
+// Scarica tutta l'immagine con i tentativi; all'uscita i due task non
+// hanno piu' buffer in volo e la ripresa in NVS e' aggiornata
+static esp_err_t ota_download(void) {
+    sess.free_q = xQueueCreate(OTA_CHUNK_BUFS + 1, sizeof(ota_chunk_t *));
+    sess.full_q = xQueueCreate(OTA_CHUNK_BUFS + 1, sizeof(ota_chunk_t *));
+    sess.chunks = malloc(OTA_CHUNK_BUFS * sizeof(ota_chunk_t));
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (sess.free_q == NULL || sess.full_q == NULL || sess.chunks == NULL) {
+        goto out;
+    }
+    for (int i = 0; i < OTA_CHUNK_BUFS; i++) {
+        ota_chunk_t *c = &sess.chunks[i];
+        xQueueSend(sess.free_q, &c, 0);
+    }
+    atomic_store(&sess.flash_err, ESP_OK);
+    task_place_t p = task_plan_get(TASK_PLAN_OTA_FLASH, APP_TASK_PLACEMENT);
+    if (xTaskCreatePinnedToCore(ota_flash_task, p.name, OTA_FLASH_TASK_STACK, NULL, p.priority,
+                                NULL, p.core) != pdPASS) {
+        goto out;
+    }
+
+    uint32_t handed = resume.written;
+    unsigned fails = 0;
+    while (true) {
+        uint32_t before = handed;
+        err = ota_fetch(&handed);
+        if (err == ESP_OK || ota_err_fatal(err)) {
+            break;
+        }
+        fails = handed > before ? 0 : fails + 1;
+        if (fails >= OTA_MAX_RETRIES) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(500 * fails));
+        if (!ota_wait_ip()) {
+            break;
+        }
+    }
+
+    ota_drain();
+    ota_chunk_t *stop = NULL;
+    xQueueSend(sess.full_q, &stop, portMAX_DELAY);
+    do {
+        xQueueReceive(sess.free_q, &stop, portMAX_DELAY);
+    } while (stop != NULL);
+    if (err == ESP_OK) {
+        err = atomic_load(&sess.flash_err);
+    }
+    if (!ota_err_fatal(err) && handed > resume.written) {
+        resume.written = handed - handed % OTA_CHUNK_LEN;
+        ota_resume_save();
+    }
+
+out:
+    if (sess.free_q) {
+        vQueueDelete(sess.free_q);
+    }
+    if (sess.full_q) {
+        vQueueDelete(sess.full_q);
+    }
+    free(sess.chunks);
+    sess.free_q = sess.full_q = NULL;
+    sess.chunks = NULL;
+    return err;
+}
+
+static esp_err_t ota_session(void) {
+    if (sess.save_url) {
+        sess.save_url = false;
+        ota_nvs_set(OTA_NVS_KEY_URL, ota_url, sizeof(ota_url));
+    }
+    sess.part = esp_ota_get_next_update_partition(NULL);
+    if (sess.part == NULL) {
+        DLOGE(OTA, "Nessuno slot OTA: serve partitions_ota.csv");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!ota_resume_load(sess.part)) {
+        memset(&resume, 0, sizeof(resume));
+        resume.version = OTA_RESUME_VERSION;
+        resume.part_addr = sess.part->address;
+        snprintf(resume.url, sizeof(resume.url), "%s", ota_url);
+    }
+    atomic_store(&prog_total, resume.total);
+    atomic_store(&prog_written, resume.written);
+    DLOGI(OTA, "Aggiornamento da %s in %s (0x%lx)", ota_url, sess.part->label,
+          (unsigned long)sess.part->address);
+    if (!ota_wait_ip()) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = ota_download();
+    if (err != ESP_OK) {
+        if (ota_err_fatal(err)) {
+            ota_resume_erase();
+        }
+        return err;
+    }
+    atomic_store(&prog_state, OTA_STATE_VERIFYING);
+    err = esp_ota_set_boot_partition(sess.part);
+    // Valida o no, questa immagine non si riprende piu'
+    ota_resume_erase();
+    if (err != ESP_OK) {
+        DLOGE(OTA, "Immagine rifiutata: %s", esp_err_to_name(err));
+        return err;
+    }
+    DLOGW(OTA, "%lu byte in %lu ms, riavvio su %s", (unsigned long)resume.total,
+          (unsigned long)((esp_timer_get_time() - t0) / 1000), sess.part->label);
+    atomic_store(&prog_state, OTA_STATE_REBOOTING);
+    journal_flush(500);
+    dlog_flush(500);
+    esp_restart();
+}
+
+static void ota_task(void *arg) {
+    esp_err_t err = ota_session();
+    DLOGE(OTA, "Aggiornamento non riuscito: %s", esp_err_to_name(err));
+    atomic_store(&prog_err, err);
+    atomic_store(&prog_state, OTA_STATE_FAILED);
+    atomic_store(&session_busy, false);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ota_update_start(const char *url) {
+    if (url != NULL && (strlen(url) >= OTA_URL_MAX ||
+                        (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Da un'immagine in prova non si aggiorna: se fallisse il rollback
+    // tornerebbe a uno slot appena sovrascritto
+    if (atomic_load(&pending_verify)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bool idle = false;
+    if (!atomic_compare_exchange_strong(&session_busy, &idle, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (url == NULL && ota_url[0] == '\0') {
+        atomic_store(&session_busy, false);
+        return ESP_ERR_NOT_FOUND;
+    }
+    // ota_url lo tocca solo chi tiene session_busy; l'NVS lo scrive ota_task
+    if (url != NULL && strcmp(url, ota_url) != 0) {
+        snprintf(ota_url, sizeof(ota_url), "%s", url);
+        sess.save_url = true;
+    }
+    // Gia' visibile nella risposta al comando che l'ha avviata
+    atomic_store(&prog_resumes, 0);
+    atomic_store(&prog_err, ESP_OK);
+    atomic_store(&prog_state, OTA_STATE_DOWNLOADING);
+    task_place_t p = task_plan_get(TASK_PLAN_OTA, APP_TASK_PLACEMENT);
+    if (xTaskCreatePinnedToCore(ota_task, p.name, OTA_TASK_STACK, NULL, p.priority, NULL,
+                                p.core) != pdPASS) {
+        atomic_store(&prog_state, OTA_STATE_IDLE);
+        atomic_store(&session_busy, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// — immagine in prova —
+
+// Confermata quando ha rifatto cio' che serve per essere aggiornata ancora:
+// advertising per il telefono e IP per il server
+static void ota_confirm_cb(void *arg) {
+    boot_profile_t prof;
+    boot_profile_get(&prof);
+    if (prof.mark_us[BOOT_MARK_ADVERTISING] != 0 && prof.mark_us[BOOT_MARK_GOT_IP] != 0) {
+        esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+        DLOGW(OTA, "Immagine nuova confermata: %s", esp_err_to_name(err));
+        atomic_store(&pending_verify, false);
+        atomic_store(&prog_state, OTA_STATE_IDLE);
+        return;
+    }
+    if (esp_timer_get_time() >= (int64_t)OTA_CONFIRM_TIMEOUT_MS * 1000) {
+        DLOGE(OTA, "Immagine nuova senza rete dopo %d ms: rollback", OTA_CONFIRM_TIMEOUT_MS);
+        journal_flush(500);
+        dlog_flush(500);
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+        return;
+    }
+    esp_timer_start_once(confirm_timer, OTA_CONFIRM_POLL_MS * 1000ULL);
+}
+
+void ota_update_init(void) {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t img_state;
+    if (running != NULL && esp_ota_get_state_partition(running, &img_state) == ESP_OK &&
+        img_state == ESP_OTA_IMG_PENDING_VERIFY) {
+        DLOGW(OTA, "Immagine in prova su %s", running->label);
+        atomic_store(&pending_verify, true);
+        atomic_store(&prog_state, OTA_STATE_PENDING_VERIFY);
+        const esp_timer_create_args_t args = { .callback = ota_confirm_cb, .name = "ota_confirm" };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &confirm_timer));
+        ESP_ERROR_CHECK(esp_timer_start_once(confirm_timer, OTA_CONFIRM_POLL_MS * 1000ULL));
+    }
+
+    if (!ota_nvs_get(OTA_NVS_KEY_URL, ota_url, sizeof(ota_url)) ||
+        ota_url[sizeof(ota_url) - 1] != '\0') {
+        ota_url[0] = '\0';
+    }
+    // Download interrotto da un riavvio: riparte da solo appena c'e' l'IP
+    ota_resume_t r;
+    if (ota_url[0] != '\0' && ota_nvs_get(OTA_NVS_KEY_RESUME, &r, sizeof(r)) &&
+        !atomic_load(&pending_verify)) {
+        DLOGI(OTA, "Download interrotto a %lu/%lu: riprendo", (unsigned long)r.written,
+              (unsigned long)r.total);
+        ota_update_start(NULL);
+    }
+}
@@ -0,0 +1,56 @@
+// perf_gate.c
+#include "perf_gate.h"
+#include "boot_profile.h"
+#include "task_plan.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+
+#if APP_PERF_GATE
+
+// Task di ESP-IDF in cui girano callback nostre (loop eventi, esp_timer) o
+// che lo stack di rete avvia anche senza radio
+static const char *const idf_tasks[] = { "sys_evt", "esp_timer", "tiT" };
+
+static void report_stack(const char *name) {
+    TaskHandle_t t = xTaskGetHandle(name);
+    if (t != NULL) {
+        printf("PERF stack.%s %u\n", name, (unsigned)uxTaskGetStackHighWaterMark(t));
+    }
+}
+
+// Una riga per misura, con printf e non con dlog: perf_gate.py legge la
+// console e il rapporto deve uscire intero anche se il log perde righe
+void perf_gate_report(void) {
+    vTaskDelay(pdMS_TO_TICKS(PERF_GATE_SETTLE_MS));
+    boot_profile_t p;
+    boot_profile_get(&p);
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        if (p.end_us[i] != 0) {
+            printf("PERF boot.%s_ms %d\n", boot_phase_name((boot_phase_t)i),
+                   (int)((p.end_us[i] - p.start_us[i]) / 1000));
+        }
+    }
+    printf("PERF boot.init_ms %d\n", (int)(p.done_us / 1000));
+    printf("PERF boot.adv_ms %d\n", (int)(p.mark_us[BOOT_MARK_ADVERTISING] / 1000));
+    printf("PERF heap.free %u\n", (unsigned)esp_get_free_heap_size());
+    printf("PERF heap.min_free %u\n", (unsigned)esp_get_minimum_free_heap_size());
+    for (int i = 0; i < TASK_PLAN_COUNT; i++) {
+        // I task di ota_update esistono solo durante un download
+        report_stack(task_plan_get((task_plan_id_t)i, APP_TASK_PLACEMENT).name);
+    }
+    for (size_t i = 0; i < sizeof(idf_tasks) / sizeof(idf_tasks[0]); i++) {
+        report_stack(idf_tasks[i]);
+    }
+    printf("PERF fine\n");
+    fflush(stdout);
+}
+
+#else
+
+void perf_gate_report(void) {
+}
+
+#endif
@@ -0,0 +1,38 @@
+// rtos_static.c
+#include "rtos_static.h"
+
+TaskHandle_t rtos_task_create(rtos_task_mem_t *mem, TaskFunction_t fn, void *arg, task_plan_id_t id) {
+    task_place_t p = task_plan_get(id, APP_TASK_PLACEMENT);
+    TaskHandle_t task = NULL;
+#if APP_STATIC_ALLOC
+    task = xTaskCreateStaticPinnedToCore(fn, p.name, mem->stack_len, arg, p.priority, mem->stack,
+                                         mem->tcb, p.core);
+#else
+    if (xTaskCreatePinnedToCore(fn, p.name, mem->stack_len, arg, p.priority, &task, p.core) != pdPASS) {
+        task = NULL;
+    }
+#endif
+    configASSERT(task != NULL);
+    return task;
+}
+
+QueueHandle_t rtos_queue_create(rtos_queue_mem_t *mem) {
+#if APP_STATIC_ALLOC
+    QueueHandle_t q = xQueueCreateStatic(mem->depth, mem->item_size, mem->storage, mem->queue);
+#else
+    QueueHandle_t q = xQueueCreate(mem->depth, mem->item_size);
+#endif
+    configASSERT(q != NULL);
+    return q;
+}
+
+SemaphoreHandle_t rtos_mutex_create(StaticSemaphore_t *buf) {
+#if APP_STATIC_ALLOC
+    SemaphoreHandle_t m = xSemaphoreCreateMutexStatic(buf);
+#else
+    (void)buf;
+    SemaphoreHandle_t m = xSemaphoreCreateMutex();
+#endif
+    configASSERT(m != NULL);
+    return m;
+}
@@ -0,0 +1,75 @@
+// scan_select.c
+#include "scan_select.h"
+#include <string.h>
+
+static void swap_rec(wifi_scan_record_t *a, wifi_scan_record_t *b) {
+    wifi_scan_record_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void sift_down(wifi_scan_record_t *h, uint8_t n, uint8_t i) {
+    for (;;) {
+        uint8_t l = 2 * i + 1, r = l + 1, min = i;
+        if (l < n && h[l].rssi < h[min].rssi) min = l;
+        if (r < n && h[r].rssi < h[min].rssi) min = r;
+        if (min == i) return;
+        swap_rec(&h[i], &h[min]);
+        i = min;
+    }
+}
+
+static void sift_up(wifi_scan_record_t *h, uint8_t i) {
+    while (i > 0) {
+        uint8_t p = (i - 1) / 2;
+        if (h[p].rssi <= h[i].rssi) return;
+        swap_rec(&h[i], &h[p]);
+        i = p;
+    }
+}
+
+void scan_select_init(scan_select_t *s, wifi_scan_record_t *buf, uint8_t cap) {
+    s->heap = buf;
+    s->count = 0;
+    s->cap = cap;
+    s->seen = 0;
+    s->merged = 0;
+}
+
+void scan_select_add(scan_select_t *s, const wifi_scan_record_t *rec) {
+    s->seen++;
+
+    // Stesso SSID gia' in tabella: si tiene il BSSID piu' forte.
+    // Con K piccolo la ricerca lineare costa meno di un indice a parte.
+    if (rec->ssid[0] != '\0') {
+        for (uint8_t i = 0; i < s->count; i++) {
+            if (strcmp(s->heap[i].ssid, rec->ssid) == 0) {
+                s->merged++;
+                if (rec->rssi > s->heap[i].rssi) {
+                    s->heap[i] = *rec;
+                    sift_down(s->heap, s->count, i);
+                }
+                return;
+            }
+        }
+    }
+
+    if (s->count < s->cap) {
+        s->heap[s->count] = *rec;
+        sift_up(s->heap, s->count);
+        s->count++;
+    } else if (s->cap > 0 && rec->rssi > s->heap[0].rssi) {
+        s->heap[0] = *rec;
+        sift_down(s->heap, s->count, 0);
+    }
+}
+
+uint8_t scan_select_finish(scan_select_t *s) {
+    // Heapsort sul min-heap: estraendo il minimo in coda si ottiene
+    // l'ordine per RSSI decrescente
+    for (uint8_t n = s->count; n > 1; n--) {
+        swap_rec(&s->heap[0], &s->heap[n - 1]);
+        sift_down(s->heap, n - 1, 0);
+    }
+    return s->count;
+}
@@ -0,0 +1,68 @@
+// scan_stream.c
+#include "scan_stream.h"
+#include <string.h>
+
+// Overhead ATT di una notifica: opcode + handle
+#define ATT_NOTIFY_HDR_LEN 3
+
+size_t scan_stream_encode(const wifi_scan_record_t *recs, uint8_t count,
+                          uint8_t *out, size_t cap) {
+    if (cap < SCAN_STREAM_BODY_HDR_LEN) {
+        return 0;
+    }
+    size_t pos = 0;
+    out[pos++] = SCAN_STREAM_VERSION;
+    out[pos++] = count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        const wifi_scan_record_t *r = &recs[i];
+        size_t ssid_len = strnlen(r->ssid, sizeof(r->ssid) - 1);
+        size_t rec_len = 1 + ssid_len + 3 + sizeof(r->bssid);
+        if (pos + rec_len > cap) {
+            return 0;
+        }
+        out[pos++] = (uint8_t)ssid_len;
+        memcpy(&out[pos], r->ssid, ssid_len);
+        pos += ssid_len;
+        out[pos++] = (uint8_t)r->rssi;
+        out[pos++] = r->channel;
+        out[pos++] = r->authmode;
+        memcpy(&out[pos], r->bssid, sizeof(r->bssid));
+        pos += sizeof(r->bssid);
+    }
+    return pos;
+}
+
+void scan_stream_chunker_init(scan_stream_chunker_t *c, const uint8_t *body, size_t len,
+                              uint8_t flags) {
+    c->body = body;
+    c->len = len;
+    c->off = 0;
+    c->seq = 0;
+    c->flags = flags;
+    c->done = false;
+}
+
+size_t scan_stream_next_chunk(scan_stream_chunker_t *c, uint16_t mtu, uint8_t *out) {
+    if (c->done) {
+        return 0;
+    }
+    size_t room = (size_t)mtu - ATT_NOTIFY_HDR_LEN - SCAN_STREAM_CHUNK_HDR_LEN;
+    size_t n = c->len - c->off;
+    if (n > room) {
+        n = room;
+    }
+    uint8_t flags = c->flags;
+    if (c->off == 0) {
+        flags |= SCAN_STREAM_FLAG_FIRST;
+    }
+    if (c->off + n == c->len) {
+        flags |= SCAN_STREAM_FLAG_LAST;
+        c->done = true;
+    }
+    out[0] = c->seq++;
+    out[1] = flags;
+    memcpy(&out[SCAN_STREAM_CHUNK_HDR_LEN], &c->body[c->off], n);
+    c->off += n;
+    return SCAN_STREAM_CHUNK_HDR_LEN + n;
+}
@@ -0,0 +1,49 @@
+// task_plan.c
+#include "task_plan.h"
+
+#include <stdbool.h>
+
+typedef struct {
+    const char *name;
+    UBaseType_t priority;
+    BaseType_t radio_core;      // core dello stack che alimenta la coda
+    bool pin;                   // false: nessuna affinita' in ogni politica
+} task_plan_entry_t;
+
+static const task_plan_entry_t plan[TASK_PLAN_COUNT] = {
+    // Le notifiche partono dal task BTC di Bluedroid
+    [TASK_PLAN_BLE]       = { "BLE_TASK",  BLE_TASK_PRIORITY,       TASK_PLAN_BT_CORE,   true },
+    // I comandi arrivano dalle callback GATTS, gli eventi dal driver Wi-Fi
+    [TASK_PLAN_WIFI]      = { "WIFI_TASK", WIFI_TASK_PRIORITY,      TASK_PLAN_WIFI_CORE, true },
+    // Il log non ha fretta: prende il core che resta libero
+    [TASK_PLAN_DLOG]      = { "DLOG_TASK", DLOG_TASK_PRIORITY,      0,                   false },
+    [TASK_PLAN_JOURNAL]   = { "JOURNAL",   JOURNAL_TASK_PRIORITY,   0,                   false },
+    // Rete e flash vanno alla velocita' della radio e della SPI, non della CPU
+    [TASK_PLAN_OTA]       = { "OTA_TASK",  OTA_TASK_PRIORITY,       0,                   false },
+    [TASK_PLAN_OTA_FLASH] = { "OTA_FLASH", OTA_FLASH_TASK_PRIORITY, 0,                   false },
+};
+
+static const char *const policy_names[TASK_PLACE_COUNT] = {
+    [TASK_PLACE_APP_CPU]   = "app_cpu",
+    [TASK_PLACE_RADIO_CPU] = "radio_cpu",
+    [TASK_PLACE_FLOAT]     = "float",
+};
+
+task_place_t task_plan_get(task_plan_id_t id, task_place_policy_t policy) {
+    configASSERT(id < TASK_PLAN_COUNT);
+    const task_plan_entry_t *e = &plan[id];
+    task_place_t place = { e->name, e->priority, tskNO_AFFINITY };
+    if (portNUM_PROCESSORS < 2 || !e->pin) {
+        return place;
+    }
+    switch (policy) {
+        case TASK_PLACE_APP_CPU:   place.core = TASK_PLAN_APP_CORE; break;
+        case TASK_PLACE_RADIO_CPU: place.core = e->radio_core;      break;
+        default:                   break;
+    }
+    return place;
+}
+
+const char *task_plan_policy_name(task_place_policy_t policy) {
+    return policy < TASK_PLACE_COUNT ? policy_names[policy] : "?";
+}
@@ -0,0 +1,134 @@
+// telemetry.c
+#include "telemetry.h"
+#include "common_variables.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "rtos_static.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include <stdatomic.h>
+
+// Task campionati, nell'ordine dell'istantanea
+static const char *const task_names[TELEMETRY_TASKS] = { "BLE_TASK", "WIFI_TASK" };
+
+// Percorso caldo: solo contatori atomici a 32 bit (senza lock su Xtensa)
+static _Atomic uint32_t hist[TELEMETRY_LAT_COUNT][TELEMETRY_HIST_BUCKETS];
+// Inizio dell'intervallo aperto, in us troncati a 32 bit; 0 = nessuno
+static _Atomic uint32_t span_start[TELEMETRY_LAT_COUNT];
+
+// Stato del campionamento: serve solo a chi costruisce l'istantanea
+static SemaphoreHandle_t snapshot_lock;
+RTOS_MUTEX_DEFINE(snapshot_lock_mem);
+static TaskHandle_t tasks[TELEMETRY_TASKS];
+static uint32_t prev_runtime[TELEMETRY_TASKS];
+static int64_t prev_sample_us;
+
+void telemetry_init(void) {
+    snapshot_lock = rtos_mutex_create(snapshot_lock_mem);
+    prev_sample_us = esp_timer_get_time();
+}
+
+static unsigned bucket_of(uint32_t us) {
+    if (us < 128) {
+        return 0;
+    }
+    unsigned k = (unsigned)(32 - __builtin_clz(us)) - 7;
+    return k < TELEMETRY_HIST_BUCKETS ? k : TELEMETRY_HIST_BUCKETS - 1;
+}
+
+void telemetry_record(telemetry_lat_t lat, uint32_t us) {
+    atomic_fetch_add_explicit(&hist[lat][bucket_of(us)], 1, memory_order_relaxed);
+}
+
+static uint32_t now_us32(void) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    return now ? now : 1;
+}
+
+void telemetry_begin(telemetry_lat_t lat) {
+    uint32_t expected = 0;
+    atomic_compare_exchange_strong(&span_start[lat], &expected, now_us32());
+}
+
+void telemetry_end(telemetry_lat_t lat) {
+    uint32_t start = atomic_exchange(&span_start[lat], 0);
+    if (start != 0) {
+        telemetry_record(lat, now_us32() - start);
+    }
+}
+
+static size_t put_u16(uint8_t *out, size_t pos, uint32_t v) {
+    if (v > UINT16_MAX) {
+        v = UINT16_MAX;
+    }
+    out[pos] = (uint8_t)v;
+    out[pos + 1] = (uint8_t)(v >> 8);
+    return pos + 2;
+}
+
+static size_t put_u32(uint8_t *out, size_t pos, uint32_t v) {
+    pos = put_u16(out, pos, v & 0xFFFF);
+    return put_u16(out, pos, v >> 16);
+}
+
+static size_t put_queue(uint8_t *out, size_t pos, const queue_stats_t *q) {
+    out[pos++] = (uint8_t)q->waiting;
+    out[pos++] = (uint8_t)q->high_water;
+    out[pos++] = (uint8_t)q->pool_in_use;
+    out[pos++] = (uint8_t)q->pool_peak;
+    return pos;
+}
+
+size_t telemetry_snapshot(uint8_t *out, size_t cap) {
+    if (cap < TELEMETRY_SNAPSHOT_LEN) {
+        return 0;
+    }
+    size_t pos = 0;
+    out[pos++] = TELEMETRY_VERSION;
+    out[pos++] = TELEMETRY_TASKS;
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    int64_t window = now - prev_sample_us;
+    prev_sample_us = now;
+    pos = put_u32(out, pos, (uint32_t)(now / 1000));
+    pos = put_u32(out, pos, esp_get_free_heap_size());
+    pos = put_u32(out, pos, esp_get_minimum_free_heap_size());
+
+    for (int i = 0; i < TELEMETRY_TASKS; i++) {
+        if (tasks[i] == NULL) {
+            tasks[i] = xTaskGetHandle(task_names[i]);
+            prev_runtime[i] = tasks[i] ? ulTaskGetRunTimeCounter(tasks[i]) : 0;
+        }
+        uint32_t cpu = 0;
+        uint32_t stack_free = 0;
+        if (tasks[i] != NULL) {
+            // contatore in us (esp_timer): la differenza resta giusta anche dopo il giro
+            uint32_t runtime = ulTaskGetRunTimeCounter(tasks[i]);
+            if (window > 0) {
+                cpu = (uint32_t)((uint64_t)(runtime - prev_runtime[i]) * 1000 / (uint64_t)window);
+            }
+            prev_runtime[i] = runtime;
+            stack_free = uxTaskGetStackHighWaterMark(tasks[i]);
+        }
+        pos = put_u16(out, pos, cpu > 1000 ? 1000 : cpu);
+        pos = put_u16(out, pos, stack_free);
+    }
+    xSemaphoreGive(snapshot_lock);
+
+    queue_stats_t bw, wb;
+    queues_get_stats(&bw, &wb);
+    pos = put_queue(out, pos, &bw);
+    pos = put_queue(out, pos, &wb);
+
+    out[pos++] = TELEMETRY_LAT_COUNT;
+    out[pos++] = TELEMETRY_HIST_BUCKETS;
+    for (int l = 0; l < TELEMETRY_LAT_COUNT; l++) {
+        for (int b = 0; b < TELEMETRY_HIST_BUCKETS; b++) {
+            pos = put_u16(out, pos, atomic_load_explicit(&hist[l][b], memory_order_relaxed));
+        }
+    }
+    return pos;
+}
@@ -1,54 +1,368 @@
 #include "common_variables.h"
 #include "wifi_handler.h"
-#include "esp_log.h"
+#include "boot_profile.h"
+#include "telemetry.h"
+#include "wifi_status.h"
+#include "dlog.h"
+#include "journal.h"
+#include "perf_gate.h"
+#include "rtos_static.h"
+#include "ble_link.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_netif.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "scan_select.h"
+#include "wifi_store.h"
 #include <string.h>
 
 
-#define WIFI_TAG "WIFI_TAG"
+#define WIFI_NVS_NAMESPACE  "wifi"
+#define WIFI_NVS_LAST_AP    "last_ap"
 
+// Ultimo AP a cui ci si e' connessi con successo: salvato in NVS per
+// ricollegarsi all'avvio e dopo una perdita del link senza scansione completa
+typedef struct {
+    char ssid[33];          // terminate da NUL
+    char password[65];
+    uint8_t bssid[6];
+    uint8_t channel;    // 0 = BSSID/canale non ancora noti
+    uint8_t authmode;
+} wifi_last_ap_t;
 
+static wifi_last_ap_t last_ap;          // rete obiettivo corrente
+static wifi_last_ap_t saved_ap;         // copia di cio' che c'e' in NVS
+static bool last_ap_known = false;      // ci sono credenziali da usare
+static esp_timer_handle_t retry_timer;
+static uint8_t retry_attempt = 0;       // fallimenti consecutivi
+static int64_t connect_started_us = 0;  // primo tentativo della connessione in corso
+static bool autojoin_pending = false;   // match con le reti salvate alla prossima lista
+static int64_t connect_failed_us = 0;   // ultimo tentativo fallito
+
+// — cache dei risultati di scansione (usata solo da wifi_task) —
+// Slot del pool wifi_to_ble: la stessa lista viene consegnata a ble_task
+// senza copie. Ogni scansione ne riempie uno nuovo, mai quello pubblicato.
+static wifi_ble_evt_t *scan_cache;
+static bool scan_cache_valid = false;
+static int64_t scan_cache_us = 0;       // fine dell'ultima scansione riuscita
+static bool scan_in_flight = false;
+// Comandi assorbiti prima di arrivare alla radio (letti da altri task)
+static wifi_cmd_stats_t cmd_stats;
+static int64_t scan_started_us = 0;
+static uint8_t scan_waiters = 0;        // richieste in attesa della scansione in corso
+
+// — scansione a gruppi (WIFI_SCAN_SPLIT) —
+// Prima i canali non sovrapposti, dove sta quasi ogni AP: la prima lista
+// parziale e' gia' quella che il telefono mostrera'
+static const uint8_t scan_channel_order[] = { 1, 6, 11, 2, 3, 4, 5, 7, 8, 9, 10, 12, 13 };
+#define SCAN_CHANNELS (sizeof(scan_channel_order) / sizeof(scan_channel_order[0]))
+static bool scan_split = false;         // scansione in corso divisa in gruppi
+static uint8_t scan_next_ch = 0;        // indice in scan_channel_order del prossimo gruppo
+static int64_t scan_group_due_us = 0;   // avvio del prossimo gruppo, 0 = nessuno
+static int64_t scan_group_gap_us = 0;
+// Lista in costruzione: slot del pool tenuto dal primo gruppo all'ultimo,
+// i record restano un min-heap di scan_select fino alla fine
+static wifi_ble_evt_t *scan_acc;
+static scan_select_t scan_sel;
+RTOS_TASK_DEFINE(wifi_task_mem, WIFI_TASK_STACK);
+
+
+static void wifi_last_ap_load(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t len = sizeof(last_ap);
+    if (nvs_get_blob(nvs, WIFI_NVS_LAST_AP, &last_ap, &len) == ESP_OK && len == sizeof(last_ap)) {
+        last_ap.ssid[sizeof(last_ap.ssid) - 1] = '\0';
+        last_ap.password[sizeof(last_ap.password) - 1] = '\0';
+        saved_ap = last_ap;
+        last_ap_known = true;
+    } else {
+        memset(&last_ap, 0, sizeof(last_ap));
+    }
+    nvs_close(nvs);
+}
+
+// Scrive in flash solo se qualcosa e' cambiato rispetto all'ultimo salvataggio
+static void wifi_last_ap_save(void) {
+    if (memcmp(&last_ap, &saved_ap, sizeof(last_ap)) == 0) {
+        return;
+    }
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, WIFI_NVS_LAST_AP, &last_ap, sizeof(last_ap));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK) {
+        saved_ap = last_ap;
+    } else {
+        DLOGE(WIFI, "Salvataggio AP in NVS fallito: %s", esp_err_to_name(err));
+    }
+}
+
+static void wifi_last_ap_forget(void) {
+    memset(&last_ap, 0, sizeof(last_ap));
+    memset(&saved_ap, 0, sizeof(saved_ap));
+    last_ap_known = false;
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_erase_key(nvs, WIFI_NVS_LAST_AP) == ESP_OK) {
+            nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+}
+
+static bool wifi_have_networks(void) {
+    return last_ap_known || wifi_store_count() > 0;
+}
+
+// Tentativo diretto: BSSID e canale noti, nessuna scansione dei 13 canali.
+// Altrimenti ricerca completa della rete per SSID.
+static void wifi_connect_attempt(bool directed) {
+    wifi_config_t wifi_config = { 0 };
+    memcpy(wifi_config.sta.ssid, last_ap.ssid, sizeof(wifi_config.sta.ssid));
+    memcpy(wifi_config.sta.password, last_ap.password, sizeof(wifi_config.sta.password));
+    if (directed) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, last_ap.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = last_ap.channel;
+        // niente downgrade rispetto alla sicurezza vista l'ultima volta
+        wifi_config.sta.threshold.authmode = (wifi_auth_mode_t)last_ap.authmode;
+    } else {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+
+    if (connect_started_us == 0) {
+        connect_started_us = esp_timer_get_time();
+    }
+    wifi_status_set(WIFI_STATE_CONNECTING, 0);
+    DLOGI(WIFI, "Connessione %s (tentativo %u)",
+          directed ? "diretta" : "con scansione", retry_attempt);
+    if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK ||
+        esp_wifi_connect() != ESP_OK) {
+        DLOGE(WIFI, "Errore durante connessione WiFi");
+    }
+}
+
+// La scansione la fa WIFI_TASK: dal timer si accoda solo la richiesta
+static void wifi_retry_cb(void *arg) {
+    if (!ble_wifi_request(BLE_WIFI_EVT_AUTOJOIN)) {
+        // coda piena: si riprova fra poco senza bloccare il task dei timer
+        esp_timer_start_once(retry_timer, (uint64_t)WIFI_RETRY_BASE_MS * 1000);
+    }
+}
+
+// Dopo un fallimento: subito un tentativo diretto se il link era su e
+// l'AP e' noto, poi scansione + scelta fra le reti salvate, con back-off
+// esponenziale e jitter
+static void wifi_schedule_retry(void) {
+    if (retry_attempt == 0 && last_ap.channel != 0) {
+        retry_attempt = 1;
+        wifi_connect_attempt(true);
+        return;
+    }
+    if (retry_attempt == 0) {
+        retry_attempt = 1;
+    }
+    uint8_t shift = retry_attempt - 1;
+    uint32_t window = WIFI_RETRY_MAX_MS;
+    if (shift < 16 && ((uint32_t)WIFI_RETRY_BASE_MS << shift) < WIFI_RETRY_MAX_MS) {
+        window = (uint32_t)WIFI_RETRY_BASE_MS << shift;
+    }
+    uint32_t delay_ms = window / 2 + esp_random() % (window / 2 + 1);
+    if (retry_attempt < UINT8_MAX) {
+        retry_attempt++;
+    }
+    DLOGI(WIFI, "Nuovo tentativo fra %u ms", (unsigned)delay_ms);
+    esp_timer_stop(retry_timer);
+    esp_timer_start_once(retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+
+// STA_CONNECTED: BSSID/canale/sicurezza per il prossimo collegamento
+// diretto; in NVS solo dopo l'IP, quando il link e' davvero buono
+static void wifi_on_sta_connected(const ble_wifi_evt_t *evt) {
+    if (evt->channel == 0) {
+        wifi_status_associated(0);
+        return;
+    }
+    DLOGI(WIFI, "Connesso all'AP SSID: %s", evt->ssid);
+    wifi_status_associated(evt->rssi);
+    memcpy(last_ap.bssid, evt->bssid, sizeof(last_ap.bssid));
+    last_ap.channel = evt->channel;
+    last_ap.authmode = evt->authmode;
+}
+
+static void wifi_on_sta_disconnected(const ble_wifi_evt_t *evt) {
+    bool was_connected = wifi_status_is_connected();
+    uint8_t rec[3] = { evt->reason, was_connected, (uint8_t)evt->rssi };
+    journal_log(JOURNAL_EV_WIFI_DISCONNECT, rec, sizeof(rec));
+    // Lasciata per un nuovo CONNECT: lo stato e' gia' CONNECTING
+    if (evt->reason != WIFI_REASON_ASSOC_LEAVE) {
+        wifi_status_set(WIFI_STATE_FAILED, evt->reason);
+    } else if (was_connected) {
+        wifi_status_set(WIFI_STATE_IDLE, 0);
+    }
+
+    // ASSOC_LEAVE: l'abbiamo chiesto noi (nuove credenziali dal telefono)
+    if (evt->reason != WIFI_REASON_ASSOC_LEAVE && wifi_have_networks()) {
+        if (!was_connected) {
+            wifi_store_note_result(last_ap.ssid, false);
+            connect_failed_us = esp_timer_get_time();
+        }
+        wifi_schedule_retry();
+    }
+}
+
+// Avvio della station: AP salvato -> collegamento diretto, altrimenti
+// scansione e scelta fra le reti conosciute
+static void wifi_on_sta_start(void) {
+    if (last_ap_known) {
+        retry_attempt = 1;
+        wifi_connect_attempt(last_ap.channel != 0);
+    } else if (wifi_store_count() > 0) {
+        retry_attempt = 1;
+        ble_wifi_request(BLE_WIFI_EVT_AUTOJOIN);
+    }
+}
+
+// IP ottenuto: connessione completa
+static void wifi_on_got_ip(const ble_wifi_evt_t *evt) {
+    esp_ip4_addr_t ip = { .addr = evt->ip };
+    int64_t now = esp_timer_get_time();
+    boot_mark(BOOT_MARK_GOT_IP);
+    wifi_status_got_ip(ip.addr);
+    DLOGI(WIFI, "IP " IPSTR " in %d ms (%u tentativi, %d ms dall'avvio)",
+          IP2STR(&ip), (int)((now - connect_started_us) / 1000),
+          retry_attempt, (int)(now / 1000));
+    wifi_status_t st;
+    wifi_status_get(&st);
+    uint32_t ms = (uint32_t)((now - connect_started_us) / 1000);
+    ms = ms > UINT16_MAX ? UINT16_MAX : ms;
+    uint8_t rec[11] = { last_ap.channel, (uint8_t)st.rssi, retry_attempt,
+                        (uint8_t)ms, (uint8_t)(ms >> 8) };
+    memcpy(&rec[5], last_ap.bssid, sizeof(last_ap.bssid));
+    journal_log(JOURNAL_EV_WIFI_CONNECT, rec, sizeof(rec));
+
+    retry_attempt = 0;
+    connect_started_us = 0;
+    wifi_last_ap_save();
+    wifi_store_note_result(last_ap.ssid, true);
+}
+
+// Gira nel loop eventi (sys_evt, stack piccolo e condiviso): copia solo i
+// dati dell'evento in un messaggio per wifi_task, che e' l'unico a toccare
+// last_ap, i tentativi e l'NVS
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
+    //Scansione asincrona terminata: i risultati li raccoglie wifi_task
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
+        wifi_event_sta_scan_done_t* done = (wifi_event_sta_scan_done_t*) event_data;
+        DLOGI(WIFI, "Evento: SCAN_DONE, status=%u, reti=%u",
+              (unsigned)done->status, done->number);
+
+        if (!ble_wifi_request(BLE_WIFI_EVT_SCAN_DONE)) {
+            DLOGW(WIFI, "Coda piena, SCAN_DONE perso (recupero al timeout)");
+        }
+        return;
+    }
+
+    ble_wifi_evt_type_t type;
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        type = BLE_WIFI_EVT_STA_START;
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        type = BLE_WIFI_EVT_STA_CONNECTED;
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        type = BLE_WIFI_EVT_STA_DISCONNECTED;
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        type = BLE_WIFI_EVT_GOT_IP;
+    } else {
+        return;
+    }
+    ble_wifi_evt_t *evt = ble_wifi_alloc_driver();
+    if (evt == NULL) {
+        return;
+    }
+    evt->type = type;
+
     //Connesso
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
-        ESP_LOGI(WIFI_TAG, "Evento: STA_CONNECTED"); 
+    if (type == BLE_WIFI_EVT_STA_CONNECTED) {
+        DLOGI(WIFI, "Evento: STA_CONNECTED"); 
 
         // Ottengo le info dell'AP a cui sono connesso
         wifi_ap_record_t ap_info;
         esp_err_t ret = esp_wifi_sta_get_ap_info(&ap_info);
         if (ret == ESP_OK) {
             // ap_info.ssid è una stringa non terminata da NULL, garantiamo terminatore
-            char ssid[33] = { 0 };
-            memcpy(ssid, ap_info.ssid, sizeof(ap_info.ssid)); 
-            ssid[32] = '\0';
-
-            ESP_LOGI(WIFI_TAG, "Connesso all'AP SSID: %s", ssid);
-
-            g_wifi_connected = true;
-
+            memcpy(evt->ssid, ap_info.ssid, sizeof(evt->ssid) - 1);
+            evt->ssid[sizeof(evt->ssid) - 1] = '\0';
+            memcpy(evt->bssid, ap_info.bssid, sizeof(evt->bssid));
+            evt->channel = ap_info.primary;
+            evt->authmode = (uint8_t)ap_info.authmode;
+            evt->rssi = ap_info.rssi;
         } else {
-            ESP_LOGE(WIFI_TAG, "Errore esp_wifi_sta_get_ap_info: %s",
-                     esp_err_to_name(ret));
+            DLOGE(WIFI, "Errore esp_wifi_sta_get_ap_info: %s",
+                  esp_err_to_name(ret));
         }
-
     }
     //Connessione persa
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-
-        g_wifi_connected = false;
-
+    else if (type == BLE_WIFI_EVT_STA_DISCONNECTED) {
         // Estraggo il dettaglio del motivo (opzionale)
         wifi_event_sta_disconnected_t* dis = (wifi_event_sta_disconnected_t*) event_data;
-        ESP_LOGI("WIFI_EVT", "STA_DISCONNECTED, reason=%d", dis->reason);  
-                                               
-        esp_wifi_connect();                     // tenta subito la riconnessione:contentReference[oaicite:7]{index=7}  
+        DLOGI(WIFI, "STA_DISCONNECTED, reason=%d", dis->reason);  
+        evt->reason = dis->reason;
+        evt->rssi = dis->rssi;
+    }
+    else if (type == BLE_WIFI_EVT_GOT_IP) {
+        ip_event_got_ip_t* got = (ip_event_got_ip_t*) event_data;
+        evt->ip = got->ip_info.ip.addr;
     }
+    ble_wifi_post(evt);
 }
 
-static void wifi_scan_start(void) {
+static void wifi_autojoin_pick(void);
+
+// Consegna a ble_task la lista in cache (vuota se non c'e' ancora nulla)
+static void wifi_scan_reply(void) {
+    wifi_ble_post(scan_cache);
+}
+
+// Chiude la scansione in corso e risponde a tutte le richieste in attesa
+static void wifi_scan_finish(bool ok) {
+    scan_in_flight = false;
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - scan_started_us) / 1000);
+    ms = ms > UINT16_MAX ? UINT16_MAX : ms;
+    uint16_t seen = ok ? scan_sel.seen : 0;
+    uint16_t merged = ok ? scan_sel.merged : 0;
+    uint8_t rec[9] = { ok, ok ? scan_cache->ap_count : 0, (uint8_t)seen, (uint8_t)(seen >> 8),
+                       (uint8_t)merged, (uint8_t)(merged >> 8), (uint8_t)ms, (uint8_t)(ms >> 8),
+                       scan_waiters };
+    journal_log(JOURNAL_EV_SCAN, rec, sizeof(rec));
+    if (ok) {
+        scan_cache_valid = scan_cache->ap_count > 0;
+        scan_cache_us = esp_timer_get_time();
+    }
+    if (scan_waiters > 0) {
+        DLOGI(WIFI, "Risposta a %u richieste con una sola scansione", scan_waiters);
+        wifi_scan_reply();
+        scan_waiters = 0;
+    }
+    if (autojoin_pending) {
+        wifi_autojoin_pick();
+    }
+}
+
+// Avvia sulla radio l'intera scansione o il prossimo gruppo di canali
+static esp_err_t wifi_scan_radio_start(void) {
     wifi_scan_config_t scan_config = {
         .ssid = NULL,
         .bssid = NULL,
@@ -56,94 +370,468 @@ static void wifi_scan_start(void) {
         .show_hidden = true,
         .scan_type = WIFI_SCAN_TYPE_ACTIVE,
     };
+    if (scan_split) {
+        // Con channel = 0 il driver scandisce i canali della bitmap
+        // (bit n = canale n), in ordine crescente
+        uint8_t end = scan_next_ch + WIFI_SCAN_GROUP_CHANNELS;
+        if (end > SCAN_CHANNELS) {
+            end = SCAN_CHANNELS;
+        }
+        for (uint8_t i = scan_next_ch; i < end; i++) {
+            scan_config.channel_bitmap.ghz_2_channels |= (uint16_t)(1u << scan_channel_order[i]);
+        }
+        scan_config.scan_time.active.min = WIFI_SCAN_COEX_DWELL_MIN_MS;
+        scan_config.scan_time.active.max = WIFI_SCAN_COEX_DWELL_MS;
+        DLOGD(WIFI, "Gruppo di canali 0x%04x", scan_config.channel_bitmap.ghz_2_channels);
+        scan_next_ch = end;
+    }
+    esp_err_t err = esp_wifi_scan_start(&scan_config, false);
+    if (err == ESP_OK) {
+        // Il timeout vale per ogni passaggio sulla radio, non per la somma
+        scan_started_us = esp_timer_get_time();
+    }
+    return err;
+}
 
-    ESP_LOGI(WIFI_TAG, "Avvio scansione WiFi...");
-    ESP_ERROR_CHECK(esp_wifi_scan_start(&scan_config, true));
+static void wifi_scan_start(void) {
+    // Con un telefono collegato la radio va lasciata al BLE fra un gruppo
+    // e l'altro per qualche evento di connessione del link piu' lento
+    uint16_t interval = 0;
+    scan_split = WIFI_SCAN_SPLIT && ble_link_active(&interval) > 0;
+    scan_next_ch = 0;
+    scan_group_due_us = 0;
+    scan_group_gap_us = (int64_t)WIFI_SCAN_GAP_EVENTS * interval * 1250;
+    if (scan_group_gap_us < (int64_t)WIFI_SCAN_GROUP_GAP_MS * 1000) {
+        scan_group_gap_us = (int64_t)WIFI_SCAN_GROUP_GAP_MS * 1000;
+    }
 
-    uint16_t ap_num = 0;
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_num));
-    if (ap_num == 0) {
-        ESP_LOGI(WIFI_TAG, "Nessuna rete WiFi trovata");
+    DLOGI(WIFI, "Avvio scansione WiFi%s...", scan_split ? " a gruppi di canali" : "");
+    esp_err_t err = wifi_scan_radio_start();
+    if (err != ESP_OK) {
+        // es. connessione in corso: si risponde con quello che c'e' in cache
+        DLOGE(WIFI, "Scansione non avviata: %s", esp_err_to_name(err));
+        wifi_scan_finish(false);
         return;
     }
+    scan_in_flight = true;
+    cmd_stats.scans_started++;
+}
 
-    wifi_ap_record_t *ap_list = malloc(sizeof(wifi_ap_record_t) * ap_num);
-    if (!ap_list) {
-        ESP_LOGE(WIFI_TAG, "Memoria esaurita per ap_list");
+// Richiesta di scansione dal telefono: cache se fresca (e non si e' chiesta
+// una lista nuova), altrimenti si aggancia alla scansione in corso o ne
+// avvia una nuova
+static void wifi_scan_request(bool fresh) {
+    int64_t age_ms = (esp_timer_get_time() - scan_cache_us) / 1000;
+    if (!fresh && scan_cache_valid && age_ms < WIFI_SCAN_CACHE_TTL_MS) {
+        DLOGI(WIFI, "Lista in cache da %d ms, risposta immediata", (int)age_ms);
+        cmd_stats.scans_cached++;
+        wifi_scan_reply();
+        return;
+    }
+    scan_waiters++;
+    if (scan_in_flight) {
+        DLOGI(WIFI, "Scansione gia' in corso, richiesta accodata");
+        cmd_stats.scans_joined++;
         return;
     }
+    wifi_scan_start();
+}
 
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_num, ap_list));
+// Lista parziale per chi aspetta: copia ordinata di quanto visto finora,
+// mentre l'accumulo resta un heap per i gruppi successivi. Senza slot
+// liberi si salta: arrivera' la lista del gruppo dopo.
+static void wifi_scan_post_partial(void) {
+    if (scan_waiters == 0 || scan_sel.count == 0) {
+        return;
+    }
+    wifi_ble_evt_t *part = wifi_ble_alloc();
+    if (part == NULL) {
+        DLOGW(WIFI, "Pool liste esaurito, lista parziale saltata");
+        return;
+    }
+    part->type = WIFI_BLE_EVT_SCAN_DONE;
+    part->partial = true;
+    memcpy(part->ap_list, scan_acc->ap_list, scan_sel.count * sizeof(part->ap_list[0]));
+    scan_select_t sorted = scan_sel;
+    sorted.heap = part->ap_list;
+    part->ap_count = scan_select_finish(&sorted);
+    wifi_ble_post(part);
+    wifi_ble_release(part);
+}
 
-    wifi_ble_evt_t evt = {
-        .type = WIFI_BLE_EVT_SCAN_DONE,
-        .ssid_count = (ap_num < MAX_WIFI_SCAN_RESULTS) ? ap_num : MAX_WIFI_SCAN_RESULTS
-    };
+// Chiude una scansione persa o fallita a meta' gruppi
+static void wifi_scan_abort(void) {
+    scan_group_due_us = 0;
+    if (scan_acc != NULL) {
+        wifi_ble_release(scan_acc);
+        scan_acc = NULL;
+    }
+    wifi_scan_finish(false);
+}
+
+// Raccoglie i risultati dopo WIFI_EVENT_SCAN_DONE (di tutta la scansione o
+// di un gruppo di canali)
+static void wifi_scan_collect(void) {
+    if (!scan_in_flight || scan_group_due_us != 0) {
+        // scansione gia' chiusa per timeout
+        esp_wifi_clear_ap_list();
+        return;
+    }
+
+    // La lista nuova si scrive direttamente in uno slot del pool; quella
+    // vecchia resta valida per chi la sta ancora inviando
+    if (scan_acc == NULL) {
+        scan_acc = wifi_ble_alloc();
+        if (scan_acc == NULL) {
+            DLOGE(WIFI, "Pool liste esaurito, risultati scartati");
+            esp_wifi_clear_ap_list();
+            wifi_scan_abort();
+            return;
+        }
+        scan_acc->type = WIFI_BLE_EVT_SCAN_DONE;
+        scan_select_init(&scan_sel, scan_acc->ap_list, MAX_WIFI_SCAN_RESULTS);
+    }
+
+    // Record letti uno alla volta: niente copia completa della lista del
+    // driver, in memoria restano solo le MAX_WIFI_SCAN_RESULTS migliori
+    wifi_ap_record_t ap;
+    while (esp_wifi_scan_get_ap_record(&ap) == ESP_OK) {
+        wifi_scan_record_t rec;
+        memcpy(rec.ssid, ap.ssid, sizeof(rec.ssid) - 1);
+        rec.ssid[sizeof(rec.ssid) - 1] = '\0';
+        memcpy(rec.bssid, ap.bssid, sizeof(rec.bssid));
+        rec.rssi = ap.rssi;
+        rec.channel = ap.primary;
+        rec.authmode = (uint8_t)ap.authmode;
+        scan_select_add(&scan_sel, &rec);
+    }
+    // libera cio' che il driver non ha consegnato (es. lettura interrotta)
+    esp_wifi_clear_ap_list();
 
-    for (int i = 0; i < evt.ssid_count; i++) {
-        strncpy(evt.ssid_list[i], (char *)ap_list[i].ssid, sizeof(evt.ssid_list[i]) - 1);
-        evt.ssid_list[i][sizeof(evt.ssid_list[i]) - 1] = '\0';
-        ESP_LOGI(WIFI_TAG, "Rete trovata: %s", evt.ssid_list[i]);
+    if (scan_split && scan_next_ch < SCAN_CHANNELS) {
+        wifi_scan_post_partial();
+        scan_group_due_us = esp_timer_get_time() + scan_group_gap_us;
+        return;
+    }
+
+    scan_acc->ap_count = scan_select_finish(&scan_sel);
+    wifi_ble_release(scan_cache);
+    scan_cache = scan_acc;
+    scan_acc = NULL;
+    DLOGI(WIFI, "Reti viste: %u, duplicati uniti: %u, inviate: %u",
+          scan_sel.seen, scan_sel.merged, scan_cache->ap_count);
+    for (int i = 0; i < scan_cache->ap_count; i++) {
+        const wifi_scan_record_t *rec = &scan_cache->ap_list[i];
+        DLOGD(WIFI, "Rete trovata: %s (%d dBm, ch %u)", rec->ssid, rec->rssi, rec->channel);
     }
 
-    xQueueSend(wifi_to_ble_q, &evt, portMAX_DELAY);
-    free(ap_list);
+    wifi_scan_finish(true);
+}
+
+// Pausa finita: prossimo gruppo di canali. Se la radio non lo accetta
+// (es. un CONNECT arrivato nella pausa) si chiude con i canali gia' visti.
+static void wifi_scan_next_group(void) {
+    scan_group_due_us = 0;
+    esp_err_t err = wifi_scan_radio_start();
+    if (err != ESP_OK) {
+        DLOGW(WIFI, "Gruppo di canali non avviato (%s), lista con %u canali",
+              esp_err_to_name(err), scan_next_ch);
+        scan_next_ch = SCAN_CHANNELS;
+        wifi_scan_collect();
+    }
 }
 
 
+// La lista in cache basta per scegliere una rete solo se e' entro il TTL e
+// piu' recente dell'ultimo fallimento (l'AP puo' essere sparito proprio da
+// li'). Dopo una scansione fallita resta quella vecchia: spesso non basta.
+static bool wifi_scan_cache_fresh(void) {
+    int64_t age_ms = (esp_timer_get_time() - scan_cache_us) / 1000;
+    return scan_cache_valid && age_ms < WIFI_SCAN_CACHE_TTL_MS && scan_cache_us > connect_failed_us;
+}
+
+// Collegamento alla miglior rete salvata presente nella lista in cache;
+// ritorna false se la lista non e' fresca o nessuna rete salvata e' in vista
+static bool wifi_autojoin_from_cache(void) {
+    wifi_store_entry_t net;
+    const wifi_scan_record_t *rec;
+    if (!wifi_scan_cache_fresh() ||
+        !wifi_store_match(scan_cache->ap_list, scan_cache->ap_count, &net, &rec)) {
+        return false;
+    }
+    DLOGI(WIFI, "Rete salvata in vista: %s (prio %u, %d dBm, ch %u)",
+          net.ssid, net.priority, rec->rssi, rec->channel);
+    memset(&last_ap, 0, sizeof(last_ap));
+    memcpy(last_ap.ssid, net.ssid, sizeof(last_ap.ssid));
+    memcpy(last_ap.password, net.password, sizeof(last_ap.password));
+    memcpy(last_ap.bssid, rec->bssid, sizeof(last_ap.bssid));
+    last_ap.channel = rec->channel;
+    last_ap.authmode = rec->authmode;
+    last_ap_known = true;
+    // BSSID e canale vengono dalla scansione: niente ricerca sui 13 canali
+    wifi_connect_attempt(true);
+    return true;
+}
+
+// Chiamata a fine scansione se un autojoin la stava aspettando
+static void wifi_autojoin_pick(void) {
+    autojoin_pending = false;
+    if (wifi_status_is_connected() || wifi_autojoin_from_cache()) {
+        return;
+    }
+    DLOGI(WIFI, "Nessuna rete salvata in vista");
+    if (wifi_have_networks()) {
+        wifi_schedule_retry();
+    }
+}
+
+// Una sola scansione per scegliere fra le reti salvate. La cache basta solo
+// per un match positivo su una lista fresca; altrimenti si riscansiona.
+static void wifi_autojoin(void) {
+    if (wifi_status_is_connected() || wifi_store_count() == 0) {
+        return;
+    }
+    if (wifi_autojoin_from_cache()) {
+        return;
+    }
+    autojoin_pending = true;
+    if (!scan_in_flight) {
+        wifi_scan_start();
+    }
+}
+
+// CONNECT con le stesse credenziali della rete su cui siamo gia', o del
+// tentativo in corso (non in attesa di back-off): non cambierebbe nulla
+static bool wifi_connect_is_redundant(const ble_wifi_evt_t *evt) {
+    if (!last_ap_known ||
+        strncmp(last_ap.ssid, evt->ssid, sizeof(last_ap.ssid)) != 0 ||
+        strncmp(last_ap.password, evt->password, sizeof(last_ap.password)) != 0) {
+        return false;
+    }
+    bool attempting = connect_started_us != 0 && !esp_timer_is_active(retry_timer);
+    return wifi_status_is_connected() || attempting;
+}
+
+// Lascia la rete (se c'e') e ferma tentativi e auto-join: si riparte solo
+// con un CONNECT o una rete aggiunta. La STA_DISCONNECTED che segue ha
+// reason ASSOC_LEAVE, quindi non programma altri tentativi.
+static void wifi_leave(void) {
+    esp_timer_stop(retry_timer);
+    autojoin_pending = false;
+    retry_attempt = 0;
+    connect_started_us = 0;
+    esp_wifi_disconnect();
+    wifi_status_set(WIFI_STATE_IDLE, 0);
+}
+
+void wifi_get_cmd_stats(wifi_cmd_stats_t *out) {
+    *out = cmd_stats;
+}
+
+// Campione di RSSI del link: wifi_status pubblica solo le variazioni ampie
+static void wifi_rssi_poll(void) {
+    int rssi;
+    if (esp_wifi_sta_get_rssi(&rssi) == ESP_OK) {
+        wifi_status_rssi((int8_t)rssi);
+    }
+}
+
 static void wifi_task(void *arg) {
-    ble_wifi_evt_t evt;
+    int64_t rssi_due_us = 0;
     while (1) {
-        if (xQueueReceive(ble_to_wifi_q, &evt, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(WIFI_TAG, "Comando ble_wifi ricevuto: %u", evt.type);
-            switch (evt.type) {
-                case BLE_WIFI_EVT_BTN_PRESS:
-                    ESP_LOGI(WIFI_TAG, "Comando scan da BLE ricevuto");
-                    wifi_scan_start();
-                    break;
-                case BLE_WIFI_EVT_CONNECT:
-                    ESP_LOGI(WIFI_TAG, "Comando connect da BLE: SSID=%s", evt.ssid);
-                    
-                    wifi_config_t wifi_config = {0};
-                    strncpy((char*)wifi_config.sta.ssid, evt.ssid, sizeof(wifi_config.sta.ssid) - 1);
-                    strncpy((char*)wifi_config.sta.password, evt.password, sizeof(wifi_config.sta.password) - 1);
-                    
-                    if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK ||
-                        esp_wifi_connect() != ESP_OK) {
-                        ESP_LOGE(WIFI_TAG, "Errore durante connessione WiFi");
-                    }
-                    break;
-                default:
-                    ESP_LOGW(WIFI_TAG, "Evento BLE->WiFi sconosciuto: %d", evt.type);
-                    break;
+        // Con una scansione in corso il timeout fa si' che un SCAN_DONE perso
+        // non blocchi per sempre le richieste. Il periodo dell'RSSI vale anche
+        // da scollegati: l'associazione arriva dal loop eventi, non da qui.
+        TickType_t wait = pdMS_TO_TICKS(WIFI_STATUS_RSSI_PERIOD_MS);
+        if (scan_in_flight && pdMS_TO_TICKS(WIFI_SCAN_TIMEOUT_MS) < wait) {
+            wait = pdMS_TO_TICKS(WIFI_SCAN_TIMEOUT_MS);
+        }
+        // Fra due gruppi di canali ci si sveglia per avviare il prossimo
+        if (scan_group_due_us != 0) {
+            int64_t left_us = scan_group_due_us - esp_timer_get_time();
+            // Per eccesso a tick interi: con 10 ms per tick pdMS_TO_TICKS
+            // darebbe 0 sotto i 10 ms e il task girerebbe a vuoto
+            const int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+            TickType_t left = left_us > 0 ? (TickType_t)((left_us + tick_us - 1) / tick_us) : 0;
+            if (left < wait) {
+                wait = left;
             }
         }
+        const ble_wifi_evt_t *evt = ble_wifi_receive(wait);
+        if (wifi_status_is_connected() && esp_timer_get_time() >= rssi_due_us) {
+            rssi_due_us = esp_timer_get_time() + (int64_t)WIFI_STATUS_RSSI_PERIOD_MS * 1000;
+            wifi_rssi_poll();
+        }
+        if (scan_group_due_us != 0 && esp_timer_get_time() >= scan_group_due_us) {
+            wifi_scan_next_group();
+        }
+        if (evt == NULL) {
+            if (scan_in_flight && scan_group_due_us == 0 &&
+                esp_timer_get_time() - scan_started_us >= (int64_t)WIFI_SCAN_TIMEOUT_MS * 1000) {
+                DLOGW(WIFI, "Scansione scaduta, la chiudo");
+                esp_wifi_scan_stop();
+                wifi_scan_abort();
+            }
+            continue;
+        }
+        int64_t evt_start_us = esp_timer_get_time();
+        DLOGD(WIFI, "Comando ble_wifi ricevuto: %u", evt->type);
+        switch (evt->type) {
+            case BLE_WIFI_EVT_BTN_PRESS:
+            case BLE_WIFI_EVT_SCAN_FRESH:
+                DLOGI(WIFI, "Comando scan da BLE ricevuto%s",
+                      evt->type == BLE_WIFI_EVT_SCAN_FRESH ? " (senza cache)" : "");
+                wifi_scan_request(evt->type == BLE_WIFI_EVT_SCAN_FRESH);
+                break;
+            case BLE_WIFI_EVT_SCAN_DONE:
+                wifi_scan_collect();
+                break;
+            case BLE_WIFI_EVT_CONNECT:
+                DLOGI(WIFI, "Comando connect da BLE: SSID=%s", evt->ssid);
+                if (wifi_connect_is_redundant(evt)) {
+                    DLOGI(WIFI, "Gia' collegati (o in collegamento) a %s, ignorato", evt->ssid);
+                    cmd_stats.connects_redundant++;
+                    break;
+                }
+                cmd_stats.connects++;
+                // La scelta esplicita vince su un auto-join in attesa di lista
+                if (autojoin_pending) {
+                    autojoin_pending = false;
+                    cmd_stats.autojoins_dropped++;
+                }
+
+                // Nuova rete: BSSID e canale si scoprono alla connessione
+                esp_timer_stop(retry_timer);
+                memset(&last_ap, 0, sizeof(last_ap));
+                // l'ultimo byte resta il terminatore del memset
+                memcpy(last_ap.ssid, evt->ssid, sizeof(last_ap.ssid) - 1);
+                memcpy(last_ap.password, evt->password, sizeof(last_ap.password) - 1);
+                last_ap_known = true;
+                retry_attempt = 1;
+                connect_started_us = 0;
+                wifi_store_upsert(evt->ssid, evt->password, 0, true);
+                wifi_connect_attempt(false);
+                break;
+            case BLE_WIFI_EVT_NET_ADD:
+                DLOGI(WIFI, "Rete salvata: %s (prio %u)", evt->ssid, evt->priority);
+                wifi_store_upsert(evt->ssid, evt->password, evt->priority, false);
+                // Se si era fermi in attesa (o mai partiti) si prova subito
+                if (!wifi_status_is_connected() &&
+                    (esp_timer_is_active(retry_timer) || connect_started_us == 0)) {
+                    esp_timer_stop(retry_timer);
+                    retry_attempt = 1;
+                    wifi_autojoin();
+                }
+                break;
+            case BLE_WIFI_EVT_NET_REMOVE:
+            case BLE_WIFI_EVT_NET_CLEAR:
+                if (evt->type == BLE_WIFI_EVT_NET_CLEAR) {
+                    wifi_store_clear();
+                } else {
+                    wifi_store_remove(evt->ssid);
+                }
+                // Rete corrente dimenticata: si lascia e si cerca un'altra
+                if (evt->type == BLE_WIFI_EVT_NET_CLEAR ||
+                    strncmp(last_ap.ssid, evt->ssid, sizeof(evt->ssid)) == 0) {
+                    DLOGI(WIFI, "Rete corrente dimenticata");
+                    esp_timer_stop(retry_timer);
+                    wifi_last_ap_forget();
+                    esp_wifi_disconnect();
+                    wifi_status_set(WIFI_STATE_IDLE, 0);
+                    retry_attempt = 1;
+                    connect_started_us = 0;
+                    wifi_autojoin();
+                }
+                break;
+            case BLE_WIFI_EVT_AUTOJOIN:
+                wifi_autojoin();
+                break;
+            case BLE_WIFI_EVT_DISCONNECT:
+                DLOGI(WIFI, "Disconnessione chiesta da BLE");
+                wifi_leave();
+                break;
+            case BLE_WIFI_EVT_STA_START:
+                wifi_on_sta_start();
+                break;
+            case BLE_WIFI_EVT_STA_CONNECTED:
+                wifi_on_sta_connected(evt);
+                break;
+            case BLE_WIFI_EVT_STA_DISCONNECTED:
+                wifi_on_sta_disconnected(evt);
+                break;
+            case BLE_WIFI_EVT_GOT_IP:
+                wifi_on_got_ip(evt);
+                break;
+            case BLE_WIFI_EVT_FACTORY_RESET:
+                // Senza riavvio: il telefono resta collegato e puo' riconfigurare
+                DLOGW(WIFI, "Ripristino di fabbrica: reti salvate, ultimo AP e cache cancellati");
+                wifi_store_clear();
+                wifi_last_ap_forget();
+                wifi_leave();
+                connect_failed_us = 0;
+                scan_cache_valid = false;
+                scan_cache_us = 0;
+                break;
+            default:
+                DLOGW(WIFI, "Evento BLE->WiFi sconosciuto: %d", evt->type);
+                break;
+        }
+        ble_wifi_release(evt);
+        telemetry_record(TELEMETRY_LAT_WIFI_EVT, (uint32_t)(esp_timer_get_time() - evt_start_us));
     }
 }
 
-void wifi_init_sta(UBaseType_t task_priority) {
+void wifi_init_sta(void) {
 
 
-    ESP_LOGI(WIFI_TAG, "Inizializzazione WiFi in modalità Station...");
+    DLOGI(WIFI, "Inizializzazione WiFi in modalità Station...");
 
     // Inizializza rete e loop eventi
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+#if !APP_PERF_GATE
     esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+#endif
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL));
 
-    // Configurazione station senza credenziali
+    const esp_timer_create_args_t retry_args = {
+        .callback = wifi_retry_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &retry_timer));
+
+#if !APP_PERF_GATE
+    // Le credenziali le salviamo noi insieme a BSSID/canale: il driver non
+    // deve riscriverle in flash a ogni esp_wifi_set_config
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+#endif
+    wifi_store_init();
+
+    // Lista vuota finche' non arriva la prima scansione
+    scan_cache = wifi_ble_alloc();
+    configASSERT(scan_cache != NULL);
+    scan_cache->type = WIFI_BLE_EVT_SCAN_DONE;
+    wifi_last_ap_load();
+    if (last_ap_known) {
+        DLOGI(WIFI, "AP salvato: %s (ch %u)", last_ap.ssid, last_ap.channel);
+    }
+
+#if !APP_PERF_GATE
+    // Configurazione station senza credenziali; se c'e' un AP salvato la
+    // connessione parte da WIFI_EVENT_STA_START. Nella build per QEMU il
+    // driver non c'e' (perf_gate.h): wifi_task parte ma non riceve eventi.
     wifi_config_t wifi_config = { 0 };
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+#endif
 
     // Crea il task per gestire comandi BLE->WiFi
-    xTaskCreate(wifi_task, "WIFI_TASK", 4096, NULL, task_priority, NULL);
-    ESP_LOGI(WIFI_TAG, "WiFi station avviata");
+    rtos_task_create(&wifi_task_mem, wifi_task, NULL, TASK_PLAN_WIFI);
+    DLOGI(WIFI, "WiFi station avviata");
 }
@@ -0,0 +1,121 @@
+// wifi_status.c
+#include "wifi_status.h"
+#include "common_variables.h"
+#include "dlog.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// [stato 8][reason 8][rssi 8][seq 8]: un solo store, quindi chi legge non
+// vede mai uno stato mescolato con il reason o l'RSSI di un altro
+#define WORD(state, reason, rssi, seq) \
+    ((uint32_t)(state) | ((uint32_t)(reason) << 8) | ((uint32_t)(uint8_t)(rssi) << 16) | ((uint32_t)(seq) << 24))
+#define WORD_STATE(w)   ((wifi_state_t)((w) & 0xFF))
+#define WORD_REASON(w)  ((uint8_t)((w) >> 8))
+#define WORD_RSSI(w)    ((int8_t)((w) >> 16))
+#define WORD_SEQ(w)     ((uint8_t)((w) >> 24))
+
+static _Atomic uint32_t status_word = WORD(WIFI_STATE_IDLE, 0, 0, 0);
+// Scritto prima della parola che dichiara GOT_IP
+static _Atomic uint32_t status_ip;
+
+static const char *const state_names[WIFI_STATE_COUNT] = {
+    [WIFI_STATE_IDLE]       = "idle",
+    [WIFI_STATE_CONNECTING] = "connecting",
+    [WIFI_STATE_ASSOCIATED] = "associated",
+    [WIFI_STATE_GOT_IP]     = "got_ip",
+    [WIFI_STATE_FAILED]     = "failed",
+};
+
+const char *wifi_state_name(wifi_state_t state) {
+    return state < WIFI_STATE_COUNT ? state_names[state] : "?";
+}
+
+static bool state_connected(wifi_state_t state) {
+    return state == WIFI_STATE_ASSOCIATED || state == WIFI_STATE_GOT_IP;
+}
+
+// Scrive lo stato se cambia qualcosa e sveglia ble_task. Scrittori: loop
+// eventi e wifi_task, quindi compare-exchange per non perdere il seq.
+static void status_store(wifi_state_t state, uint8_t reason, int8_t rssi) {
+    uint32_t old = atomic_load(&status_word);
+    uint32_t next;
+    do {
+        if (WORD_STATE(old) == state && WORD_REASON(old) == reason && WORD_RSSI(old) == rssi
+            && state != WIFI_STATE_GOT_IP) {
+            return;
+        }
+        next = WORD(state, reason, rssi, (uint8_t)(WORD_SEQ(old) + 1));
+    } while (!atomic_compare_exchange_weak(&status_word, &old, next));
+
+    if (WORD_STATE(old) != state) {
+        DLOGI(STATUS, "%s -> %s (reason %u, %d dBm)", wifi_state_name(WORD_STATE(old)),
+              wifi_state_name(state), reason, rssi);
+    }
+    // Gia' in coda: ble_task leggera' comunque la parola aggiornata
+    wifi_ble_request(WIFI_BLE_EVT_CONNECT_STATUS);
+}
+
+void wifi_status_set(wifi_state_t state, uint8_t reason) {
+    if (state == WIFI_STATE_CONNECTING) {
+        // Il nuovo tentativo tiene il motivo del fallimento precedente: se
+        // FAILED e' durato meno di un giro di ble_task il telefono lo vede qui
+        uint32_t w = atomic_load(&status_word);
+        bool retry = WORD_STATE(w) == WIFI_STATE_FAILED || WORD_STATE(w) == WIFI_STATE_CONNECTING;
+        reason = retry ? WORD_REASON(w) : 0;
+    } else if (state != WIFI_STATE_FAILED) {
+        reason = 0;
+    }
+    status_store(state, reason, 0);
+}
+
+void wifi_status_associated(int8_t rssi) {
+    status_store(WIFI_STATE_ASSOCIATED, 0, rssi);
+}
+
+void wifi_status_got_ip(uint32_t ip) {
+    atomic_store(&status_ip, ip);
+    status_store(WIFI_STATE_GOT_IP, 0, WORD_RSSI(atomic_load(&status_word)));
+}
+
+void wifi_status_rssi(int8_t rssi) {
+    uint32_t w = atomic_load(&status_word);
+    if (!state_connected(WORD_STATE(w)) || abs(rssi - WORD_RSSI(w)) < WIFI_STATUS_RSSI_DELTA) {
+        return;
+    }
+    // Un cambio di stato nel frattempo non va sovrascritto da un campione
+    uint32_t next = WORD(WORD_STATE(w), 0, rssi, (uint8_t)(WORD_SEQ(w) + 1));
+    if (atomic_compare_exchange_strong(&status_word, &w, next)) {
+        wifi_ble_request(WIFI_BLE_EVT_CONNECT_STATUS);
+    }
+}
+
+void wifi_status_get(wifi_status_t *out) {
+    uint32_t w = atomic_load(&status_word);
+    out->state = WORD_STATE(w);
+    out->reason = WORD_REASON(w);
+    out->rssi = WORD_RSSI(w);
+    out->seq = WORD_SEQ(w);
+    out->ip = out->state == WIFI_STATE_GOT_IP ? atomic_load(&status_ip) : 0;
+}
+
+bool wifi_status_is_connected(void) {
+    return state_connected(WORD_STATE(atomic_load(&status_word)));
+}
+
+size_t wifi_status_encode(const wifi_status_t *st, uint8_t *out, size_t cap) {
+    if (cap < WIFI_STATUS_VALUE_LEN) {
+        return 0;
+    }
+    out[0] = WIFI_STATUS_VERSION;
+    out[1] = (uint8_t)st->state;
+    out[2] = st->reason;
+    out[3] = (uint8_t)st->rssi;
+    out[4] = st->seq;
+    // addr e' gia' in ordine di rete: il primo byte in memoria e' 'a'
+    out[5] = (uint8_t)st->ip;
+    out[6] = (uint8_t)(st->ip >> 8);
+    out[7] = (uint8_t)(st->ip >> 16);
+    out[8] = (uint8_t)(st->ip >> 24);
+    return WIFI_STATUS_VALUE_LEN;
+}
@@ -0,0 +1,214 @@
+// wifi_store.c
+#include "wifi_store.h"
+#include "dlog.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "rtos_static.h"
+#include <string.h>
+
+#define STORE_NVS_NAMESPACE "wifi"
+#define STORE_NVS_KEY       "networks"
+#define STORE_BLOB_VERSION  1
+
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    wifi_store_entry_t net[WIFI_STORE_MAX_NETWORKS];
+} wifi_store_blob_t;
+
+// Scritto da WIFI_TASK, letto anche dal callback GATT: sempre sotto mutex
+static wifi_store_blob_t store;
+// Copia da salvare, fuori dal mutex e dallo stack (un solo scrittore)
+static wifi_store_blob_t save_buf;
+static uint8_t fails[WIFI_STORE_MAX_NETWORKS];
+static SemaphoreHandle_t store_lock;
+RTOS_MUTEX_DEFINE(store_lock_mem);
+
+static int find_locked(const char *ssid) {
+    for (int i = 0; i < store.count; i++) {
+        if (strncmp(store.net[i].ssid, ssid, sizeof(store.net[i].ssid)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Salva la copia presa sotto mutex: la scrittura in flash avviene fuori
+static esp_err_t save(const wifi_store_blob_t *blob) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(STORE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, STORE_NVS_KEY, blob, sizeof(*blob));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        DLOGE(STORE, "Salvataggio reti fallito: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void wifi_store_init(void) {
+    store_lock = rtos_mutex_create(store_lock_mem);
+    memset(&store, 0, sizeof(store));
+    store.version = STORE_BLOB_VERSION;
+
+    nvs_handle_t nvs;
+    if (nvs_open(STORE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t len = sizeof(save_buf);
+    if (nvs_get_blob(nvs, STORE_NVS_KEY, &save_buf, &len) == ESP_OK && len == sizeof(save_buf) &&
+        save_buf.version == STORE_BLOB_VERSION && save_buf.count <= WIFI_STORE_MAX_NETWORKS) {
+        store = save_buf;
+    }
+    nvs_close(nvs);
+    DLOGI(STORE, "Reti salvate: %u", store.count);
+}
+
+esp_err_t wifi_store_upsert(const char *ssid, const char *password, uint8_t priority,
+                            bool keep_priority) {
+    if (ssid == NULL || ssid[0] == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int idx = find_locked(ssid);
+    if (idx < 0) {
+        if (store.count < WIFI_STORE_MAX_NETWORKS) {
+            idx = store.count++;
+        } else {
+            // piena: si sacrifica la rete meno prioritaria (la piu' vecchia a parita')
+            idx = 0;
+            for (int i = 1; i < store.count; i++) {
+                if (store.net[i].priority < store.net[idx].priority) {
+                    idx = i;
+                }
+            }
+            DLOGW(STORE, "Memoria piena, sostituisco %s", store.net[idx].ssid);
+        }
+        memset(&store.net[idx], 0, sizeof(store.net[idx]));
+        strncpy(store.net[idx].ssid, ssid, sizeof(store.net[idx].ssid) - 1);
+        store.net[idx].priority = priority;
+    } else if (!keep_priority) {
+        store.net[idx].priority = priority;
+    }
+    memset(store.net[idx].password, 0, sizeof(store.net[idx].password));
+    if (password) {
+        strncpy(store.net[idx].password, password, sizeof(store.net[idx].password) - 1);
+    }
+    fails[idx] = 0;
+    save_buf = store;
+    xSemaphoreGive(store_lock);
+    return save(&save_buf);
+}
+
+esp_err_t wifi_store_remove(const char *ssid) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int idx = find_locked(ssid);
+    if (idx < 0) {
+        xSemaphoreGive(store_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (int i = idx; i + 1 < store.count; i++) {
+        store.net[i] = store.net[i + 1];
+        fails[i] = fails[i + 1];
+    }
+    store.count--;
+    memset(&store.net[store.count], 0, sizeof(store.net[store.count]));
+    fails[store.count] = 0;
+    save_buf = store;
+    xSemaphoreGive(store_lock);
+    return save(&save_buf);
+}
+
+esp_err_t wifi_store_clear(void) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    memset(&store, 0, sizeof(store));
+    store.version = STORE_BLOB_VERSION;
+    memset(fails, 0, sizeof(fails));
+    save_buf = store;
+    xSemaphoreGive(store_lock);
+    return save(&save_buf);
+}
+
+uint8_t wifi_store_count(void) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    uint8_t n = store.count;
+    xSemaphoreGive(store_lock);
+    return n;
+}
+
+bool wifi_store_match(const wifi_scan_record_t *recs, uint8_t count,
+                      wifi_store_entry_t *net, const wifi_scan_record_t **rec) {
+    int best = -1;
+    const wifi_scan_record_t *best_rec = NULL;
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    for (int i = 0; i < store.count; i++) {
+        // la lista e' gia' de-duplicata per SSID: al massimo un record per rete
+        const wifi_scan_record_t *r = NULL;
+        for (uint8_t j = 0; j < count && r == NULL; j++) {
+            if (strncmp(recs[j].ssid, store.net[i].ssid, sizeof(recs[j].ssid)) == 0) {
+                r = &recs[j];
+            }
+        }
+        if (r == NULL) {
+            continue;
+        }
+        if (best < 0 ||
+            fails[i] < fails[best] ||
+            (fails[i] == fails[best] && store.net[i].priority > store.net[best].priority) ||
+            (fails[i] == fails[best] && store.net[i].priority == store.net[best].priority &&
+             r->rssi > best_rec->rssi)) {
+            best = i;
+            best_rec = r;
+        }
+    }
+    if (best >= 0) {
+        *net = store.net[best];
+        *rec = best_rec;
+    }
+    xSemaphoreGive(store_lock);
+    return best >= 0;
+}
+
+void wifi_store_note_result(const char *ssid, bool ok) {
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    int idx = find_locked(ssid);
+    if (idx >= 0) {
+        if (ok) {
+            fails[idx] = 0;
+        } else if (fails[idx] < UINT8_MAX) {
+            fails[idx]++;
+        }
+    }
+    xSemaphoreGive(store_lock);
+}
+
+size_t wifi_store_describe(uint8_t *out, size_t cap) {
+    if (cap < 2) {
+        return 0;
+    }
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    size_t pos = 0;
+    out[pos++] = WIFI_STORE_LIST_VERSION;
+    out[pos++] = 0;
+    for (int i = 0; i < store.count; i++) {
+        const wifi_store_entry_t *n = &store.net[i];
+        size_t ssid_len = strnlen(n->ssid, sizeof(n->ssid) - 1);
+        if (pos + 3 + ssid_len > cap) {
+            break;
+        }
+        out[pos++] = n->priority;
+        out[pos++] = n->password[0] ? WIFI_STORE_FLAG_HAS_PASS : 0;
+        out[pos++] = (uint8_t)ssid_len;
+        memcpy(&out[pos], n->ssid, ssid_len);
+        pos += ssid_len;
+        out[1]++;
+    }
+    xSemaphoreGive(store_lock);
+    return pos;
+}